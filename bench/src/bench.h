@@ -0,0 +1,119 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * DAP test bench: queue transport and target helpers shared by the suites
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+#define PKT_SIZE CONFIG_DAP_QUEUE_PACKET_SIZE
+
+/* CMSIS-DAP commands */
+#define DAP_CMD_CONNECT			0x02
+#define DAP_CMD_TRANSFER_CONFIGURE	0x04
+#define DAP_CMD_TRANSFER		0x05
+#define DAP_CMD_TRANSFER_BLOCK		0x06
+#define DAP_CMD_SWJ_CLOCK		0x11
+#define DAP_CMD_SWJ_SEQUENCE		0x12
+#define DAP_CMD_SWD_CONFIGURE		0x13
+
+/* Transfer request bits */
+#define REQ_AP			BIT(0)
+#define REQ_READ		BIT(1)
+#define REQ_ADDR(a)		((a) & 0x0C)
+#define REQ_MATCH_VALUE		BIT(4)
+#define REQ_MATCH_MASK		BIT(5)
+
+#define DP_IDCODE		REQ_ADDR(0x0)
+#define DP_ABORT		REQ_ADDR(0x0)
+#define DP_CTRL_STAT		REQ_ADDR(0x4)
+#define DP_SELECT		REQ_ADDR(0x8)
+#define AP_CSW			(REQ_AP | REQ_ADDR(0x0))
+#define AP_TAR			(REQ_AP | REQ_ADDR(0x4))
+#define AP_DRW			(REQ_AP | REQ_ADDR(0xC))
+
+#define ACK_OK			0x01
+
+#define CTRL_PWRUP_REQ		(BIT(28) | BIT(30))
+#define CTRL_PWRUP_ACK		(BIT(29) | BIT(31))
+/* 32-bit accesses, auto increment */
+#define CSW_WORD_INC		0x23000012
+
+#define TARGET_RAM		0x20000000
+#define TARGET_FLASH		0x10000000
+
+/* Longest wait for a response of the queue thread */
+#define BENCH_TIMEOUT		K_MSEC(1000)
+
+/**
+ * Setup of the DAP suites: set up the DAP core as the probe does, attach
+ * the bench transport to the queue engine and connect to the emulated
+ * target. Only the first call does the work, the suite fails if it did
+ * not succeed.
+ *
+ * @return NULL, no fixture
+ */
+void *bench_suite_setup(void);
+
+/**
+ * Queue one request packet, as the USB class does when it receives one.
+ *
+ * @param request Packet
+ * @param len Packet length
+ */
+void bench_submit(const uint8_t *request, size_t len);
+
+/**
+ * Take the next response sent by the queue thread.
+ *
+ * @param response Destination, PKT_SIZE bytes
+ * @param timeout Longest wait
+ * @return Response length, -EAGAIN if none came in time
+ */
+int bench_recv(uint8_t *response, k_timeout_t timeout);
+
+/**
+ * Run one request through the queue and wait for its response.
+ *
+ * @param request Packet
+ * @param len Packet length
+ * @param response Destination, PKT_SIZE bytes
+ * @return Response length, -EAGAIN if none came in time
+ */
+int bench_exec(const uint8_t *request, size_t len, uint8_t *response);
+
+/**
+ * Run one DAP_Transfer built from (request, value) pairs.
+ *
+ * @param requests Transfer requests
+ * @param values Values of the writes and value matches
+ * @param count Number of transfers
+ * @param response Destination, PKT_SIZE bytes
+ * @return 0 if all transfers were acknowledged, -EIO otherwise
+ */
+int bench_transfer(const uint8_t *requests, const uint32_t *values,
+		   uint8_t count, uint8_t *response);
+
+/**
+ * Get the CPUs the responses were sent from, that is where the queue
+ * thread ran, since the previous call.
+ *
+ * @return Bit mask of CPU numbers
+ */
+uint32_t bench_response_cpus(void);
+
+/**
+ * Host clock on native_sim, for latencies that do not depend on the
+ * simulated time; the cycle counter on the other targets.
+ *
+ * @return Monotonic time in ns
+ */
+uint64_t bench_clock_ns(void);
+
+#endif /* BENCH_H */
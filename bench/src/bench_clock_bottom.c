@@ -0,0 +1,20 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Host side of the benchmark clock. native_sim time is simulated and
+ * does not advance while code runs, so latencies are taken from the
+ * host monotonic clock.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+uint64_t bench_clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
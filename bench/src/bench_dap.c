@@ -0,0 +1,220 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Bench transport of the DAP queue engine
+ *
+ * Stands in for the USB class of the probe: requests are net_bufs of a
+ * pool as deep as the DAP_Info packet count, submitted to the queue the
+ * way the OUT endpoint does, and responses come from a pool of
+ * CONFIG_DAP_QUEUE_IN_BUFFERS, handed to the suites through a FIFO in
+ * place of the IN endpoint. Everything behind the transport is the probe
+ * code: queue thread, batches, DAP_Info overrides, vendor commands and
+ * the DAP core on the emulated SWD target.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/net_buf.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+#include <string.h>
+
+#include <cmsis_dap.h>
+
+#include "bench.h"
+#include "dap_queue.h"
+#include "dap_vendor.h"
+#include "swd_target.h"
+
+/* A response not read for this long resets the link, as on USB */
+#define BENCH_ALLOC_TIMEOUT	K_MSEC(200)
+
+NET_BUF_POOL_DEFINE(bench_req_pool, CONFIG_DAP_QUEUE_PACKET_COUNT, PKT_SIZE,
+		    0, NULL);
+NET_BUF_POOL_DEFINE(bench_resp_pool, CONFIG_DAP_QUEUE_IN_BUFFERS, PKT_SIZE,
+		    0, NULL);
+
+static K_FIFO_DEFINE(bench_responses);
+static atomic_t bench_cpus;
+
+static const struct device *const swd_dev = DEVICE_DT_GET(DT_NODELABEL(dp0));
+
+static struct net_buf *bench_alloc_response(void)
+{
+	return net_buf_alloc(&bench_resp_pool, BENCH_ALLOC_TIMEOUT);
+}
+
+static int bench_send(struct net_buf *buf)
+{
+	/* CPU of the queue thread, exact once it is pinned */
+	atomic_or(&bench_cpus, BIT(arch_curr_cpu()->id));
+	k_fifo_put(&bench_responses, buf);
+
+	return 0;
+}
+
+static void bench_release(struct net_buf *buf)
+{
+	net_buf_unref(buf);
+}
+
+static void bench_flush(void)
+{
+	struct net_buf *buf;
+
+	while ((buf = k_fifo_get(&bench_responses, K_NO_WAIT)) != NULL) {
+		net_buf_unref(buf);
+	}
+}
+
+static const struct dap_queue_transport bench_transport = {
+	.alloc_response = bench_alloc_response,
+	.send = bench_send,
+	.release = bench_release,
+	.flush = bench_flush,
+};
+
+void bench_submit(const uint8_t *request, size_t len)
+{
+	struct net_buf *buf = net_buf_alloc(&bench_req_pool, BENCH_TIMEOUT);
+
+	__ASSERT(buf != NULL, "more requests in flight than the packet count");
+
+	net_buf_add_mem(buf, request, len);
+	dap_queue_submit(buf);
+}
+
+int bench_recv(uint8_t *response, k_timeout_t timeout)
+{
+	struct net_buf *buf = k_fifo_get(&bench_responses, timeout);
+	int len;
+
+	if (buf == NULL) {
+		return -EAGAIN;
+	}
+
+	len = buf->len;
+	memcpy(response, buf->data, len);
+	net_buf_unref(buf);
+
+	return len;
+}
+
+uint32_t bench_response_cpus(void)
+{
+	return atomic_clear(&bench_cpus);
+}
+
+int bench_exec(const uint8_t *request, size_t len, uint8_t *response)
+{
+	bench_submit(request, len);
+
+	return bench_recv(response, BENCH_TIMEOUT);
+}
+
+int bench_transfer(const uint8_t *requests, const uint32_t *values,
+		   uint8_t count, uint8_t *response)
+{
+	uint8_t req[PKT_SIZE];
+	uint8_t *p = &req[3];
+
+	req[0] = DAP_CMD_TRANSFER;
+	req[1] = 0;
+	req[2] = count;
+
+	for (uint8_t i = 0; i < count; i++) {
+		*p++ = requests[i];
+		if (!(requests[i] & REQ_READ) || (requests[i] & REQ_MATCH_VALUE)) {
+			sys_put_le32(values[i], p);
+			p += 4;
+		}
+	}
+
+	if (bench_exec(req, p - req, response) < 3) {
+		return -EIO;
+	}
+
+	return (response[1] == count && response[2] == ACK_OK) ? 0 : -EIO;
+}
+
+/* Connect, line reset and power up the debug domain */
+static int bench_connect(void)
+{
+	static const uint8_t clock[] = {
+		DAP_CMD_SWJ_CLOCK, 0x00, 0x09, 0x3D, 0x00, /* 4 MHz */
+	};
+	static const uint8_t transfer_cfg[] = {
+		DAP_CMD_TRANSFER_CONFIGURE, 0, 64, 0, 64, 0,
+	};
+	static const uint8_t swd_cfg[] = { DAP_CMD_SWD_CONFIGURE, 0 };
+	static const uint8_t connect[] = { DAP_CMD_CONNECT, 1 };
+	/* 56 ones (line reset) then 8 idle cycles */
+	static const uint8_t line_reset[] = {
+		DAP_CMD_SWJ_SEQUENCE, 64,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00,
+	};
+	const uint8_t requests[] = {
+		DP_IDCODE | REQ_READ, DP_ABORT, DP_CTRL_STAT, DP_SELECT, AP_CSW,
+	};
+	const uint32_t values[] = {
+		0, 0x1E, CTRL_PWRUP_REQ, 0, CSW_WORD_INC,
+	};
+	uint8_t resp[PKT_SIZE];
+
+	if (bench_exec(connect, sizeof(connect), resp) < 2 || resp[1] != 1) {
+		return -ENODEV;
+	}
+
+	bench_exec(clock, sizeof(clock), resp);
+	bench_exec(transfer_cfg, sizeof(transfer_cfg), resp);
+	bench_exec(swd_cfg, sizeof(swd_cfg), resp);
+	bench_exec(line_reset, sizeof(line_reset), resp);
+
+	if (bench_transfer(requests, values, ARRAY_SIZE(requests), resp) < 0) {
+		return -EIO;
+	}
+
+	if (sys_get_le32(&resp[3]) != SWD_TARGET_DPIDR) {
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int bench_dap_init(void)
+{
+	static int ret = -EAGAIN;
+
+	if (ret != -EAGAIN) {
+		return ret;
+	}
+
+	/* Same DAP setup as the probe, on the emulated SWD port */
+	ret = dap_setup(swd_dev);
+	if (ret) {
+		return ret;
+	}
+
+	dap_update_pkt_size(PKT_SIZE);
+
+#if defined(CONFIG_DAP_VENDOR)
+	ret = dap_vendor_init(swd_dev);
+	if (ret) {
+		return ret;
+	}
+#endif
+
+	dap_queue_set_transport(&bench_transport);
+
+	ret = bench_connect();
+
+	return ret;
+}
+
+void *bench_suite_setup(void)
+{
+	zassert_ok(bench_dap_init(), "DAP setup or target connection failed");
+
+	return NULL;
+}
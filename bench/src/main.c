@@ -0,0 +1,363 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * CMSIS-DAP throughput benchmark against the emulated SWD target
+ *
+ * Feeds scripted workloads to the DAP queue engine of the probe, set up
+ * the same way (dap_setup() on the dp0 SWD port), here backed by the
+ * software target model and the bench transport: single DAP_Transfer
+ * accesses, DAP_TransferBlock reads and writes of several sizes, and
+ * register polling with value match. Every command is timed on the host
+ * clock, from its submission to the queue to its response.
+ *
+ * The SWO trace ring buffer is benchmarked the same way, fed by a
+ * synthetic producer standing in for the DMA channel: each drain of one
+ * DAP_SWO_Data payload is timed and its bytes are checked against the
+ * generated sequence, with and without the producer lapping the reader.
+ *
+ * Results are printed as one JSON object, and the test fails if any
+ * response was wrong:
+ *
+ *   {"packet_size":512,"iterations":2000,"workloads":[
+ *     {"name":"block_read_126","commands":2000,"transfers":252000,
+ *      "bytes":1008000,"transfers_per_s":...,"bytes_per_s":...,
+ *      "latency_ns":{"p50":...,"p90":...,"p99":...,"max":...},
+ *      "errors":0}, ...]}
+ *
+ * The numbers measure the DAP queue, DAP and SWD protocol code on the
+ * host CPU, not the wire. They are meant to be compared between builds.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "swd_target.h"
+#include "swo_ring.h"
+
+#define ITERATIONS CONFIG_DAP_BENCH_ITERATIONS
+
+/* Most words in one DAP_TransferBlock, read or write */
+#define BLOCK_MAX_WORDS		((PKT_SIZE - 5) / 4)
+
+/* SWO ring and the payload of one DAP_SWO_Data response */
+#define SWO_SIZE		CONFIG_DAP_BENCH_SWO_BUFFER_SIZE
+#define SWO_CHUNK		(PKT_SIZE - 4)
+
+struct workload {
+	const char *name;
+	/* Fill the request, once per command */
+	size_t (*prepare)(const struct workload *w, uint8_t *req);
+	/* Run before each command, not timed */
+	void (*setup)(const struct workload *w);
+	/* Check the response */
+	bool (*check)(const struct workload *w, const uint8_t *resp);
+	/* SWD data transfers and payload bytes per command */
+	uint32_t transfers;
+	uint32_t bytes;
+	uint32_t addr;
+};
+
+static uint8_t req[PKT_SIZE];
+static uint8_t resp[PKT_SIZE];
+static uint64_t samples[ITERATIONS];
+
+static void bench_set_tar(const struct workload *w)
+{
+	const uint8_t requests[] = { AP_TAR };
+	const uint32_t values[] = { w->addr };
+
+	bench_transfer(requests, values, 1, resp);
+}
+
+/* Single DAP_Transfer: read DPIDR */
+static size_t prep_read_dp(const struct workload *w, uint8_t *r)
+{
+	r[0] = DAP_CMD_TRANSFER;
+	r[1] = 0;
+	r[2] = 1;
+	r[3] = DP_IDCODE | REQ_READ;
+
+	return 4;
+}
+
+static bool check_read_dp(const struct workload *w, const uint8_t *r)
+{
+	return r[1] == 1 && r[2] == ACK_OK &&
+	       sys_get_le32(&r[3]) == SWD_TARGET_DPIDR;
+}
+
+/* Single DAP_Transfer: TAR write + DRW write, one word to RAM */
+static size_t prep_write_mem(const struct workload *w, uint8_t *r)
+{
+	r[0] = DAP_CMD_TRANSFER;
+	r[1] = 0;
+	r[2] = 2;
+	r[3] = AP_TAR;
+	sys_put_le32(w->addr, &r[4]);
+	r[8] = AP_DRW;
+	sys_put_le32(0xA5A5A5A5, &r[9]);
+
+	return 13;
+}
+
+static bool check_write_mem(const struct workload *w, const uint8_t *r)
+{
+	return r[1] == 2 && r[2] == ACK_OK;
+}
+
+/* Register polling: CTRL/STAT read until the power-up ACKs match */
+static size_t prep_poll(const struct workload *w, uint8_t *r)
+{
+	r[0] = DAP_CMD_TRANSFER;
+	r[1] = 0;
+	r[2] = 2;
+	r[3] = REQ_MATCH_MASK;
+	sys_put_le32(CTRL_PWRUP_ACK, &r[4]);
+	r[8] = DP_CTRL_STAT | REQ_READ | REQ_MATCH_VALUE;
+	sys_put_le32(CTRL_PWRUP_ACK, &r[9]);
+
+	return 13;
+}
+
+static bool check_poll(const struct workload *w, const uint8_t *r)
+{
+	return r[1] == 2 && r[2] == ACK_OK;
+}
+
+static size_t prep_block_read(const struct workload *w, uint8_t *r)
+{
+	r[0] = DAP_CMD_TRANSFER_BLOCK;
+	r[1] = 0;
+	sys_put_le16(w->transfers, &r[2]);
+	r[4] = AP_DRW | REQ_READ;
+
+	return 5;
+}
+
+static size_t prep_block_write(const struct workload *w, uint8_t *r)
+{
+	r[0] = DAP_CMD_TRANSFER_BLOCK;
+	r[1] = 0;
+	sys_put_le16(w->transfers, &r[2]);
+	r[4] = AP_DRW;
+
+	for (uint32_t i = 0; i < w->transfers; i++) {
+		sys_put_le32(w->addr + i * 4, &r[5 + i * 4]);
+	}
+
+	return 5 + w->transfers * 4;
+}
+
+static bool check_block(const struct workload *w, const uint8_t *r)
+{
+	return sys_get_le16(&r[1]) == w->transfers && r[3] == ACK_OK;
+}
+
+/* Block read of erased flash must return 0xFFFFFFFF words */
+static bool check_block_flash(const struct workload *w, const uint8_t *r)
+{
+	if (!check_block(w, r)) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < w->transfers; i++) {
+		if (sys_get_le32(&r[4 + i * 4]) != 0xFFFFFFFF) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#define BLOCK_READ(_name, _words, _addr, _check)			\
+	{ .name = _name, .prepare = prep_block_read,			\
+	  .setup = bench_set_tar, .check = _check,			\
+	  .transfers = _words, .bytes = (_words) * 4, .addr = _addr }
+
+#define BLOCK_WRITE(_name, _words)					\
+	{ .name = _name, .prepare = prep_block_write,			\
+	  .setup = bench_set_tar, .check = check_block,			\
+	  .transfers = _words, .bytes = (_words) * 4, .addr = TARGET_RAM }
+
+static const struct workload workloads[] = {
+	{ .name = "transfer_read_dp", .prepare = prep_read_dp,
+	  .check = check_read_dp, .transfers = 1, .bytes = 4 },
+	{ .name = "transfer_write_mem", .prepare = prep_write_mem,
+	  .check = check_write_mem, .transfers = 2, .bytes = 4,
+	  .addr = TARGET_RAM },
+	{ .name = "poll_ctrl_stat", .prepare = prep_poll,
+	  .check = check_poll, .transfers = 1, .bytes = 0 },
+	BLOCK_WRITE("block_write_1", 1),
+	BLOCK_WRITE("block_write_8", 8),
+	BLOCK_WRITE("block_write_32", 32),
+	BLOCK_WRITE("block_write_max", BLOCK_MAX_WORDS),
+	BLOCK_READ("block_read_1", 1, TARGET_RAM, check_block),
+	BLOCK_READ("block_read_8", 8, TARGET_RAM, check_block),
+	BLOCK_READ("block_read_32", 32, TARGET_RAM, check_block),
+	BLOCK_READ("block_read_max", BLOCK_MAX_WORDS, TARGET_RAM, check_block),
+	BLOCK_READ("block_read_flash_max", BLOCK_MAX_WORDS, TARGET_FLASH,
+		   check_block_flash),
+};
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static uint64_t percentile(uint32_t pct)
+{
+	return samples[((ITERATIONS - 1) * pct) / 100];
+}
+
+static void bench_report(const char *name, uint64_t transfers, uint64_t bytes,
+			 uint64_t total, uint32_t errors, bool last)
+{
+	qsort(samples, ITERATIONS, sizeof(samples[0]), cmp_u64);
+	total = MAX(total, 1);
+
+	printk("  {\"name\":\"%s\",\"commands\":%u,\"transfers\":%llu,"
+	       "\"bytes\":%llu,\"transfers_per_s\":%llu,\"bytes_per_s\":%llu,"
+	       "\"latency_ns\":{\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,"
+	       "\"max\":%llu},\"errors\":%u}%s\n",
+	       name, ITERATIONS, transfers, bytes,
+	       (transfers * 1000000000ULL) / total,
+	       (bytes * 1000000000ULL) / total,
+	       percentile(50), percentile(90), percentile(99),
+	       samples[ITERATIONS - 1], errors, last ? "" : ",");
+}
+
+static uint32_t bench_run(const struct workload *w, bool last)
+{
+	size_t len = w->prepare(w, req);
+	uint64_t total = 0;
+	uint32_t errors = 0;
+	uint64_t t0;
+	int ret;
+
+	for (uint32_t i = 0; i < ITERATIONS; i++) {
+		if (w->setup != NULL) {
+			w->setup(w);
+		}
+
+		t0 = bench_clock_ns();
+		ret = bench_exec(req, len, resp);
+		samples[i] = bench_clock_ns() - t0;
+		total += samples[i];
+
+		if (ret <= 0 || !w->check(w, resp)) {
+			errors++;
+		}
+	}
+
+	bench_report(w->name, (uint64_t)w->transfers * ITERATIONS,
+		     (uint64_t)w->bytes * ITERATIONS, total, errors, last);
+
+	return errors;
+}
+
+BUILD_ASSERT(IS_POWER_OF_TWO(SWO_SIZE), "SWO buffer size must be a power of 2");
+
+static uint8_t swo_buf[SWO_SIZE];
+static uint32_t swo_wr;
+
+static uint32_t swo_written(void)
+{
+	return swo_wr;
+}
+
+static struct swo_ring swo_ring = {
+	.buf = swo_buf,
+	.size = SWO_SIZE,
+	.written = swo_written,
+};
+
+static inline uint8_t swo_pattern(uint32_t pos)
+{
+	return (uint8_t)(pos ^ (pos >> 8));
+}
+
+/* Write the ring the way the DMA channel does */
+static void swo_produce(uint32_t len)
+{
+	for (uint32_t i = 0; i < len; i++, swo_wr++) {
+		swo_buf[swo_wr & (SWO_SIZE - 1)] = swo_pattern(swo_wr);
+	}
+}
+
+/*
+ * Produce a burst, then time one drain into a DAP_SWO_Data payload. A
+ * burst larger than the ring laps the reader, which must report the
+ * overrun and go on with consistent data.
+ */
+static uint32_t bench_swo(const char *name, uint32_t burst, bool last)
+{
+	bool lapped = burst > SWO_SIZE;
+	uint64_t total = 0;
+	uint64_t bytes = 0;
+	uint32_t errors = 0;
+	uint32_t len;
+	uint32_t start;
+	bool overrun;
+	uint64_t t0;
+
+	swo_wr = 0;
+	swo_ring_reset(&swo_ring, 0);
+
+	for (uint32_t i = 0; i < ITERATIONS; i++) {
+		swo_produce(burst);
+		overrun = false;
+
+		t0 = bench_clock_ns();
+		len = swo_ring_read(&swo_ring, resp, SWO_CHUNK, &overrun);
+		samples[i] = bench_clock_ns() - t0;
+		total += samples[i];
+		bytes += len;
+
+		start = swo_ring.rd - len;
+		if (overrun != lapped || len != MIN(burst, SWO_CHUNK)) {
+			errors++;
+			continue;
+		}
+
+		for (uint32_t j = 0; j < len; j++) {
+			if (resp[j] != swo_pattern(start + j)) {
+				errors++;
+				break;
+			}
+		}
+	}
+
+	bench_report(name, ITERATIONS, bytes, total, errors, last);
+
+	return errors;
+}
+
+ZTEST(dap_bench, test_workloads)
+{
+	uint32_t errors = 0;
+
+	printk("{\"packet_size\":%u,\"iterations\":%u,\"workloads\":[\n",
+	       PKT_SIZE, ITERATIONS);
+
+	for (size_t i = 0; i < ARRAY_SIZE(workloads); i++) {
+		errors += bench_run(&workloads[i], false);
+	}
+
+	errors += bench_swo("swo_ring_drain", SWO_CHUNK, false);
+	errors += bench_swo("swo_ring_overrun", SWO_SIZE + SWO_CHUNK, true);
+
+	printk("]}\n");
+
+	zassert_equal(errors, 0, "%u wrong responses", errors);
+}
+
+ZTEST_SUITE(dap_bench, NULL, bench_suite_setup, NULL, NULL, NULL);
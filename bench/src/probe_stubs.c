@@ -0,0 +1,30 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Probe services the DAP queue engine reports to, reduced to what the
+ * bench needs: the activity counters are real, the boot timeline and
+ * the thread supervisor (watchdog) have no use on native_sim.
+ */
+
+#include <zephyr/kernel.h>
+
+#include "activity.h"
+#include "boot_time.h"
+#include "health.h"
+
+volatile uint32_t activity_counters[ACTIVITY_COUNT];
+
+atomic_t boot_marked;
+
+void boot_mark_now(enum boot_phase phase)
+{
+	atomic_set_bit(&boot_marked, phase);
+}
+
+int health_register(struct health_hb *hb)
+{
+	ARG_UNUSED(hb);
+
+	return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Activity counter tests
+ *
+ * The DAP queue thread signals once per request packet it executes,
+ * whatever the packet holds, and the signal must stay negligible next to
+ * the request itself. Both are timed on the host clock: the bench
+ * target has no wire, so a request here is cheaper than on the probe and
+ * the bound is conservative.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+
+#include "activity.h"
+#include "bench.h"
+#include "dap_queue.h"
+#include "dap_vendor.h"
+
+#define SIGNAL_LOOPS	100000
+#define REQUEST_LOOPS	1000
+#define RUNS		8
+
+/* Largest share of a DAP request the signal may take */
+#define OVERHEAD_MAX_PERCENT	1
+
+static uint8_t resp[PKT_SIZE];
+
+ZTEST(activity, test_dap_request)
+{
+	const uint8_t info[] = { DAP_CMD_INFO, DAP_INFO_PACKET_COUNT };
+	uint32_t before = activity_read(ACTIVITY_DAP);
+
+	for (int i = 0; i < 10; i++) {
+		zassert_equal(bench_exec(info, sizeof(info), resp), 3);
+	}
+
+	zassert_equal(activity_read(ACTIVITY_DAP) - before, 10);
+}
+
+/* Queued packets count when they run, one each */
+ZTEST(activity, test_dap_batch)
+{
+	const uint8_t queued[] = {
+		DAP_CMD_QUEUE_COMMANDS, 1, DAP_CMD_INFO, DAP_INFO_PACKET_COUNT,
+	};
+	const uint8_t last[] = {
+		DAP_CMD_EXECUTE_COMMANDS, 1, DAP_CMD_INFO, DAP_INFO_PACKET_SIZE,
+	};
+	uint32_t before = activity_read(ACTIVITY_DAP);
+
+	bench_submit(queued, sizeof(queued));
+	bench_submit(queued, sizeof(queued));
+	bench_submit(last, sizeof(last));
+
+	for (int i = 0; i < 3; i++) {
+		zassert_true(bench_recv(resp, BENCH_TIMEOUT) > 0);
+	}
+
+	zassert_equal(activity_read(ACTIVITY_DAP) - before, 3);
+}
+
+/* A streamed read is one request, however many responses it takes */
+ZTEST(activity, test_dap_stream)
+{
+	uint32_t before = activity_read(ACTIVITY_DAP);
+	uint8_t req[9];
+	int responses = 0;
+
+	req[0] = DAP_VENDOR_READ_MEM;
+	sys_put_le32(TARGET_RAM, &req[1]);
+	sys_put_le32(4 * PKT_SIZE, &req[5]);
+	bench_submit(req, sizeof(req));
+
+	while (bench_recv(resp, K_MSEC(100)) > 0) {
+		responses++;
+	}
+
+	zassert_true(responses > 1);
+	zassert_equal(activity_read(ACTIVITY_DAP) - before, 1);
+}
+
+/*
+ * Cost of activity_signal() against the same loop without it, best of
+ * several runs. Nothing writes the UART counters in the bench, so one
+ * of them stands in for the DAP counter without breaking the single
+ * writer rule.
+ */
+static uint64_t signal_ns(void)
+{
+	uint64_t base = UINT64_MAX;
+	uint64_t with = UINT64_MAX;
+
+	for (int run = 0; run < RUNS; run++) {
+		uint64_t t0 = bench_clock_ns();
+
+		for (int i = 0; i < SIGNAL_LOOPS; i++) {
+			__asm__ volatile("" ::: "memory");
+		}
+
+		uint64_t t1 = bench_clock_ns();
+
+		for (int i = 0; i < SIGNAL_LOOPS; i++) {
+			activity_signal(ACTIVITY_UART_TX);
+			__asm__ volatile("" ::: "memory");
+		}
+
+		uint64_t t2 = bench_clock_ns();
+
+		base = MIN(base, t1 - t0);
+		with = MIN(with, t2 - t1);
+	}
+
+	return (with > base) ? (with - base) : 0;
+}
+
+/* Shortest DAP request round trip through the queue */
+static uint64_t request_ns(void)
+{
+	const uint8_t info[] = { DAP_CMD_INFO, DAP_INFO_PACKET_COUNT };
+	uint64_t best = UINT64_MAX;
+
+	for (int i = 0; i < REQUEST_LOOPS; i++) {
+		uint64_t t0 = bench_clock_ns();
+
+		zassert_equal(bench_exec(info, sizeof(info), resp), 3);
+		best = MIN(best, bench_clock_ns() - t0);
+	}
+
+	return best;
+}
+
+ZTEST(activity, test_overhead)
+{
+	uint64_t signal = signal_ns();
+	uint64_t request = request_ns();
+
+	printk("activity: %llu ns per %u signals, %llu ns per DAP request\n",
+	       signal, SIGNAL_LOOPS, request);
+
+	zassert_true(signal * 100 <= request * SIGNAL_LOOPS * OVERHEAD_MAX_PERCENT,
+		     "signal takes more than %u%% of a DAP request",
+		     OVERHEAD_MAX_PERCENT);
+}
+
+ZTEST_SUITE(activity, NULL, bench_suite_setup, NULL, NULL, NULL);
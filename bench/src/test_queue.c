@@ -0,0 +1,309 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * DAP queue engine protocol tests
+ *
+ * What the host relies on beyond the DAP core: the DAP_Info answers of
+ * the transport, DAP_QueueCommands batches answered as
+ * DAP_ExecuteCommands, vendor memory reads streamed over several
+ * responses and ended by DAP_TransferAbort or sharing the response of a
+ * batch, and the link reset when responses are not read.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+#include <string.h>
+
+#include "bench.h"
+#include "dap_queue.h"
+#include "dap_vendor.h"
+
+/* Vendor read response header: command, status, byte count */
+#define READ_MEM_HDR	4
+#define READ_MEM_MAX	((PKT_SIZE - READ_MEM_HDR) & ~3)
+/* DAP_ExecuteCommands response header: command, count */
+#define BATCH_HDR	2
+#define WRITE_MEM_MAX	((PKT_SIZE - 7) & ~3)
+
+/* Straddles a 1 KB TAR block inside a response */
+#define STREAM_ADDR	(TARGET_RAM + 1024 - 64)
+#define STREAM_LEN	2048
+
+/* No response comes after this */
+#define QUIET		K_MSEC(100)
+
+static uint8_t resp[PKT_SIZE];
+
+static uint32_t stream_pattern(uint32_t addr)
+{
+	return addr * 2654435761U;
+}
+
+static void write_mem(uint32_t addr, const uint8_t *data, uint16_t len)
+{
+	uint8_t req[PKT_SIZE];
+
+	req[0] = DAP_VENDOR_WRITE_MEM;
+	sys_put_le32(addr, &req[1]);
+	sys_put_le16(len, &req[5]);
+	memcpy(&req[7], data, len);
+
+	zassert_equal(bench_exec(req, 7 + len, resp), 2);
+	zassert_equal(resp[0], DAP_VENDOR_WRITE_MEM);
+	zassert_equal(resp[1], ACK_OK, "write at 0x%08x: ack %u", addr, resp[1]);
+}
+
+/* Fill the stream range with a pattern of its addresses */
+static void stream_fill(void)
+{
+	uint8_t data[WRITE_MEM_MAX];
+
+	for (uint32_t off = 0; off < STREAM_LEN; off += sizeof(data)) {
+		uint16_t len = MIN(sizeof(data), STREAM_LEN - off);
+
+		for (uint16_t i = 0; i < len; i += 4) {
+			uint32_t addr = STREAM_ADDR + off + i;
+
+			sys_put_le32(stream_pattern(addr), &data[i]);
+		}
+		write_mem(STREAM_ADDR + off, data, len);
+	}
+}
+
+static void read_mem_request(uint8_t *req, uint32_t addr, uint32_t len)
+{
+	req[0] = DAP_VENDOR_READ_MEM;
+	sys_put_le32(addr, &req[1]);
+	sys_put_le32(len, &req[5]);
+}
+
+ZTEST(dap_queue, test_info_packet)
+{
+	const uint8_t count[] = { DAP_CMD_INFO, DAP_INFO_PACKET_COUNT };
+	const uint8_t size[] = { DAP_CMD_INFO, DAP_INFO_PACKET_SIZE };
+
+	zassert_equal(bench_exec(count, sizeof(count), resp), 3);
+	zassert_equal(resp[1], 1);
+	zassert_equal(resp[2], CONFIG_DAP_QUEUE_PACKET_COUNT);
+
+	zassert_equal(bench_exec(size, sizeof(size), resp), 4);
+	zassert_equal(resp[1], 2);
+	zassert_equal(sys_get_le16(&resp[2]), PKT_SIZE);
+}
+
+ZTEST(dap_queue, test_info_capabilities)
+{
+	const uint8_t caps[] = { DAP_CMD_INFO, DAP_INFO_CAPABILITIES };
+
+	zassert_true(bench_exec(caps, sizeof(caps), resp) >= 3);
+	zassert_true(resp[1] >= 1);
+	zassert_true(resp[2] & DAP_CAP_ATOMIC_COMMANDS,
+		     "atomic commands not advertised");
+}
+
+ZTEST(dap_queue, test_execute_commands)
+{
+	const uint8_t req[] = {
+		DAP_CMD_EXECUTE_COMMANDS, 2,
+		DAP_CMD_INFO, DAP_INFO_PACKET_COUNT,
+		DAP_CMD_INFO, DAP_INFO_PACKET_SIZE,
+	};
+
+	zassert_equal(bench_exec(req, sizeof(req), resp), 2 + 3 + 4);
+	zassert_equal(resp[0], DAP_CMD_EXECUTE_COMMANDS);
+	zassert_equal(resp[1], 2);
+	zassert_equal(resp[4], CONFIG_DAP_QUEUE_PACKET_COUNT);
+	zassert_equal(sys_get_le16(&resp[7]), PKT_SIZE);
+}
+
+/* Held until a packet of another type, then answered in order */
+ZTEST(dap_queue, test_queue_commands)
+{
+	const uint8_t queued[] = {
+		DAP_CMD_QUEUE_COMMANDS, 1, DAP_CMD_INFO, DAP_INFO_PACKET_COUNT,
+	};
+	const uint8_t last[] = {
+		DAP_CMD_EXECUTE_COMMANDS, 1, DAP_CMD_INFO, DAP_INFO_PACKET_SIZE,
+	};
+	struct dap_queue_stats before, after;
+
+	dap_queue_get_stats(&before);
+
+	bench_submit(queued, sizeof(queued));
+	bench_submit(queued, sizeof(queued));
+	zassert_equal(bench_recv(resp, QUIET), -EAGAIN,
+		      "queued packet answered before the batch closed");
+
+	bench_submit(last, sizeof(last));
+
+	for (int i = 0; i < 2; i++) {
+		zassert_equal(bench_recv(resp, BENCH_TIMEOUT), 5);
+		zassert_equal(resp[0], DAP_CMD_EXECUTE_COMMANDS);
+		zassert_equal(resp[1], 1);
+		zassert_equal(resp[4], CONFIG_DAP_QUEUE_PACKET_COUNT);
+	}
+
+	zassert_equal(bench_recv(resp, BENCH_TIMEOUT), 6);
+	zassert_equal(resp[0], DAP_CMD_EXECUTE_COMMANDS);
+	zassert_equal(sys_get_le16(&resp[4]), PKT_SIZE);
+
+	dap_queue_get_stats(&after);
+	zassert_equal(after.queued - before.queued, 2);
+	zassert_equal(after.batches - before.batches, 1);
+}
+
+ZTEST(dap_queue, test_vendor_unknown)
+{
+	const uint8_t req[] = { DAP_VENDOR_LAST };
+
+	zassert_equal(bench_exec(req, sizeof(req), resp), 1);
+	zassert_equal(resp[0], DAP_VENDOR_ERROR);
+}
+
+/* A read longer than a packet comes back in consecutive responses */
+ZTEST(dap_queue, test_vendor_read_stream)
+{
+	uint32_t addr = STREAM_ADDR;
+	uint8_t req[9];
+	int len;
+
+	stream_fill();
+
+	read_mem_request(req, STREAM_ADDR, STREAM_LEN);
+	bench_submit(req, sizeof(req));
+
+	while (addr < STREAM_ADDR + STREAM_LEN) {
+		uint16_t count;
+
+		len = bench_recv(resp, BENCH_TIMEOUT);
+		zassert_true(len >= READ_MEM_HDR, "stream ended at 0x%08x", addr);
+		zassert_equal(resp[0], DAP_VENDOR_READ_MEM);
+		zassert_equal(resp[1], ACK_OK);
+
+		count = sys_get_le16(&resp[2]);
+		zassert_equal(count,
+			      MIN(READ_MEM_MAX, STREAM_ADDR + STREAM_LEN - addr));
+		zassert_equal(len, READ_MEM_HDR + count);
+
+		for (uint16_t i = 0; i < count; i += 4, addr += 4) {
+			zassert_equal(sys_get_le32(&resp[READ_MEM_HDR + i]),
+				      stream_pattern(addr),
+				      "wrong word at 0x%08x", addr);
+		}
+	}
+
+	zassert_equal(bench_recv(resp, QUIET), -EAGAIN);
+}
+
+/*
+ * Two reads in one batch: the first starts past the batch header, the
+ * second gets what is left of the response packet, and neither streams.
+ */
+ZTEST(dap_queue, test_vendor_read_batch)
+{
+	const uint32_t first = 16;
+	const uint32_t second = ((PKT_SIZE - BATCH_HDR - READ_MEM_HDR - first -
+				  READ_MEM_HDR) & ~3);
+	uint8_t req[BATCH_HDR + 2 * 9];
+	const uint8_t *data;
+
+	stream_fill();
+
+	req[0] = DAP_CMD_EXECUTE_COMMANDS;
+	req[1] = 2;
+	read_mem_request(&req[BATCH_HDR], STREAM_ADDR, first);
+	read_mem_request(&req[BATCH_HDR + 9], STREAM_ADDR + first, STREAM_LEN);
+
+	zassert_equal(bench_exec(req, sizeof(req), resp),
+		      BATCH_HDR + 2 * READ_MEM_HDR + first + second);
+	zassert_equal(resp[0], DAP_CMD_EXECUTE_COMMANDS);
+	zassert_equal(resp[1], 2);
+
+	data = &resp[BATCH_HDR];
+	for (int i = 0; i < 2; i++) {
+		uint32_t addr = STREAM_ADDR + (i ? first : 0);
+		uint16_t count = sys_get_le16(&data[2]);
+
+		zassert_equal(data[0], DAP_VENDOR_READ_MEM);
+		zassert_equal(data[1], ACK_OK);
+		zassert_equal(count, i ? second : first);
+
+		for (uint16_t j = 0; j < count; j += 4, addr += 4) {
+			zassert_equal(sys_get_le32(&data[READ_MEM_HDR + j]),
+				      stream_pattern(addr),
+				      "wrong word at 0x%08x", addr);
+		}
+		data += READ_MEM_HDR + count;
+	}
+
+	zassert_equal(bench_recv(resp, QUIET), -EAGAIN);
+}
+
+/* A queued DAP_TransferAbort ends the stream at the next response */
+ZTEST(dap_queue, test_vendor_read_abort)
+{
+	const uint8_t abort[] = { DAP_CMD_TRANSFER_ABORT };
+	uint8_t req[9];
+	int reads = 0;
+
+	read_mem_request(req, TARGET_RAM, STREAM_LEN);
+
+	k_sched_lock();
+	bench_submit(req, sizeof(req));
+	bench_submit(abort, sizeof(abort));
+	k_sched_unlock();
+
+	while (bench_recv(resp, QUIET) > 0) {
+		if (resp[0] == DAP_VENDOR_READ_MEM) {
+			reads++;
+		}
+	}
+
+	zassert_equal(reads, 1, "%d read responses after the abort", reads);
+	zassert_false(dap_queue_aborted());
+}
+
+ZTEST(dap_queue, test_vendor_read_limit)
+{
+	uint8_t req[9];
+
+	read_mem_request(req, TARGET_RAM, CONFIG_DAP_VENDOR_READ_LIMIT + 4);
+
+	zassert_equal(bench_exec(req, sizeof(req), resp), READ_MEM_HDR);
+	zassert_equal(resp[1], DAP_VENDOR_ERROR);
+	zassert_equal(bench_recv(resp, QUIET), -EAGAIN);
+}
+
+/*
+ * Responses the host does not read: once the response buffers are all
+ * in use, the next request resets the link instead of being answered
+ * out of turn.
+ */
+ZTEST(dap_queue, test_link_reset)
+{
+	const uint8_t info[] = { DAP_CMD_INFO, DAP_INFO_PACKET_COUNT };
+	struct dap_queue_stats before, after;
+
+	dap_queue_get_stats(&before);
+
+	for (int i = 0; i <= CONFIG_DAP_QUEUE_IN_BUFFERS; i++) {
+		bench_submit(info, sizeof(info));
+	}
+
+	/* Give the queue thread time to give up on a response buffer */
+	k_sleep(K_MSEC(500));
+
+	dap_queue_get_stats(&after);
+	zassert_equal(after.resets - before.resets, 1);
+	zassert_equal(after.dropped - before.dropped, 1);
+	zassert_equal(bench_recv(resp, K_NO_WAIT), -EAGAIN,
+		      "unread responses kept across the link reset");
+
+	/* Back in step */
+	zassert_equal(bench_exec(info, sizeof(info), resp), 3);
+	zassert_equal(resp[2], CONFIG_DAP_QUEUE_PACKET_COUNT);
+}
+
+ZTEST_SUITE(dap_queue, NULL, bench_suite_setup, NULL, NULL, NULL);
@@ -0,0 +1,128 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * DAP queue tests on an SMP target (QEMU)
+ *
+ * As in the dap-core1 build of the probe, the queue thread is pinned to
+ * CONFIG_DAP_QUEUE_CPU. Requests are submitted from a thread pinned to
+ * another CPU, the way the USB stack runs on core 0, so the request
+ * ring is filled and drained from two cores at once, wrapping many
+ * times. Every response must come back from the queue CPU, in order.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+
+#include "bench.h"
+#include "dap_queue.h"
+#include "dap_vendor.h"
+
+BUILD_ASSERT(IS_ENABLED(CONFIG_DAP_QUEUE_CPU_PIN),
+	     "the SMP scenario pins the queue thread");
+
+/* Words of target RAM, one request each */
+#define SMP_WORDS	256
+#define SMP_ROUNDS	8
+#define SMP_REQUESTS	(SMP_WORDS * SMP_ROUNDS)
+
+#define SUBMIT_STACK_SIZE	2048
+
+/* Submitting CPU, any but the queue one */
+#define SUBMIT_CPU	(CONFIG_DAP_QUEUE_CPU == 0 ? 1 : 0)
+
+static K_THREAD_STACK_DEFINE(submit_stack, SUBMIT_STACK_SIZE);
+static struct k_thread submit_thread;
+
+static uint8_t resp[PKT_SIZE];
+static atomic_t submit_cpus;
+
+static uint32_t smp_pattern(uint32_t i)
+{
+	return 0xC0DE0000 | i;
+}
+
+static void submit_requests(void *p1, void *p2, void *p3)
+{
+	uint8_t req[9];
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	req[0] = DAP_VENDOR_READ_MEM;
+	sys_put_le32(4, &req[5]);
+
+	for (uint32_t i = 0; i < SMP_REQUESTS; i++) {
+		atomic_or(&submit_cpus, BIT(arch_curr_cpu()->id));
+		sys_put_le32(TARGET_RAM + 4 * (i % SMP_WORDS), &req[1]);
+		bench_submit(req, sizeof(req));
+	}
+}
+
+ZTEST(dap_smp, test_queue_pinned)
+{
+	const uint8_t info[] = { DAP_CMD_INFO, DAP_INFO_PACKET_COUNT };
+
+	bench_response_cpus();
+
+	for (int i = 0; i < 100; i++) {
+		zassert_equal(bench_exec(info, sizeof(info), resp), 3);
+	}
+
+	zassert_equal(bench_response_cpus(), BIT(CONFIG_DAP_QUEUE_CPU),
+		      "responses not all sent from CPU %d",
+		      CONFIG_DAP_QUEUE_CPU);
+}
+
+ZTEST(dap_smp, test_ring_cross_core)
+{
+	uint8_t req[7 + 4];
+	struct dap_queue_stats before, after;
+
+	/* One word per request, so each response tells its request */
+	req[0] = DAP_VENDOR_WRITE_MEM;
+	sys_put_le16(4, &req[5]);
+	for (uint32_t i = 0; i < SMP_WORDS; i++) {
+		sys_put_le32(TARGET_RAM + 4 * i, &req[1]);
+		sys_put_le32(smp_pattern(i), &req[7]);
+		zassert_equal(bench_exec(req, sizeof(req), resp), 2);
+		zassert_equal(resp[1], ACK_OK);
+	}
+
+	dap_queue_get_stats(&before);
+	bench_response_cpus();
+	atomic_clear(&submit_cpus);
+
+	k_thread_create(&submit_thread, submit_stack,
+			K_THREAD_STACK_SIZEOF(submit_stack), submit_requests,
+			NULL, NULL, NULL, K_PRIO_PREEMPT(1), 0, K_FOREVER);
+	zassert_ok(k_thread_cpu_pin(&submit_thread, SUBMIT_CPU));
+	k_thread_start(&submit_thread);
+
+	for (uint32_t i = 0; i < SMP_REQUESTS; i++) {
+		zassert_equal(bench_recv(resp, BENCH_TIMEOUT), 8,
+			      "no response to request %u", i);
+		zassert_equal(resp[0], DAP_VENDOR_READ_MEM);
+		zassert_equal(resp[1], ACK_OK);
+		zassert_equal(sys_get_le32(&resp[4]), smp_pattern(i % SMP_WORDS),
+			      "response %u out of order", i);
+	}
+
+	zassert_ok(k_thread_join(&submit_thread, BENCH_TIMEOUT));
+
+	dap_queue_get_stats(&after);
+	zassert_equal(after.resets, before.resets, "link reset");
+	zassert_equal(atomic_get(&submit_cpus), BIT(SUBMIT_CPU));
+	zassert_equal(bench_response_cpus(), BIT(CONFIG_DAP_QUEUE_CPU));
+}
+
+static void *smp_setup(void)
+{
+	zassert_true(arch_num_cpus() > 1, "needs two CPUs");
+
+	return bench_suite_setup();
+}
+
+ZTEST_SUITE(dap_smp, NULL, smp_setup, NULL, NULL, NULL);
@@ -0,0 +1,169 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * SWO ring buffer tests
+ *
+ * The producer is synthetic: it writes the ring the way the DMA channel
+ * does, and can be made to run between the two reads of its count by
+ * swo_ring_read(), which is when the DMA channel overwrites the bytes
+ * being copied.
+ */
+
+#include <zephyr/ztest.h>
+
+#include "swo_ring.h"
+
+#define RING_SIZE	1024
+#define CHUNK		256
+
+static uint8_t ring_buf[RING_SIZE];
+static uint8_t out[RING_SIZE];
+
+/* Producer count, and bytes it writes on its next read */
+static uint32_t ring_wr;
+static uint32_t ring_during;
+
+static inline uint8_t ring_pattern(uint32_t pos)
+{
+	return (uint8_t)(pos ^ (pos >> 8));
+}
+
+static void ring_produce(uint32_t len)
+{
+	for (uint32_t i = 0; i < len; i++, ring_wr++) {
+		ring_buf[ring_wr & (RING_SIZE - 1)] = ring_pattern(ring_wr);
+	}
+}
+
+/* The burst lands while the consumer copies, after its first count */
+static uint32_t ring_written(void)
+{
+	uint32_t wr = ring_wr;
+
+	ring_produce(ring_during);
+	ring_during = 0;
+
+	return wr;
+}
+
+static struct swo_ring ring = {
+	.buf = ring_buf,
+	.size = RING_SIZE,
+	.written = ring_written,
+};
+
+static void check_bytes(uint32_t start, uint32_t len)
+{
+	for (uint32_t i = 0; i < len; i++) {
+		zassert_equal(out[i], ring_pattern(start + i),
+			      "wrong byte %u of %u from %u", i, len, start);
+	}
+}
+
+ZTEST(swo_ring, test_in_order)
+{
+	bool overrun = false;
+	uint32_t len;
+
+	ring_produce(CHUNK + 100);
+
+	len = swo_ring_read(&ring, out, CHUNK, &overrun);
+	zassert_equal(len, CHUNK);
+	check_bytes(0, len);
+
+	len = swo_ring_read(&ring, out, CHUNK, &overrun);
+	zassert_equal(len, 100);
+	check_bytes(CHUNK, len);
+
+	zassert_false(overrun);
+	zassert_equal(ring.overruns, 0);
+	zassert_equal(swo_ring_level(&ring, ring_wr), 0);
+}
+
+/* Wraps around the end of the storage in one copy */
+ZTEST(swo_ring, test_wrap)
+{
+	bool overrun = false;
+	uint32_t len;
+
+	ring_produce(RING_SIZE - 10);
+	swo_ring_reset(&ring, ring_wr);
+	ring_produce(CHUNK);
+
+	len = swo_ring_read(&ring, out, CHUNK, &overrun);
+	zassert_equal(len, CHUNK);
+	check_bytes(RING_SIZE - 10, len);
+	zassert_false(overrun);
+}
+
+/* Lapped before the read: resume at the newest half */
+ZTEST(swo_ring, test_lap_before_read)
+{
+	bool overrun = false;
+	uint32_t len;
+
+	ring_produce(RING_SIZE + 10);
+
+	len = swo_ring_read(&ring, out, CHUNK, &overrun);
+	zassert_true(overrun);
+	zassert_equal(ring.overruns, 1);
+	zassert_equal(len, CHUNK);
+	check_bytes(ring_wr - RING_SIZE / 2, len);
+}
+
+/* Lapped during the copy: the overwritten head is dropped */
+ZTEST(swo_ring, test_lap_during_copy)
+{
+	bool overrun = false;
+	uint32_t len;
+
+	ring_produce(RING_SIZE);
+	ring_during = 100;
+
+	len = swo_ring_read(&ring, out, CHUNK, &overrun);
+	zassert_true(overrun);
+	zassert_equal(ring.overruns, 1);
+	zassert_equal(len, CHUNK - 100);
+	check_bytes(100, len);
+
+	/* The rest follows on */
+	overrun = false;
+	len = swo_ring_read(&ring, out, CHUNK, &overrun);
+	zassert_false(overrun);
+	zassert_equal(len, CHUNK);
+	check_bytes(CHUNK, len);
+}
+
+/* The whole copy overwritten: nothing returned, next read resyncs */
+ZTEST(swo_ring, test_lap_whole_copy)
+{
+	bool overrun = false;
+	uint32_t len;
+
+	ring_produce(RING_SIZE);
+	ring_during = CHUNK + 44;
+
+	len = swo_ring_read(&ring, out, CHUNK, &overrun);
+	zassert_true(overrun);
+	zassert_equal(len, 0);
+
+	overrun = false;
+	len = swo_ring_read(&ring, out, CHUNK, &overrun);
+	zassert_true(overrun);
+	zassert_equal(ring.overruns, 2);
+	zassert_equal(len, CHUNK);
+	check_bytes(ring_wr - RING_SIZE / 2, len);
+}
+
+static void ring_before(void *fixture)
+{
+	ARG_UNUSED(fixture);
+
+	ring_wr = 0;
+	ring_during = 0;
+	ring.overruns = 0;
+	swo_ring_reset(&ring, 0);
+}
+
+ZTEST_SUITE(swo_ring, NULL, NULL, ring_before, NULL, NULL);
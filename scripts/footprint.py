@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: AGPL-3.0-or-later
+# Copyright (c) 2025 Vincent Jardin
+#
+# RAM and flash footprint per subsystem, from the GNU ld map file.
+#
+# Every input section of the map is charged to a subsystem, named after
+# the object it comes from: app/<file> for the application sources,
+# shell for any *shell* object (the diagnostic shells of the drivers and
+# subsystems), and the library path otherwise (kernel, subsys/usb,
+# drivers/serial, libc, ...). Sections placed in RAM count as RAM,
+# initialized ones also count as flash for their load image.
+#
+# The totals are checked against a budget file:
+#
+#   {
+#     "total": {"rom": 262144, "ram": 196608},
+#     "subsystems": {"app/dap_usb": {"ram": 12288}, "shell": {"rom": 40960}}
+#   }
+#
+# and written as JSON next to the map, so CI can keep them per build.
+# The build passes the size of the code partition with --rom-limit: the
+# total flash budget never goes beyond it.
+
+import argparse
+import json
+import re
+import sys
+
+# RP2040: XIP flash and SRAM
+ROM_BASE, ROM_SIZE = 0x10000000, 0x01000000
+RAM_BASE, RAM_SIZE = 0x20000000, 0x00042000
+
+# Output and input sections with no load image
+NOLOAD = re.compile(r"^(\.?bss|\.?noinit|COMMON|\.stack|\.heap)")
+
+SECTION = re.compile(r"^ (\S+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+OUTPUT = re.compile(r"^(\S+)(\s+0x([0-9a-f]+)\s+0x([0-9a-f]+))?")
+OBJECT = re.compile(r"(?:^|/)lib([^/]+)\.a\(([^)]+)\)$")
+
+
+def subsystem(path):
+    """Map an object path of the map file to a subsystem name."""
+    m = OBJECT.search(path)
+    if m is None:
+        obj = path.rsplit("/", 1)[-1]
+        return "shell" if "shell" in obj else "other"
+
+    lib, obj = m.group(1), m.group(2)
+    if "shell" in obj:
+        return "shell"
+    if lib == "app":
+        return "app/" + obj.split(".", 1)[0]
+
+    parts = lib.split("__")
+    if parts[0] in ("subsys", "drivers") and len(parts) > 1:
+        return "/".join(parts[:2])
+    if parts[0] in ("c", "m", "gcc", "nosys", "c_nano"):
+        return "libc"
+    return parts[0]
+
+
+def parse_map(path):
+    """Return {subsystem: {"rom": bytes, "ram": bytes}}."""
+    sizes = {}
+    output = None
+    pending = None
+    in_map = False
+
+    with open(path, encoding="utf-8", errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if not in_map:
+                in_map = line.startswith("Linker script and memory map")
+                continue
+
+            m = OUTPUT.match(line)
+            if m:
+                output = m.group(1)
+                pending = None
+                continue
+
+            m = SECTION.match(line)
+            if m is None:
+                # Long input section names are alone on their line
+                stripped = line.strip()
+                if line.startswith(" ") and " " not in stripped and stripped:
+                    pending = stripped
+                continue
+
+            name = m.group(1) or pending
+            pending = None
+            addr = int(m.group(2), 16)
+            size = int(m.group(3), 16)
+            obj = m.group(4).strip()
+            if size == 0 or name is None or obj.startswith("0x"):
+                continue
+
+            entry = sizes.setdefault(subsystem(obj), {"rom": 0, "ram": 0})
+            if ROM_BASE <= addr < ROM_BASE + ROM_SIZE:
+                entry["rom"] += size
+            elif RAM_BASE <= addr < RAM_BASE + RAM_SIZE:
+                entry["ram"] += size
+                if not NOLOAD.match(output or "") and not NOLOAD.match(name):
+                    entry["rom"] += size
+
+    return sizes
+
+
+def check(sizes, total, budget):
+    """Return the budget overruns as messages."""
+    errors = []
+
+    def over(what, used, limits):
+        for kind in ("rom", "ram"):
+            if kind in limits and used[kind] > limits[kind]:
+                errors.append(f"{what} {kind.upper()} {used[kind]} bytes, "
+                              f"budget {limits[kind]} "
+                              f"(+{used[kind] - limits[kind]})")
+
+    over("total", total, budget.get("total", {}))
+    for name, limits in budget.get("subsystems", {}).items():
+        over(name, sizes.get(name, {"rom": 0, "ram": 0}), limits)
+
+    return errors
+
+
+def update(sizes, total, margin, rom_limit):
+    """Budget of the current build with some headroom."""
+    def room(v):
+        return (v * (100 + margin) // 100 + 255) // 256 * 256
+
+    limits = {k: room(v) for k, v in total.items()}
+    if rom_limit:
+        limits["rom"] = rom_limit
+
+    return {
+        "total": limits,
+        "subsystems": {
+            name: {k: room(v) for k, v in used.items() if v}
+            for name, used in sorted(sizes.items())
+        },
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("map", help="zephyr.map of the build")
+    parser.add_argument("-b", "--budget", help="budget file (JSON)")
+    parser.add_argument("-o", "--output", help="write the report as JSON")
+    parser.add_argument("--strict", action="store_true",
+                        help="exit with an error when over budget")
+    parser.add_argument("--update", action="store_true",
+                        help="rewrite the budget file from this build")
+    parser.add_argument("--margin", type=int, default=5,
+                        help="headroom in percent for --update (default 5)")
+    parser.add_argument("--rom-limit", type=int, default=0,
+                        help="size of the code partition, caps the total "
+                             "flash budget")
+    parser.add_argument("-q", "--quiet", action="store_true",
+                        help="only print budget overruns")
+    args = parser.parse_args()
+
+    sizes = parse_map(args.map)
+    total = {
+        "rom": sum(s["rom"] for s in sizes.values()),
+        "ram": sum(s["ram"] for s in sizes.values()),
+    }
+
+    if not args.quiet:
+        print(f"{'Subsystem':<28}{'Flash':>10}{'RAM':>10}")
+        for name, used in sorted(sizes.items(),
+                                 key=lambda i: (-i[1]["ram"], -i[1]["rom"])):
+            print(f"{name:<28}{used['rom']:>10}{used['ram']:>10}")
+        print(f"{'total':<28}{total['rom']:>10}{total['ram']:>10}")
+
+    if args.output:
+        with open(args.output, "w", encoding="utf-8") as f:
+            json.dump({"total": total, "subsystems": sizes}, f, indent=2,
+                      sort_keys=True)
+            f.write("\n")
+
+    if args.budget is None:
+        return 0
+
+    if args.update:
+        with open(args.budget, "w", encoding="utf-8") as f:
+            json.dump(update(sizes, total, args.margin, args.rom_limit), f,
+                      indent=2)
+            f.write("\n")
+        print(f"Budget written to {args.budget}")
+        return 0
+
+    try:
+        with open(args.budget, encoding="utf-8") as f:
+            budget = json.load(f)
+    except FileNotFoundError:
+        print(f"warning: no footprint budget {args.budget}", file=sys.stderr)
+        return 0
+
+    if args.rom_limit:
+        limits = budget.setdefault("total", {})
+        limits["rom"] = min(limits.get("rom", args.rom_limit), args.rom_limit)
+
+    errors = check(sizes, total, budget)
+    for e in errors:
+        print(f"{'error' if args.strict else 'warning'}: footprint: {e}",
+              file=sys.stderr)
+
+    return 1 if errors and args.strict else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: AGPL-3.0-or-later
+# Copyright (c) 2025 Vincent Jardin
+#
+# Generate the gamma corrected LED waveform tables used by src/leds.c.
+#
+# Every table holds 16-bit duty cycles (0..65535) already corrected for
+# the eye response, one sample per PWM period. The firmware only scales
+# them to the PWM TOP value, there is no math left at runtime.
+
+import argparse
+import math
+
+
+def gamma(x, g):
+    return round(65535 * (max(0.0, min(1.0, x)) ** g))
+
+
+def square(rate, hz, duty=0.5):
+    n = max(2, round(rate / hz))
+    on = max(1, round(n * duty))
+    return [1.0] * on + [0.0] * (n - on)
+
+
+def waveforms(rate):
+    waves = {}
+
+    # Raised cosine, 2.56 s per cycle
+    n = round(rate * 2.56)
+    waves["breathe"] = [(1 - math.cos(2 * math.pi * i / n)) / 2
+                        for i in range(n)]
+
+    waves["blink"] = square(rate, 1)
+    waves["blink_fast"] = square(rate, 4)
+
+    # Two short beats per second
+    n = round(rate)
+    beat = max(1, round(rate * 0.1))
+    waves["heartbeat"] = [1.0 if i < beat or 2 * beat <= i < 3 * beat
+                          else 0.0 for i in range(n)]
+
+    # One-shot: full on, then fade out over 300 ms
+    n = max(2, round(rate * 0.3))
+    waves["flash"] = [1.0 - i / (n - 1) for i in range(n)]
+
+    return waves
+
+
+def emit_table(out, name, values):
+    out.write(f"static const uint16_t {name}[{len(values)}] = {{\n")
+    for i in range(0, len(values), 8):
+        row = ", ".join(f"{v:5d}" for v in values[i:i + 8])
+        out.write(f"\t{row},\n")
+    out.write("};\n\n")
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Generate LED waveform tables")
+    ap.add_argument("--rate", type=int, required=True,
+                    help="samples per second (PWM frequency)")
+    ap.add_argument("--gamma", type=float, default=2.2,
+                    help="gamma exponent")
+    ap.add_argument("output", help="header to generate")
+    args = ap.parse_args()
+
+    with open(args.output, "w") as out:
+        out.write("/* Generated by scripts/gen_led_waveforms.py, do not edit */\n\n")
+        out.write("#ifndef LED_WAVEFORMS_H\n#define LED_WAVEFORMS_H\n\n")
+        out.write("#include <stdint.h>\n\n")
+        out.write(f"#define LED_WAVE_RATE_HZ {args.rate}\n\n")
+
+        # Perceptual brightness 0..100 % to duty cycle
+        emit_table(out, "led_gamma",
+                   [gamma(p / 100, args.gamma) for p in range(101)])
+
+        for name, wave in waveforms(args.rate).items():
+            emit_table(out, f"led_wave_{name}",
+                       [gamma(x, args.gamma) for x in wave])
+
+        out.write("#endif /* LED_WAVEFORMS_H */\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,92 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Activity signalling from the data paths to the LEDs
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include "activity.h"
+
+volatile uint32_t activity_counters[ACTIVITY_COUNT];
+
+static const char *const activity_names[ACTIVITY_COUNT] = {
+	[ACTIVITY_DAP] = "dap",
+	[ACTIVITY_UART_RX] = "uart-rx",
+	[ACTIVITY_UART_TX] = "uart-tx",
+};
+
+/* Shell commands */
+
+static int cmd_activity_show(const struct shell *sh, size_t argc, char **argv)
+{
+	for (int i = 0; i < ACTIVITY_COUNT; i++) {
+		shell_print(sh, "%-8s %10u", activity_names[i], activity_read(i));
+	}
+
+	return 0;
+}
+
+#define ACTIVITY_BENCH_LOOPS 10000
+
+/*
+ * Cost of activity_signal() as seen by a hot path: time a loop of
+ * signals against the same loop without them. The scratch counter is
+ * not one of the live ones, so the bench does not disturb the LEDs or
+ * break the single writer rule.
+ */
+static int cmd_activity_bench(const struct shell *sh, size_t argc, char **argv)
+{
+	static volatile uint32_t scratch;
+	uint32_t base = UINT32_MAX;
+	uint32_t with = UINT32_MAX;
+	uint64_t hz = sys_clock_hw_cycles_per_sec();
+	uint32_t delta;
+
+	for (int run = 0; run < 8; run++) {
+		unsigned int key = irq_lock();
+		uint32_t t0 = k_cycle_get_32();
+
+		for (int i = 0; i < ACTIVITY_BENCH_LOOPS; i++) {
+			__asm__ volatile("" ::: "memory");
+		}
+
+		uint32_t t1 = k_cycle_get_32();
+
+		for (int i = 0; i < ACTIVITY_BENCH_LOOPS; i++) {
+			scratch++;
+			__asm__ volatile("" ::: "memory");
+		}
+
+		uint32_t t2 = k_cycle_get_32();
+
+		irq_unlock(key);
+
+		base = MIN(base, t1 - t0);
+		with = MIN(with, t2 - t1);
+	}
+
+	delta = (with > base) ? (with - base) : 0;
+
+	shell_print(sh, "%u loops: %llu us with signal, %llu us without",
+		    ACTIVITY_BENCH_LOOPS, (with * 1000000ULL) / hz,
+		    (base * 1000000ULL) / hz);
+	shell_print(sh, "Per signal: %llu ns", (delta * 1000000000ULL) /
+		    (hz * ACTIVITY_BENCH_LOOPS));
+	shell_print(sh, "A DAP request carries at least one SWD transfer "
+		    "(46 SWCLK cycles, 4.6 us at 10 MHz)");
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_activity,
+	SHELL_CMD(show, NULL, "Show activity counters", cmd_activity_show),
+	SHELL_CMD(bench, NULL, "Measure the cost of one activity signal",
+		  cmd_activity_bench),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(activity, &sub_activity, "Data path activity counters",
+		   cmd_activity_show);
@@ -0,0 +1,53 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Activity signalling from the data paths to the LEDs
+ *
+ * Each source has exactly one writer (the DAP queue thread, or the UART1
+ * interrupt), so signalling is a plain increment of a word owned by that
+ * writer: no lock, no read-modify-write shared with another context.
+ * The LED engine only reads the counters and compares them with the
+ * values it saw last time.
+ */
+
+#ifndef ACTIVITY_H
+#define ACTIVITY_H
+
+#include <stdint.h>
+
+enum activity_src {
+	/* DAP request executed (queue thread) */
+	ACTIVITY_DAP,
+	/* Bytes received from the target on UART1 (UART1 ISR) */
+	ACTIVITY_UART_RX,
+	/* Bytes sent to the target on UART1 (UART1 ISR) */
+	ACTIVITY_UART_TX,
+	ACTIVITY_COUNT,
+};
+
+extern volatile uint32_t activity_counters[ACTIVITY_COUNT];
+
+/**
+ * Signal activity on a source. Must only be called by the single
+ * writer of that source.
+ *
+ * @param src Activity source
+ */
+static inline void activity_signal(enum activity_src src)
+{
+	activity_counters[src]++;
+}
+
+/**
+ * Read the counter of a source.
+ *
+ * @param src Activity source
+ * @return Number of events since boot, wraps around
+ */
+static inline uint32_t activity_read(enum activity_src src)
+{
+	return activity_counters[src];
+}
+
+#endif /* ACTIVITY_H */
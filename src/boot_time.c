@@ -0,0 +1,92 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Boot timeline
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#if defined(CONFIG_SOC_SERIES_RP2XXX)
+#include <hardware/structs/timer.h>
+#endif
+
+#include "boot_time.h"
+
+atomic_t boot_marked;
+static uint32_t boot_us[BOOT_PHASE_COUNT];
+
+static const char *const boot_names[BOOT_PHASE_COUNT] = {
+	[BOOT_MAIN] = "main",
+	[BOOT_DAP_SETUP] = "dap_setup",
+	[BOOT_LEDS] = "leds",
+	[BOOT_WATCHDOG] = "watchdog",
+	[BOOT_USBD_INIT] = "usbd_init",
+	[BOOT_USBD_ENABLE] = "usbd_enable",
+	[BOOT_USB_CONFIGURED] = "usb_configured",
+	[BOOT_CONSOLE] = "console",
+	[BOOT_FIRST_DAP] = "first_dap",
+};
+
+/* Microseconds since reset */
+static inline uint32_t boot_now_us(void)
+{
+#if defined(CONFIG_SOC_SERIES_RP2XXX)
+	return timer_hw->timerawl;
+#else
+	return k_ticks_to_us_floor32(k_uptime_ticks());
+#endif
+}
+
+void boot_mark_now(enum boot_phase phase)
+{
+	uint32_t now = boot_now_us();
+
+	/* Until the time is stored, readers show the phase as pending */
+	if (!atomic_test_and_set_bit(&boot_marked, phase)) {
+		boot_us[phase] = now;
+	}
+}
+
+int boot_time_get(enum boot_phase phase, uint32_t *us)
+{
+	if (!atomic_test_bit(&boot_marked, phase) || boot_us[phase] == 0) {
+		return -ENOENT;
+	}
+
+	*us = boot_us[phase];
+
+	return 0;
+}
+
+/* Shell commands */
+
+static int cmd_boot_timeline(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t prev = 0;
+	uint32_t us;
+
+	shell_print(sh, "%-16s %12s %12s", "Phase", "Time (ms)", "Delta (ms)");
+
+	for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+		if (boot_time_get(i, &us)) {
+			shell_print(sh, "%-16s %12s", boot_names[i], "-");
+			continue;
+		}
+
+		shell_print(sh, "%-16s %8u.%03u %8u.%03u", boot_names[i],
+			    us / 1000, us % 1000,
+			    (us - prev) / 1000, (us - prev) % 1000);
+		prev = us;
+	}
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_boot,
+	SHELL_CMD(timeline, NULL, "Show the boot phase timestamps",
+		  cmd_boot_timeline),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(boot, &sub_boot, "Boot timeline", cmd_boot_timeline);
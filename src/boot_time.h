@@ -0,0 +1,72 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Boot timeline
+ *
+ * Each startup phase records once the time it completed, in
+ * microseconds since reset (the RP2040 timer runs from reset, so the
+ * boot ROM and the kernel init are included). Later calls for the same
+ * phase are ignored, which lets the data paths mark their first event
+ * at the cost of one load per call.
+ */
+
+#ifndef BOOT_TIME_H
+#define BOOT_TIME_H
+
+#include <stdint.h>
+#include <zephyr/sys/atomic.h>
+
+enum boot_phase {
+	/* main() entered, the kernel is up */
+	BOOT_MAIN,
+	/* CMSIS-DAP core ready */
+	BOOT_DAP_SETUP,
+	/* LEDs and periodic jobs running */
+	BOOT_LEDS,
+	/* Watchdog armed */
+	BOOT_WATCHDOG,
+	/* USB device stack initialized */
+	BOOT_USBD_INIT,
+	/* USB device enabled, waiting for the host */
+	BOOT_USBD_ENABLE,
+	/* Configuration set by the host */
+	BOOT_USB_CONFIGURED,
+	/* Terminal opened on the shell CDC ACM (DTR) */
+	BOOT_CONSOLE,
+	/* First DAP request executed */
+	BOOT_FIRST_DAP,
+	BOOT_PHASE_COUNT,
+};
+
+extern atomic_t boot_marked;
+
+/**
+ * Record a phase timestamp, slow path of boot_mark().
+ *
+ * @param phase Phase
+ */
+void boot_mark_now(enum boot_phase phase);
+
+/**
+ * Record the completion time of a phase, only the first call counts.
+ *
+ * @param phase Phase
+ */
+static inline void boot_mark(enum boot_phase phase)
+{
+	if (!atomic_test_bit(&boot_marked, phase)) {
+		boot_mark_now(phase);
+	}
+}
+
+/**
+ * Get the completion time of a phase.
+ *
+ * @param phase Phase
+ * @param us Microseconds since reset
+ * @return 0 on success, -ENOENT if the phase did not complete yet
+ */
+int boot_time_get(enum boot_phase phase, uint32_t *us);
+
+#endif /* BOOT_TIME_H */
@@ -0,0 +1,563 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * On-probe flash programming with a target flash algorithm
+ *
+ * The host streams the image with FLASH_DATA packets and only gets a
+ * status back; the probe runs the download loop itself:
+ *
+ *   1. collect a page from the FLASH_DATA packets
+ *   2. write it to the free RAM buffer of the target, while the
+ *      algorithm is still programming the previous page from the other
+ *      buffer
+ *   3. wait for the previous ProgramPage to reach its breakpoint
+ *   4. EraseSector when the page starts a sector of the sector table
+ *   5. start ProgramPage on the new buffer, without waiting
+ *
+ * Core registers are written through DCRSR/DCRDR while the core is
+ * halted, completion is polled on DHCSR.S_HALT. Interrupts of the target
+ * stay masked while the algorithm runs.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/swdp.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(dap_flash, LOG_LEVEL_INF);
+
+#include "dap_flash.h"
+#include "dap_queue.h"
+#include "dap_vendor.h"
+
+/* Cortex-M debug registers */
+#define DHCSR		0xE000EDF0
+#define DCRSR		0xE000EDF4
+#define DCRDR		0xE000EDF8
+
+#define DHCSR_DBGKEY	0xA05F0000
+#define DHCSR_C_DEBUGEN	BIT(0)
+#define DHCSR_C_HALT	BIT(1)
+#define DHCSR_C_MASKINTS BIT(3)
+#define DHCSR_S_REGRDY	BIT(16)
+#define DHCSR_S_HALT	BIT(17)
+
+#define DCRSR_REGWNR	BIT(16)
+
+/* DCRSR register selectors */
+#define REG_R0		0
+#define REG_R9		9
+#define REG_SP		13
+#define REG_LR		14
+#define REG_PC		15
+#define REG_XPSR	16
+
+#define XPSR_THUMB	BIT(24)
+
+/* FLM Init/UnInit function code */
+#define FLM_PROGRAM	2
+
+/* Polls of DHCSR.S_REGRDY before giving up */
+#define REGRDY_POLLS	100
+
+/* Flash algorithm, as given by FLASH_SETUP */
+struct dap_flash_algo {
+	uint32_t breakpoint;
+	uint32_t init;
+	uint32_t uninit;
+	uint32_t erase_sector;
+	uint32_t program_page;
+	uint32_t static_base;
+	uint32_t stack_top;
+	uint32_t buffer[2];
+	uint32_t page_size;
+};
+
+#define FLASH_SETUP_LEN (1 + sizeof(struct dap_flash_algo))
+
+/* Sector table region: sectors of one size, up to the next region */
+struct dap_flash_region {
+	uint32_t addr;
+	uint32_t sector_size;
+};
+
+enum dap_flash_state {
+	FLASH_IDLE,
+	FLASH_READY,
+	FLASH_ACTIVE,
+};
+
+static struct dap_flash_algo algo;
+
+static struct dap_flash_region regions[CONFIG_DAP_FLASH_SECTOR_REGIONS];
+static uint8_t region_count;
+
+static struct {
+	enum dap_flash_state state;
+	uint8_t status;
+	/* Next page to program */
+	uint32_t addr;
+	/* Page being programmed by the target, if busy */
+	uint32_t busy_addr;
+	bool busy;
+	/* Target buffer for the next page */
+	uint8_t next;
+	/* Failing page and algorithm return value */
+	uint32_t fail_addr;
+	uint32_t result;
+	uint32_t fill;
+	uint8_t page[CONFIG_DAP_FLASH_PAGE_MAX];
+} flash;
+
+static int dap_flash_read_word(uint32_t addr, uint32_t *value)
+{
+	uint8_t buf[4];
+	uint32_t done;
+
+	if (dap_vendor_mem_read(addr, buf, 1, &done) != SWDP_ACK_OK) {
+		return -EIO;
+	}
+
+	*value = sys_get_le32(buf);
+
+	return 0;
+}
+
+static int dap_flash_write_word(uint32_t addr, uint32_t value)
+{
+	uint8_t buf[4];
+
+	sys_put_le32(value, buf);
+
+	return dap_vendor_mem_write(addr, buf, 1) == SWDP_ACK_OK ? 0 : -EIO;
+}
+
+static int dap_flash_wait_regrdy(void)
+{
+	uint32_t dhcsr;
+
+	for (int i = 0; i < REGRDY_POLLS; i++) {
+		if (dap_flash_read_word(DHCSR, &dhcsr)) {
+			return -EIO;
+		}
+		if (dhcsr & DHCSR_S_REGRDY) {
+			return 0;
+		}
+	}
+
+	return -ETIMEDOUT;
+}
+
+static int dap_flash_write_reg(uint8_t reg, uint32_t value)
+{
+	if (dap_flash_write_word(DCRDR, value) ||
+	    dap_flash_write_word(DCRSR, DCRSR_REGWNR | reg)) {
+		return -EIO;
+	}
+
+	return dap_flash_wait_regrdy();
+}
+
+static int dap_flash_read_reg(uint8_t reg, uint32_t *value)
+{
+	int ret;
+
+	if (dap_flash_write_word(DCRSR, reg)) {
+		return -EIO;
+	}
+
+	ret = dap_flash_wait_regrdy();
+	if (ret) {
+		return ret;
+	}
+
+	return dap_flash_read_word(DCRDR, value);
+}
+
+/*
+ * Sector size of the region holding addr, 0 outside of the flash. start
+ * tells whether addr is the first byte of a sector.
+ */
+static uint32_t dap_flash_sector(uint32_t addr, bool *start)
+{
+	const struct dap_flash_region *region = NULL;
+
+	for (uint8_t i = 0; i < region_count && regions[i].addr <= addr; i++) {
+		region = &regions[i];
+	}
+
+	if (region == NULL || region->sector_size == 0) {
+		return 0;
+	}
+
+	*start = (addr - region->addr) % region->sector_size == 0;
+
+	return region->sector_size;
+}
+
+/* Record the first error, later commands only report it */
+static uint8_t dap_flash_fail(uint8_t status, uint32_t addr, uint32_t result)
+{
+	if (flash.status == DAP_FLASH_OK) {
+		flash.status = status;
+		flash.fail_addr = addr;
+		flash.result = result;
+		LOG_WRN("Flash error %u at 0x%08x (result 0x%x)",
+			status, addr, result);
+	}
+
+	return flash.status;
+}
+
+/* Start an algorithm function on the halted core, does not wait */
+static uint8_t dap_flash_call(uint32_t entry, uint32_t r0, uint32_t r1,
+			      uint32_t r2)
+{
+	const uint32_t args[] = { r0, r1, r2 };
+	uint32_t dhcsr;
+
+	if (dap_flash_read_word(DHCSR, &dhcsr)) {
+		return DAP_FLASH_ERR_SWD;
+	}
+	if (!(dhcsr & DHCSR_S_HALT)) {
+		return DAP_FLASH_ERR_STATE;
+	}
+
+	for (uint8_t reg = REG_R0; reg < ARRAY_SIZE(args); reg++) {
+		if (dap_flash_write_reg(reg, args[reg])) {
+			return DAP_FLASH_ERR_SWD;
+		}
+	}
+
+	if (dap_flash_write_reg(REG_R9, algo.static_base) ||
+	    dap_flash_write_reg(REG_SP, algo.stack_top) ||
+	    dap_flash_write_reg(REG_LR, algo.breakpoint | 1) ||
+	    dap_flash_write_reg(REG_PC, entry) ||
+	    dap_flash_write_reg(REG_XPSR, XPSR_THUMB)) {
+		return DAP_FLASH_ERR_SWD;
+	}
+
+	/* C_MASKINTS may only change while halted, then clear C_HALT */
+	if (dap_flash_write_word(DHCSR, DHCSR_DBGKEY | DHCSR_C_DEBUGEN |
+				 DHCSR_C_HALT | DHCSR_C_MASKINTS) ||
+	    dap_flash_write_word(DHCSR, DHCSR_DBGKEY | DHCSR_C_DEBUGEN |
+				 DHCSR_C_MASKINTS)) {
+		return DAP_FLASH_ERR_SWD;
+	}
+
+	return DAP_FLASH_OK;
+}
+
+/* Wait for the running function to reach its breakpoint */
+static uint8_t dap_flash_wait(uint32_t *result)
+{
+	int64_t deadline = k_uptime_get() + CONFIG_DAP_FLASH_TIMEOUT_MS;
+	uint32_t dhcsr;
+
+	while (true) {
+		if (dap_flash_read_word(DHCSR, &dhcsr)) {
+			return DAP_FLASH_ERR_SWD;
+		}
+		if (dhcsr & DHCSR_S_HALT) {
+			break;
+		}
+		if (k_uptime_get() > deadline) {
+			/* Stop the algorithm, it is left halted */
+			dap_flash_write_word(DHCSR, DHCSR_DBGKEY |
+					     DHCSR_C_DEBUGEN | DHCSR_C_HALT);
+			return DAP_FLASH_ERR_TIMEOUT;
+		}
+		/* Let the lower priority threads run during long operations */
+		k_usleep(CONFIG_DAP_FLASH_POLL_US);
+		dap_queue_beat();
+	}
+
+	if (dap_flash_read_reg(REG_R0, result)) {
+		return DAP_FLASH_ERR_SWD;
+	}
+
+	return *result == 0 ? DAP_FLASH_OK : DAP_FLASH_ERR_ALGO;
+}
+
+static uint8_t dap_flash_run(uint32_t entry, uint32_t r0, uint32_t r1,
+			     uint32_t r2)
+{
+	uint32_t result = 0;
+	uint8_t status;
+
+	status = dap_flash_call(entry, r0, r1, r2);
+	if (status == DAP_FLASH_OK) {
+		status = dap_flash_wait(&result);
+	}
+
+	if (status != DAP_FLASH_OK) {
+		return dap_flash_fail(status, r0, result);
+	}
+
+	return DAP_FLASH_OK;
+}
+
+/* Wait for the page being programmed, if any */
+static uint8_t dap_flash_sync(void)
+{
+	uint32_t result = 0;
+	uint8_t status;
+
+	if (!flash.busy) {
+		return DAP_FLASH_OK;
+	}
+
+	flash.busy = false;
+	status = dap_flash_wait(&result);
+	if (status != DAP_FLASH_OK) {
+		return dap_flash_fail(status, flash.busy_addr, result);
+	}
+
+	return DAP_FLASH_OK;
+}
+
+/* Hand a full page to the target, see the sequence at the top */
+static uint8_t dap_flash_page(void)
+{
+	uint32_t buffer = algo.buffer[flash.next];
+	uint8_t status;
+	bool start;
+
+	if (dap_flash_sector(flash.addr, &start) == 0) {
+		return dap_flash_fail(DAP_FLASH_ERR_PARAM, flash.addr, 0);
+	}
+
+	if (dap_vendor_mem_write(buffer, flash.page,
+				 algo.page_size / 4) != SWDP_ACK_OK) {
+		return dap_flash_fail(DAP_FLASH_ERR_SWD, flash.addr, 0);
+	}
+
+	status = dap_flash_sync();
+	if (status != DAP_FLASH_OK) {
+		return status;
+	}
+
+	if (start) {
+		status = dap_flash_run(algo.erase_sector, flash.addr, 0, 0);
+		if (status != DAP_FLASH_OK) {
+			return status;
+		}
+	}
+
+	status = dap_flash_call(algo.program_page, flash.addr,
+				algo.page_size, buffer);
+	if (status != DAP_FLASH_OK) {
+		return dap_flash_fail(status, flash.addr, 0);
+	}
+
+	flash.busy = true;
+	flash.busy_addr = flash.addr;
+	flash.addr += algo.page_size;
+	flash.next ^= 1;
+	flash.fill = 0;
+
+	return DAP_FLASH_OK;
+}
+
+static uint8_t dap_flash_setup(const uint8_t *request)
+{
+	uint32_t *fields = (uint32_t *)&algo;
+
+	for (size_t i = 0; i < sizeof(algo) / 4; i++) {
+		fields[i] = sys_get_le32(&request[1 + 4 * i]);
+	}
+
+	flash.state = FLASH_IDLE;
+	region_count = 0;
+
+	if (algo.page_size == 0 || algo.page_size % 4 ||
+	    algo.page_size > CONFIG_DAP_FLASH_PAGE_MAX) {
+		return DAP_FLASH_ERR_PARAM;
+	}
+
+	flash.state = FLASH_READY;
+
+	return DAP_FLASH_OK;
+}
+
+static uint8_t dap_flash_sectors(const uint8_t *request, uint8_t count)
+{
+	if (flash.state != FLASH_READY) {
+		return DAP_FLASH_ERR_STATE;
+	}
+	if (count > ARRAY_SIZE(regions) - region_count) {
+		return DAP_FLASH_ERR_PARAM;
+	}
+
+	for (uint8_t i = 0; i < count; i++) {
+		struct dap_flash_region region = {
+			.addr = sys_get_le32(&request[2 + 8 * i]),
+			.sector_size = sys_get_le32(&request[6 + 8 * i]),
+		};
+
+		if (region.sector_size % algo.page_size ||
+		    region.addr % algo.page_size ||
+		    (region_count > 0 &&
+		     region.addr <= regions[region_count - 1].addr)) {
+			region_count = 0;
+			return DAP_FLASH_ERR_PARAM;
+		}
+
+		regions[region_count++] = region;
+	}
+
+	return DAP_FLASH_OK;
+}
+
+static uint8_t dap_flash_start(const uint8_t *request)
+{
+	uint32_t addr = sys_get_le32(&request[1]);
+	bool start;
+
+	if (flash.state == FLASH_IDLE || region_count == 0) {
+		return DAP_FLASH_ERR_STATE;
+	}
+	if (dap_flash_sector(addr, &start) == 0 || !start) {
+		return DAP_FLASH_ERR_PARAM;
+	}
+
+	flash.status = DAP_FLASH_OK;
+	flash.addr = addr;
+	flash.busy = false;
+	flash.next = 0;
+	flash.fill = 0;
+	flash.fail_addr = 0;
+	flash.result = 0;
+
+	if (dap_flash_run(algo.init, addr, 0, FLM_PROGRAM) != DAP_FLASH_OK) {
+		flash.state = FLASH_READY;
+		return flash.status;
+	}
+
+	flash.state = FLASH_ACTIVE;
+
+	return DAP_FLASH_OK;
+}
+
+static uint8_t dap_flash_data(const uint8_t *data, uint16_t len)
+{
+	if (flash.state != FLASH_ACTIVE) {
+		return DAP_FLASH_ERR_STATE;
+	}
+
+	while (len > 0 && flash.status == DAP_FLASH_OK) {
+		uint32_t n = MIN(len, algo.page_size - flash.fill);
+
+		memcpy(&flash.page[flash.fill], data, n);
+		flash.fill += n;
+		data += n;
+		len -= n;
+
+		if (flash.fill == algo.page_size) {
+			dap_flash_page();
+		}
+	}
+
+	return flash.status;
+}
+
+static uint8_t dap_flash_finish(void)
+{
+	if (flash.state != FLASH_ACTIVE) {
+		return DAP_FLASH_ERR_STATE;
+	}
+
+	if (flash.status == DAP_FLASH_OK && flash.fill > 0) {
+		memset(&flash.page[flash.fill], 0xFF,
+		       algo.page_size - flash.fill);
+		dap_flash_page();
+	}
+
+	/*
+	 * The last page may still be programming, even after an error: wait
+	 * for it, or halt it, before UnInit. An error here is kept in
+	 * flash.status unless one came first.
+	 */
+	dap_flash_sync();
+
+	/* UnInit even after an error, unless the core is not back */
+	if (flash.status != DAP_FLASH_ERR_TIMEOUT &&
+	    flash.status != DAP_FLASH_ERR_SWD) {
+		dap_flash_run(algo.uninit, FLM_PROGRAM, 0, 0);
+	}
+
+	flash.state = FLASH_READY;
+	if (flash.status == DAP_FLASH_OK) {
+		/* Report the end of the programmed range */
+		flash.fail_addr = flash.addr;
+	}
+
+	return flash.status;
+}
+
+bool dap_flash_busy(void)
+{
+	return flash.state == FLASH_ACTIVE;
+}
+
+uint32_t dap_flash_execute(const uint8_t *request, uint32_t req_len,
+			   uint8_t *response, uint32_t resp_size)
+{
+	uint16_t len;
+	uint8_t count;
+
+	/* Every response has a status, FLASH_FINISH also the result */
+	if (resp_size < 2 ||
+	    (request[0] == DAP_VENDOR_FLASH_FINISH && resp_size < 10)) {
+		return dap_vendor_reject(response, req_len);
+	}
+
+	response[0] = request[0];
+
+	switch (request[0]) {
+	case DAP_VENDOR_FLASH_SETUP:
+		if (req_len < FLASH_SETUP_LEN) {
+			return dap_vendor_reject(response, req_len);
+		}
+		response[1] = dap_flash_setup(request);
+		return (FLASH_SETUP_LEN << 16) | 2;
+	case DAP_VENDOR_FLASH_START:
+		if (req_len < 5) {
+			return dap_vendor_reject(response, req_len);
+		}
+		response[1] = dap_flash_start(request);
+		return (5 << 16) | 2;
+	case DAP_VENDOR_FLASH_DATA:
+		if (req_len < 3) {
+			return dap_vendor_reject(response, req_len);
+		}
+		len = sys_get_le16(&request[1]);
+		if (len > req_len - 3) {
+			response[1] = DAP_FLASH_ERR_PARAM;
+			return (req_len << 16) | 2;
+		}
+		response[1] = dap_flash_data(&request[3], len);
+		return ((3 + len) << 16) | 2;
+	case DAP_VENDOR_FLASH_SECTORS:
+		if (req_len < 2) {
+			return dap_vendor_reject(response, req_len);
+		}
+		count = request[1];
+		if (2 + 8 * count > req_len) {
+			response[1] = DAP_FLASH_ERR_PARAM;
+			return (req_len << 16) | 2;
+		}
+		response[1] = dap_flash_sectors(request, count);
+		return ((2 + 8 * count) << 16) | 2;
+	case DAP_VENDOR_FLASH_FINISH:
+		response[1] = dap_flash_finish();
+		sys_put_le32(flash.fail_addr, &response[2]);
+		sys_put_le32(flash.result, &response[6]);
+		return (1 << 16) | 10;
+	default:
+		response[0] = DAP_VENDOR_ERROR;
+		return (1 << 16) | 1;
+	}
+}
@@ -0,0 +1,79 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * On-probe flash programming with a target flash algorithm
+ *
+ * The host loads a CMSIS-Pack (FLM) style algorithm into target RAM,
+ * for example with DAP_VENDOR_WRITE_MEM, halts the core, then:
+ *
+ * FLASH_SETUP  0x82, breakpoint, init, uninit, erase_sector,
+ *              program_page, static_base, stack_top, buffer0, buffer1,
+ *              page_size (10 x u32)
+ *              -> 0x82, status
+ * FLASH_SECTORS 0x8A, count (u8), count x (address, sector size) (u32)
+ *              -> 0x8A, status
+ * FLASH_START  0x83, flash address (u32, sector aligned)
+ *              -> 0x83, status
+ * FLASH_DATA   0x84, length (u16), image data
+ *              -> 0x84, status
+ * FLASH_FINISH 0x85
+ *              -> 0x85, status, address (u32), algorithm result (u32)
+ *
+ * FLASH_SECTORS carries the sector table of the FLM FlashDevice, as
+ * absolute addresses: each region holds sectors of one size, from its
+ * address up to the next region, and a region of size 0 ends the flash.
+ * Regions are appended in ascending order, over several packets if
+ * needed; FLASH_SETUP empties the table.
+ *
+ * All addresses are absolute target addresses. The functions are called
+ * with the usual FLM arguments and return to the breakpoint address,
+ * where a BKPT instruction halts the core. Sectors are erased when the
+ * first page of a sector is programmed; the last page is padded with
+ * 0xFF. FLASH_FINISH returns the end of the programmed range, or the
+ * page that failed and the value returned by the algorithm.
+ */
+
+#ifndef DAP_FLASH_H
+#define DAP_FLASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Status byte of the flash vendor commands, sticky until FLASH_START */
+enum dap_flash_status {
+	DAP_FLASH_OK = 0,
+	/* SWD transfer failed */
+	DAP_FLASH_ERR_SWD = 1,
+	/* The algorithm did not reach its breakpoint in time */
+	DAP_FLASH_ERR_TIMEOUT = 2,
+	/* The algorithm returned a non-zero value */
+	DAP_FLASH_ERR_ALGO = 3,
+	/* Command out of sequence, or the core is not halted */
+	DAP_FLASH_ERR_STATE = 4,
+	/* Malformed parameters */
+	DAP_FLASH_ERR_PARAM = 5,
+};
+
+/**
+ * Run one flash vendor command (0x82-0x85).
+ *
+ * @param request Command
+ * @param req_len Request bytes left, from the command ID on
+ * @param response Response buffer
+ * @param resp_size Response bytes left, at least 1
+ * @return Request length in the upper 16 bits, response length in the
+ *         lower 16 bits, as dap_execute_cmd()
+ */
+uint32_t dap_flash_execute(const uint8_t *request, uint32_t req_len,
+			   uint8_t *response, uint32_t resp_size);
+
+/**
+ * Check for a flash session, from FLASH_START to FLASH_FINISH, during
+ * which the algorithm owns the target RAM.
+ *
+ * @return true while a session is open
+ */
+bool dap_flash_busy(void);
+
+#endif /* DAP_FLASH_H */
@@ -0,0 +1,538 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * CMSIS-DAP multi-packet command queue
+ *
+ * Request buffers received from the host are queued to a dedicated
+ * thread, so the transport can accept the next packets while the
+ * current one is running on the SWD port. Each command is executed in
+ * place, from the request buffer straight into a response buffer of
+ * the transport. The transport provides CONFIG_DAP_QUEUE_PACKET_COUNT
+ * request buffers, which is the depth reported in DAP_Info, letting the
+ * host keep that many packets in flight.
+ *
+ * DAP_QueueCommands packets are held without a response until a packet
+ * of another type arrives; the whole batch is then run back to back and
+ * its responses are sent in order, with the DAP_ExecuteCommands ID as
+ * the specification requires. DAP_ExecuteCommands runs all its embedded
+ * commands in one go. Both are atomic with respect to other requests
+ * since a single thread owns the SWD port.
+ *
+ * The host pairs responses with requests by their order. When no
+ * response buffer can be had, because the host stopped reading or the
+ * interface went down, the link is reset rather than one response
+ * dropped, which would shift every later one: the transport flushes the
+ * responses not read yet, and the requests still queued are released
+ * unanswered. The host times out on them and starts again in sync.
+ *
+ * Requests reach the queue thread through a single producer, single
+ * consumer ring of buffer pointers: the USB stack only publishes the
+ * head index, the queue thread only publishes the tail index, and a
+ * semaphore wakes the thread up. With CONFIG_DAP_QUEUE_CPU_PIN, the
+ * thread is pinned to its own CPU, so shell or USB work on the other
+ * core does not delay the SWD transfers, and the ring is the only data
+ * shared between the cores.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/net_buf.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/barrier.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(dap_queue, LOG_LEVEL_INF);
+
+#include <cmsis_dap.h>
+
+#include "dap_queue.h"
+#include "dap_usb.h"
+#include "dap_vendor.h"
+#include "swo.h"
+#include "rtt.h"
+#include "swd_cal.h"
+#include "prefs.h"
+#include "activity.h"
+#include "health.h"
+#include "boot_time.h"
+#include "perf.h"
+
+#define DAP_QUEUE_COUNT CONFIG_DAP_QUEUE_PACKET_COUNT
+#define DAP_QUEUE_SIZE CONFIG_DAP_QUEUE_PACKET_SIZE
+
+/*
+ * Request ring, never full since the transport owns DAP_QUEUE_COUNT
+ * request buffers. Indexes run freely, head - tail is the fill level.
+ */
+static struct net_buf *dap_ring[DAP_QUEUE_COUNT];
+static atomic_t dap_ring_head;
+static atomic_t dap_ring_tail;
+static K_SEM_DEFINE(dap_ring_sem, 0, DAP_QUEUE_COUNT);
+
+static HEALTH_HB_DEFINE(dap_queue, CONFIG_DAP_QUEUE_HEALTH_BUDGET_MS);
+static atomic_t dap_depth;
+
+/* DAP_TransferAbort requests queued and not run yet */
+static atomic_t dap_aborts;
+
+static const struct dap_queue_transport *dap_transport;
+static struct dap_queue_stats dap_stats;
+
+/* Uptime in ms when the last request completed */
+static uint32_t dap_last_run;
+
+void dap_queue_set_transport(const struct dap_queue_transport *transport)
+{
+	dap_transport = transport;
+}
+
+/* Producer side, USB stack only */
+static void dap_queue_ring_put(struct net_buf *buf)
+{
+	atomic_val_t head = atomic_get(&dap_ring_head);
+
+	__ASSERT(head - atomic_get(&dap_ring_tail) < DAP_QUEUE_COUNT,
+		 "DAP request ring overflow");
+
+	dap_ring[head % DAP_QUEUE_COUNT] = buf;
+	/* Publish the slot before the index */
+	barrier_dmem_fence_full();
+	atomic_set(&dap_ring_head, head + 1);
+
+	k_sem_give(&dap_ring_sem);
+}
+
+/* Consumer side, queue thread only */
+static struct net_buf *dap_queue_ring_get(k_timeout_t timeout)
+{
+	atomic_val_t tail = atomic_get(&dap_ring_tail);
+	struct net_buf *buf;
+
+	if (k_sem_take(&dap_ring_sem, timeout) != 0) {
+		return NULL;
+	}
+
+	/* The semaphore is given once the slot is published */
+	barrier_dmem_fence_full();
+	buf = dap_ring[tail % DAP_QUEUE_COUNT];
+	barrier_dmem_fence_full();
+	atomic_set(&dap_ring_tail, tail + 1);
+
+	if (buf->len > 0 && buf->data[0] == DAP_CMD_TRANSFER_ABORT) {
+		atomic_dec(&dap_aborts);
+	}
+
+	return buf;
+}
+
+void dap_queue_submit(struct net_buf *buf)
+{
+	atomic_val_t depth = atomic_inc(&dap_depth) + 1;
+
+	dap_stats.requests++;
+	dap_stats.max_depth = MAX(dap_stats.max_depth, (uint8_t)depth);
+
+	/* Seen before its turn, so it can end the command it aborts */
+	if (buf->len > 0 && buf->data[0] == DAP_CMD_TRANSFER_ABORT) {
+		atomic_inc(&dap_aborts);
+	}
+
+	dap_queue_ring_put(buf);
+}
+
+bool dap_queue_aborted(void)
+{
+	return atomic_get(&dap_aborts) != 0;
+}
+
+void dap_queue_beat(void)
+{
+	health_beat(&dap_queue);
+}
+
+uint32_t dap_queue_idle_ms(void)
+{
+	if (atomic_get(&dap_depth) != 0) {
+		return 0;
+	}
+
+	return k_uptime_get_32() - dap_last_run;
+}
+
+void dap_queue_get_stats(struct dap_queue_stats *stats)
+{
+	*stats = dap_stats;
+}
+
+void dap_queue_reset_stats(void)
+{
+	memset(&dap_stats, 0, sizeof(dap_stats));
+}
+
+/* Answer the DAP_Info IDs that depend on the transport, not the DAP core */
+static bool dap_queue_info(const uint8_t *request, uint8_t *response,
+			   uint32_t *ret)
+{
+	switch (request[1]) {
+	case DAP_INFO_PACKET_COUNT:
+		response[0] = DAP_CMD_INFO;
+		response[1] = 1;
+		response[2] = DAP_QUEUE_COUNT;
+		*ret = (2U << 16) | 3U;
+		return true;
+
+	case DAP_INFO_PACKET_SIZE:
+		response[0] = DAP_CMD_INFO;
+		response[1] = 2;
+		sys_put_le16(DAP_QUEUE_SIZE, &response[2]);
+		*ret = (2U << 16) | 4U;
+		return true;
+
+	case DAP_INFO_CAPABILITIES:
+		*ret = dap_execute_cmd(request, response);
+		if (response[1] >= 1) {
+			response[2] |= DAP_CAP_ATOMIC_COMMANDS;
+			if (IS_ENABLED(CONFIG_SWO)) {
+				response[2] |= DAP_CAP_SWO_UART |
+					       DAP_CAP_SWO_STREAM;
+			}
+		}
+		return true;
+
+#if defined(CONFIG_SWO)
+	case DAP_INFO_SWO_BUFFER_SIZE:
+		response[0] = DAP_CMD_INFO;
+		response[1] = 4;
+		sys_put_le32(CONFIG_SWO_BUFFER_SIZE, &response[2]);
+		*ret = (2U << 16) | 6U;
+		return true;
+#endif
+
+	default:
+		return false;
+	}
+}
+
+/*
+ * Run a single command, with req_len bytes left in the request packet
+ * and resp_size in the response packet. Vendor commands may only stream
+ * further responses when they are not part of a batch.
+ *
+ * @return Request length in the upper 16 bits, response length in
+ *         the lower 16 bits, as dap_execute_cmd()
+ */
+PERF_POINT_DEFINE(dap_cmd);
+
+static uint32_t dap_queue_execute_one(const uint8_t *request, uint32_t req_len,
+				      uint8_t *response, uint32_t resp_size,
+				      bool stream)
+{
+	uint32_t ret;
+
+	PERF_BEGIN(dap_cmd);
+
+	if (IS_ENABLED(CONFIG_DAP_VENDOR) && dap_vendor_is_cmd(request[0])) {
+		ret = dap_vendor_execute(request, req_len, response, resp_size,
+					 stream);
+	} else if (IS_ENABLED(CONFIG_SWO) && swo_is_cmd(request[0])) {
+		ret = swo_execute(request, req_len, response, resp_size);
+	} else if (request[0] != DAP_CMD_INFO ||
+		   !dap_queue_info(request, response, &ret)) {
+		ret = dap_execute_cmd(request, response);
+	}
+
+	PERF_END(dap_cmd);
+
+	if (IS_ENABLED(CONFIG_RTT)) {
+		rtt_snoop(request, response);
+	}
+
+	if (IS_ENABLED(CONFIG_SWD_CAL)) {
+		swd_cal_snoop(request, response);
+	}
+
+	return ret;
+}
+
+/* Run a request packet, returns the response length */
+static size_t dap_queue_execute(const uint8_t *request, size_t len,
+				uint8_t *response)
+{
+	uint32_t req_pos = 2;
+	uint32_t resp_pos = 2;
+	uint8_t count;
+
+	if (request[0] != DAP_CMD_EXECUTE_COMMANDS &&
+	    request[0] != DAP_CMD_QUEUE_COMMANDS) {
+		return dap_queue_execute_one(request, len, response,
+					     DAP_QUEUE_SIZE, true) & 0xFFFF;
+	}
+
+	if (len < 2) {
+		response[0] = DAP_CMD_INVALID;
+		return 1;
+	}
+
+	count = request[1];
+	/* A DAP_QueueCommands packet is answered as DAP_ExecuteCommands */
+	response[0] = DAP_CMD_EXECUTE_COMMANDS;
+	response[1] = count;
+
+	/* Each command gets what is left of both packets */
+	for (uint8_t i = 0; i < count && req_pos < len &&
+	     resp_pos < DAP_QUEUE_SIZE; i++) {
+		uint32_t ret = dap_queue_execute_one(&request[req_pos],
+						     len - req_pos,
+						     &response[resp_pos],
+						     DAP_QUEUE_SIZE - resp_pos,
+						     false);
+
+		req_pos += ret >> 16;
+		resp_pos += ret & 0xFFFF;
+	}
+
+	return resp_pos;
+}
+
+/* Give back a request that gets no response */
+static void dap_queue_drop(struct net_buf *req)
+{
+	dap_stats.dropped++;
+	atomic_dec(&dap_depth);
+	dap_transport->release(req);
+}
+
+/* Bring the host and the probe back in step, see the top of the file */
+static void dap_queue_reset_link(void)
+{
+	struct net_buf *req;
+
+	dap_stats.resets++;
+
+	if (IS_ENABLED(CONFIG_DAP_VENDOR)) {
+		dap_vendor_cancel();
+	}
+
+	if (dap_transport->flush != NULL) {
+		dap_transport->flush();
+	}
+
+	while ((req = dap_queue_ring_get(K_NO_WAIT)) != NULL) {
+		dap_queue_drop(req);
+	}
+
+	LOG_WRN("No response buffer, DAP link reset");
+}
+
+/*
+ * Execute one request in place into a response buffer.
+ *
+ * @return false if the link was reset, the request is then released
+ */
+static bool dap_queue_run(struct net_buf *req)
+{
+	struct net_buf *resp = dap_transport->alloc_response();
+
+	activity_signal(ACTIVITY_DAP);
+	boot_mark(BOOT_FIRST_DAP);
+
+	if (resp == NULL) {
+		dap_queue_drop(req);
+		dap_queue_reset_link();
+		return false;
+	}
+
+	net_buf_add(resp, dap_queue_execute(req->data, req->len, resp->data));
+	if (dap_transport->send(resp) == 0) {
+		dap_stats.responses++;
+	}
+
+	/* Vendor reads longer than a packet go on in the next responses */
+	while (IS_ENABLED(CONFIG_DAP_VENDOR) && dap_vendor_pending()) {
+		resp = dap_transport->alloc_response();
+		if (resp == NULL) {
+			dap_queue_drop(req);
+			dap_queue_reset_link();
+			return false;
+		}
+
+		net_buf_add(resp, dap_vendor_continue(resp->data));
+		if (dap_transport->send(resp) == 0) {
+			dap_stats.responses++;
+		}
+		health_beat(&dap_queue);
+	}
+
+	dap_last_run = k_uptime_get_32();
+	atomic_dec(&dap_depth);
+	dap_transport->release(req);
+
+	return true;
+}
+
+static void dap_queue_thread(void *p1, void *p2, void *p3)
+{
+	struct net_buf *batch[DAP_QUEUE_COUNT];
+	uint8_t count = 0;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	health_register(&dap_queue);
+
+	while (true) {
+		/* Wake up while idle to keep the heartbeat going */
+		k_ticks_t wait = k_ms_to_ticks_ceil64(
+			CONFIG_DAP_QUEUE_HEALTH_BUDGET_MS / 4);
+		struct net_buf *req;
+
+		/* RTT polls the target between requests, never in a batch */
+		if (IS_ENABLED(CONFIG_RTT) && count == 0) {
+			wait = rtt_poll_ticks(wait);
+		}
+
+		req = dap_queue_ring_get(K_TICKS(wait));
+
+		health_beat(&dap_queue);
+		if (req == NULL) {
+			if (IS_ENABLED(CONFIG_RTT) && count == 0) {
+				rtt_poll();
+			}
+			if (IS_ENABLED(CONFIG_SWD_CAL) && count == 0) {
+				swd_cal_poll();
+			}
+			/* Flash stalls only once the host went quiet */
+			if (IS_ENABLED(CONFIG_PREFS) && count == 0) {
+				prefs_poll();
+			}
+			continue;
+		}
+
+		batch[count++] = req;
+
+		/* Hold queued packets until the batch is closed */
+		if (req->data[0] == DAP_CMD_QUEUE_COMMANDS &&
+		    count < DAP_QUEUE_COUNT) {
+			dap_stats.queued++;
+			continue;
+		}
+
+		if (count > 1) {
+			dap_stats.batches++;
+		}
+
+		for (uint8_t i = 0; i < count; i++) {
+			if (!dap_queue_run(batch[i])) {
+				/* The rest of the batch goes with the link */
+				while (++i < count) {
+					dap_queue_drop(batch[i]);
+				}
+				break;
+			}
+			health_beat(&dap_queue);
+		}
+
+		count = 0;
+
+		if (IS_ENABLED(CONFIG_RTT)) {
+			rtt_poll();
+		}
+		if (IS_ENABLED(CONFIG_SWD_CAL)) {
+			swd_cal_poll();
+		}
+	}
+}
+
+/* A pinned thread is started once its CPU mask is set */
+K_THREAD_DEFINE(dap_queue_tid, CONFIG_DAP_QUEUE_STACK_SIZE,
+		dap_queue_thread, NULL, NULL, NULL,
+		CONFIG_DAP_QUEUE_THREAD_PRIORITY, 0,
+		IS_ENABLED(CONFIG_DAP_QUEUE_CPU_PIN) ? SYS_FOREVER_MS : 0);
+
+#if defined(CONFIG_DAP_QUEUE_CPU_PIN)
+static int dap_queue_pin(void)
+{
+	int ret;
+
+	ret = k_thread_cpu_pin(dap_queue_tid, CONFIG_DAP_QUEUE_CPU);
+	if (ret) {
+		printk("DAP queue: cannot pin to CPU %d: %d\n",
+		       CONFIG_DAP_QUEUE_CPU, ret);
+	}
+
+	k_thread_start(dap_queue_tid);
+
+	return 0;
+}
+
+SYS_INIT(dap_queue_pin, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+#endif /* CONFIG_DAP_QUEUE_CPU_PIN */
+
+#if defined(CONFIG_SHELL)
+
+/* Shell commands */
+
+#if defined(CONFIG_DAP_USB)
+static void dap_print_rate(const struct shell *sh, const char *name,
+			   uint32_t packets, uint64_t bytes, int64_t ms)
+{
+	uint32_t rate = (ms > 0) ? (uint32_t)((bytes * 1000U) / ms) : 0;
+
+	shell_print(sh, "  %-4s %10u packets %12llu bytes %8u B/s",
+		    name, packets, bytes, rate);
+}
+#endif
+
+static int cmd_dap_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "Queue (%d x %d bytes):", DAP_QUEUE_COUNT, DAP_QUEUE_SIZE);
+	shell_print(sh, "  requests:  %u", dap_stats.requests);
+	shell_print(sh, "  responses: %u", dap_stats.responses);
+	shell_print(sh, "  queued:    %u in %u batches",
+		    dap_stats.queued, dap_stats.batches);
+	shell_print(sh, "  dropped:   %u in %u link resets",
+		    dap_stats.dropped, dap_stats.resets);
+	shell_print(sh, "  max depth: %u", dap_stats.max_depth);
+#if defined(CONFIG_DAP_QUEUE_CPU_PIN)
+	shell_print(sh, "  thread:    CPU %d", CONFIG_DAP_QUEUE_CPU);
+#endif
+#if defined(CONFIG_DAP_USB)
+	struct dap_usb_stats usb;
+
+	dap_usb_get_stats(&usb);
+
+	shell_print(sh, "USB (over %lld ms):", usb.elapsed_ms);
+	dap_print_rate(sh, "OUT", usb.out_packets, usb.out_bytes, usb.elapsed_ms);
+	dap_print_rate(sh, "IN", usb.in_packets, usb.in_bytes, usb.elapsed_ms);
+	shell_print(sh, "  OUT starved: %u, IN timeouts: %u",
+		    usb.out_starved, usb.in_timeouts);
+#endif
+
+	return 0;
+}
+
+static int cmd_dap_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	dap_queue_reset_stats();
+#if defined(CONFIG_DAP_USB)
+	dap_usb_reset_stats();
+#endif
+	shell_print(sh, "DAP counters reset");
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_dap,
+	SHELL_CMD(stats, NULL, "Show DAP queue and USB throughput counters",
+		  cmd_dap_stats),
+	SHELL_CMD(reset, NULL, "Reset DAP counters", cmd_dap_reset),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(dap, &sub_dap, "CMSIS-DAP commands", NULL);
+
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,118 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * CMSIS-DAP multi-packet command queue
+ */
+
+#ifndef DAP_QUEUE_H
+#define DAP_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <zephyr/sys/util.h>
+
+struct net_buf;
+
+/* CMSIS-DAP command IDs handled by the queue engine */
+#define DAP_CMD_INFO			0x00
+#define DAP_CMD_TRANSFER_ABORT		0x07
+#define DAP_CMD_QUEUE_COMMANDS		0x7E
+#define DAP_CMD_EXECUTE_COMMANDS	0x7F
+#define DAP_CMD_INVALID			0xFF
+
+/* DAP_Info IDs answered by the queue engine */
+#define DAP_INFO_CAPABILITIES		0xF0
+#define DAP_INFO_SWO_BUFFER_SIZE	0xFD
+#define DAP_INFO_PACKET_SIZE		0xFE
+#define DAP_INFO_PACKET_COUNT		0xFF
+
+/* Capabilities byte 0 */
+#define DAP_CAP_SWO_UART		BIT(2)
+#define DAP_CAP_ATOMIC_COMMANDS		BIT(4)
+#define DAP_CAP_SWO_STREAM		BIT(6)
+
+/*
+ * Transport the queue engine works with. Requests and responses are
+ * transport buffers: commands are executed in place from the request
+ * buffer into the response buffer, without intermediate copies.
+ */
+struct dap_queue_transport {
+	/**
+	 * Get an empty response buffer.
+	 * May block until the host has read a previous response.
+	 */
+	struct net_buf *(*alloc_response)(void);
+	/** Send a filled response buffer, ownership is passed on */
+	int (*send)(struct net_buf *buf);
+	/** Give back an executed request buffer */
+	void (*release)(struct net_buf *buf);
+	/**
+	 * Drop the responses sent but not read by the host yet, when the
+	 * link is reset after alloc_response() failed. May be NULL.
+	 */
+	void (*flush)(void);
+};
+
+/* Queue engine counters */
+struct dap_queue_stats {
+	uint32_t requests;
+	uint32_t responses;
+	uint32_t queued;
+	uint32_t batches;
+	/* Requests released without a response, and link resets */
+	uint32_t dropped;
+	uint32_t resets;
+	uint8_t max_depth;
+};
+
+/**
+ * Attach the transport that provides the buffers.
+ *
+ * @param transport Transport callbacks
+ */
+void dap_queue_set_transport(const struct dap_queue_transport *transport);
+
+/**
+ * Submit one request buffer received from the host.
+ * The queue takes ownership and gives it back through release().
+ *
+ * @param buf Request buffer
+ */
+void dap_queue_submit(struct net_buf *buf);
+
+/**
+ * Signal that the queue thread is alive from a long command.
+ * Must only be called from the queue thread.
+ */
+void dap_queue_beat(void);
+
+/**
+ * Check for a DAP_TransferAbort received and still queued, so a command
+ * running in the queue thread can end early.
+ *
+ * @return true if an abort is pending
+ */
+bool dap_queue_aborted(void);
+
+/**
+ * Get the time since the last request completed.
+ *
+ * @return Idle time in ms, 0 while requests are pending
+ */
+uint32_t dap_queue_idle_ms(void);
+
+/**
+ * Get a snapshot of the queue counters.
+ *
+ * @param stats Destination
+ */
+void dap_queue_get_stats(struct dap_queue_stats *stats);
+
+/**
+ * Reset the queue counters.
+ */
+void dap_queue_reset_stats(void);
+
+#endif /* DAP_QUEUE_H */
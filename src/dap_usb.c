@@ -0,0 +1,514 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * CMSIS-DAP v2 USB class (vendor interface with bulk OUT/IN)
+ *
+ * Replaces the stock DAP USB backend so that request packets are
+ * handed to the command queue instead of being executed one at a time
+ * in the USB stack thread.
+ *
+ * Request and response packets live in two pre-allocated UDC buffer
+ * pools. An OUT buffer received from the controller is queued as is and
+ * the command is executed in place into an IN buffer, which is then
+ * enqueued directly: the packet data is never copied by this class.
+ * Two OUT buffers are kept armed, so the next request is already being
+ * received while the current one is processed, and two IN buffers allow
+ * a response to be prepared while the previous one is still being sent.
+ *
+ * With CONFIG_SWO, the interface has a third endpoint, bulk IN, on
+ * which the SWO module streams the captured trace data as specified for
+ * CMSIS-DAP v2.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/net_buf.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/usb/usbd.h>
+#include <zephyr/drivers/usb/udc.h>
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(dap_usb, LOG_LEVEL_INF);
+
+#include "dap_queue.h"
+#include "dap_usb.h"
+#include "health.h"
+
+/* Class state bits */
+#define DAP_USB_ENABLED		0
+
+/* Buffers kept armed on each endpoint */
+#define DAP_USB_OUT_ARMED	2
+#define DAP_USB_IN_BUFFERS	CONFIG_DAP_QUEUE_IN_BUFFERS
+#define DAP_USB_SWO_BUFFERS	2
+
+/* Time the queue thread waits for the host to read a response */
+#define DAP_USB_IN_TIMEOUT	K_MSEC(1000)
+
+/*
+ * The USB device stack thread hands every SOF to the classes: beat on
+ * them while the bus is active, so a stalled stack stops the watchdog.
+ */
+#if defined(CONFIG_HEALTH_USBD)
+static HEALTH_HB_DEFINE(usbd, CONFIG_HEALTH_USBD_BUDGET_MS);
+#endif
+
+UDC_BUF_POOL_DEFINE(dap_usb_out_pool, CONFIG_DAP_QUEUE_PACKET_COUNT,
+		    CONFIG_DAP_QUEUE_PACKET_SIZE, sizeof(struct udc_buf_info), NULL);
+UDC_BUF_POOL_DEFINE(dap_usb_in_pool, DAP_USB_IN_BUFFERS,
+		    CONFIG_DAP_QUEUE_PACKET_SIZE, sizeof(struct udc_buf_info), NULL);
+#if defined(CONFIG_SWO)
+UDC_BUF_POOL_DEFINE(dap_usb_swo_pool, DAP_USB_SWO_BUFFERS,
+		    CONFIG_SWO_STREAM_PACKET_SIZE, sizeof(struct udc_buf_info), NULL);
+#endif
+
+struct dap_usb_desc {
+	struct usb_if_descriptor if0;
+	struct usb_ep_descriptor if0_out_ep;
+	struct usb_ep_descriptor if0_in_ep;
+	struct usb_ep_descriptor if0_hs_out_ep;
+	struct usb_ep_descriptor if0_hs_in_ep;
+#if defined(CONFIG_SWO)
+	struct usb_ep_descriptor if0_swo_ep;
+	struct usb_ep_descriptor if0_hs_swo_ep;
+#endif
+	struct usb_desc_header nil_desc;
+};
+
+struct dap_usb_data {
+	struct usbd_class_data *c_data;
+	struct dap_usb_desc *const desc;
+	const struct usb_desc_header **const fs_desc;
+	const struct usb_desc_header **const hs_desc;
+	atomic_t out_armed;
+	atomic_t state;
+	struct dap_usb_stats stats;
+	int64_t stats_start;
+};
+
+USBD_DESC_STRING_DEFINE(dap_usb_if_str, "CMSIS-DAP v2", USBD_DUT_STRING_INTERFACE);
+
+static struct dap_usb_desc dap_usb_desc = {
+	.if0 = {
+		.bLength = sizeof(struct usb_if_descriptor),
+		.bDescriptorType = USB_DESC_INTERFACE,
+		.bInterfaceNumber = 0,
+		.bAlternateSetting = 0,
+		.bNumEndpoints = IS_ENABLED(CONFIG_SWO) ? 3 : 2,
+		.bInterfaceClass = USB_BCC_VENDOR,
+		.bInterfaceSubClass = 0,
+		.bInterfaceProtocol = 0,
+		.iInterface = 0,
+	},
+	.if0_out_ep = {
+		.bLength = sizeof(struct usb_ep_descriptor),
+		.bDescriptorType = USB_DESC_ENDPOINT,
+		.bEndpointAddress = 0x01,
+		.bmAttributes = USB_EP_TYPE_BULK,
+		.wMaxPacketSize = sys_cpu_to_le16(64U),
+		.bInterval = 0,
+	},
+	.if0_in_ep = {
+		.bLength = sizeof(struct usb_ep_descriptor),
+		.bDescriptorType = USB_DESC_ENDPOINT,
+		.bEndpointAddress = 0x81,
+		.bmAttributes = USB_EP_TYPE_BULK,
+		.wMaxPacketSize = sys_cpu_to_le16(64U),
+		.bInterval = 0,
+	},
+	.if0_hs_out_ep = {
+		.bLength = sizeof(struct usb_ep_descriptor),
+		.bDescriptorType = USB_DESC_ENDPOINT,
+		.bEndpointAddress = 0x01,
+		.bmAttributes = USB_EP_TYPE_BULK,
+		.wMaxPacketSize = sys_cpu_to_le16(512U),
+		.bInterval = 0,
+	},
+	.if0_hs_in_ep = {
+		.bLength = sizeof(struct usb_ep_descriptor),
+		.bDescriptorType = USB_DESC_ENDPOINT,
+		.bEndpointAddress = 0x81,
+		.bmAttributes = USB_EP_TYPE_BULK,
+		.wMaxPacketSize = sys_cpu_to_le16(512U),
+		.bInterval = 0,
+	},
+#if defined(CONFIG_SWO)
+	.if0_swo_ep = {
+		.bLength = sizeof(struct usb_ep_descriptor),
+		.bDescriptorType = USB_DESC_ENDPOINT,
+		.bEndpointAddress = 0x82,
+		.bmAttributes = USB_EP_TYPE_BULK,
+		.wMaxPacketSize = sys_cpu_to_le16(64U),
+		.bInterval = 0,
+	},
+	.if0_hs_swo_ep = {
+		.bLength = sizeof(struct usb_ep_descriptor),
+		.bDescriptorType = USB_DESC_ENDPOINT,
+		.bEndpointAddress = 0x82,
+		.bmAttributes = USB_EP_TYPE_BULK,
+		.wMaxPacketSize = sys_cpu_to_le16(512U),
+		.bInterval = 0,
+	},
+#endif
+	.nil_desc = {
+		.bLength = 0,
+		.bDescriptorType = 0,
+	},
+};
+
+static const struct usb_desc_header *dap_usb_fs_desc[] = {
+	(struct usb_desc_header *)&dap_usb_desc.if0,
+	(struct usb_desc_header *)&dap_usb_desc.if0_out_ep,
+	(struct usb_desc_header *)&dap_usb_desc.if0_in_ep,
+#if defined(CONFIG_SWO)
+	(struct usb_desc_header *)&dap_usb_desc.if0_swo_ep,
+#endif
+	(struct usb_desc_header *)&dap_usb_desc.nil_desc,
+};
+
+static const struct usb_desc_header *dap_usb_hs_desc[] = {
+	(struct usb_desc_header *)&dap_usb_desc.if0,
+	(struct usb_desc_header *)&dap_usb_desc.if0_hs_out_ep,
+	(struct usb_desc_header *)&dap_usb_desc.if0_hs_in_ep,
+#if defined(CONFIG_SWO)
+	(struct usb_desc_header *)&dap_usb_desc.if0_hs_swo_ep,
+#endif
+	(struct usb_desc_header *)&dap_usb_desc.nil_desc,
+};
+
+static struct dap_usb_data dap_usb_data = {
+	.desc = &dap_usb_desc,
+	.fs_desc = dap_usb_fs_desc,
+	.hs_desc = dap_usb_hs_desc,
+};
+
+static bool dap_usb_is_hs(struct usbd_class_data *const c_data)
+{
+	return USBD_SUPPORTS_HIGH_SPEED &&
+	       usbd_bus_speed(usbd_class_get_ctx(c_data)) == USBD_SPEED_HS;
+}
+
+static uint8_t dap_usb_ep_out(struct usbd_class_data *const c_data)
+{
+	struct dap_usb_data *data = usbd_class_get_private(c_data);
+
+	return dap_usb_is_hs(c_data) ? data->desc->if0_hs_out_ep.bEndpointAddress :
+				       data->desc->if0_out_ep.bEndpointAddress;
+}
+
+static uint8_t dap_usb_ep_in(struct usbd_class_data *const c_data)
+{
+	struct dap_usb_data *data = usbd_class_get_private(c_data);
+
+	return dap_usb_is_hs(c_data) ? data->desc->if0_hs_in_ep.bEndpointAddress :
+				       data->desc->if0_in_ep.bEndpointAddress;
+}
+
+#if defined(CONFIG_SWO)
+static uint8_t dap_usb_ep_swo(struct usbd_class_data *const c_data)
+{
+	struct dap_usb_data *data = usbd_class_get_private(c_data);
+
+	return dap_usb_is_hs(c_data) ? data->desc->if0_hs_swo_ep.bEndpointAddress :
+				       data->desc->if0_swo_ep.bEndpointAddress;
+}
+#endif
+
+static struct net_buf *dap_usb_buf_alloc(struct net_buf_pool *pool,
+					 const uint8_t ep, k_timeout_t timeout)
+{
+	struct net_buf *buf;
+	struct udc_buf_info *bi;
+
+	buf = net_buf_alloc(pool, timeout);
+	if (buf == NULL) {
+		return NULL;
+	}
+
+	bi = udc_get_buf_info(buf);
+	bi->ep = ep;
+
+	return buf;
+}
+
+/* Keep DAP_USB_OUT_ARMED request buffers armed on the OUT endpoint */
+static void dap_usb_arm_out(struct usbd_class_data *const c_data)
+{
+	struct dap_usb_data *data = usbd_class_get_private(c_data);
+	struct net_buf *buf;
+
+	while (atomic_test_bit(&data->state, DAP_USB_ENABLED)) {
+		if (atomic_inc(&data->out_armed) >= DAP_USB_OUT_ARMED) {
+			atomic_dec(&data->out_armed);
+			break;
+		}
+
+		buf = dap_usb_buf_alloc(&dap_usb_out_pool,
+					dap_usb_ep_out(c_data), K_NO_WAIT);
+		if (buf == NULL) {
+			/* All request buffers are waiting in the queue */
+			data->stats.out_starved++;
+			atomic_dec(&data->out_armed);
+			break;
+		}
+
+		if (usbd_ep_enqueue(c_data, buf)) {
+			net_buf_unref(buf);
+			atomic_dec(&data->out_armed);
+			break;
+		}
+	}
+}
+
+static struct net_buf *dap_usb_alloc_response(void)
+{
+	struct dap_usb_data *data = &dap_usb_data;
+	struct net_buf *buf;
+
+	if (!atomic_test_bit(&data->state, DAP_USB_ENABLED)) {
+		return NULL;
+	}
+
+	buf = dap_usb_buf_alloc(&dap_usb_in_pool, dap_usb_ep_in(data->c_data),
+				DAP_USB_IN_TIMEOUT);
+	if (buf == NULL) {
+		data->stats.in_timeouts++;
+		LOG_WRN("Host did not read the previous responses");
+	}
+
+	return buf;
+}
+
+static int dap_usb_send(struct net_buf *buf)
+{
+	struct dap_usb_data *data = &dap_usb_data;
+	int ret;
+
+	ret = usbd_ep_enqueue(data->c_data, buf);
+	if (ret) {
+		net_buf_unref(buf);
+	}
+
+	return ret;
+}
+
+/*
+ * The host reads responses with a buffer of the DAP packet size, a
+ * shorter one that fills its last USB packet needs a ZLP to end there.
+ */
+static int dap_usb_send_response(struct net_buf *buf)
+{
+	struct dap_usb_data *data = &dap_usb_data;
+	size_t mps = dap_usb_is_hs(data->c_data) ? 512U : 64U;
+
+	if (buf->len < CONFIG_DAP_QUEUE_PACKET_SIZE && buf->len % mps == 0) {
+		udc_ep_buf_set_zlp(buf);
+	}
+
+	return dap_usb_send(buf);
+}
+
+static void dap_usb_release(struct net_buf *buf)
+{
+	net_buf_unref(buf);
+
+	if (dap_usb_data.c_data != NULL) {
+		dap_usb_arm_out(dap_usb_data.c_data);
+	}
+}
+
+#if defined(CONFIG_SWO)
+struct net_buf *dap_usb_swo_alloc(k_timeout_t timeout)
+{
+	struct dap_usb_data *data = &dap_usb_data;
+
+	if (!atomic_test_bit(&data->state, DAP_USB_ENABLED)) {
+		return NULL;
+	}
+
+	return dap_usb_buf_alloc(&dap_usb_swo_pool, dap_usb_ep_swo(data->c_data),
+				 timeout);
+}
+
+int dap_usb_swo_send(struct net_buf *buf)
+{
+	struct dap_usb_data *data = &dap_usb_data;
+	size_t mps = dap_usb_is_hs(data->c_data) ? 512U : 64U;
+
+	/* End the transfer on the host side when the data fills packets */
+	if (buf->len % mps == 0) {
+		udc_ep_buf_set_zlp(buf);
+	}
+
+	return dap_usb_send(buf);
+}
+#endif /* CONFIG_SWO */
+
+/* Cancel the responses still queued on the IN endpoint */
+static void dap_usb_flush(void)
+{
+	struct dap_usb_data *data = &dap_usb_data;
+
+	if (atomic_test_bit(&data->state, DAP_USB_ENABLED)) {
+		usbd_ep_dequeue(data->c_data, dap_usb_ep_in(data->c_data));
+	}
+}
+
+static const struct dap_queue_transport dap_usb_transport = {
+	.alloc_response = dap_usb_alloc_response,
+	.send = dap_usb_send_response,
+	.release = dap_usb_release,
+	.flush = dap_usb_flush,
+};
+
+static int dap_usb_request(struct usbd_class_data *const c_data,
+			   struct net_buf *buf, int err)
+{
+	struct dap_usb_data *data = usbd_class_get_private(c_data);
+	struct udc_buf_info *bi = udc_get_buf_info(buf);
+
+	if (bi->ep == dap_usb_ep_out(c_data)) {
+		atomic_dec(&data->out_armed);
+
+		if (err == 0 && buf->len > 0) {
+			data->stats.out_packets++;
+			data->stats.out_bytes += buf->len;
+			/* The queue owns the buffer until dap_usb_release() */
+			dap_queue_submit(buf);
+		} else {
+			net_buf_unref(buf);
+		}
+
+		if (err != -ECONNABORTED) {
+			dap_usb_arm_out(c_data);
+		}
+#if defined(CONFIG_SWO)
+	} else if (bi->ep == dap_usb_ep_swo(c_data)) {
+		/* SWO stream buffers are counted by the SWO module */
+		net_buf_unref(buf);
+#endif
+	} else {
+		if (err == 0) {
+			data->stats.in_packets++;
+			data->stats.in_bytes += buf->len;
+		}
+		net_buf_unref(buf);
+	}
+
+	return 0;
+}
+
+void dap_usb_get_stats(struct dap_usb_stats *stats)
+{
+	*stats = dap_usb_data.stats;
+	stats->elapsed_ms = k_uptime_get() - dap_usb_data.stats_start;
+}
+
+void dap_usb_reset_stats(void)
+{
+	memset(&dap_usb_data.stats, 0, sizeof(dap_usb_data.stats));
+	dap_usb_data.stats_start = k_uptime_get();
+}
+
+static void *dap_usb_get_desc(struct usbd_class_data *const c_data,
+			      const enum usbd_speed speed)
+{
+	struct dap_usb_data *data = usbd_class_get_private(c_data);
+
+	if (USBD_SUPPORTS_HIGH_SPEED && speed == USBD_SPEED_HS) {
+		return data->hs_desc;
+	}
+
+	return data->fs_desc;
+}
+
+static void dap_usb_enable(struct usbd_class_data *const c_data)
+{
+	struct dap_usb_data *data = usbd_class_get_private(c_data);
+
+	atomic_set(&data->out_armed, 0);
+	atomic_set_bit(&data->state, DAP_USB_ENABLED);
+	dap_usb_arm_out(c_data);
+
+#if defined(CONFIG_HEALTH_USBD)
+	health_pause(&usbd, false);
+#endif
+
+	LOG_INF("CMSIS-DAP v2 interface enabled");
+}
+
+static void dap_usb_disable(struct usbd_class_data *const c_data)
+{
+	struct dap_usb_data *data = usbd_class_get_private(c_data);
+
+	atomic_clear_bit(&data->state, DAP_USB_ENABLED);
+
+#if defined(CONFIG_HEALTH_USBD)
+	health_pause(&usbd, true);
+#endif
+}
+
+#if defined(CONFIG_HEALTH_USBD)
+static void dap_usb_sof(struct usbd_class_data *const c_data)
+{
+	health_beat(&usbd);
+}
+
+/* No SOF while the bus is suspended */
+static void dap_usb_suspended(struct usbd_class_data *const c_data)
+{
+	health_pause(&usbd, true);
+}
+
+static void dap_usb_resumed(struct usbd_class_data *const c_data)
+{
+	struct dap_usb_data *data = usbd_class_get_private(c_data);
+
+	if (atomic_test_bit(&data->state, DAP_USB_ENABLED)) {
+		health_pause(&usbd, false);
+	}
+}
+#endif /* CONFIG_HEALTH_USBD */
+
+static int dap_usb_init(struct usbd_class_data *const c_data)
+{
+	struct usbd_context *uds_ctx = usbd_class_get_ctx(c_data);
+	struct dap_usb_data *data = usbd_class_get_private(c_data);
+	int ret;
+
+	ret = usbd_add_descriptor(uds_ctx, &dap_usb_if_str);
+	if (ret) {
+		LOG_ERR("Failed to add interface string descriptor");
+		return ret;
+	}
+
+	data->desc->if0.iInterface = usbd_str_desc_get_idx(&dap_usb_if_str);
+	data->c_data = c_data;
+	data->stats_start = k_uptime_get();
+	dap_queue_set_transport(&dap_usb_transport);
+
+#if defined(CONFIG_HEALTH_USBD)
+	/* Supervised once the host configures the interface */
+	health_register(&usbd);
+	health_pause(&usbd, true);
+#endif
+
+	return 0;
+}
+
+static const struct usbd_class_api dap_usb_api = {
+	.request = dap_usb_request,
+	.enable = dap_usb_enable,
+	.disable = dap_usb_disable,
+#if defined(CONFIG_HEALTH_USBD)
+	.sof = dap_usb_sof,
+	.suspended = dap_usb_suspended,
+	.resumed = dap_usb_resumed,
+#endif
+	.init = dap_usb_init,
+	.get_desc = dap_usb_get_desc,
+};
+
+USBD_DEFINE_CLASS(dap_usb, &dap_usb_api, &dap_usb_data, NULL);
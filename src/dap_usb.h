@@ -0,0 +1,58 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * CMSIS-DAP v2 USB class
+ */
+
+#ifndef DAP_USB_H
+#define DAP_USB_H
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+struct net_buf;
+
+/* Per-direction transfer counters of the DAP bulk endpoints */
+struct dap_usb_stats {
+	uint32_t out_packets;
+	uint64_t out_bytes;
+	uint32_t in_packets;
+	uint64_t in_bytes;
+	/* OUT endpoint left unarmed because all request buffers were queued */
+	uint32_t out_starved;
+	/* Responses dropped because the host did not read them in time */
+	uint32_t in_timeouts;
+	/* Time since the counters were reset */
+	int64_t elapsed_ms;
+};
+
+/**
+ * Get a snapshot of the DAP endpoint counters.
+ *
+ * @param stats Destination
+ */
+void dap_usb_get_stats(struct dap_usb_stats *stats);
+
+/**
+ * Reset the DAP endpoint counters.
+ */
+void dap_usb_reset_stats(void);
+
+/**
+ * Get an empty buffer for the SWO endpoint.
+ *
+ * @param timeout Time to wait for the host to read a previous buffer
+ * @return Buffer, or NULL on timeout or while the interface is disabled
+ */
+struct net_buf *dap_usb_swo_alloc(k_timeout_t timeout);
+
+/**
+ * Send a filled SWO buffer, ownership is passed on.
+ *
+ * @param buf Buffer from dap_usb_swo_alloc()
+ * @return 0 on success, negative errno otherwise
+ */
+int dap_usb_swo_send(struct net_buf *buf);
+
+#endif /* DAP_USB_H */
@@ -0,0 +1,400 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * CMSIS-DAP vendor commands
+ *
+ * Commands 0x80-0x9F are handed to this module by the queue engine,
+ * before the DAP core. They run in the queue thread, which owns the SWD
+ * port, so they are atomic with respect to the standard commands.
+ *
+ * Memory reads use a block engine that keeps the MEM-AP busy:
+ *
+ * - AP reads are posted: each DRW read returns the data of the previous
+ *   one, and RDBUFF collects the last word, so a block of N words costs
+ *   N + 1 SWD packets instead of 2N.
+ * - TAR auto-increment is only guaranteed within a 1 KB block (ADIv5),
+ *   so TAR is written once per block, not once per packet.
+ * - WAIT answers are retried in place, without going back to the host.
+ *
+ * Writes use the same engine: posted DRW writes back to back, and one
+ * RDBUFF read at the end to collect the status of the last one.
+ *
+ * A read streamed over several responses keeps its MEM-AP state from one
+ * response to the next: CSW is written once at the start, TAR only when
+ * the address wraps to a new 1 KB block, and the read posted at the end
+ * of a response is collected by the first packet of the next one. No
+ * other SWD user runs in between, the queue thread sends all the
+ * responses before it takes the next request. A DAP_TransferAbort
+ * queued by the host ends the stream early.
+ *
+ * The host selects the MEM-AP and bank 0 with DAP_Transfer beforehand.
+ * CSW is left set to 32-bit accesses with auto-increment.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/swdp.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "dap_vendor.h"
+#include "dap_queue.h"
+#include "dap_flash.h"
+#include "die_temp.h"
+#include "telemetry.h"
+#include "swd_cal.h"
+#include "fw_update.h"
+
+/* MEM-AP and DP registers, as SWDP_REQUEST_* bits */
+#define AP_CSW		SWDP_REQUEST_APnDP
+#define AP_TAR		(SWDP_REQUEST_APnDP | SWDP_REQUEST_A2)
+#define AP_DRW		(SWDP_REQUEST_APnDP | SWDP_REQUEST_A2 | SWDP_REQUEST_A3)
+#define DP_ABORT	0
+#define DP_IDCODE	SWDP_REQUEST_RnW
+#define DP_CTRL_STAT	SWDP_REQUEST_A2
+#define DP_RDBUFF	(SWDP_REQUEST_A2 | SWDP_REQUEST_A3)
+
+#define ABORT_CLEAR	0x1E
+#define CTRL_PWRUP_REQ	(BIT(28) | BIT(30))
+#define CTRL_PWRUP_ACK	(BIT(29) | BIT(31))
+#define PWRUP_POLLS	100
+
+/* 32-bit, auto-increment single, privileged debug access */
+#define CSW_WORD_INCR	0x23000012
+
+/* Smallest TAR auto-increment range allowed by ADIv5 */
+#define TAR_WRAP	1024
+
+/* Request: command, address, byte count */
+#define READ_MEM_REQ	9
+/* Response header: command, status, byte count */
+#define READ_MEM_HDR	4
+/* Data bytes that fit a response of the given size */
+#define READ_MEM_MAX(size)	(((size) - READ_MEM_HDR) & ~3)
+
+/* Request header: command, address, byte count */
+#define WRITE_MEM_HDR	7
+
+static const struct device *swd_dev;
+
+/* Streamed read in progress */
+static struct {
+	uint32_t addr;
+	uint32_t remaining;
+	/* A DRW read is posted, its data comes with the next packet */
+	bool posted;
+} read_stream;
+
+int dap_vendor_init(const struct device *dev)
+{
+	if (!device_is_ready(dev)) {
+		return -ENODEV;
+	}
+
+	swd_dev = dev;
+
+	return 0;
+}
+
+uint8_t dap_vendor_xfer(uint8_t request, uint32_t *data)
+{
+	const struct swdp_api *api = swd_dev->api;
+	uint32_t retry = CONFIG_DAP_VENDOR_WAIT_RETRIES;
+	uint8_t ack;
+
+	do {
+		api->swdp_transfer(swd_dev, request, data, 0, &ack);
+	} while (ack == SWDP_ACK_WAIT && retry-- > 0);
+
+	return ack;
+}
+
+int dap_vendor_attach(uint32_t *dpidr)
+{
+	/* Line reset, JTAG-to-SWD select (0xE79E), line reset, idle */
+	static const uint8_t jtag_to_swd[] = {
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0x9E, 0xE7,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0x00,
+	};
+	const struct swdp_api *api = swd_dev->api;
+	uint32_t value;
+	uint8_t ack;
+
+	api->swdp_output_sequence(swd_dev, sizeof(jtag_to_swd) * 8,
+				  jtag_to_swd);
+
+	if (dap_vendor_xfer(DP_IDCODE, &value) != SWDP_ACK_OK) {
+		return -EIO;
+	}
+
+	if (dpidr != NULL) {
+		*dpidr = value;
+	}
+
+	value = ABORT_CLEAR;
+	dap_vendor_xfer(DP_ABORT, &value);
+
+	value = CTRL_PWRUP_REQ;
+	ack = dap_vendor_xfer(DP_CTRL_STAT, &value);
+
+	for (int i = 0; ack == SWDP_ACK_OK && i < PWRUP_POLLS; i++) {
+		ack = dap_vendor_xfer(DP_CTRL_STAT | SWDP_REQUEST_RnW, &value);
+		if (ack == SWDP_ACK_OK &&
+		    (value & CTRL_PWRUP_ACK) == CTRL_PWRUP_ACK) {
+			return 0;
+		}
+	}
+
+	return ack == SWDP_ACK_OK ? -ETIMEDOUT : -EIO;
+}
+
+uint8_t dap_vendor_mem_read(uint32_t addr, uint8_t *dst, uint32_t words,
+			    uint32_t *done)
+{
+	uint32_t csw = CSW_WORD_INCR;
+	uint32_t value;
+	uint8_t ack;
+
+	*done = 0;
+
+	ack = dap_vendor_xfer(AP_CSW, &csw);
+
+	while (ack == SWDP_ACK_OK && words > 0) {
+		uint32_t chunk = MIN(words, (TAR_WRAP - (addr % TAR_WRAP)) / 4);
+
+		ack = dap_vendor_xfer(AP_TAR, &addr);
+		if (ack != SWDP_ACK_OK) {
+			break;
+		}
+
+		/* Post the first read, its data comes with the next packet */
+		ack = dap_vendor_xfer(AP_DRW | SWDP_REQUEST_RnW, &value);
+
+		for (uint32_t i = 0; i < chunk && ack == SWDP_ACK_OK; i++) {
+			uint8_t req = (i == chunk - 1) ? DP_RDBUFF : AP_DRW;
+
+			ack = dap_vendor_xfer(req | SWDP_REQUEST_RnW, &value);
+			if (ack == SWDP_ACK_OK) {
+				sys_put_le32(value, dst);
+				dst += 4;
+				(*done)++;
+			}
+		}
+
+		addr += chunk * 4;
+		words -= chunk;
+	}
+
+	return ack;
+}
+
+uint8_t dap_vendor_mem_write(uint32_t addr, const uint8_t *src,
+			     uint32_t words)
+{
+	uint32_t csw = CSW_WORD_INCR;
+	uint32_t value;
+	uint8_t ack;
+
+	ack = dap_vendor_xfer(AP_CSW, &csw);
+
+	while (ack == SWDP_ACK_OK && words > 0) {
+		uint32_t chunk = MIN(words, (TAR_WRAP - (addr % TAR_WRAP)) / 4);
+
+		ack = dap_vendor_xfer(AP_TAR, &addr);
+
+		/* Writes are posted too, the ACK is for the previous one */
+		for (uint32_t i = 0; i < chunk && ack == SWDP_ACK_OK; i++) {
+			value = sys_get_le32(src);
+			ack = dap_vendor_xfer(AP_DRW, &value);
+			src += 4;
+		}
+
+		addr += chunk * 4;
+		words -= chunk;
+	}
+
+	/* Wait for the last write to complete */
+	if (ack == SWDP_ACK_OK) {
+		ack = dap_vendor_xfer(DP_RDBUFF | SWDP_REQUEST_RnW, &value);
+	}
+
+	return ack;
+}
+
+/* Fill one read response of at most size bytes from the stream state */
+static size_t dap_vendor_read_next(uint8_t *response, uint32_t size)
+{
+	uint32_t words = MIN(read_stream.remaining, READ_MEM_MAX(size)) / 4;
+	uint8_t *dst = &response[READ_MEM_HDR];
+	uint32_t done = 0;
+	uint32_t value;
+	uint8_t ack = SWDP_ACK_OK;
+
+	while (done < words) {
+		uint32_t addr = read_stream.addr;
+		bool last;
+
+		/* Start of the stream or of a TAR block */
+		if (!read_stream.posted) {
+			ack = dap_vendor_xfer(AP_TAR, &addr);
+			if (ack == SWDP_ACK_OK) {
+				ack = dap_vendor_xfer(AP_DRW | SWDP_REQUEST_RnW,
+						      &value);
+			}
+			if (ack != SWDP_ACK_OK) {
+				break;
+			}
+			read_stream.posted = true;
+		}
+
+		/* RDBUFF collects the last word without posting another read */
+		last = read_stream.remaining == 4 || (addr + 4) % TAR_WRAP == 0;
+		ack = dap_vendor_xfer((last ? DP_RDBUFF : AP_DRW) |
+				      SWDP_REQUEST_RnW, &value);
+		if (ack != SWDP_ACK_OK) {
+			break;
+		}
+
+		sys_put_le32(value, dst);
+		dst += 4;
+		done++;
+		read_stream.addr += 4;
+		read_stream.remaining -= 4;
+		read_stream.posted = !last;
+	}
+
+	response[0] = DAP_VENDOR_READ_MEM;
+	response[1] = ack;
+	sys_put_le16(done * 4, &response[2]);
+
+	if (ack != SWDP_ACK_OK || dap_queue_aborted()) {
+		/* The host sees the error in this response, stop here */
+		dap_vendor_cancel();
+	}
+
+	return READ_MEM_HDR + done * 4;
+}
+
+static uint32_t dap_vendor_read_mem(const uint8_t *request, uint32_t req_len,
+				    uint8_t *response, uint32_t resp_size,
+				    bool stream)
+{
+	uint32_t addr;
+	uint32_t len;
+	uint32_t csw = CSW_WORD_INCR;
+	uint8_t ack = DAP_VENDOR_ERROR;
+
+	if (req_len < READ_MEM_REQ || resp_size < READ_MEM_HDR) {
+		return dap_vendor_reject(response, req_len);
+	}
+
+	addr = sys_get_le32(&request[1]);
+	len = sys_get_le32(&request[5]);
+
+	if (swd_dev != NULL && ((addr | len) & 3) == 0 &&
+	    len <= CONFIG_DAP_VENDOR_READ_LIMIT) {
+		ack = dap_vendor_xfer(AP_CSW, &csw);
+	}
+
+	if (ack != SWDP_ACK_OK) {
+		response[0] = DAP_VENDOR_READ_MEM;
+		response[1] = ack;
+		sys_put_le16(0, &response[2]);
+		return (READ_MEM_REQ << 16) | READ_MEM_HDR;
+	}
+
+	read_stream.addr = addr;
+	read_stream.remaining = stream ? len :
+				MIN(len, READ_MEM_MAX(resp_size));
+	read_stream.posted = false;
+
+	return (READ_MEM_REQ << 16) | dap_vendor_read_next(response, resp_size);
+}
+
+static uint32_t dap_vendor_write_mem(const uint8_t *request, uint32_t req_len,
+				     uint8_t *response, uint32_t resp_size)
+{
+	uint32_t addr;
+	uint16_t len;
+	uint8_t ack = DAP_VENDOR_ERROR;
+
+	if (req_len < WRITE_MEM_HDR || resp_size < 2) {
+		return dap_vendor_reject(response, req_len);
+	}
+
+	addr = sys_get_le32(&request[1]);
+	len = sys_get_le16(&request[5]);
+	if (len > req_len - WRITE_MEM_HDR) {
+		return dap_vendor_reject(response, req_len);
+	}
+
+	response[0] = DAP_VENDOR_WRITE_MEM;
+
+	if (swd_dev != NULL && ((addr | len) & 3) == 0) {
+		ack = dap_vendor_mem_write(addr, &request[WRITE_MEM_HDR],
+					   len / 4);
+	}
+
+	response[1] = ack;
+
+	return ((WRITE_MEM_HDR + len) << 16) | 2;
+}
+
+uint32_t dap_vendor_execute(const uint8_t *request, uint32_t req_len,
+			    uint8_t *response, uint32_t resp_size, bool stream)
+{
+	switch (request[0]) {
+	case DAP_VENDOR_READ_MEM:
+		return dap_vendor_read_mem(request, req_len, response,
+					   resp_size, stream);
+	case DAP_VENDOR_WRITE_MEM:
+		return dap_vendor_write_mem(request, req_len, response,
+					    resp_size);
+#if defined(CONFIG_DAP_FLASH)
+	case DAP_VENDOR_FLASH_SETUP:
+	case DAP_VENDOR_FLASH_START:
+	case DAP_VENDOR_FLASH_DATA:
+	case DAP_VENDOR_FLASH_FINISH:
+	case DAP_VENDOR_FLASH_SECTORS:
+		return dap_flash_execute(request, req_len, response, resp_size);
+#endif
+#if defined(CONFIG_DIE_TEMP)
+	case DAP_VENDOR_DIE_TEMP:
+		return die_temp_execute(request, req_len, response, resp_size);
+#endif
+#if defined(CONFIG_TELEMETRY)
+	case DAP_VENDOR_TELEMETRY:
+		return telemetry_execute(request, req_len, response, resp_size);
+#endif
+#if defined(CONFIG_SWD_CAL)
+	case DAP_VENDOR_SWD_CAL:
+		return swd_cal_execute(request, req_len, response, resp_size);
+#endif
+#if defined(CONFIG_FW_UPDATE)
+	case DAP_VENDOR_FW_UPDATE:
+		return fw_update_execute(request, req_len, response, resp_size);
+#endif
+	default:
+		/* Unknown vendor command, as answered by the DAP core */
+		response[0] = DAP_VENDOR_ERROR;
+		return (1 << 16) | 1;
+	}
+}
+
+bool dap_vendor_pending(void)
+{
+	return read_stream.remaining > 0;
+}
+
+size_t dap_vendor_continue(uint8_t *response)
+{
+	return dap_vendor_read_next(response, CONFIG_DAP_QUEUE_PACKET_SIZE);
+}
+
+void dap_vendor_cancel(void)
+{
+	read_stream.remaining = 0;
+	read_stream.posted = false;
+}
@@ -0,0 +1,205 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * CMSIS-DAP vendor commands
+ */
+
+#ifndef DAP_VENDOR_H
+#define DAP_VENDOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct device;
+
+/* ID_DAP_Vendor0 to ID_DAP_Vendor31 */
+#define DAP_VENDOR_FIRST		0x80
+#define DAP_VENDOR_LAST			0x9F
+
+/*
+ * Read target memory through the selected MEM-AP.
+ * Request:  0x80, address (u32), length in bytes (u32)
+ * Response: 0x80, status, byte count (u16), data
+ * Address and length must be word aligned. The status is the SWD ACK of
+ * the last transfer (1 = OK), or 0xFF for a malformed request or one
+ * longer than CONFIG_DAP_VENDOR_READ_LIMIT. Reads longer than a packet
+ * are streamed in consecutive responses, until a DAP_TransferAbort.
+ */
+#define DAP_VENDOR_READ_MEM		0x80
+
+/*
+ * Write target memory through the selected MEM-AP.
+ * Request:  0x81, address (u32), length in bytes (u16), data
+ * Response: 0x81, status
+ * Address and length must be word aligned, the data fits in one packet.
+ */
+#define DAP_VENDOR_WRITE_MEM		0x81
+
+/* On-probe flash programming, see dap_flash.h */
+#define DAP_VENDOR_FLASH_SETUP		0x82
+#define DAP_VENDOR_FLASH_START		0x83
+#define DAP_VENDOR_FLASH_DATA		0x84
+#define DAP_VENDOR_FLASH_FINISH		0x85
+#define DAP_VENDOR_FLASH_SECTORS	0x8A
+
+/*
+ * Die temperature, in millidegrees Celsius, calibration applied.
+ * Request:  0x86
+ * Response: 0x86, status, current (i32), min (i32), max (i32)
+ * The status is 0xFF until the first value is available.
+ */
+#define DAP_VENDOR_DIE_TEMP		0x86
+
+/* Probe telemetry snapshot, see telemetry.h */
+#define DAP_VENDOR_TELEMETRY		0x87
+
+/*
+ * Calibrate the SWD clock on the connected target, see swd_cal.h.
+ * Request:  0x88, highest clock in Hz (u32, 0 = port limit),
+ *           RAM address for the pattern test (u32, 0 = default)
+ * Response: 0x88, status, DPIDR (u32), highest passing clock (u32),
+ *           stored clock (u32)
+ * The status is 0xFF if the target fails at the lowest clock, its core
+ * cannot be halted, or the result cannot be stored.
+ */
+#define DAP_VENDOR_SWD_CAL		0x88
+
+/*
+ * Firmware update status, and test boot of the uploaded image, see
+ * fw_update.h.
+ * Request:  0x89, action (u8, DAP_VENDOR_FW_UPDATE_*)
+ * Response: 0x89, status, state (u8), image size (u32), bytes received
+ *           (u32), elapsed time in us (u32), rate in B/s (u32), largest
+ *           chunk (u32), time spent writing in us (u32)
+ * The status is 0xFF if the boot is refused. After a successful boot
+ * action the probe resets about 100 ms later.
+ */
+#define DAP_VENDOR_FW_UPDATE		0x89
+#define DAP_VENDOR_FW_UPDATE_STATUS	0
+#define DAP_VENDOR_FW_UPDATE_BOOT	1
+
+/* Status of a malformed vendor request */
+#define DAP_VENDOR_ERROR		0xFF
+
+/**
+ * Check if a command ID belongs to the vendor range.
+ *
+ * @param cmd Command ID
+ * @return true for a vendor command
+ */
+static inline bool dap_vendor_is_cmd(uint8_t cmd)
+{
+	return cmd >= DAP_VENDOR_FIRST && cmd <= DAP_VENDOR_LAST;
+}
+
+/**
+ * Answer a vendor command that does not fit in the rest of the request
+ * or response packet. The rest of the request is dropped, it cannot be
+ * parsed any further.
+ *
+ * @param response Response buffer, at least 1 byte
+ * @param req_len Request bytes left, from the command ID on
+ * @return Request length in the upper 16 bits, response length in the
+ *         lower 16 bits, as dap_execute_cmd()
+ */
+static inline uint32_t dap_vendor_reject(uint8_t *response, uint32_t req_len)
+{
+	response[0] = DAP_VENDOR_ERROR;
+
+	return (req_len << 16) | 1;
+}
+
+/**
+ * Set the SWD port used by the vendor commands, the same one given to
+ * dap_setup().
+ *
+ * @param swd_dev SWD port device
+ * @return 0 on success, -ENODEV if the device is not ready
+ */
+int dap_vendor_init(const struct device *swd_dev);
+
+/**
+ * Run one SWD packet, retrying WAIT answers.
+ *
+ * @param request SWDP_REQUEST_* bits
+ * @param data Data to write, or location for read data
+ * @return SWD ACK of the last attempt
+ */
+uint8_t dap_vendor_xfer(uint8_t request, uint32_t *data);
+
+/**
+ * Bring the debug port up as a host does on connection: line reset and
+ * JTAG-to-SWD switch, DPIDR read, sticky errors cleared and debug power
+ * requested. The SWD port must be on and clocked.
+ *
+ * @param dpidr Location for DPIDR, may be NULL
+ * @return 0 on success, -EIO on an SWD error, -ETIMEDOUT if the power
+ *         up is not acknowledged
+ */
+int dap_vendor_attach(uint32_t *dpidr);
+
+/**
+ * Read target words through the selected MEM-AP, with pipelined AP
+ * reads and one TAR write per auto-increment block.
+ *
+ * @param addr Word aligned target address
+ * @param dst Destination, little endian
+ * @param words Number of words
+ * @param done Number of words read before an error
+ * @return SWD ACK, SWDP_ACK_OK on success
+ */
+uint8_t dap_vendor_mem_read(uint32_t addr, uint8_t *dst, uint32_t words,
+			    uint32_t *done);
+
+/**
+ * Write target words through the selected MEM-AP, with posted AP
+ * writes and one TAR write per auto-increment block.
+ *
+ * @param addr Word aligned target address
+ * @param src Source, little endian
+ * @param words Number of words
+ * @return SWD ACK, SWDP_ACK_OK on success
+ */
+uint8_t dap_vendor_mem_write(uint32_t addr, const uint8_t *src,
+			     uint32_t words);
+
+/**
+ * Run one vendor command. Inside DAP_ExecuteCommands or
+ * DAP_QueueCommands the command starts past the head of both packets,
+ * and only the rest of them is available.
+ *
+ * @param request Command
+ * @param req_len Request bytes left, from the command ID on
+ * @param response Response buffer
+ * @param resp_size Response bytes left, at least 1
+ * @param stream true if the command may go on in further responses of
+ *        CONFIG_DAP_QUEUE_PACKET_SIZE bytes, false inside a batch
+ * @return Request length in the upper 16 bits, response length in the
+ *         lower 16 bits, as dap_execute_cmd()
+ */
+uint32_t dap_vendor_execute(const uint8_t *request, uint32_t req_len,
+			    uint8_t *response, uint32_t resp_size, bool stream);
+
+/**
+ * Check if the last command has more responses to send.
+ *
+ * @return true while dap_vendor_continue() has data
+ */
+bool dap_vendor_pending(void);
+
+/**
+ * Fill the next response of a streamed command.
+ *
+ * @param response Response buffer of CONFIG_DAP_QUEUE_PACKET_SIZE bytes
+ * @return Response length
+ */
+size_t dap_vendor_continue(uint8_t *response);
+
+/**
+ * Drop the rest of a streamed command.
+ */
+void dap_vendor_cancel(void);
+
+#endif /* DAP_VENDOR_H */
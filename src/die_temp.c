@@ -0,0 +1,366 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Die temperature telemetry
+ *
+ * The ADC converts its temperature sensor input (channel 4) in
+ * free-running mode, paced by its clock divider. Results go through the
+ * ADC FIFO to a DMA channel that fills two buffers in turn; the only CPU
+ * work is one interrupt per buffer, which re-arms the channel on the
+ * other buffer and averages the finished one:
+ *
+ *   uV  = sum * VREF / (4096 * N)
+ *   m°C = 27000 - (uV - 706000) / 1.721 + offset
+ *
+ * all in integer arithmetic. The per-device offset is kept in the factory
+ * partition, a flash sector of its own that is only written when the
+ * probe is calibrated.
+ *
+ * The ADC and the DMA channel (CONFIG_DIE_TEMP_DMA_CHANNEL) are driven
+ * directly: the Zephyr ADC driver must be disabled and no Zephyr DMA
+ * client may get the channel. The completion interrupt is DMA_IRQ_1,
+ * DMA_IRQ_0 is left to the Zephyr DMA driver.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/irq.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <stdlib.h>
+
+#include <hardware/adc.h>
+#include <hardware/dma.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(die_temp, LOG_LEVEL_INF);
+
+#include "die_temp.h"
+#include "dap_vendor.h"
+#include "flash_guard.h"
+
+#define DIE_TEMP_INPUT 4
+#define DIE_TEMP_ADC_CLK_HZ 48000000
+#define DIE_TEMP_ADC_CYCLES 96
+#define DIE_TEMP_ADC_BITS 12
+
+#define DIE_TEMP_DMA_CH CONFIG_DIE_TEMP_DMA_CHANNEL
+#define DIE_TEMP_DMA_IRQN DT_IRQ_BY_IDX(DT_NODELABEL(dma), 1, irq)
+#define DIE_TEMP_DMA_IRQ_PRIO DT_IRQ_BY_IDX(DT_NODELABEL(dma), 1, priority)
+
+#define DIE_TEMP_SAMPLES CONFIG_DIE_TEMP_SAMPLES
+/* Free-running period is (1 + DIV) ADC clocks, at least 96 */
+#define DIE_TEMP_DIV (DIE_TEMP_ADC_CLK_HZ / CONFIG_DIE_TEMP_SAMPLE_RATE - 1)
+
+/* RP2040 datasheet: 0.706 V at 27 °C, -1.721 mV/°C */
+#define DIE_TEMP_V27_UV 706000
+#define DIE_TEMP_SLOPE_UV 1721
+#define DIE_TEMP_VREF_UV (CONFIG_DIE_TEMP_VREF_MV * 1000LL)
+
+#define DIE_TEMP_FACTORY FIXED_PARTITION_ID(factory_partition)
+/* "TCAL" */
+#define DIE_TEMP_MAGIC 0x4C414354
+
+BUILD_ASSERT(DIE_TEMP_DIV >= DIE_TEMP_ADC_CYCLES - 1 && DIE_TEMP_DIV <= UINT16_MAX,
+	     "Sample rate out of the ADC divider range");
+
+/* Calibration record at the start of the factory partition */
+struct die_temp_factory {
+	uint32_t magic;
+	int32_t offset;
+	uint32_t crc;
+};
+
+static uint16_t die_temp_buf[2][DIE_TEMP_SAMPLES] __aligned(4);
+
+static struct {
+	/* Buffer the DMA channel is filling */
+	uint8_t cur;
+	int32_t offset;
+	int32_t current;
+	int32_t min;
+	int32_t max;
+	uint32_t buffers;
+} die_temp;
+
+/* Millidegrees from the sum of a buffer of samples */
+static int32_t die_temp_convert(uint32_t sum)
+{
+	int64_t uv = ((int64_t)sum * DIE_TEMP_VREF_UV) /
+		     ((int64_t)DIE_TEMP_SAMPLES << DIE_TEMP_ADC_BITS);
+
+	return 27000 - (int32_t)(((uv - DIE_TEMP_V27_UV) * 1000) /
+				 DIE_TEMP_SLOPE_UV) + die_temp.offset;
+}
+
+static void die_temp_dma_isr(const void *arg)
+{
+	const uint16_t *done = die_temp_buf[die_temp.cur];
+	uint32_t sum = 0;
+	int32_t t;
+
+	ARG_UNUSED(arg);
+
+	dma_hw->ints1 = BIT(DIE_TEMP_DMA_CH);
+
+	/* Other buffer first, the ADC FIFO covers this interrupt latency */
+	die_temp.cur ^= 1;
+	dma_channel_set_write_addr(DIE_TEMP_DMA_CH, die_temp_buf[die_temp.cur],
+				   true);
+
+	for (int i = 0; i < DIE_TEMP_SAMPLES; i++) {
+		sum += done[i];
+	}
+
+	t = die_temp_convert(sum);
+	if (die_temp.buffers == 0) {
+		die_temp.min = t;
+		die_temp.max = t;
+	}
+
+	die_temp.current = t;
+	die_temp.min = MIN(die_temp.min, t);
+	die_temp.max = MAX(die_temp.max, t);
+	die_temp.buffers++;
+}
+
+int die_temp_get(struct die_temp_stats *stats)
+{
+	unsigned int key = irq_lock();
+
+	stats->current = die_temp.current;
+	stats->min = die_temp.min;
+	stats->max = die_temp.max;
+	stats->offset = die_temp.offset;
+	stats->buffers = die_temp.buffers;
+
+	irq_unlock(key);
+
+	return stats->buffers ? 0 : -EAGAIN;
+}
+
+void die_temp_reset(void)
+{
+	unsigned int key = irq_lock();
+
+	die_temp.min = die_temp.current;
+	die_temp.max = die_temp.current;
+
+	irq_unlock(key);
+}
+
+static uint32_t die_temp_crc(const struct die_temp_factory *rec)
+{
+	return crc32_ieee((const uint8_t *)rec, offsetof(struct die_temp_factory, crc));
+}
+
+static void die_temp_load_offset(void)
+{
+	const struct flash_area *fa;
+	struct die_temp_factory rec;
+
+	if (flash_area_open(DIE_TEMP_FACTORY, &fa)) {
+		return;
+	}
+
+	if (flash_area_read(fa, 0, &rec, sizeof(rec)) == 0 &&
+	    rec.magic == DIE_TEMP_MAGIC && rec.crc == die_temp_crc(&rec)) {
+		die_temp.offset = rec.offset;
+	}
+
+	flash_area_close(fa);
+}
+
+int die_temp_set_offset(int32_t offset)
+{
+	const struct flash_area *fa;
+	struct die_temp_factory rec = {
+		.magic = DIE_TEMP_MAGIC,
+		.offset = offset,
+	};
+	unsigned int key;
+	int ret;
+
+	rec.crc = die_temp_crc(&rec);
+
+	ret = flash_area_open(DIE_TEMP_FACTORY, &fa);
+	if (ret) {
+		return ret;
+	}
+
+	/* A one-off write at calibration time, XIP stalls meanwhile */
+	flash_guard_enter();
+	ret = flash_area_erase(fa, 0, fa->fa_size);
+	if (ret == 0) {
+		ret = flash_area_write(fa, 0, &rec, sizeof(rec));
+	}
+	flash_guard_exit();
+
+	flash_area_close(fa);
+
+	if (ret == 0) {
+		/* Shift the running values along with the offset */
+		key = irq_lock();
+		die_temp.current += offset - die_temp.offset;
+		die_temp.min += offset - die_temp.offset;
+		die_temp.max += offset - die_temp.offset;
+		die_temp.offset = offset;
+		irq_unlock(key);
+	}
+
+	return ret;
+}
+
+uint32_t die_temp_execute(const uint8_t *request, uint32_t req_len,
+			  uint8_t *response, uint32_t resp_size)
+{
+	struct die_temp_stats stats;
+
+	ARG_UNUSED(request);
+
+	if (resp_size < 14) {
+		return dap_vendor_reject(response, req_len);
+	}
+
+	response[0] = DAP_VENDOR_DIE_TEMP;
+	response[1] = die_temp_get(&stats) ? DAP_VENDOR_ERROR : 0;
+	sys_put_le32(stats.current, &response[2]);
+	sys_put_le32(stats.min, &response[6]);
+	sys_put_le32(stats.max, &response[10]);
+
+	return (1 << 16) | 14;
+}
+
+static int die_temp_init(void)
+{
+	dma_channel_config cfg = dma_channel_get_default_config(DIE_TEMP_DMA_CH);
+
+	die_temp_load_offset();
+
+	adc_init();
+	adc_set_temp_sensor_enabled(true);
+	adc_select_input(DIE_TEMP_INPUT);
+	/* DREQ on every sample, 12-bit results without error flag */
+	adc_fifo_setup(true, true, 1, false, false);
+	adc_hw->div = DIE_TEMP_DIV << ADC_DIV_INT_LSB;
+
+	channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
+	channel_config_set_read_increment(&cfg, false);
+	channel_config_set_write_increment(&cfg, true);
+	channel_config_set_dreq(&cfg, DREQ_ADC);
+	dma_channel_configure(DIE_TEMP_DMA_CH, &cfg, die_temp_buf[0],
+			      &adc_hw->fifo, DIE_TEMP_SAMPLES, true);
+
+	IRQ_CONNECT(DIE_TEMP_DMA_IRQN, DIE_TEMP_DMA_IRQ_PRIO,
+		    die_temp_dma_isr, NULL, 0);
+	dma_channel_set_irq1_enabled(DIE_TEMP_DMA_CH, true);
+	irq_enable(DIE_TEMP_DMA_IRQN);
+
+	adc_run(true);
+
+	return 0;
+}
+
+SYS_INIT(die_temp_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+/* Shell commands */
+
+static void die_temp_print(const struct shell *sh, const char *name, int32_t m)
+{
+	shell_print(sh, "  %-8s %s%d.%03d C", name, m < 0 ? "-" : "",
+		    abs(m) / 1000, abs(m) % 1000);
+}
+
+static int cmd_temp_show(const struct shell *sh, size_t argc, char **argv)
+{
+	struct die_temp_stats stats;
+
+	if (die_temp_get(&stats)) {
+		shell_print(sh, "No sample yet");
+		return 0;
+	}
+
+	shell_print(sh, "Die temperature, %u samples at %u Hz per value:",
+		    DIE_TEMP_SAMPLES, CONFIG_DIE_TEMP_SAMPLE_RATE);
+	die_temp_print(sh, "current", stats.current);
+	die_temp_print(sh, "min", stats.min);
+	die_temp_print(sh, "max", stats.max);
+	die_temp_print(sh, "offset", stats.offset);
+	shell_print(sh, "  buffers  %u", stats.buffers);
+
+	return 0;
+}
+
+static int cmd_temp_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	die_temp_reset();
+	shell_print(sh, "Min and max reset");
+
+	return 0;
+}
+
+static int cmd_temp_cal(const struct shell *sh, size_t argc, char **argv)
+{
+	struct die_temp_stats stats;
+	int32_t offset;
+	int ret;
+
+	if (argc < 2) {
+		die_temp_get(&stats);
+		die_temp_print(sh, "offset", stats.offset);
+		return 0;
+	}
+
+	offset = strtol(argv[1], NULL, 0);
+	ret = die_temp_set_offset(offset);
+	if (ret) {
+		shell_error(sh, "Failed to store the offset: %d", ret);
+		return ret;
+	}
+
+	shell_print(sh, "Offset stored");
+
+	return 0;
+}
+
+static int cmd_temp_cal_ref(const struct shell *sh, size_t argc, char **argv)
+{
+	struct die_temp_stats stats;
+	int32_t ref = strtol(argv[1], NULL, 0);
+	int ret;
+
+	if (die_temp_get(&stats)) {
+		shell_error(sh, "No sample yet");
+		return -EAGAIN;
+	}
+
+	/* Offset that makes the current reading match the reference */
+	ret = die_temp_set_offset(ref - (stats.current - stats.offset));
+	if (ret) {
+		shell_error(sh, "Failed to store the offset: %d", ret);
+		return ret;
+	}
+
+	return cmd_temp_cal(sh, 1, argv);
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_temp_cal,
+	SHELL_CMD_ARG(ref, NULL, "Calibrate against a reference: <mdegC>",
+		      cmd_temp_cal_ref, 2, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_temp,
+	SHELL_CMD(show, NULL, "Show current, min and max die temperature",
+		  cmd_temp_show),
+	SHELL_CMD(reset, NULL, "Restart min and max", cmd_temp_reset),
+	SHELL_CMD_ARG(cal, &sub_temp_cal,
+		      "Show or store the calibration offset: [mdegC]",
+		      cmd_temp_cal, 1, 1),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(temp, &sub_temp, "Die temperature telemetry", cmd_temp_show);
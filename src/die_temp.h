@@ -0,0 +1,60 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Die temperature telemetry
+ */
+
+#ifndef DIE_TEMP_H
+#define DIE_TEMP_H
+
+#include <stdint.h>
+
+/* Temperatures in millidegrees Celsius, calibration applied */
+struct die_temp_stats {
+	/* Average of the last buffer */
+	int32_t current;
+	/* Extremes since boot or die_temp_reset() */
+	int32_t min;
+	int32_t max;
+	/* Per-device calibration offset */
+	int32_t offset;
+	/* Buffers averaged since boot */
+	uint32_t buffers;
+};
+
+/**
+ * Get a snapshot of the temperatures.
+ *
+ * @param stats Destination
+ * @return 0 on success, -EAGAIN before the first buffer is averaged
+ */
+int die_temp_get(struct die_temp_stats *stats);
+
+/**
+ * Restart min and max from the current temperature.
+ */
+void die_temp_reset(void);
+
+/**
+ * Set the calibration offset and store it in the factory partition.
+ *
+ * @param offset Offset in millidegrees, added to the computed value
+ * @return 0 on success, negative errno from the flash driver otherwise
+ */
+int die_temp_set_offset(int32_t offset);
+
+/**
+ * Run the DAP_VENDOR_DIE_TEMP vendor command.
+ *
+ * @param request Command
+ * @param req_len Request bytes left, from the command ID on
+ * @param response Response buffer
+ * @param resp_size Response bytes left, at least 1
+ * @return Request length in the upper 16 bits, response length in the
+ *         lower 16 bits, as dap_execute_cmd()
+ */
+uint32_t die_temp_execute(const uint8_t *request, uint32_t req_len,
+			  uint8_t *response, uint32_t resp_size);
+
+#endif /* DIE_TEMP_H */
@@ -0,0 +1,140 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Flash sections with the other cores parked in RAM
+ *
+ * A flash program or erase, and the BOOTSEL read through QSPI_SS, take
+ * the flash out of XIP mode. irq_lock() only holds the calling core: on
+ * SMP the other core would go on fetching code from flash and fault. For
+ * the length of such a section, each other core runs a parker thread of
+ * the highest priority, pinned to it, which masks its interrupts and
+ * spins in RAM until the section ends.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/sys/barrier.h>
+
+#include "flash_guard.h"
+
+BUILD_ASSERT(IS_ENABLED(CONFIG_SCHED_CPU_MASK),
+	     "parker threads are pinned to their core");
+
+#define FLASH_GUARD_PARKERS	(CONFIG_MP_MAX_NUM_CPUS - 1)
+#define FLASH_GUARD_STACK_SIZE	512
+
+struct flash_guard_parker {
+	struct k_thread thread;
+	struct k_sem wake;
+	/* Spinning in RAM, interrupts masked */
+	volatile bool parked;
+};
+
+static struct flash_guard_parker parkers[FLASH_GUARD_PARKERS];
+static K_THREAD_STACK_ARRAY_DEFINE(parker_stacks, FLASH_GUARD_PARKERS,
+				   FLASH_GUARD_STACK_SIZE);
+
+static K_MUTEX_DEFINE(flash_guard_lock);
+static volatile bool flash_guard_hold;
+
+/* Nothing here may come from flash: inline code and RAM data only */
+static void __ramfunc flash_guard_spin(struct flash_guard_parker *p)
+{
+	unsigned int key = irq_lock();
+
+	p->parked = true;
+	barrier_dmem_fence_full();
+
+	while (flash_guard_hold) {
+	}
+
+	p->parked = false;
+	barrier_dmem_fence_full();
+	irq_unlock(key);
+}
+
+static void flash_guard_parker(void *p1, void *p2, void *p3)
+{
+	struct flash_guard_parker *p = p1;
+
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	for (;;) {
+		k_sem_take(&p->wake, K_FOREVER);
+		flash_guard_spin(p);
+	}
+}
+
+void flash_guard_enter(void)
+{
+	unsigned int key;
+	int self;
+	int cpu = 0;
+
+	k_mutex_lock(&flash_guard_lock, K_FOREVER);
+
+	key = irq_lock();
+	self = arch_curr_cpu()->id;
+	irq_unlock(key);
+
+	flash_guard_hold = true;
+	barrier_dmem_fence_full();
+
+	for (int i = 0; i < FLASH_GUARD_PARKERS; i++, cpu++) {
+		struct flash_guard_parker *p = &parkers[i];
+
+		if (cpu == self) {
+			cpu++;
+		}
+
+		/* Only a pending thread can be pinned */
+		while (k_thread_cpu_pin(&p->thread, cpu) != 0) {
+			k_yield();
+		}
+		k_sem_give(&p->wake);
+	}
+
+	/*
+	 * Yield meanwhile: if this thread moved to a core being parked, its
+	 * parker takes over and the thread goes on on the free core.
+	 */
+	for (int i = 0; i < FLASH_GUARD_PARKERS; i++) {
+		while (!parkers[i].parked) {
+			k_yield();
+		}
+	}
+}
+
+void flash_guard_exit(void)
+{
+	flash_guard_hold = false;
+	barrier_dmem_fence_full();
+
+	for (int i = 0; i < FLASH_GUARD_PARKERS; i++) {
+		while (parkers[i].parked) {
+		}
+	}
+
+	k_mutex_unlock(&flash_guard_lock);
+}
+
+static int flash_guard_init(void)
+{
+	for (int i = 0; i < FLASH_GUARD_PARKERS; i++) {
+		struct flash_guard_parker *p = &parkers[i];
+
+		k_sem_init(&p->wake, 0, 1);
+		k_thread_create(&p->thread, parker_stacks[i],
+				K_THREAD_STACK_SIZEOF(parker_stacks[i]),
+				flash_guard_parker, p, NULL, NULL,
+				K_HIGHEST_THREAD_PRIO, 0, K_FOREVER);
+		k_thread_name_set(&p->thread, "flash_guard");
+		k_thread_start(&p->thread);
+	}
+
+	return 0;
+}
+
+SYS_INIT(flash_guard_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,38 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Flash sections with the other cores parked in RAM
+ */
+
+#ifndef FLASH_GUARD_H
+#define FLASH_GUARD_H
+
+#if defined(CONFIG_SMP)
+
+/**
+ * Park every other core in RAM, interrupts masked, before taking the
+ * flash out of XIP mode (program, erase, QSPI_SS override). Thread
+ * context only, sections are serialized.
+ */
+void flash_guard_enter(void);
+
+/**
+ * Release the other cores, once the flash is back in XIP mode.
+ */
+void flash_guard_exit(void);
+
+#else
+
+/* A single core: irq_lock() in the flash driver is enough */
+static inline void flash_guard_enter(void)
+{
+}
+
+static inline void flash_guard_exit(void)
+{
+}
+
+#endif /* CONFIG_SMP */
+
+#endif /* FLASH_GUARD_H */
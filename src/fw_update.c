@@ -0,0 +1,376 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Firmware update over mcumgr, with MCUboot
+ *
+ * The mcumgr image group receives the new image on its own CDC ACM and
+ * streams it into the second slot: each SMP packet carries one chunk,
+ * the image manager buffers a flash sector and erases ahead of the
+ * writes, so no separate erase pass stalls the start of the upload.
+ * Reception goes on in the CDC ACM interrupt while the SMP work queue
+ * writes the previous chunk; the flash program itself masks interrupts
+ * on the RP2040, so the host is NAKed for its duration.
+ *
+ * This module hooks into the upload:
+ *
+ * - the SHA-256 sent by the host with the first chunk is checked as the
+ *   chunks arrive, and the last chunk is refused on a mismatch, instead
+ *   of reading the slot back in a second pass;
+ * - the upload rate, chunk sizes and time spent in flash writes are
+ *   measured, to tune the chunk size (the SMP MTU of the host tool).
+ *
+ * An image confirms itself once the host has configured its USB device,
+ * the path new images come through. MCUboot reverts to the previous one
+ * if a test boot resets before that.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/reboot.h>
+#include <zephyr/dfu/mcuboot.h>
+#include <zephyr/mgmt/mcumgr/mgmt/callbacks.h>
+#include <zephyr/mgmt/mcumgr/grp/img_mgmt/img_mgmt.h>
+#include <zephyr/mgmt/mcumgr/grp/img_mgmt/img_mgmt_callbacks.h>
+#include <psa/crypto.h>
+#include <string.h>
+#include <hardware/structs/timer.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(fw_update, LOG_LEVEL_INF);
+
+#include "fw_update.h"
+#include "dap_vendor.h"
+
+#define FW_UPDATE_SHA_LEN 32
+
+/* Leave time for the answer to reach the host */
+#define FW_UPDATE_REBOOT_DELAY K_MSEC(100)
+
+static const char *const fw_update_state_name[] = {
+	[FW_UPDATE_IDLE] = "idle",
+	[FW_UPDATE_RECEIVING] = "receiving",
+	[FW_UPDATE_VERIFIED] = "complete, hash verified",
+	[FW_UPDATE_UNVERIFIED] = "complete, not verified",
+	[FW_UPDATE_FAILED] = "failed",
+};
+
+static struct {
+	struct fw_update_stats stats;
+
+	/* Incremental hash of the chunks received in order */
+	psa_hash_operation_t hash;
+	uint8_t sha[FW_UPDATE_SHA_LEN];
+	bool check;
+	bool verified;
+
+	/* Timer at the first chunk, and at the start of the current one */
+	uint32_t start;
+	uint32_t chunk_start;
+} fw_update;
+
+/* Serializes the SMP work queue with the shell and the DAP queue */
+static struct k_spinlock fw_update_lock;
+
+static void fw_update_reboot(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	sys_reboot(SYS_REBOOT_WARM);
+}
+
+static K_WORK_DELAYABLE_DEFINE(fw_update_reboot_work, fw_update_reboot);
+
+/* First chunk: start the hash and the measures */
+static void fw_update_start(const struct img_mgmt_upload_req *req,
+			    const struct img_mgmt_upload_action *action)
+{
+	psa_hash_abort(&fw_update.hash);
+	fw_update.hash = psa_hash_operation_init();
+
+	/* Without the SHA of the whole image, MCUboot still checks it */
+	fw_update.check = req->data_sha.len == FW_UPDATE_SHA_LEN &&
+			  psa_hash_setup(&fw_update.hash, PSA_ALG_SHA_256) ==
+			  PSA_SUCCESS;
+	if (fw_update.check) {
+		memcpy(fw_update.sha, req->data_sha.value, FW_UPDATE_SHA_LEN);
+	}
+	fw_update.verified = false;
+
+	K_SPINLOCK(&fw_update_lock) {
+		memset(&fw_update.stats, 0, sizeof(fw_update.stats));
+		fw_update.stats.state = FW_UPDATE_RECEIVING;
+		fw_update.stats.size = action->size;
+	}
+
+	fw_update.start = timer_hw->timerawl;
+}
+
+/* Hash a chunk before it is written, refuse the last one on a mismatch */
+static enum mgmt_cb_return fw_update_chunk(const struct img_mgmt_upload_check *up,
+					   int32_t *rc, uint16_t *group)
+{
+	const struct img_mgmt_upload_req *req = up->req;
+	const uint8_t *data = req->img_data.value;
+	size_t len = req->img_data.len;
+	bool last = req->off + len == up->action->size;
+
+	if (req->off == 0) {
+		fw_update_start(req, up->action);
+	}
+
+	fw_update.chunk_start = timer_hw->timerawl;
+
+	/* A resumed or repeated chunk leaves a hole in the hash */
+	if (fw_update.check && req->off != fw_update.stats.received) {
+		psa_hash_abort(&fw_update.hash);
+		fw_update.check = false;
+	}
+
+	if (fw_update.check &&
+	    psa_hash_update(&fw_update.hash, data, len) != PSA_SUCCESS) {
+		psa_hash_abort(&fw_update.hash);
+		fw_update.check = false;
+	}
+
+	if (fw_update.check && last) {
+		fw_update.check = false;
+		fw_update.verified =
+			psa_hash_verify(&fw_update.hash, fw_update.sha,
+					FW_UPDATE_SHA_LEN) == PSA_SUCCESS;
+		if (!fw_update.verified) {
+			psa_hash_abort(&fw_update.hash);
+			LOG_ERR("Image hash mismatch, upload refused");
+			K_SPINLOCK(&fw_update_lock) {
+				fw_update.stats.state = FW_UPDATE_FAILED;
+			}
+			*rc = IMG_MGMT_ERR_INVALID_HASH;
+			*group = MGMT_GROUP_ID_IMAGE;
+			return MGMT_CB_ERROR_ERR;
+		}
+	}
+
+	K_SPINLOCK(&fw_update_lock) {
+		fw_update.stats.received = req->off + len;
+		fw_update.stats.chunks++;
+		fw_update.stats.chunk_last = len;
+		fw_update.stats.chunk_max = MAX(fw_update.stats.chunk_max, len);
+	}
+
+	return MGMT_CB_OK;
+}
+
+/* The chunk is in flash, or in the sector buffer */
+static void fw_update_written(void)
+{
+	uint32_t now = timer_hw->timerawl;
+	uint32_t write_us = now - fw_update.chunk_start;
+	uint32_t elapsed_us = now - fw_update.start;
+
+	K_SPINLOCK(&fw_update_lock) {
+		struct fw_update_stats *stats = &fw_update.stats;
+
+		stats->write_us += write_us;
+		stats->write_max_us = MAX(stats->write_max_us, write_us);
+		stats->elapsed_us = elapsed_us;
+		if (elapsed_us != 0) {
+			stats->rate = (uint64_t)stats->received * USEC_PER_SEC /
+				      elapsed_us;
+		}
+	}
+}
+
+static enum mgmt_cb_return fw_update_event(uint32_t event,
+					   enum mgmt_cb_return prev_status,
+					   int32_t *rc, uint16_t *group,
+					   bool *abort_more, void *data,
+					   size_t data_size)
+{
+	ARG_UNUSED(prev_status);
+	ARG_UNUSED(abort_more);
+	ARG_UNUSED(data_size);
+
+	switch (event) {
+	case MGMT_EVT_OP_IMG_MGMT_DFU_CHUNK:
+		return fw_update_chunk(data, rc, group);
+	case MGMT_EVT_OP_IMG_MGMT_DFU_CHUNK_WRITE_COMPLETE:
+		fw_update_written();
+		break;
+	case MGMT_EVT_OP_IMG_MGMT_DFU_PENDING:
+		K_SPINLOCK(&fw_update_lock) {
+			fw_update.stats.state = fw_update.verified ?
+						FW_UPDATE_VERIFIED :
+						FW_UPDATE_UNVERIFIED;
+		}
+		LOG_INF("Image received: %u bytes at %u B/s",
+			fw_update.stats.received, fw_update.stats.rate);
+		break;
+	case MGMT_EVT_OP_IMG_MGMT_DFU_STOPPED:
+		K_SPINLOCK(&fw_update_lock) {
+			fw_update.stats.state = FW_UPDATE_FAILED;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return MGMT_CB_OK;
+}
+
+static struct mgmt_callback fw_update_callback = {
+	.callback = fw_update_event,
+	.event_id = MGMT_EVT_OP_IMG_MGMT_ALL,
+};
+
+void fw_update_get_stats(struct fw_update_stats *stats)
+{
+	K_SPINLOCK(&fw_update_lock) {
+		*stats = fw_update.stats;
+	}
+}
+
+int fw_update_boot(void)
+{
+	enum fw_update_state state;
+	int ret;
+
+	K_SPINLOCK(&fw_update_lock) {
+		state = fw_update.stats.state;
+	}
+
+	if (state != FW_UPDATE_VERIFIED && state != FW_UPDATE_UNVERIFIED) {
+		return -ENOENT;
+	}
+
+	ret = boot_request_upgrade(BOOT_UPGRADE_TEST);
+	if (ret) {
+		return ret;
+	}
+
+	k_work_schedule(&fw_update_reboot_work, FW_UPDATE_REBOOT_DELAY);
+
+	return 0;
+}
+
+uint32_t fw_update_execute(const uint8_t *request, uint32_t req_len,
+			   uint8_t *response, uint32_t resp_size)
+{
+	struct fw_update_stats stats;
+	int ret = 0;
+
+	if (req_len < 2 || resp_size < 27) {
+		return dap_vendor_reject(response, req_len);
+	}
+
+	if (request[1] == DAP_VENDOR_FW_UPDATE_BOOT) {
+		ret = fw_update_boot();
+	}
+
+	fw_update_get_stats(&stats);
+
+	response[0] = DAP_VENDOR_FW_UPDATE;
+	response[1] = ret ? DAP_VENDOR_ERROR : 0;
+	response[2] = stats.state;
+	sys_put_le32(stats.size, &response[3]);
+	sys_put_le32(stats.received, &response[7]);
+	sys_put_le32(stats.elapsed_us, &response[11]);
+	sys_put_le32(stats.rate, &response[15]);
+	sys_put_le32(stats.chunk_max, &response[19]);
+	sys_put_le32(stats.write_us, &response[23]);
+
+	return (2 << 16) | 27;
+}
+
+/* Flash write, out of the USB stack thread */
+static void fw_update_confirm(struct k_work *work)
+{
+	int ret;
+
+	ARG_UNUSED(work);
+
+	if (boot_is_img_confirmed()) {
+		return;
+	}
+
+	ret = boot_write_img_confirmed();
+	if (ret) {
+		LOG_ERR("Failed to confirm the image: %d", ret);
+		return;
+	}
+
+	LOG_INF("New image confirmed");
+}
+
+static K_WORK_DEFINE(fw_update_confirm_work, fw_update_confirm);
+
+void fw_update_usb_configured(void)
+{
+	k_work_submit(&fw_update_confirm_work);
+}
+
+int fw_update_init(void)
+{
+	if (psa_crypto_init() != PSA_SUCCESS) {
+		return -EIO;
+	}
+
+	mgmt_callback_register(&fw_update_callback);
+
+	return 0;
+}
+
+/* Shell commands */
+
+static int cmd_fwup_status(const struct shell *sh, size_t argc, char **argv)
+{
+	struct fw_update_stats stats;
+
+	fw_update_get_stats(&stats);
+
+	shell_print(sh, "Running image: %s",
+		    boot_is_img_confirmed() ? "confirmed" : "on test");
+	shell_print(sh, "Upload: %s", fw_update_state_name[stats.state]);
+	if (stats.state == FW_UPDATE_IDLE) {
+		return 0;
+	}
+
+	shell_print(sh, "  received: %u of %u bytes in %u chunks",
+		    stats.received, stats.size, stats.chunks);
+	shell_print(sh, "  chunk:    last %u bytes, max %u bytes",
+		    stats.chunk_last, stats.chunk_max);
+	shell_print(sh, "  time:     %u ms, %u B/s",
+		    stats.elapsed_us / USEC_PER_MSEC, stats.rate);
+	shell_print(sh, "  writes:   %u ms in total, max %u us per chunk",
+		    stats.write_us / USEC_PER_MSEC, stats.write_max_us);
+
+	return 0;
+}
+
+static int cmd_fwup_boot(const struct shell *sh, size_t argc, char **argv)
+{
+	int ret = fw_update_boot();
+
+	if (ret == -ENOENT) {
+		shell_error(sh, "No complete upload");
+		return ret;
+	}
+	if (ret) {
+		shell_error(sh, "Failed to request the upgrade: %d", ret);
+		return ret;
+	}
+
+	shell_print(sh, "Rebooting into the new image...");
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_fwup,
+	SHELL_CMD(status, NULL, "Show the running image and the last upload",
+		  cmd_fwup_status),
+	SHELL_CMD(boot, NULL, "Test boot the uploaded image", cmd_fwup_boot),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(fwup, &sub_fwup, "Firmware update over mcumgr",
+		   cmd_fwup_status);
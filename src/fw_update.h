@@ -0,0 +1,89 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Firmware update over mcumgr, with MCUboot
+ */
+
+#ifndef FW_UPDATE_H
+#define FW_UPDATE_H
+
+#include <stdint.h>
+
+enum fw_update_state {
+	/* No upload since boot */
+	FW_UPDATE_IDLE,
+	/* Upload in progress */
+	FW_UPDATE_RECEIVING,
+	/* Complete, the hash sent by the host matched */
+	FW_UPDATE_VERIFIED,
+	/* Complete, no hash sent or the upload was resumed */
+	FW_UPDATE_UNVERIFIED,
+	/* Aborted, or the hash did not match */
+	FW_UPDATE_FAILED,
+};
+
+/* Last or current upload */
+struct fw_update_stats {
+	enum fw_update_state state;
+	/* Image size announced by the host, and bytes received */
+	uint32_t size;
+	uint32_t received;
+	/* From the first chunk to the last write, in us */
+	uint32_t elapsed_us;
+	/* received / elapsed, in bytes per second */
+	uint32_t rate;
+	/* Chunks and their size, set by the host */
+	uint32_t chunks;
+	uint32_t chunk_last;
+	uint32_t chunk_max;
+	/* Time spent writing chunks to flash, when USB is stalled, in us */
+	uint32_t write_us;
+	uint32_t write_max_us;
+};
+
+/**
+ * Follow the uploads made through mcumgr.
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+int fw_update_init(void);
+
+/**
+ * Confirm the running image, so MCUboot keeps it, once the host has
+ * configured the USB device. The flash write is deferred to the system
+ * work queue.
+ */
+void fw_update_usb_configured(void);
+
+/**
+ * Get the statistics of the last or current upload.
+ *
+ * @param stats Destination
+ */
+void fw_update_get_stats(struct fw_update_stats *stats);
+
+/**
+ * Mark the uploaded image for a test boot and reboot shortly after, so
+ * the caller can still answer. MCUboot swaps the slots and reverts if
+ * the new image does not confirm itself.
+ *
+ * @return 0 on success, -ENOENT if no complete upload is available,
+ *         negative errno from the boot library otherwise
+ */
+int fw_update_boot(void);
+
+/**
+ * Run the DAP_VENDOR_FW_UPDATE vendor command.
+ *
+ * @param request Command
+ * @param req_len Request bytes left, from the command ID on
+ * @param response Response buffer
+ * @param resp_size Response bytes left, at least 1
+ * @return Request length in the upper 16 bits, response length in the
+ *         lower 16 bits, as dap_execute_cmd()
+ */
+uint32_t fw_update_execute(const uint8_t *request, uint32_t req_len,
+			   uint8_t *response, uint32_t resp_size);
+
+#endif /* FW_UPDATE_H */
@@ -0,0 +1,314 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Thread health supervisor on top of the hardware watchdog
+ *
+ * Critical threads beat a heartbeat with a latency budget. The
+ * supervisor job only feeds wdt0 while every heartbeat is within its
+ * budget, so a wedged thread resets the probe even though the scheduler
+ * is still running. The supervisor itself runs from the scheduler work
+ * queue: if that one stalls, nothing feeds the watchdog either.
+ *
+ * Threads without a loop of their own are pinged: the system work queue
+ * by a work item, the shell through a work queue at the shell thread
+ * priority. Equal priority threads do not preempt each other, so a shell
+ * command that never returns stops that ping as surely as higher
+ * priority threads starving the shell.
+ *
+ * The worst gap of each heartbeat and the one that stopped the feeding
+ * are kept in a __noinit RAM section, protected by a CRC, which survives
+ * a watchdog reset. After a reset the shell shows which thread missed
+ * its deadline and by how much.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/hwinfo.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+
+#include "health.h"
+#include "watchdog.h"
+
+#define HEALTH_MAX_HB 6
+#define HEALTH_NAME_LEN 12
+#define HEALTH_MAGIC 0x48454C54 /* "HELT" */
+#define HEALTH_NONE 0xFF
+
+struct health_record {
+	char name[HEALTH_NAME_LEN];
+	uint32_t budget_ms;
+	uint32_t worst_ms;
+};
+
+/* Survives warm resets, validated by magic and CRC at boot */
+struct health_retained {
+	uint32_t magic;
+	uint32_t boots;
+	struct health_record hb[HEALTH_MAX_HB];
+	/* Heartbeat that stopped the watchdog feeding, and its gap */
+	uint8_t culprit;
+	uint32_t culprit_gap_ms;
+	uint32_t crc;
+};
+
+static __noinit struct health_retained retained;
+
+/* Copy of the retained data as found at boot */
+static struct health_retained previous;
+static bool previous_valid;
+
+static sys_slist_t health_list = SYS_SLIST_STATIC_INIT(&health_list);
+static uint8_t health_count;
+static bool feeding_stopped;
+
+/* The system work queue has no hook, ping it from the supervisor */
+static HEALTH_HB_DEFINE(sysworkq, 1000);
+
+static void health_ping_handler(struct k_work *work)
+{
+	health_beat(&sysworkq);
+}
+
+static K_WORK_DEFINE(health_ping, health_ping_handler);
+
+#if defined(CONFIG_SHELL)
+#if defined(CONFIG_SHELL_THREAD_PRIORITY_OVERRIDE)
+#define HEALTH_SHELL_PRIO CONFIG_SHELL_THREAD_PRIORITY
+#else
+#define HEALTH_SHELL_PRIO K_LOWEST_APPLICATION_THREAD_PRIO
+#endif
+
+#define HEALTH_SHELL_STACK_SIZE 512
+
+static HEALTH_HB_DEFINE(shell, CONFIG_HEALTH_SHELL_BUDGET_MS);
+static K_THREAD_STACK_DEFINE(health_shell_stack, HEALTH_SHELL_STACK_SIZE);
+static struct k_work_q health_shell_q;
+
+static void health_shell_ping_handler(struct k_work *work)
+{
+	health_beat(&shell);
+}
+
+static K_WORK_DEFINE(health_shell_ping, health_shell_ping_handler);
+#endif /* CONFIG_SHELL */
+
+static uint32_t health_crc(const struct health_retained *r)
+{
+	return crc32_ieee((const uint8_t *)r, offsetof(struct health_retained, crc));
+}
+
+static void health_commit(void)
+{
+	retained.crc = health_crc(&retained);
+}
+
+static bool health_valid(const struct health_retained *r)
+{
+	return r->magic == HEALTH_MAGIC && r->crc == health_crc(r);
+}
+
+int health_register(struct health_hb *hb)
+{
+	struct health_record *rec;
+
+	if (health_count >= HEALTH_MAX_HB) {
+		return -ENOMEM;
+	}
+
+	hb->slot = health_count++;
+	hb->worst_ms = 0;
+	health_beat(hb);
+
+	/* Keep the worst gap seen before the reset for the same thread */
+	rec = &retained.hb[hb->slot];
+	if (strncmp(rec->name, hb->name, sizeof(rec->name)) != 0) {
+		memset(rec, 0, sizeof(*rec));
+		strncpy(rec->name, hb->name, sizeof(rec->name) - 1);
+	}
+	rec->budget_ms = hb->budget_ms;
+	health_commit();
+
+	sys_slist_append(&health_list, &hb->node);
+
+	return 0;
+}
+
+void health_supervise(void)
+{
+	uint32_t now = k_uptime_get_32();
+	struct health_hb *late = NULL;
+	uint32_t late_gap = 0;
+	struct health_hb *hb;
+	bool dirty = false;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&health_list, hb, node) {
+		uint32_t gap = now - hb->last_ms;
+		struct health_record *rec = &retained.hb[hb->slot];
+
+		if (hb->paused) {
+			continue;
+		}
+
+		hb->worst_ms = MAX(hb->worst_ms, gap);
+		if (gap > rec->worst_ms) {
+			rec->worst_ms = gap;
+			dirty = true;
+		}
+
+		if (gap > hb->budget_ms && late == NULL) {
+			late = hb;
+			late_gap = gap;
+		}
+	}
+
+	if (late != NULL) {
+		/* Let the watchdog fire, record who caused it */
+		if (!feeding_stopped || retained.culprit_gap_ms < late_gap) {
+			retained.culprit = late->slot;
+			retained.culprit_gap_ms = late_gap;
+			dirty = true;
+		}
+		if (!feeding_stopped) {
+			printk("%s missed its %u ms budget (%u ms), "
+			       "watchdog no longer fed\n",
+			       late->name, late->budget_ms, late_gap);
+		}
+		feeding_stopped = true;
+	} else if (IS_ENABLED(CONFIG_HEALTH_WATCHDOG)) {
+		watchdog_feed();
+	}
+
+	if (dirty) {
+		health_commit();
+	}
+
+	k_work_submit(&health_ping);
+#if defined(CONFIG_SHELL)
+	k_work_submit_to_queue(&health_shell_q, &health_shell_ping);
+#endif
+}
+
+void health_get_status(struct health_status *status)
+{
+	status->fed = !feeding_stopped;
+	status->boots = retained.boots;
+	status->last_culprit_gap_ms =
+		(previous_valid && previous.culprit < HEALTH_MAX_HB) ?
+		previous.culprit_gap_ms : 0;
+}
+
+static int health_init(void)
+{
+	previous = retained;
+	previous_valid = health_valid(&previous);
+
+	if (!previous_valid) {
+		memset(&retained, 0, sizeof(retained));
+		retained.magic = HEALTH_MAGIC;
+	}
+
+	retained.boots++;
+	retained.culprit = HEALTH_NONE;
+	retained.culprit_gap_ms = 0;
+	health_commit();
+
+#if defined(CONFIG_SHELL)
+	k_work_queue_start(&health_shell_q, health_shell_stack,
+			   K_THREAD_STACK_SIZEOF(health_shell_stack),
+			   HEALTH_SHELL_PRIO,
+			   &(struct k_work_queue_config){ .name = "health_shell" });
+	health_register(&shell);
+#endif
+
+	return health_register(&sysworkq);
+}
+
+SYS_INIT(health_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+/* Shell commands */
+
+static int cmd_health_show(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t now = k_uptime_get_32();
+	struct health_hb *hb;
+
+	shell_print(sh, "Watchdog: %s", feeding_stopped ? "NOT FED" : "fed");
+	shell_print(sh, "%-12s %8s %8s %8s %12s", "Thread", "Budget", "Gap",
+		    "Worst", "Worst ever");
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&health_list, hb, node) {
+		shell_print(sh, "%-12s %6ums %6ums %6ums %10ums%s",
+			    hb->name, hb->budget_ms, now - hb->last_ms,
+			    hb->worst_ms, retained.hb[hb->slot].worst_ms,
+			    hb->paused ? " (paused)" : "");
+	}
+
+	return 0;
+}
+
+static int cmd_health_last(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t cause = 0;
+
+	if (hwinfo_get_reset_cause(&cause) == 0) {
+		shell_print(sh, "Reset cause: 0x%08x%s", cause,
+			    (cause & RESET_WATCHDOG) ? " (watchdog)" : "");
+	}
+
+	if (!previous_valid) {
+		shell_print(sh, "No retained health record (cold boot)");
+		return 0;
+	}
+
+	shell_print(sh, "Boot #%u", retained.boots);
+
+	if (previous.culprit < HEALTH_MAX_HB) {
+		const struct health_record *rec = &previous.hb[previous.culprit];
+
+		shell_print(sh, "Before reset: %s missed its %u ms budget by %u ms",
+			    rec->name, rec->budget_ms,
+			    previous.culprit_gap_ms - rec->budget_ms);
+	} else {
+		shell_print(sh, "Before reset: all heartbeats within budget");
+	}
+
+	for (int i = 0; i < HEALTH_MAX_HB; i++) {
+		const struct health_record *rec = &previous.hb[i];
+
+		if (rec->name[0] != '\0') {
+			shell_print(sh, "  %-12s budget %6u ms, worst %6u ms",
+				    rec->name, rec->budget_ms, rec->worst_ms);
+		}
+	}
+
+	return 0;
+}
+
+static int cmd_health_clear(const struct shell *sh, size_t argc, char **argv)
+{
+	struct health_hb *hb;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&health_list, hb, node) {
+		hb->worst_ms = 0;
+		retained.hb[hb->slot].worst_ms = 0;
+	}
+	health_commit();
+
+	shell_print(sh, "Worst gaps cleared");
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_health,
+	SHELL_CMD(show, NULL, "Show heartbeat gaps and budgets", cmd_health_show),
+	SHELL_CMD(last, NULL, "Show the retained record of the previous boot",
+		  cmd_health_last),
+	SHELL_CMD(clear, NULL, "Clear worst gaps, also the retained ones",
+		  cmd_health_clear),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(health, &sub_health, "Thread health supervisor",
+		   cmd_health_show);
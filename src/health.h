@@ -0,0 +1,99 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Thread health supervisor on top of the hardware watchdog
+ */
+
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/slist.h>
+
+/* Heartbeat of a supervised thread, statically allocated by its owner */
+struct health_hb {
+	/* Name shown by the health shell command, also kept across resets */
+	const char *name;
+	/* Maximum time allowed between two beats */
+	uint32_t budget_ms;
+
+	/* Private, managed by the supervisor */
+	sys_snode_t node;
+	volatile bool paused;
+	volatile uint32_t last_ms;
+	uint32_t worst_ms;
+	uint8_t slot;
+};
+
+/* Supervisor state */
+struct health_status {
+	/* The watchdog is still fed */
+	bool fed;
+	/* Boots counted in the retained record */
+	uint32_t boots;
+	/* Gap that stopped the feeding before the last reset, or 0 */
+	uint32_t last_culprit_gap_ms;
+};
+
+/**
+ * Define a heartbeat.
+ *
+ * @param _name Variable name, also used as the heartbeat name
+ * @param _budget_ms Maximum gap between two beats in milliseconds
+ */
+#define HEALTH_HB_DEFINE(_name, _budget_ms)				\
+	struct health_hb _name = {					\
+		.name = #_name,						\
+		.budget_ms = _budget_ms,				\
+	}
+
+/**
+ * Register a heartbeat. The supervisor stops feeding the watchdog as soon
+ * as one registered heartbeat is older than its budget.
+ *
+ * @param hb Heartbeat to supervise
+ * @return 0 on success, -ENOMEM if all retained slots are used
+ */
+int health_register(struct health_hb *hb);
+
+/**
+ * Signal that the owner thread is alive. A single word store.
+ *
+ * @param hb Heartbeat
+ */
+static inline void health_beat(struct health_hb *hb)
+{
+	hb->last_ms = k_uptime_get_32();
+}
+
+/**
+ * Stop or restart the supervision of a heartbeat, while its thread waits
+ * for an event that may legitimately never come (USB suspended...).
+ * Restarting counts as a beat.
+ *
+ * @param hb Heartbeat
+ * @param paused true to stop the supervision
+ */
+static inline void health_pause(struct health_hb *hb, bool paused)
+{
+	health_beat(hb);
+	hb->paused = paused;
+}
+
+/**
+ * Check all heartbeats and feed the watchdog if they are within budget.
+ * Run periodically from a scheduler job.
+ */
+void health_supervise(void);
+
+/**
+ * Get the supervisor state, without locking.
+ *
+ * @param status Destination
+ */
+void health_get_status(struct health_status *status);
+
+#endif /* HEALTH_H */
@@ -0,0 +1,278 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Interrupt latency profiler
+ *
+ * Two measurements, both against the 1 MHz RP2040 timer:
+ *
+ * - Handler time of every IRQ, from the tracing user hooks called by the
+ *   Zephyr interrupt wrapper on entry and exit. It shows which IRQs keep
+ *   the CPU (USB controller, PIO, UART...).
+ *
+ * - Entry latency, from a probe on a spare timer alarm: the alarm is
+ *   armed for a known time and its handler reads how late it runs. The
+ *   difference is what any IRQ waits at that priority, time spent with
+ *   interrupts masked or in higher priority handlers included.
+ *
+ * Each measurement keeps count, min, average, max and a log2 histogram.
+ *
+ * The nesting level given to the hooks is not maintained on Cortex-M,
+ * where the hardware nests interrupts by itself, so the profiler keeps
+ * its own depth per CPU: the entry hook pushes the entry time, the exit
+ * hook pops it.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/irq.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/tracing/tracing.h>
+#include <cmsis_core.h>
+#include <hardware/resets.h>
+#include <hardware/structs/timer.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "irq_prof.h"
+
+#define IRQ_PROF_NUM_IRQS CONFIG_NUM_IRQS
+/* Bucket n counts values in [2^(n-1), 2^n) us, bucket 0 counts 0 us */
+#define IRQ_PROF_BUCKETS 10
+/* Nesting levels, one per Cortex-M0+ priority */
+#define IRQ_PROF_NESTING 4
+
+/* Latency probe on TIMER alarm 3, TIMER_IRQ_n is IRQ n on RP2040 */
+#define PROBE_ALARM 3
+#define PROBE_IRQN PROBE_ALARM
+
+struct irq_prof_stats {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t hist[IRQ_PROF_BUCKETS];
+};
+
+static struct irq_prof_stats irq_stats[IRQ_PROF_NUM_IRQS];
+static struct irq_prof_stats probe_stats;
+static struct irq_prof_stats masked_stats;
+
+/* Entry time per nesting level, and current level, per CPU */
+static uint32_t irq_entry[CONFIG_MP_MAX_NUM_CPUS][IRQ_PROF_NESTING];
+static uint8_t irq_depth[CONFIG_MP_MAX_NUM_CPUS];
+static uint32_t probe_target;
+static bool probe_running;
+
+static inline uint32_t irq_prof_now(void)
+{
+	return timer_hw->timerawl;
+}
+
+static void irq_prof_add(struct irq_prof_stats *st, uint32_t us)
+{
+	uint32_t bucket = (us == 0) ? 0 : MIN(32 - __builtin_clz(us),
+					      IRQ_PROF_BUCKETS - 1);
+
+	if (st->count == 0 || us < st->min) {
+		st->min = us;
+	}
+	st->max = MAX(st->max, us);
+	st->sum += us;
+	st->count++;
+	st->hist[bucket]++;
+}
+
+void sys_trace_isr_enter_user(int nested_interrupts)
+{
+	uint8_t cpu = arch_curr_cpu()->id;
+	uint8_t level = irq_depth[cpu]++;
+
+	ARG_UNUSED(nested_interrupts);
+
+	if (level < IRQ_PROF_NESTING) {
+		irq_entry[cpu][level] = irq_prof_now();
+	}
+}
+
+void sys_trace_isr_exit_user(int nested_interrupts)
+{
+	int irq = (int)(__get_IPSR() & 0x3F) - 16;
+	uint8_t cpu = arch_curr_cpu()->id;
+	uint8_t level;
+
+	ARG_UNUSED(nested_interrupts);
+
+	/* An exit without its entry, the profiler started in a handler */
+	if (irq_depth[cpu] == 0) {
+		return;
+	}
+
+	level = --irq_depth[cpu];
+	if (level < IRQ_PROF_NESTING && irq >= 0 && irq < IRQ_PROF_NUM_IRQS) {
+		irq_prof_add(&irq_stats[irq],
+			     irq_prof_now() - irq_entry[cpu][level]);
+	}
+}
+
+void irq_prof_masked(uint32_t us)
+{
+	unsigned int key = irq_lock();
+
+	irq_prof_add(&masked_stats, us);
+	irq_unlock(key);
+}
+
+static void irq_prof_probe_arm(void)
+{
+	probe_target += CONFIG_IRQ_PROFILER_PROBE_PERIOD_US;
+
+	/* The alarm only matches the exact time, never arm it in the past */
+	if ((int32_t)(probe_target - irq_prof_now()) <= 0) {
+		probe_target = irq_prof_now() + CONFIG_IRQ_PROFILER_PROBE_PERIOD_US;
+	}
+
+	timer_hw->alarm[PROBE_ALARM] = probe_target;
+}
+
+static void irq_prof_probe_isr(const void *arg)
+{
+	uint32_t late = irq_prof_now() - probe_target;
+
+	ARG_UNUSED(arg);
+
+	timer_hw->intr = BIT(PROBE_ALARM);
+	irq_prof_add(&probe_stats, late);
+
+	if (probe_running) {
+		irq_prof_probe_arm();
+	}
+}
+
+static void irq_prof_probe_start(void)
+{
+	probe_running = true;
+	probe_target = irq_prof_now();
+	hw_set_bits(&timer_hw->inte, BIT(PROBE_ALARM));
+	irq_prof_probe_arm();
+}
+
+static void irq_prof_probe_stop(void)
+{
+	probe_running = false;
+	hw_clear_bits(&timer_hw->inte, BIT(PROBE_ALARM));
+	timer_hw->armed = BIT(PROBE_ALARM);
+}
+
+static int irq_prof_init(void)
+{
+	/* No-op if the timer is already running */
+	unreset_block_wait(RESETS_RESET_TIMER_BITS);
+
+	IRQ_CONNECT(PROBE_IRQN, CONFIG_IRQ_PROFILER_PROBE_PRIORITY,
+		    irq_prof_probe_isr, NULL, 0);
+	irq_enable(PROBE_IRQN);
+
+	irq_prof_probe_start();
+
+	return 0;
+}
+
+SYS_INIT(irq_prof_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+/* Shell commands */
+
+static void irq_prof_print(const struct shell *sh, const char *name,
+			   const struct irq_prof_stats *st)
+{
+	shell_fprintf(sh, SHELL_NORMAL, "%-10s %8u %5u %5u %5u |",
+		      name, st->count, st->min,
+		      (uint32_t)(st->sum / MAX(st->count, 1U)), st->max);
+	for (int i = 0; i < IRQ_PROF_BUCKETS; i++) {
+		shell_fprintf(sh, SHELL_NORMAL, " %u", st->hist[i]);
+	}
+	shell_fprintf(sh, SHELL_NORMAL, "\n");
+}
+
+static int cmd_irqlat_show(const struct shell *sh, size_t argc, char **argv)
+{
+	struct irq_prof_stats st;
+	unsigned int key;
+	char name[12];
+
+	shell_print(sh, "%-10s %8s %5s %5s %5s | histogram (us): "
+		    "0 1 2-3 4-7 ... >=256", "Source", "Count", "Min", "Avg", "Max");
+
+	/* Copy with interrupts masked so a line is self-consistent */
+	key = irq_lock();
+	st = probe_stats;
+	irq_unlock(key);
+	irq_prof_print(sh, "latency", &st);
+
+	key = irq_lock();
+	st = masked_stats;
+	irq_unlock(key);
+	irq_prof_print(sh, "masked", &st);
+
+	shell_print(sh, "Handler time per IRQ:");
+	for (int irq = 0; irq < IRQ_PROF_NUM_IRQS; irq++) {
+		key = irq_lock();
+		st = irq_stats[irq];
+		irq_unlock(key);
+		if (st.count == 0) {
+			continue;
+		}
+		snprintf(name, sizeof(name), "irq %d", irq);
+		irq_prof_print(sh, name, &st);
+	}
+
+	return 0;
+}
+
+static int cmd_irqlat_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	unsigned int key = irq_lock();
+
+	memset(irq_stats, 0, sizeof(irq_stats));
+	memset(&probe_stats, 0, sizeof(probe_stats));
+	memset(&masked_stats, 0, sizeof(masked_stats));
+	irq_unlock(key);
+
+	shell_print(sh, "IRQ latency counters reset");
+
+	return 0;
+}
+
+static int cmd_irqlat_probe(const struct shell *sh, size_t argc, char **argv)
+{
+	if (argc < 2) {
+		shell_print(sh, "Latency probe: %s, every %u us",
+			    probe_running ? "running" : "stopped",
+			    CONFIG_IRQ_PROFILER_PROBE_PERIOD_US);
+		return 0;
+	}
+
+	if (strcmp(argv[1], "on") == 0) {
+		if (!probe_running) {
+			irq_prof_probe_start();
+		}
+	} else if (strcmp(argv[1], "off") == 0) {
+		irq_prof_probe_stop();
+	} else {
+		shell_error(sh, "Usage: irqlat probe [on|off]");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_irqlat,
+	SHELL_CMD(show, NULL, "Show IRQ latency and handler time statistics",
+		  cmd_irqlat_show),
+	SHELL_CMD(reset, NULL, "Reset IRQ statistics", cmd_irqlat_reset),
+	SHELL_CMD(probe, NULL, "Control the latency probe: irqlat probe [on|off]",
+		  cmd_irqlat_probe),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(irqlat, &sub_irqlat, "Interrupt latency profiler",
+		   cmd_irqlat_show);
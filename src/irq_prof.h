@@ -0,0 +1,32 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Interrupt latency profiler
+ */
+
+#ifndef IRQ_PROF_H
+#define IRQ_PROF_H
+
+#include <stdint.h>
+
+#if defined(CONFIG_IRQ_PROFILER)
+
+/**
+ * Record a section run with interrupts masked.
+ * Shown next to the IRQ statistics, since it adds to their latency.
+ *
+ * @param us Masked time in microseconds
+ */
+void irq_prof_masked(uint32_t us);
+
+#else
+
+static inline void irq_prof_masked(uint32_t us)
+{
+	(void)us;
+}
+
+#endif /* CONFIG_IRQ_PROFILER */
+
+#endif /* IRQ_PROF_H */
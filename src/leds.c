@@ -3,15 +3,37 @@
  * Copyright (c) 2025 Vincent Jardin
  *
  * LED management for Debug Probe
+ *
+ * PWM LEDs are animated from gamma corrected duty cycle tables generated
+ * at build time (scripts/gen_led_waveforms.py), one sample per PWM
+ * period. The PWM wrap interrupt of each LED slice loads the next sample
+ * in the compare register, so animations run without any thread wakeup;
+ * only a pattern change goes through the CPU. Static levels do not use
+ * the interrupt at all.
+ *
+ * In activity mode the LEDs follow the data paths like the debugprobe
+ * firmware: D2/D3 for UART1 RX/TX, D4 for a DAP session (host seen in the
+ * last seconds, breathing otherwise), D5 for DAP requests running. The
+ * data paths only bump counters (activity.h), leds_activity_update()
+ * samples them and holds an LED on for a few samples after the last
+ * event.
  */
 
 #include <zephyr/kernel.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/pwm.h>
+#include <zephyr/irq.h>
 #include <zephyr/shell/shell.h>
 #include <stdlib.h>
+#include <string.h>
+#include <hardware/pwm.h>
+
+#include <led_waveforms.h>
 
 #include "leds.h"
+#include "activity.h"
+#include "perf.h"
+#include "prefs.h"
 
 /* GPIO-controlled LEDs (accent LEDs: D1, D2, D3) */
 #define NUM_GPIO_LEDS 3
@@ -30,17 +52,309 @@ static const struct pwm_dt_spec pwm_leds[NUM_PWM_LEDS] = {
 	PWM_DT_SPEC_GET(DT_ALIAS(pwm_led1)),
 };
 
-/* PWM brightness state */
-static uint32_t pwm_brightness[NUM_PWM_LEDS] = {0, 0};
-static uint32_t breathing_brightness = 0;
-static bool breathing_increasing = true;
-static bool breathing_enabled = true;
-
-#define PWM_STEP 5
 #define PWM_MAX 100
 
+/* All slices share the PWM_IRQ_WRAP line */
+#define PWM_WRAP_IRQN DT_IRQN(DT_NODELABEL(pwm))
+#define PWM_WRAP_IRQ_PRIO DT_IRQ(DT_NODELABEL(pwm), priority)
+
+struct led_wave {
+	const char *name;
+	const uint16_t *samples;
+	uint16_t len;
+	/* Back to the previous pattern once played */
+	bool one_shot;
+};
+
+#define LED_WAVE(_name, _table, _one_shot)				\
+	{ .name = _name, .samples = _table,				\
+	  .len = ARRAY_SIZE(_table), .one_shot = _one_shot }
+
+static const struct led_wave led_waves[LED_PATTERN_COUNT] = {
+	[LED_PATTERN_STATIC] = { .name = "static" },
+	[LED_PATTERN_BREATHE] = LED_WAVE("breathe", led_wave_breathe, false),
+	[LED_PATTERN_BLINK] = LED_WAVE("blink", led_wave_blink, false),
+	[LED_PATTERN_BLINK_FAST] = LED_WAVE("blink-fast", led_wave_blink_fast, false),
+	[LED_PATTERN_HEARTBEAT] = LED_WAVE("heartbeat", led_wave_heartbeat, false),
+	[LED_PATTERN_FLASH] = LED_WAVE("flash", led_wave_flash, true),
+};
+
+/* Per LED animation state, shared with the wrap interrupt */
+struct led_anim {
+	uint8_t slice;
+	uint8_t chan;
+	enum led_pattern pattern;
+	enum led_pattern resume;
+	uint16_t index;
+	/* PWM TOP + 1 scaled by the brightness */
+	uint32_t gain;
+};
+
+static struct led_anim led_anims[NUM_PWM_LEDS];
+static struct k_spinlock anim_lock;
+
+/* Brightness in percent: static level, and amplitude of the patterns */
+static uint32_t pwm_brightness[NUM_PWM_LEDS] = {PWM_MAX, PWM_MAX};
+
+static inline uint16_t leds_duty_to_level(uint16_t duty, uint32_t gain)
+{
+	return (uint16_t)(((uint32_t)duty * gain + 0x8000U) >> 16);
+}
+
+static inline uint32_t leds_top1(const struct led_anim *anim)
+{
+	return pwm_hw->slice[anim->slice].top + 1U;
+}
+
+/* Apply the static level and stop the animation */
+static void leds_anim_static(int led)
+{
+	struct led_anim *anim = &led_anims[led];
+
+	pwm_set_irq_enabled(anim->slice, false);
+	pwm_set_chan_level(anim->slice, anim->chan,
+			   leds_duty_to_level(led_gamma[pwm_brightness[led]],
+					      leds_top1(anim)));
+}
+
+PERF_POINT_DEFINE(led_pwm_wrap);
+PERF_POINT_DEFINE(led_activity);
+PERF_POINT_DEFINE(led_gpio_toggle);
+
+static void leds_pwm_wrap_isr(const void *arg)
+{
+	uint32_t status;
+
+	ARG_UNUSED(arg);
+	PERF_BEGIN(led_pwm_wrap);
+
+	status = pwm_get_irq_status_mask();
+
+	for (int i = 0; i < NUM_PWM_LEDS; i++) {
+		struct led_anim *anim = &led_anims[i];
+		const struct led_wave *wave = &led_waves[anim->pattern];
+
+		if (!(status & BIT(anim->slice))) {
+			continue;
+		}
+
+		pwm_clear_irq(anim->slice);
+
+		if (wave->samples == NULL) {
+			continue;
+		}
+
+		pwm_set_chan_level(anim->slice, anim->chan,
+				   leds_duty_to_level(wave->samples[anim->index],
+						      anim->gain));
+
+		if (++anim->index < wave->len) {
+			continue;
+		}
+
+		anim->index = 0;
+		if (wave->one_shot) {
+			anim->pattern = anim->resume;
+			anim->gain = (leds_top1(anim) * pwm_brightness[i]) / PWM_MAX;
+			if (led_waves[anim->pattern].samples == NULL) {
+				leds_anim_static(i);
+			}
+		}
+	}
+
+	PERF_END(led_pwm_wrap);
+}
+
+/* Start a pattern, called with anim_lock held */
+static void leds_anim_start(int led, enum led_pattern pattern)
+{
+	struct led_anim *anim = &led_anims[led];
+
+	if (pattern == LED_PATTERN_FLASH) {
+		if (anim->pattern != LED_PATTERN_FLASH) {
+			anim->resume = anim->pattern;
+		}
+		/* Flashes are always at full brightness */
+		anim->gain = leds_top1(anim);
+	} else {
+		anim->gain = (leds_top1(anim) * pwm_brightness[led]) / PWM_MAX;
+	}
+
+	anim->pattern = pattern;
+	anim->index = 0;
+
+	if (led_waves[pattern].samples == NULL) {
+		leds_anim_static(led);
+	} else {
+		pwm_clear_irq(anim->slice);
+		pwm_set_irq_enabled(anim->slice, true);
+	}
+}
+
+/* Samples an LED stays on after the last event */
+#define ACTIVITY_HOLD 2
+#define ACTIVITY_SESSION_HOLD (5000 / LEDS_ACTIVITY_PERIOD_MS)
+
+struct led_activity {
+	enum activity_src src;
+	uint16_t hold_time;
+	uint32_t last;
+	uint16_t hold;
+	bool on;
+};
+
+enum {
+	ACT_UART_RX,
+	ACT_UART_TX,
+	ACT_DAP_SESSION,
+	ACT_DAP_RUNNING,
+	ACT_COUNT,
+};
+
+static struct led_activity led_activities[ACT_COUNT] = {
+	[ACT_UART_RX] = { .src = ACTIVITY_UART_RX, .hold_time = ACTIVITY_HOLD },
+	[ACT_UART_TX] = { .src = ACTIVITY_UART_TX, .hold_time = ACTIVITY_HOLD },
+	[ACT_DAP_SESSION] = { .src = ACTIVITY_DAP,
+			      .hold_time = ACTIVITY_SESSION_HOLD },
+	[ACT_DAP_RUNNING] = { .src = ACTIVITY_DAP, .hold_time = ACTIVITY_HOLD },
+};
+
+static bool activity_enabled = true;
+
+/* D5 level and D4/D5 breathing set by the user, while the DAP drives D5 */
+static struct {
+	uint32_t brightness;
+	bool breathing;
+} led_user = { .brightness = PWM_MAX, .breathing = true };
+
+/* Sample one source, returns true when the LED state changed */
+static bool leds_activity_poll(struct led_activity *act)
+{
+	uint32_t count = activity_read(act->src);
+	bool on;
+
+	if (count != act->last) {
+		act->last = count;
+		act->hold = act->hold_time;
+	} else if (act->hold > 0) {
+		act->hold--;
+	}
+
+	on = act->hold > 0;
+	if (on == act->on) {
+		return false;
+	}
+
+	act->on = on;
+	return true;
+}
+
+void leds_activity_update(void)
+{
+	struct led_activity *act;
+
+	if (!activity_enabled) {
+		return;
+	}
+
+	PERF_BEGIN(led_activity);
+
+	if (leds_activity_poll(&led_activities[ACT_UART_RX])) {
+		gpio_pin_set_dt(&gpio_leds[1], led_activities[ACT_UART_RX].on);
+	}
+
+	if (leds_activity_poll(&led_activities[ACT_UART_TX])) {
+		gpio_pin_set_dt(&gpio_leds[2], led_activities[ACT_UART_TX].on);
+	}
+
+	act = &led_activities[ACT_DAP_SESSION];
+	if (leds_activity_poll(act)) {
+		leds_pwm_set_pattern(0, act->on ? LED_PATTERN_STATIC :
+						  LED_PATTERN_BREATHE);
+	}
+
+	act = &led_activities[ACT_DAP_RUNNING];
+	if (leds_activity_poll(act)) {
+		leds_pwm_set_brightness(1, act->on ? PWM_MAX : 0);
+	}
+
+	PERF_END(led_activity);
+}
+
+/* Leave activity mode with the settings of the user, stored ones first */
+static void leds_user_restore(void)
+{
+	bool breathing = led_user.breathing;
+	uint32_t value;
+
+	pwm_brightness[1] = led_user.brightness;
+
+	if (IS_ENABLED(CONFIG_PREFS)) {
+		if (prefs_get(PREFS_LED_BRIGHTNESS_D5, &value) == 0) {
+			pwm_brightness[1] = MIN(value, PWM_MAX);
+		}
+		if (prefs_get(PREFS_LED_BREATHING, &value) == 0) {
+			breathing = value != 0;
+		}
+	}
+
+	leds_pwm_set_breathing(breathing);
+}
+
+void leds_activity_set(bool enable)
+{
+	if (enable && !activity_enabled) {
+		led_user.brightness = pwm_brightness[1];
+		led_user.breathing = leds_pwm_get_breathing();
+	}
+
+	activity_enabled = enable;
+
+	for (int i = 0; i < ACT_COUNT; i++) {
+		led_activities[i].on = false;
+		led_activities[i].hold = 0;
+	}
+
+	gpio_pin_set_dt(&gpio_leds[1], 0);
+	gpio_pin_set_dt(&gpio_leds[2], 0);
+
+	if (enable) {
+		leds_pwm_set_pattern(0, LED_PATTERN_BREATHE);
+		leds_pwm_set_brightness(1, 0);
+	} else {
+		leds_user_restore();
+	}
+}
+
+bool leds_activity_get(void)
+{
+	return activity_enabled;
+}
+
+/* Apply the stored levels and patterns over the defaults */
+static void leds_restore(void)
+{
+	uint32_t value;
+
+	for (int i = 0; i < NUM_PWM_LEDS; i++) {
+		if (prefs_get(PREFS_LED_BRIGHTNESS_D4 + i, &value) == 0) {
+			pwm_brightness[i] = MIN(value, PWM_MAX);
+		}
+	}
+
+	if (activity_enabled) {
+		/* D5 follows the DAP, D4 breathes at its stored level */
+		leds_pwm_set_pattern(0, LED_PATTERN_BREATHE);
+		return;
+	}
+
+	leds_pwm_set_breathing(prefs_get(PREFS_LED_BREATHING, &value) != 0 ||
+			       value != 0);
+}
+
 int leds_init(void)
 {
+	uint32_t value;
 	int ret;
 
 	/* Initialize GPIO LEDs (D1, D2, D3) */
@@ -63,6 +377,37 @@ int leds_init(void)
 			printk("PWM LED%d not ready\n", i);
 			return -ENODEV;
 		}
+
+		/* Let the driver program TOP and the divider for the period */
+		ret = pwm_set_pulse_dt(&pwm_leds[i], 0);
+		if (ret < 0) {
+			printk("Failed to configure PWM LED%d: %d\n", i, ret);
+			return ret;
+		}
+
+		/* Zephyr PWM channels are numbered slice * 2 + channel */
+		led_anims[i].slice = pwm_leds[i].channel / 2;
+		led_anims[i].chan = pwm_leds[i].channel % 2;
+	}
+
+	IRQ_CONNECT(PWM_WRAP_IRQN, PWM_WRAP_IRQ_PRIO, leds_pwm_wrap_isr, NULL, 0);
+	irq_enable(PWM_WRAP_IRQN);
+
+	K_SPINLOCK(&anim_lock) {
+		for (int i = 0; i < NUM_PWM_LEDS; i++) {
+			leds_anim_start(i, LED_PATTERN_BREATHE);
+		}
+	}
+
+	if (IS_ENABLED(CONFIG_PREFS) &&
+	    prefs_get(PREFS_LED_ACTIVITY, &value) == 0) {
+		activity_enabled = value != 0;
+	}
+
+	leds_activity_set(activity_enabled);
+
+	if (IS_ENABLED(CONFIG_PREFS)) {
+		leds_restore();
 	}
 
 	printk("LEDs initialized (3 GPIO + 2 PWM)\n");
@@ -71,35 +416,47 @@ int leds_init(void)
 
 void leds_gpio_toggle(void)
 {
-	for (int i = 0; i < NUM_GPIO_LEDS; i++) {
+	/* D2/D3 belong to the UART activity in activity mode */
+	int count = activity_enabled ? 1 : NUM_GPIO_LEDS;
+
+	PERF_BEGIN(led_gpio_toggle);
+
+	for (int i = 0; i < count; i++) {
 		gpio_pin_toggle_dt(&gpio_leds[i]);
 	}
+
+	PERF_END(led_gpio_toggle);
 }
 
-void leds_pwm_update(void)
+int leds_pwm_set_pattern(int led, enum led_pattern pattern)
 {
-	if (breathing_enabled) {
-		/* Update breathing brightness */
-		if (breathing_increasing) {
-			breathing_brightness += PWM_STEP;
-			if (breathing_brightness >= PWM_MAX) {
-				breathing_brightness = PWM_MAX;
-				breathing_increasing = false;
-			}
-		} else {
-			breathing_brightness -= PWM_STEP;
-			if (breathing_brightness == 0) {
-				breathing_increasing = true;
-			}
-		}
+	if (led < 0 || led >= NUM_PWM_LEDS || pattern >= LED_PATTERN_COUNT) {
+		return -EINVAL;
+	}
 
-		/* Apply breathing to both PWM LEDs */
-		for (int i = 0; i < NUM_PWM_LEDS; i++) {
-			pwm_brightness[i] = breathing_brightness;
-			uint32_t pulse = (pwm_leds[i].period * breathing_brightness) / PWM_MAX;
-			pwm_set_pulse_dt(&pwm_leds[i], pulse);
-		}
+	K_SPINLOCK(&anim_lock) {
+		leds_anim_start(led, pattern);
+	}
+
+	return 0;
+}
+
+enum led_pattern leds_pwm_get_pattern(int led)
+{
+	if (led < 0 || led >= NUM_PWM_LEDS) {
+		return LED_PATTERN_STATIC;
 	}
+
+	return led_anims[led].pattern;
+}
+
+const char *leds_pattern_name(enum led_pattern pattern)
+{
+	if (pattern >= LED_PATTERN_COUNT) {
+		return "unknown";
+	}
+
+	return led_waves[pattern].name;
 }
 
 int leds_pwm_set_brightness(int led, uint32_t brightness)
@@ -113,8 +470,8 @@ int leds_pwm_set_brightness(int led, uint32_t brightness)
 	}
 
 	pwm_brightness[led] = brightness;
-	uint32_t pulse = (pwm_leds[led].period * brightness) / PWM_MAX;
-	return pwm_set_pulse_dt(&pwm_leds[led], pulse);
+
+	return leds_pwm_set_pattern(led, LED_PATTERN_STATIC);
 }
 
 int leds_pwm_get_brightness(int led)
@@ -128,23 +485,40 @@ int leds_pwm_get_brightness(int led)
 
 void leds_pwm_set_breathing(bool enable)
 {
-	breathing_enabled = enable;
+	for (int i = 0; i < NUM_PWM_LEDS; i++) {
+		leds_pwm_set_pattern(i, enable ? LED_PATTERN_BREATHE :
+						 LED_PATTERN_STATIC);
+	}
 }
 
 bool leds_pwm_get_breathing(void)
 {
-	return breathing_enabled;
+	for (int i = 0; i < NUM_PWM_LEDS; i++) {
+		if (led_anims[i].pattern != LED_PATTERN_BREATHE) {
+			return false;
+		}
+	}
+
+	return true;
 }
 
 /* Shell commands */
 
 static int cmd_led_status(const struct shell *sh, size_t argc, char **argv)
 {
-	shell_print(sh, "GPIO LEDs: D1 (red), D2 (green), D3 (yellow) - toggling");
+	if (activity_enabled) {
+		shell_print(sh, "Activity mode: D1 toggling, D2/D3 UART RX/TX, "
+			    "D4 DAP session, D5 DAP running");
+	} else {
+		shell_print(sh, "GPIO LEDs: D1 (red), D2 (green), D3 (yellow) - toggling");
+	}
 	shell_print(sh, "PWM LEDs:");
-	shell_print(sh, "  D4 (green debug): %d%%", pwm_brightness[0]);
-	shell_print(sh, "  D5 (yellow debug): %d%%", pwm_brightness[1]);
-	shell_print(sh, "Breathing: %s", breathing_enabled ? "enabled" : "disabled");
+	shell_print(sh, "  D4 (green debug): %s, %d%%",
+		    leds_pattern_name(led_anims[0].pattern), pwm_brightness[0]);
+	shell_print(sh, "  D5 (yellow debug): %s, %d%%",
+		    leds_pattern_name(led_anims[1].pattern), pwm_brightness[1]);
+	shell_print(sh, "Breathing: %s",
+		    leds_pwm_get_breathing() ? "enabled" : "disabled");
 
 	return 0;
 }
@@ -170,16 +544,23 @@ static int cmd_led_brightness(const struct shell *sh, size_t argc, char **argv)
 		return -EINVAL;
 	}
 
-	/* Disable breathing when manually setting brightness */
-	breathing_enabled = false;
-
+	/* A static level replaces the running pattern */
 	int ret = leds_pwm_set_brightness(led, brightness);
 	if (ret < 0) {
 		shell_error(sh, "Failed to set brightness: %d", ret);
 		return ret;
 	}
 
-	shell_print(sh, "D%d brightness set to %d%% (breathing disabled)",
+	/* In activity mode, D5 takes it once the mode is left */
+	if (led == 1) {
+		led_user.brightness = brightness;
+	}
+
+	if (IS_ENABLED(CONFIG_PREFS)) {
+		prefs_set(PREFS_LED_BRIGHTNESS_D4 + led, brightness);
+	}
+
+	shell_print(sh, "D%d brightness set to %d%% (static)",
 		    led == 0 ? 4 : 5, brightness);
 
 	return 0;
@@ -188,21 +569,97 @@ static int cmd_led_brightness(const struct shell *sh, size_t argc, char **argv)
 static int cmd_led_breathing(const struct shell *sh, size_t argc, char **argv)
 {
 	if (argc < 2) {
-		shell_print(sh, "Breathing: %s", breathing_enabled ? "enabled" : "disabled");
+		shell_print(sh, "Breathing: %s",
+			    leds_pwm_get_breathing() ? "enabled" : "disabled");
 		return 0;
 	}
 
 	if (strcmp(argv[1], "on") == 0) {
-		breathing_enabled = true;
-		shell_print(sh, "Breathing enabled");
+		led_user.breathing = true;
 	} else if (strcmp(argv[1], "off") == 0) {
-		breathing_enabled = false;
-		shell_print(sh, "Breathing disabled");
+		led_user.breathing = false;
 	} else {
 		shell_error(sh, "Usage: led breathing [on|off]");
 		return -EINVAL;
 	}
 
+	leds_pwm_set_breathing(led_user.breathing);
+	shell_print(sh, "Breathing %s",
+		    led_user.breathing ? "enabled" : "disabled");
+
+	if (IS_ENABLED(CONFIG_PREFS)) {
+		prefs_set(PREFS_LED_BREATHING, led_user.breathing);
+	}
+
+	return 0;
+}
+
+static int cmd_led_pattern(const struct shell *sh, size_t argc, char **argv)
+{
+	int first = 0;
+	int last = NUM_PWM_LEDS - 1;
+	int pattern;
+
+	if (argc < 3) {
+		shell_error(sh, "Usage: led pattern <0|1|all> <pattern>");
+		shell_fprintf(sh, SHELL_NORMAL, "  patterns:");
+		for (int i = 0; i < LED_PATTERN_COUNT; i++) {
+			shell_fprintf(sh, SHELL_NORMAL, " %s", led_waves[i].name);
+		}
+		shell_fprintf(sh, SHELL_NORMAL, "\n");
+		return -EINVAL;
+	}
+
+	if (strcmp(argv[1], "all") != 0) {
+		first = last = atoi(argv[1]);
+		if (first < 0 || first >= NUM_PWM_LEDS) {
+			shell_error(sh, "Invalid LED: %s (use 0, 1 or all)", argv[1]);
+			return -EINVAL;
+		}
+	}
+
+	for (pattern = 0; pattern < LED_PATTERN_COUNT; pattern++) {
+		if (strcmp(argv[2], led_waves[pattern].name) == 0) {
+			break;
+		}
+	}
+
+	if (pattern == LED_PATTERN_COUNT) {
+		shell_error(sh, "Unknown pattern: %s", argv[2]);
+		return -EINVAL;
+	}
+
+	for (int i = first; i <= last; i++) {
+		leds_pwm_set_pattern(i, pattern);
+	}
+
+	shell_print(sh, "Pattern %s started", argv[2]);
+
+	return 0;
+}
+
+static int cmd_led_activity(const struct shell *sh, size_t argc, char **argv)
+{
+	if (argc < 2) {
+		shell_print(sh, "Activity: %s", activity_enabled ? "enabled" : "disabled");
+		return 0;
+	}
+
+	if (strcmp(argv[1], "on") == 0) {
+		leds_activity_set(true);
+		shell_print(sh, "Activity mode enabled");
+	} else if (strcmp(argv[1], "off") == 0) {
+		leds_activity_set(false);
+		shell_print(sh, "Activity mode disabled, demo patterns restored");
+	} else {
+		shell_error(sh, "Usage: led activity [on|off]");
+		return -EINVAL;
+	}
+
+	if (IS_ENABLED(CONFIG_PREFS)) {
+		prefs_set(PREFS_LED_ACTIVITY, activity_enabled);
+	}
+
 	return 0;
 }
 
@@ -212,6 +669,12 @@ SHELL_STATIC_SUBCMD_SET_CREATE(sub_led,
 		  cmd_led_brightness),
 	SHELL_CMD(breathing, NULL, "Control breathing effect: led breathing [on|off]",
 		  cmd_led_breathing),
+	SHELL_CMD(pattern, NULL,
+		  "Select PWM LED pattern: led pattern <0|1|all> "
+		  "<static|breathe|blink|blink-fast|heartbeat|flash>",
+		  cmd_led_pattern),
+	SHELL_CMD(activity, NULL, "LEDs follow SWD/UART activity: led activity [on|off]",
+		  cmd_led_activity),
 	SHELL_SUBCMD_SET_END
 );
 
@@ -9,6 +9,24 @@
 #define LEDS_H
 
 #include <stdint.h>
+#include <stdbool.h>
+
+/* PWM LED patterns, gamma corrected */
+enum led_pattern {
+	/* Constant level set by the brightness */
+	LED_PATTERN_STATIC,
+	/* Raised cosine, 2.56 s period */
+	LED_PATTERN_BREATHE,
+	/* 1 Hz blink */
+	LED_PATTERN_BLINK,
+	/* 4 Hz blink */
+	LED_PATTERN_BLINK_FAST,
+	/* Two short beats per second */
+	LED_PATTERN_HEARTBEAT,
+	/* One-shot 300 ms flash, then back to the previous pattern */
+	LED_PATTERN_FLASH,
+	LED_PATTERN_COUNT,
+};
 
 /**
  * Initialize all LEDs (GPIO and PWM).
@@ -24,13 +42,35 @@ int leds_init(void);
 void leds_gpio_toggle(void);
 
 /**
- * Update PWM LEDs (D4, D5) brightness.
- * Called periodically from main loop for breathing effect.
+ * Start a pattern on a PWM LED. Patterns are played by the PWM wrap
+ * interrupt, no periodic call is needed.
+ *
+ * @param led LED index (0 = D4 green, 1 = D5 yellow)
+ * @param pattern Pattern to play
+ * @return 0 on success, negative error code on failure
+ */
+int leds_pwm_set_pattern(int led, enum led_pattern pattern);
+
+/**
+ * Get the pattern running on a PWM LED.
+ *
+ * @param led LED index (0 = D4 green, 1 = D5 yellow)
+ * @return Current pattern
+ */
+enum led_pattern leds_pwm_get_pattern(int led);
+
+/**
+ * Get the shell name of a pattern.
+ *
+ * @param pattern Pattern
+ * @return Pattern name
  */
-void leds_pwm_update(void);
+const char *leds_pattern_name(enum led_pattern pattern);
 
 /**
- * Set PWM LED brightness directly.
+ * Set a static PWM LED brightness, stopping its pattern.
+ * The level is gamma corrected. It is also the amplitude of the
+ * patterns started afterwards, except flashes.
  *
  * @param led LED index (0 = D4 green, 1 = D5 yellow)
  * @param brightness Brightness level 0-100 (percent)
@@ -47,9 +87,9 @@ int leds_pwm_set_brightness(int led, uint32_t brightness);
 int leds_pwm_get_brightness(int led);
 
 /**
- * Enable or disable automatic breathing effect.
+ * Enable or disable automatic breathing effect on both PWM LEDs.
  *
- * @param enable true to enable breathing, false to disable
+ * @param enable true to breathe, false for a static level
  */
 void leds_pwm_set_breathing(bool enable);
 
@@ -60,4 +100,29 @@ void leds_pwm_set_breathing(bool enable);
  */
 bool leds_pwm_get_breathing(void);
 
+/* Sampling period of the activity counters */
+#define LEDS_ACTIVITY_PERIOD_MS 50
+
+/**
+ * Sample the activity counters and update the LEDs.
+ * Called every LEDS_ACTIVITY_PERIOD_MS in activity mode.
+ */
+void leds_activity_update(void);
+
+/**
+ * Enable or disable activity mode. When disabled, the LEDs go back to
+ * the demo (D1-D3 toggling) with the D5 level and the breathing setting
+ * of the user, the stored ones if any.
+ *
+ * @param enable true for activity mode
+ */
+void leds_activity_set(bool enable);
+
+/**
+ * Check if activity mode is enabled.
+ *
+ * @return true if the LEDs follow the data paths
+ */
+bool leds_activity_get(void);
+
 #endif /* LEDS_H */
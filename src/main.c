@@ -11,8 +11,12 @@
 #include <zephyr/usb/usbd.h>
 #include <zephyr/usb/bos.h>
 #include <zephyr/usb/msos_desc.h>
+#include <string.h>
+#if defined(CONFIG_BOOTSEL)
 #include <hardware/structs/ioqspi.h>
 #include <hardware/structs/sio.h>
+#include <hardware/structs/timer.h>
+#endif
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(main, LOG_LEVEL_INF);
@@ -20,25 +24,85 @@ LOG_MODULE_REGISTER(main, LOG_LEVEL_INF);
 #include <sample_usbd.h>
 #include <cmsis_dap.h>
 
+/* Before the vendor request handlers, which are timed */
+#include "perf.h"
 #include "msosv2.h"
 #include "webusb.h"
 #include "leds.h"
 #include "watchdog.h"
+#include "uart_bridge.h"
+#include "sched.h"
+#include "irq_prof.h"
+#include "health.h"
+#include "dap_vendor.h"
+#include "swo.h"
+#include "rtt.h"
+#include "swd_cal.h"
+#include "prefs.h"
+#include "fw_update.h"
+#include "boot_time.h"
+#include "flash_guard.h"
 
 /* Bonjour state from shell_cmds.c */
 extern bool bonjour_enabled;
 
-/* UART1 device for Bonjour output on J2 connector */
-static const struct device *const uart1_dev = DEVICE_DT_GET(DT_NODELABEL(uart1));
-
-/* Send string to UART1 (J2 connector) */
+/* Queue a string on UART1 (J2 connector) through the bridge TX ring */
 static void uart1_print(const char *str)
 {
-	while (*str) {
-		uart_poll_out(uart1_dev, *str++);
+	uart_bridge_write((const uint8_t *)str, strlen(str));
+}
+
+static const struct device *const console_dev =
+	DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
+
+/* Greet the first terminal opened on the shell CDC ACM */
+static void console_ready(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	printk("Starting Debug Probe LED demo...\n");
+	printk("Note: I2C shell disabled - GPIO4/5 used by UART1 (J2 connector)\n");
+}
+
+static K_WORK_DEFINE(console_work, console_ready);
+
+static void console_line_state(void)
+{
+	uint32_t dtr = 0;
+
+	if (uart_line_ctrl_get(console_dev, UART_LINE_CTRL_DTR, &dtr) == 0 &&
+	    dtr && !atomic_test_bit(&boot_marked, BOOT_CONSOLE)) {
+		boot_mark(BOOT_CONSOLE);
+		k_work_submit(&console_work);
 	}
 }
 
+static void usbd_msg_cb(struct usbd_context *const ctx,
+			const struct usbd_msg *msg)
+{
+	ARG_UNUSED(ctx);
+
+	if (msg->type == USBD_MSG_CONFIGURATION) {
+		boot_mark(BOOT_USB_CONFIGURED);
+		if (IS_ENABLED(CONFIG_FW_UPDATE)) {
+			fw_update_usb_configured();
+		}
+	}
+
+	if (msg->type == USBD_MSG_CDC_ACM_CONTROL_LINE_STATE &&
+	    msg->dev == console_dev) {
+		console_line_state();
+	}
+
+	uart_bridge_usbd_msg(msg);
+}
+
+/* BOOTSEL held, the Bonjour output pauses */
+static bool bootsel_pressed;
+
+PERF_POINT_DEFINE(bonjour);
+
+#if defined(CONFIG_BOOTSEL)
 /*
  * Read BOOTSEL button state.
  *
@@ -53,18 +117,24 @@ static void uart1_print(const char *str)
  * The sequence is:
  *   1. Disable interrupts (ISRs in flash would crash if flash is disabled)
  *   2. Override QSPI_SS pin to act as GPIO input (this disables flash!)
- *   3. Short delay for the signal to settle
+ *   3. Wait for the signal to settle, timed on the 1 MHz timer
  *   4. Read button state from the QSPI GPIO bank
  *   5. Restore QSPI_SS to normal operation (re-enables flash)
  *   6. Re-enable interrupts
  *
  * Without __ramfunc, the CPU would crash immediately when trying to fetch
  * the next instruction from the now-disabled flash.
+ *
+ * The settle time used to be a 1000 iteration busy loop, whose length
+ * depends on the CPU clock and the compiler. It is now a minimum window
+ * read from the hardware timer (a register, safe without flash), and the
+ * whole masked time is returned through masked_us so it can be profiled.
  */
-static bool __ramfunc get_bootsel_button(void)
+static bool __ramfunc get_bootsel_button(uint32_t *masked_us)
 {
 	const uint32_t CS_PIN_INDEX = 1;
 	unsigned int key = irq_lock();
+	uint32_t start = timer_hw->timerawl;
 
 	/*
 	 * Set QSPI_SS output override to LOW (value 2).
@@ -76,8 +146,13 @@ static bool __ramfunc get_bootsel_button(void)
 			oeover_low,
 			IO_QSPI_GPIO_QSPI_SS_CTRL_OEOVER_BITS);
 
-	/* Short delay for the signal to settle */
-	for (volatile int i = 0; i < 1000; ++i) {
+	/*
+	 * Wait for the signal to settle. Start from the next timer tick so
+	 * the window is never shorter than CONFIG_BOOTSEL_SETTLE_US.
+	 */
+	uint32_t settle = timer_hw->timerawl;
+
+	while (timer_hw->timerawl - settle <= CONFIG_BOOTSEL_SETTLE_US) {
 		;
 	}
 
@@ -92,21 +167,77 @@ static bool __ramfunc get_bootsel_button(void)
 			0u,
 			IO_QSPI_GPIO_QSPI_SS_CTRL_OEOVER_BITS);
 
+	*masked_us = timer_hw->timerawl - start;
 	irq_unlock(key);
 
 	return button_state;
 }
 
+PERF_POINT_DEFINE(bootsel_read);
+
+/* Sample BOOTSEL, the firmware update hint is shown once per press */
+static void bootsel_job(void)
+{
+	uint32_t masked_us;
+	bool pressed;
+
+	PERF_BEGIN(bootsel_read);
+	flash_guard_enter();
+	pressed = get_bootsel_button(&masked_us);
+	flash_guard_exit();
+	PERF_END(bootsel_read);
+
+	irq_prof_masked(masked_us);
+
+	if (pressed && !bootsel_pressed) {
+		if (IS_ENABLED(CONFIG_FW_UPDATE)) {
+			printk("BOOTSEL pressed, new firmware can also be "
+			       "uploaded with mcumgr, no replug needed\n");
+		} else {
+			printk("BOOTSEL pressed, "
+			       "unplug/plug USB to flash a new firmware\n");
+		}
+	}
+
+	bootsel_pressed = pressed;
+}
+#endif /* CONFIG_BOOTSEL */
+
+static void bonjour_job(void)
+{
+	PERF_BEGIN(bonjour);
+
+	if (bonjour_enabled && !bootsel_pressed) {
+		uart1_print("Bonjour\r\n");
+	}
+
+	PERF_END(bonjour);
+}
+
+/*
+ * Periodic jobs. The watchdog timeout is 5 s, it is fed by the health
+ * supervisor job, so a stuck scheduler thread or a late heartbeat resets
+ * the probe.
+ */
+#if defined(CONFIG_BOOTSEL)
+SCHED_JOB_DEFINE(bootsel, bootsel_job, 1000, 10);
+#endif
+SCHED_JOB_DEFINE(bonjour, bonjour_job, 1000, 0);
+#if defined(CONFIG_LEDS)
+SCHED_JOB_DEFINE(leds_toggle, leds_gpio_toggle, 1000, 0);
+SCHED_JOB_DEFINE(leds_activity, leds_activity_update,
+		 LEDS_ACTIVITY_PERIOD_MS, 0);
+#endif
+SCHED_JOB_DEFINE(health, health_supervise, 250, 0);
+
 int main(void)
 {
 	int ret;
-	const struct device *const console_dev =
-		DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
 	const struct device *const swd_dev =
-		DEVICE_DT_GET_ONE(zephyr_swdp_gpio);
+		DEVICE_DT_GET(DT_NODELABEL(dp0));
 	struct usbd_context *sample_usbd;
-	uint32_t dtr = 0;
-	bool bootsel_msg_shown = false;
+
+	boot_mark(BOOT_MAIN);
 
 	/* Initialize CMSIS-DAP with the SWD device */
 	ret = dap_setup(swd_dev);
@@ -114,9 +245,61 @@ int main(void)
 		printk("Failed to initialize DAP: %d\n", ret);
 		return ret;
 	}
+	boot_mark(BOOT_DAP_SETUP);
+
+#if defined(CONFIG_DAP_QUEUE)
+	/* Packet size reported by the queue must match the DAP core */
+	dap_update_pkt_size(CONFIG_DAP_QUEUE_PACKET_SIZE);
+#endif
+
+#if defined(CONFIG_DAP_VENDOR)
+	ret = dap_vendor_init(swd_dev);
+	if (ret) {
+		printk("Failed to initialize DAP vendor commands: %d\n", ret);
+	}
+#endif
+
+#if defined(CONFIG_SWD_CAL)
+	ret = swd_cal_init(swd_dev);
+	if (ret) {
+		printk("Failed to initialize SWD calibration: %d\n", ret);
+	}
+#endif
+
+#if defined(CONFIG_SWO)
+	ret = swo_init();
+	if (ret) {
+		printk("Failed to initialize SWO capture: %d\n", ret);
+	}
+#endif
+
+	/*
+	 * LEDs, watchdog and periodic jobs come up before USB, so the probe
+	 * is supervised while the host enumerates it. Nothing waits for a
+	 * terminal: the banner is printed when DTR is raised.
+	 */
+#if defined(CONFIG_LEDS)
+	ret = leds_init();
+	if (ret < 0) {
+		return ret;
+	}
+
+	sched_add(&leds_toggle);
+	sched_add(&leds_activity);
+#endif
+#if defined(CONFIG_BOOTSEL)
+	sched_add(&bootsel);
+#endif
+	sched_add(&health);
+	boot_mark(BOOT_LEDS);
+
+	if (IS_ENABLED(CONFIG_HEALTH_WATCHDOG)) {
+		watchdog_init();
+	}
+	boot_mark(BOOT_WATCHDOG);
 
-	/* Setup USB device with all registered classes (CDC ACM + DAP) */
-	sample_usbd = sample_usbd_setup_device(NULL);
+	/* Setup USB device with all registered classes (CDC ACM instances + DAP v2) */
+	sample_usbd = sample_usbd_setup_device(usbd_msg_cb);
 	if (sample_usbd == NULL) {
 		printk("Failed to setup USB device\n");
 		return -ENODEV;
@@ -141,76 +324,46 @@ int main(void)
 		printk("Failed to initialize USB: %d\n", ret);
 		return ret;
 	}
+	boot_mark(BOOT_USBD_INIT);
 
 	ret = usbd_enable(sample_usbd);
 	if (ret) {
 		printk("Failed to enable USB: %d\n", ret);
 		return ret;
 	}
+	boot_mark(BOOT_USBD_ENABLE);
 
-	/*
-	 * Wait for DTR (terminal connected) before starting.
-	 * Timeout after 3 seconds to allow simulation without DTR support.
-	 */
-	if (device_is_ready(console_dev)) {
-		int dtr_timeout = 30; /* 30 * 100ms = 3 seconds */
-
-		while (!dtr && dtr_timeout > 0) {
-			uart_line_ctrl_get(console_dev, UART_LINE_CTRL_DTR,
-					   &dtr);
-			k_sleep(K_MSEC(100));
-			dtr_timeout--;
-		}
+#if defined(CONFIG_FW_UPDATE)
+	/* A new image is confirmed once the host configures USB */
+	ret = fw_update_init();
+	if (ret) {
+		printk("Failed to initialize firmware update: %d\n", ret);
 	}
+#endif
 
-	/* Check UART1 for Bonjour output */
-	if (!device_is_ready(uart1_dev)) {
-		printk("UART1 device not ready\n");
+	/* Bridge the second CDC ACM to UART1, also used for Bonjour output */
+	ret = uart_bridge_init();
+	if (ret) {
+		printk("Failed to start UART bridge: %d\n", ret);
 	}
 
-	printk("Starting Debug Probe LED demo...\n");
-	printk("Note: I2C shell disabled - GPIO4/5 used by UART1 (J2 connector)\n");
+#if defined(CONFIG_PREFS)
+	/* The stored state wins over the default */
+	uint32_t bonjour_pref;
 
-	/* Initialize LEDs */
-	ret = leds_init();
-	if (ret < 0) {
-		return ret;
+	if (prefs_get(PREFS_BONJOUR, &bonjour_pref) == 0) {
+		bonjour_enabled = bonjour_pref != 0;
 	}
+#endif
+	sched_add(&bonjour);
 
-	/* Initialize watchdog */
-	watchdog_init();
-
-	uint32_t loop_count = 0;
-
-	while (1) {
-		/* Check BOOTSEL button and Bonjour ~once per second (64ms * 16 = 1024ms) */
-		if ((loop_count & 0x0F) == 0) {
-			if (get_bootsel_button()) {
-				if (!bootsel_msg_shown) {
-					printk("BOOTSEL pressed, "
-					       "unplug/plug USB to flash a new firmware\n");
-					bootsel_msg_shown = true;
-				}
-			} else {
-				bootsel_msg_shown = false;
-				if (bonjour_enabled) {
-					uart1_print("Bonjour\r\n");
-				}
-			}
-
-			/* Toggle GPIO LEDs once per second */
-			leds_gpio_toggle();
-		}
-
-		/* Update PWM LEDs with breathing effect */
-		leds_pwm_update();
-
-		/* Feed the watchdog to prevent reset */
-		watchdog_feed();
-
-		loop_count++;
-		k_sleep(K_MSEC(64));
+#if defined(CONFIG_RTT)
+	ret = rtt_init(swd_dev);
+	if (ret) {
+		printk("Failed to initialize RTT: %d\n", ret);
 	}
+#endif
 
+	/* From now on everything runs from scheduler jobs */
 	return 0;
 }
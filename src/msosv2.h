@@ -110,10 +110,15 @@ struct bos_msosv2_descriptor bos_msosv2_desc = {
 	},
 };
 
+PERF_POINT_DEFINE(usb_msosv2_req);
+
 static int msosv2_to_host_cb(const struct usbd_context *const ctx,
 			     const struct usb_setup_packet *const setup,
 			     struct net_buf *const buf)
 {
+	int ret = -ENOTSUP;
+
+	PERF_BEGIN(usb_msosv2_req);
 	LOG_DBG("MSOS v2 vendor callback");
 
 	if (setup->bRequest == SAMPLE_MSOS2_VENDOR_CODE &&
@@ -123,10 +128,12 @@ static int msosv2_to_host_cb(const struct usbd_context *const ctx,
 		net_buf_add_mem(buf, &msosv2_desc,
 				MIN(net_buf_tailroom(buf), sizeof(msosv2_desc)));
 
-		return 0;
+		ret = 0;
 	}
 
-	return -ENOTSUP;
+	PERF_END(usb_msosv2_req);
+
+	return ret;
 }
 
 USBD_DESC_BOS_VREQ_DEFINE(bos_vreq_msosv2, sizeof(bos_msosv2_desc), &bos_msosv2_desc,
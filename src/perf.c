@@ -0,0 +1,157 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Code section timing probes: readers and perf shell command
+ *
+ * "perf dump" prints the points as a binary record for scripts, hex
+ * encoded so it goes through the shell unchanged, all little endian:
+ *
+ *   header: "PERF", u16 version, u16 points, u32 cycles per second
+ *   point:  char name[PERF_DUMP_NAME_LEN], u32 count, u32 min, u32 max,
+ *           u64 sum (cycles)
+ *
+ * tools/perf_dump.py reads it from the shell port.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+
+#include "perf.h"
+
+#define PERF_DUMP_VERSION 1
+#define PERF_DUMP_NAME_LEN 24
+#define PERF_DUMP_HEADER_LEN 12
+#define PERF_DUMP_POINT_LEN (PERF_DUMP_NAME_LEN + 20)
+/* Bytes per hex line of the dump */
+#define PERF_DUMP_LINE 32
+
+void perf_read(const struct perf_point *pt, struct perf_snapshot *snap)
+{
+	uint32_t seq;
+
+	do {
+		seq = pt->seq;
+		barrier_dmem_fence_full();
+		snap->count = pt->count;
+		snap->min = pt->min;
+		snap->max = pt->max;
+		snap->sum = pt->sum;
+		barrier_dmem_fence_full();
+	} while ((seq & 1) || seq != pt->seq);
+
+	if (pt->reset) {
+		memset(snap, 0, sizeof(*snap));
+	}
+}
+
+void perf_reset(void)
+{
+	STRUCT_SECTION_FOREACH(perf_point, pt) {
+		pt->reset = true;
+	}
+}
+
+static uint32_t perf_cyc_to_ns(uint64_t cycles)
+{
+	return (uint32_t)k_cyc_to_ns_floor64(cycles);
+}
+
+/* Shell commands */
+
+static int cmd_perf_list(const struct shell *sh, size_t argc, char **argv)
+{
+	struct perf_snapshot snap;
+
+	shell_print(sh, "%-20s %10s %10s %10s %10s", "point", "count",
+		    "min ns", "avg ns", "max ns");
+
+	STRUCT_SECTION_FOREACH(perf_point, pt) {
+		perf_read(pt, &snap);
+
+		if (snap.count == 0) {
+			shell_print(sh, "%-20s %10u %10s %10s %10s", pt->name,
+				    0, "-", "-", "-");
+			continue;
+		}
+
+		shell_print(sh, "%-20s %10u %10u %10u %10u", pt->name,
+			    snap.count, perf_cyc_to_ns(snap.min),
+			    perf_cyc_to_ns(snap.sum / snap.count),
+			    perf_cyc_to_ns(snap.max));
+	}
+
+	shell_print(sh, "Clock: %u Hz", sys_clock_hw_cycles_per_sec());
+
+	return 0;
+}
+
+static int cmd_perf_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	perf_reset();
+	shell_print(sh, "Perf probes reset");
+
+	return 0;
+}
+
+static void perf_dump_hex(const struct shell *sh, const uint8_t *data,
+			  size_t len)
+{
+	char line[2 * PERF_DUMP_LINE + 1];
+	size_t off = 0;
+
+	while (off < len) {
+		size_t n = MIN(len - off, PERF_DUMP_LINE);
+
+		bin2hex(&data[off], n, line, sizeof(line));
+		shell_print(sh, "%s", line);
+		off += n;
+	}
+}
+
+static int cmd_perf_dump(const struct shell *sh, size_t argc, char **argv)
+{
+	uint8_t rec[PERF_DUMP_POINT_LEN];
+	struct perf_snapshot snap;
+	int points;
+
+	STRUCT_SECTION_COUNT(perf_point, &points);
+
+	memcpy(rec, "PERF", 4);
+	sys_put_le16(PERF_DUMP_VERSION, &rec[4]);
+	sys_put_le16(points, &rec[6]);
+	sys_put_le32(sys_clock_hw_cycles_per_sec(), &rec[8]);
+
+	shell_print(sh, "-- perf dump %d --",
+		    PERF_DUMP_HEADER_LEN + points * PERF_DUMP_POINT_LEN);
+	perf_dump_hex(sh, rec, PERF_DUMP_HEADER_LEN);
+
+	STRUCT_SECTION_FOREACH(perf_point, pt) {
+		perf_read(pt, &snap);
+
+		memset(rec, 0, PERF_DUMP_NAME_LEN);
+		strncpy((char *)rec, pt->name, PERF_DUMP_NAME_LEN - 1);
+		sys_put_le32(snap.count, &rec[PERF_DUMP_NAME_LEN]);
+		sys_put_le32(snap.min, &rec[PERF_DUMP_NAME_LEN + 4]);
+		sys_put_le32(snap.max, &rec[PERF_DUMP_NAME_LEN + 8]);
+		sys_put_le64(snap.sum, &rec[PERF_DUMP_NAME_LEN + 12]);
+		perf_dump_hex(sh, rec, sizeof(rec));
+	}
+
+	shell_print(sh, "-- end --");
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_perf,
+	SHELL_CMD(list, NULL, "Show probe points (count, min/avg/max ns)",
+		  cmd_perf_list),
+	SHELL_CMD(reset, NULL, "Reset probe points", cmd_perf_reset),
+	SHELL_CMD(dump, NULL, "Dump probe points as hex encoded binary",
+		  cmd_perf_dump),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(perf, &sub_perf, "Code section timing probes", cmd_perf_list);
@@ -0,0 +1,133 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Code section timing probes
+ *
+ * A probe point aggregates count, min, max and sum of the cycles spent
+ * between PERF_BEGIN() and PERF_END(). Times come from k_cycle_get_32(),
+ * which counts CPU cycles on the SysTick system timer: the Cortex-M0+ has
+ * no DWT cycle counter, and the 1 MHz RP2040 timer is too coarse for most
+ * of the sections measured.
+ *
+ * Each point has exactly one writer context. The writer updates its slot
+ * under a sequence counter, odd while an update is in progress, and
+ * readers retry until they see the same even value before and after the
+ * copy. Nothing is locked on the measured path. A reset is only
+ * requested by the reader, the writer clears the slot on its next record.
+ *
+ * Without CONFIG_PERF_PROBES, the macros compile to nothing.
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/barrier.h>
+#include <zephyr/sys/iterable_sections.h>
+
+struct perf_point {
+	const char *name;
+
+	/* Private, written by the single writer of the point */
+	volatile uint32_t seq;
+	/* Set by perf_reset(), cleared by the writer */
+	volatile bool reset;
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+};
+
+/* Consistent copy of a probe point, in cycles */
+struct perf_snapshot {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+};
+
+#if defined(CONFIG_PERF_PROBES)
+
+/**
+ * Define a probe point.
+ *
+ * @param _name Point name, shown by the perf shell command
+ */
+#define PERF_POINT_DEFINE(_name)					\
+	static STRUCT_SECTION_ITERABLE(perf_point, perf_##_name) = {	\
+		.name = #_name,						\
+	}
+
+/**
+ * Start timing a section. Opens a declaration, so it must be in the same
+ * block as the matching PERF_END().
+ *
+ * @param _name Point name
+ */
+#define PERF_BEGIN(_name) uint32_t perf_t0_##_name = k_cycle_get_32()
+
+/**
+ * Stop timing a section and record it on its point.
+ *
+ * @param _name Point name
+ */
+#define PERF_END(_name)							\
+	perf_record(&perf_##_name, k_cycle_get_32() - perf_t0_##_name)
+
+/**
+ * Record a section duration. Must only be called by the single writer
+ * of the point.
+ *
+ * @param pt Probe point
+ * @param cycles Duration in CPU cycles
+ */
+static inline void perf_record(struct perf_point *pt, uint32_t cycles)
+{
+	pt->seq++;
+	barrier_dmem_fence_full();
+
+	if (pt->reset) {
+		pt->reset = false;
+		pt->count = 0;
+		pt->max = 0;
+		pt->sum = 0;
+	}
+	if (pt->count == 0 || cycles < pt->min) {
+		pt->min = cycles;
+	}
+	if (cycles > pt->max) {
+		pt->max = cycles;
+	}
+	pt->sum += cycles;
+	pt->count++;
+
+	barrier_dmem_fence_full();
+	pt->seq++;
+}
+
+/**
+ * Copy a probe point without stopping its writer.
+ *
+ * @param pt Probe point
+ * @param snap Destination
+ */
+void perf_read(const struct perf_point *pt, struct perf_snapshot *snap);
+
+/**
+ * Clear all probe points. Each point is cleared by its writer on its next
+ * record, until then it reads as empty.
+ */
+void perf_reset(void);
+
+#else
+
+#define PERF_POINT_DEFINE(_name) extern struct perf_point perf_##_name
+#define PERF_BEGIN(_name) do { } while (0)
+#define PERF_END(_name) do { } while (0)
+
+#endif /* CONFIG_PERF_PROBES */
+
+#endif /* PERF_H */
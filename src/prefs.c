@@ -0,0 +1,422 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Persistent runtime settings
+ *
+ * Settings live in RAM and are committed to flash as whole records: one
+ * 256-byte page holding every stored setting, a sequence number and a
+ * CRC. Records are appended page after page through the partition,
+ * which is used as a ring of sectors, so each sector is erased once per
+ * turn of the ring. At boot, the valid record with the highest sequence
+ * number wins; a record torn by a reset fails its CRC and the previous
+ * one is used.
+ *
+ * Programming or erasing the QSPI flash takes it out of XIP mode. The
+ * flash driver runs the operation from RAM with interrupts masked, so
+ * nothing runs meanwhile: not USB, not the SWD port, not the other
+ * threads. To keep those stalls out of the way:
+ *
+ * - changes are coalesced in RAM and committed CONFIG_PREFS_COMMIT_DELAY_MS
+ *   after the last one, so a burst of shell commands costs one record;
+ * - flash operations run in the DAP queue thread, between requests, once
+ *   no request has run for CONFIG_PREFS_IDLE_MS, so they never cut an
+ *   SWD transfer;
+ * - an idle window runs a single operation: a page program (about 1 ms)
+ *   or, once per sector of records, the erase of the next sector, ahead
+ *   of the commit that needs it.
+ *
+ * Each operation is timed on the 1 MHz hardware timer, which keeps
+ * counting with interrupts masked, and the longest stall is reported by
+ * the prefs shell command.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+#include <hardware/structs/timer.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(prefs, LOG_LEVEL_INF);
+
+#include "prefs.h"
+#include "flash_guard.h"
+#include "dap_queue.h"
+
+#define PREFS_PARTITION FIXED_PARTITION_ID(prefs_partition)
+#define PREFS_SIZE FIXED_PARTITION_SIZE(prefs_partition)
+#define PREFS_PAGE 256
+#define PREFS_SECTOR 4096
+#define PREFS_PAGES (PREFS_SIZE / PREFS_PAGE)
+#define PREFS_PAGES_PER_SECTOR (PREFS_SECTOR / PREFS_PAGE)
+/* "PREF" */
+#define PREFS_MAGIC 0x46455250
+
+struct prefs_entry {
+	uint16_t key;
+	uint16_t reserved;
+	uint32_t value;
+};
+
+/* One flash page */
+struct prefs_record {
+	uint32_t magic;
+	uint32_t seq;
+	uint32_t count;
+	uint32_t crc;
+	struct prefs_entry entry[(PREFS_PAGE - 16) / sizeof(struct prefs_entry)];
+};
+
+BUILD_ASSERT(sizeof(struct prefs_record) == PREFS_PAGE);
+BUILD_ASSERT(PREFS_KEY_COUNT <= ARRAY_SIZE(((struct prefs_record *)0)->entry),
+	     "Settings do not fit in a record");
+BUILD_ASSERT(PREFS_SIZE % PREFS_SECTOR == 0 && PREFS_SIZE >= 2 * PREFS_SECTOR,
+	     "The settings partition must hold at least two sectors");
+
+static const char *const prefs_key_name[PREFS_KEY_COUNT] = {
+	[PREFS_BONJOUR] = "bonjour",
+	[PREFS_LED_BRIGHTNESS_D4] = "led_brightness_d4",
+	[PREFS_LED_BRIGHTNESS_D5] = "led_brightness_d5",
+	[PREFS_LED_BREATHING] = "led_breathing",
+	[PREFS_LED_ACTIVITY] = "led_activity",
+};
+
+static struct {
+	const struct flash_area *fa;
+
+	/* Settings, a bit per key in set */
+	uint32_t value[PREFS_KEY_COUNT];
+	uint32_t set;
+	bool dirty;
+	uint32_t changed_ms;
+
+	/* Next page to program, and whether its sector needs an erase */
+	uint32_t next;
+	bool erase_pending;
+
+	struct prefs_stats stats;
+} prefs;
+
+/* Serializes the shell with the queue thread */
+static struct k_spinlock prefs_lock;
+
+/* Record being programmed, the driver reads it with XIP off */
+static struct prefs_record prefs_rec;
+
+static uint32_t prefs_crc(const struct prefs_record *rec)
+{
+	uint32_t crc;
+
+	crc = crc32_ieee((const uint8_t *)rec, offsetof(struct prefs_record, crc));
+
+	return crc32_ieee_update(crc, (const uint8_t *)rec->entry,
+				 rec->count * sizeof(rec->entry[0]));
+}
+
+static bool prefs_valid(const struct prefs_record *rec)
+{
+	return rec->magic == PREFS_MAGIC &&
+	       rec->count <= ARRAY_SIZE(rec->entry) &&
+	       rec->crc == prefs_crc(rec);
+}
+
+static bool prefs_blank(uint32_t page)
+{
+	uint32_t words[PREFS_PAGE / 4];
+
+	if (flash_area_read(prefs.fa, page * PREFS_PAGE, words, sizeof(words))) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < ARRAY_SIZE(words); i++) {
+		if (words[i] != UINT32_MAX) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool prefs_sector_blank(uint32_t page)
+{
+	for (uint32_t i = 0; i < PREFS_PAGES_PER_SECTOR; i++) {
+		if (!prefs_blank(page + i)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Find the first blank page from page on */
+static void prefs_seek(uint32_t page)
+{
+	prefs.next = page % PREFS_PAGES;
+
+	/* Skip pages left by a failed or torn program */
+	while (prefs.next % PREFS_PAGES_PER_SECTOR != 0 &&
+	       !prefs_blank(prefs.next)) {
+		prefs.next = (prefs.next + 1) % PREFS_PAGES;
+	}
+
+	/* A new sector still holds the records of the previous turn */
+	if (prefs.next % PREFS_PAGES_PER_SECTOR == 0) {
+		prefs.erase_pending = !prefs_sector_blank(prefs.next);
+	}
+}
+
+static void prefs_load(void)
+{
+	int latest = -1;
+
+	for (uint32_t page = 0; page < PREFS_PAGES; page++) {
+		if (flash_area_read(prefs.fa, page * PREFS_PAGE, &prefs_rec,
+				    sizeof(prefs_rec)) ||
+		    !prefs_valid(&prefs_rec)) {
+			continue;
+		}
+
+		if (latest < 0 || (int32_t)(prefs_rec.seq - prefs.stats.seq) > 0) {
+			latest = page;
+			prefs.stats.seq = prefs_rec.seq;
+		}
+	}
+
+	if (latest < 0) {
+		prefs_seek(0);
+		return;
+	}
+
+	flash_area_read(prefs.fa, latest * PREFS_PAGE, &prefs_rec,
+			sizeof(prefs_rec));
+
+	for (uint32_t i = 0; i < prefs_rec.count; i++) {
+		const struct prefs_entry *e = &prefs_rec.entry[i];
+
+		/* Keys of a newer firmware are dropped */
+		if (e->key < PREFS_KEY_COUNT) {
+			prefs.value[e->key] = e->value;
+			prefs.set |= BIT(e->key);
+		}
+	}
+
+	prefs.stats.page = latest;
+	prefs_seek(latest + 1);
+}
+
+int prefs_get(enum prefs_key key, uint32_t *value)
+{
+	k_spinlock_key_t key_lock;
+	int ret = -ENOENT;
+
+	if (key >= PREFS_KEY_COUNT) {
+		return -EINVAL;
+	}
+
+	key_lock = k_spin_lock(&prefs_lock);
+	if (prefs.set & BIT(key)) {
+		*value = prefs.value[key];
+		ret = 0;
+	}
+	k_spin_unlock(&prefs_lock, key_lock);
+
+	return ret;
+}
+
+void prefs_set(enum prefs_key key, uint32_t value)
+{
+	k_spinlock_key_t key_lock;
+
+	if (key >= PREFS_KEY_COUNT) {
+		return;
+	}
+
+	key_lock = k_spin_lock(&prefs_lock);
+	if (!(prefs.set & BIT(key)) || prefs.value[key] != value) {
+		prefs.value[key] = value;
+		prefs.set |= BIT(key);
+		prefs.dirty = true;
+		prefs.changed_ms = k_uptime_get_32();
+	}
+	k_spin_unlock(&prefs_lock, key_lock);
+}
+
+void prefs_clear(void)
+{
+	k_spinlock_key_t key_lock = k_spin_lock(&prefs_lock);
+
+	prefs.set = 0;
+	prefs.dirty = true;
+	prefs.changed_ms = k_uptime_get_32();
+	k_spin_unlock(&prefs_lock, key_lock);
+}
+
+static void prefs_erase(void)
+{
+	uint32_t sector = prefs.next / PREFS_PAGES_PER_SECTOR;
+	uint32_t start = timer_hw->timerawl;
+	int ret;
+
+	flash_guard_enter();
+	ret = flash_area_erase(prefs.fa, sector * PREFS_SECTOR, PREFS_SECTOR);
+	flash_guard_exit();
+
+	prefs.stats.erase_last_us = timer_hw->timerawl - start;
+	prefs.stats.erase_max_us = MAX(prefs.stats.erase_max_us,
+				       prefs.stats.erase_last_us);
+
+	if (ret) {
+		LOG_ERR("Erase of sector %u failed: %d", sector, ret);
+		prefs.stats.errors++;
+		return;
+	}
+
+	prefs.stats.erases++;
+	prefs.erase_pending = false;
+}
+
+static void prefs_commit(void)
+{
+	k_spinlock_key_t key_lock;
+	uint32_t start;
+	int ret;
+
+	memset(&prefs_rec, 0xFF, sizeof(prefs_rec));
+	prefs_rec.magic = PREFS_MAGIC;
+	prefs_rec.seq = prefs.stats.seq + 1;
+	prefs_rec.count = 0;
+
+	key_lock = k_spin_lock(&prefs_lock);
+	for (uint32_t key = 0; key < PREFS_KEY_COUNT; key++) {
+		if (prefs.set & BIT(key)) {
+			struct prefs_entry *e = &prefs_rec.entry[prefs_rec.count++];
+
+			e->key = key;
+			e->reserved = 0;
+			e->value = prefs.value[key];
+		}
+	}
+	prefs.dirty = false;
+	k_spin_unlock(&prefs_lock, key_lock);
+
+	prefs_rec.crc = prefs_crc(&prefs_rec);
+
+	start = timer_hw->timerawl;
+	flash_guard_enter();
+	ret = flash_area_write(prefs.fa, prefs.next * PREFS_PAGE, &prefs_rec,
+			       sizeof(prefs_rec));
+	flash_guard_exit();
+	prefs.stats.program_last_us = timer_hw->timerawl - start;
+	prefs.stats.program_max_us = MAX(prefs.stats.program_max_us,
+					 prefs.stats.program_last_us);
+
+	if (ret) {
+		LOG_ERR("Commit to page %u failed: %d", prefs.next, ret);
+		prefs.stats.errors++;
+		key_lock = k_spin_lock(&prefs_lock);
+		prefs.dirty = true;
+		k_spin_unlock(&prefs_lock, key_lock);
+		/* Try again in the next page */
+		prefs_seek(prefs.next + 1);
+		return;
+	}
+
+	prefs.stats.commits++;
+	prefs.stats.seq = prefs_rec.seq;
+	prefs.stats.page = prefs.next;
+	prefs_seek(prefs.next + 1);
+}
+
+void prefs_poll(void)
+{
+	if (prefs.fa == NULL ||
+	    dap_queue_idle_ms() < CONFIG_PREFS_IDLE_MS) {
+		return;
+	}
+
+	/* One flash operation per idle window */
+	if (prefs.erase_pending) {
+		prefs_erase();
+	} else if (prefs.dirty &&
+		   k_uptime_get_32() - prefs.changed_ms >=
+		   CONFIG_PREFS_COMMIT_DELAY_MS) {
+		prefs_commit();
+	}
+}
+
+void prefs_get_stats(struct prefs_stats *stats)
+{
+	*stats = prefs.stats;
+	stats->dirty = prefs.dirty;
+}
+
+static int prefs_init(void)
+{
+	int ret;
+
+	ret = flash_area_open(PREFS_PARTITION, &prefs.fa);
+	if (ret) {
+		LOG_ERR("No settings partition: %d", ret);
+		prefs.fa = NULL;
+		return 0;
+	}
+
+	prefs_load();
+
+	return 0;
+}
+
+/* Before main(), which applies the settings */
+SYS_INIT(prefs_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+/* Shell commands */
+
+static int cmd_prefs_show(const struct shell *sh, size_t argc, char **argv)
+{
+	struct prefs_stats stats;
+	uint32_t value;
+
+	prefs_get_stats(&stats);
+
+	shell_print(sh, "Settings%s:", stats.dirty ? " (not committed yet)" : "");
+	for (uint32_t key = 0; key < PREFS_KEY_COUNT; key++) {
+		if (prefs_get(key, &value) == 0) {
+			shell_print(sh, "  %-20s %u", prefs_key_name[key], value);
+		} else {
+			shell_print(sh, "  %-20s default", prefs_key_name[key]);
+		}
+	}
+
+	shell_print(sh, "Store (%u KB, %u pages):", PREFS_SIZE / 1024, PREFS_PAGES);
+	shell_print(sh, "  record:   #%u in page %u, next page %u%s",
+		    stats.seq, stats.page, prefs.next,
+		    prefs.erase_pending ? " (erase pending)" : "");
+	shell_print(sh, "  commits:  %u, erases %u, errors %u",
+		    stats.commits, stats.erases, stats.errors);
+	shell_print(sh, "  program:  last %u us, max %u us",
+		    stats.program_last_us, stats.program_max_us);
+	shell_print(sh, "  erase:    last %u us, max %u us",
+		    stats.erase_last_us, stats.erase_max_us);
+
+	return 0;
+}
+
+static int cmd_prefs_clear(const struct shell *sh, size_t argc, char **argv)
+{
+	prefs_clear();
+	shell_print(sh, "Settings cleared, defaults apply from the next boot");
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_prefs,
+	SHELL_CMD(show, NULL, "Show the settings and the flash stall times",
+		  cmd_prefs_show),
+	SHELL_CMD(clear, NULL, "Forget every setting", cmd_prefs_clear),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(prefs, &sub_prefs, "Persistent settings", cmd_prefs_show);
@@ -0,0 +1,82 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Persistent runtime settings
+ */
+
+#ifndef PREFS_H
+#define PREFS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Setting keys, stored by number: only ever append */
+enum prefs_key {
+	/* Bonjour message on UART1 (bool) */
+	PREFS_BONJOUR,
+	/* Static level of D4 and D5 in percent */
+	PREFS_LED_BRIGHTNESS_D4,
+	PREFS_LED_BRIGHTNESS_D5,
+	/* Breathing effect on the PWM LEDs (bool) */
+	PREFS_LED_BREATHING,
+	/* LEDs follow the SWD and UART activity (bool) */
+	PREFS_LED_ACTIVITY,
+	PREFS_KEY_COUNT,
+};
+
+/* Commit counters and flash stall times */
+struct prefs_stats {
+	uint32_t commits;
+	uint32_t erases;
+	uint32_t errors;
+	/* Time interrupts stayed masked by one flash operation, in us */
+	uint32_t program_last_us;
+	uint32_t program_max_us;
+	uint32_t erase_last_us;
+	uint32_t erase_max_us;
+	/* Sequence number and page of the last record */
+	uint32_t seq;
+	uint32_t page;
+	/* Changes not committed yet */
+	bool dirty;
+};
+
+/**
+ * Get a setting.
+ *
+ * @param key Setting key
+ * @param value Destination
+ * @return 0 on success, -ENOENT if the setting was never stored
+ */
+int prefs_get(enum prefs_key key, uint32_t *value);
+
+/**
+ * Change a setting in RAM. Changes are coalesced and committed to flash
+ * later, in an idle window of the DAP queue.
+ *
+ * @param key Setting key
+ * @param value New value
+ */
+void prefs_set(enum prefs_key key, uint32_t value);
+
+/**
+ * Forget every setting, the defaults apply from the next boot.
+ */
+void prefs_clear(void);
+
+/**
+ * Run one pending flash operation, a record program or a sector erase,
+ * if the DAP queue has been idle long enough. Must only be called from
+ * the DAP queue thread, between requests.
+ */
+void prefs_poll(void);
+
+/**
+ * Get the commit counters.
+ *
+ * @param stats Destination
+ */
+void prefs_get_stats(struct prefs_stats *stats);
+
+#endif /* PREFS_H */
@@ -0,0 +1,949 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Probe-side SEGGER RTT engine
+ *
+ * The probe finds the RTT control block itself, by scanning a target RAM
+ * range for its "SEGGER RTT" ID, then moves the data of each channel
+ * between the target buffers and a CDC ACM instance:
+ *
+ *   target up-buffer   --> rtt_up ring   --> CDC ACM IN   (target output)
+ *   CDC ACM OUT --> rtt_down ring --> target down-buffer  (host input)
+ *
+ * Polling runs in the DAP queue thread, which owns the SWD port, one
+ * step at a time between host requests and never inside a batch: a
+ * step is one slice of the scan, or at most one transfer per channel
+ * and direction, so a DAP request waits for one step at most. The poll
+ * interval is adaptive: back to the minimum as soon as a step moves
+ * data or the host types, doubled after each idle step up to the
+ * maximum.
+ *
+ * Steps go through MEM-AP 0 and leave the debug port as the host left
+ * it: CSW and TAR are read before and written back after, and DP SELECT
+ * is restored from the last value the host wrote, snooped from its
+ * DAP_Transfer commands. When no host is connected, the engine brings
+ * the port up on its own (CONFIG_RTT_ATTACH), so target consoles keep
+ * flowing without a debugger.
+ *
+ * Polling is suspended while the host has the core halted, as snooped
+ * from its DHCSR writes, and during an on-probe flash session: the host
+ * may be loading a flash algorithm over the RAM that held the control
+ * block. The control block ID is read again before each write to the
+ * target, so a step never writes offsets into memory that changed under
+ * it.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/swdp.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(rtt, LOG_LEVEL_INF);
+
+#include "rtt.h"
+#include "dap_vendor.h"
+#include "dap_flash.h"
+#include "swd_cal.h"
+#include "perf.h"
+
+/* Host commands tracked by rtt_snoop() */
+#define DAP_CMD_CONNECT		0x02
+#define DAP_CMD_DISCONNECT	0x03
+#define DAP_CMD_TRANSFER	0x05
+
+/* DAP_Transfer request bits */
+#define XFER_RnW		BIT(1)
+#define XFER_REG_MASK		0x0F
+#define XFER_MATCH_VALUE	BIT(4)
+#define XFER_MATCH_MASK		BIT(5)
+#define XFER_DP_SELECT		0x08
+#define XFER_AP_TAR		0x05
+#define XFER_AP_DRW		0x0D
+
+/* Cortex-M halting debug, as written by the host */
+#define DHCSR			0xE000EDF0
+#define DHCSR_KEY_MASK		0xFFFF0000
+#define DHCSR_DBGKEY		0xA05F0000
+#define DHCSR_C_HALT		BIT(1)
+
+/* Debug port and MEM-AP registers, as SWDP_REQUEST_* bits */
+#define DP_ABORT	0
+#define DP_SELECT	SWDP_REQUEST_A3
+#define DP_RDBUFF	(SWDP_REQUEST_A2 | SWDP_REQUEST_A3)
+#define AP_CSW		SWDP_REQUEST_APnDP
+#define AP_TAR		(SWDP_REQUEST_APnDP | SWDP_REQUEST_A2)
+#define AP_DRW		(SWDP_REQUEST_APnDP | SWDP_REQUEST_A2 | SWDP_REQUEST_A3)
+
+#define ABORT_CLEAR	0x1E
+
+/* 8-bit, auto-increment single, privileged debug access */
+#define CSW_BYTE_INCR	0x23000010
+#define TAR_WRAP	1024
+
+/* SEGGER_RTT_CB and SEGGER_RTT_BUFFER_UP/DOWN layouts */
+#define CB_ID_LEN	16
+#define CB_MAX_UP	16
+#define CB_BUFFERS	24
+#define DESC_SIZE	24
+#define DESC_BUF	4
+#define DESC_WR_OFF	12
+#define DESC_RD_OFF	16
+
+/* Sanity limit on the buffer counts of a candidate control block */
+#define CB_MAX_BUFFERS	32
+
+#define RTT_SCAN_SLICE	1024
+#define RTT_CHUNK	CONFIG_RTT_CHUNK_SIZE
+#define RTT_VERIFY_MS	1000
+#define RTT_RESCAN_MS	1000
+
+static const uint8_t rtt_id[CB_ID_LEN] = "SEGGER RTT";
+
+struct rtt_channel {
+	const struct device *cdc;
+	struct ring_buf *up;
+	struct ring_buf *down;
+	bool rx_paused;
+	/* Target descriptors, 0 when the control block has none */
+	uint32_t up_desc;
+	uint32_t up_buf;
+	uint32_t up_size;
+	uint32_t down_desc;
+	uint32_t down_buf;
+	uint32_t down_size;
+	/* Bytes moved since rtt_start() */
+	uint32_t up_bytes;
+	uint32_t down_bytes;
+};
+
+#define RTT_RINGS(i, _)							\
+	RING_BUF_DECLARE(rtt_up##i, CONFIG_RTT_RING_SIZE);		\
+	RING_BUF_DECLARE(rtt_down##i, CONFIG_RTT_RING_SIZE)
+
+#define RTT_CHANNEL(i, _)						\
+	{								\
+		.cdc = DEVICE_DT_GET(DT_NODELABEL(cdc_acm_rtt##i)),	\
+		.up = &rtt_up##i,					\
+		.down = &rtt_down##i,					\
+	}
+
+LISTIFY(CONFIG_RTT_CHANNELS, RTT_RINGS, (;));
+
+static struct rtt_channel rtt_channels[] = {
+	LISTIFY(CONFIG_RTT_CHANNELS, RTT_CHANNEL, (,))
+};
+
+enum rtt_state {
+	RTT_STOPPED,
+	RTT_SCANNING,
+	RTT_RUNNING,
+};
+
+static const char *const rtt_state_str[] = {
+	[RTT_STOPPED] = "stopped",
+	[RTT_SCANNING] = "scanning",
+	[RTT_RUNNING] = "running",
+};
+
+static struct {
+	const struct device *swd_dev;
+	enum rtt_state state;
+	uint32_t range_addr;
+	uint32_t range_size;
+	uint32_t scan_addr;
+	uint32_t cb;
+	int64_t verify_ms;
+	k_ticks_t next;
+	uint32_t interval_us;
+
+	/* Debug port state left by the host */
+	bool host_connected;
+	bool attached;
+	uint32_t host_select;
+	/* Last TAR written by the host, and whether it halted the core */
+	uint32_t host_tar;
+	bool host_halted;
+	uint32_t csw;
+	uint32_t tar;
+
+	/* Counters since rtt_start() */
+	int64_t start_ms;
+	uint32_t steps;
+	uint32_t errors;
+	uint64_t step_cycles;
+	uint32_t step_max;
+} rtt;
+
+/* Serializes the shell with the queue thread */
+static K_MUTEX_DEFINE(rtt_lock);
+/* Set by the CDC side when the host sent data */
+static atomic_t rtt_kick;
+
+/* Word aligned target data of the current step */
+static uint8_t rtt_scratch[MAX(RTT_SCAN_SLICE, RTT_CHUNK + 8)] __aligned(4);
+
+static int rtt_xfer(uint8_t request, uint32_t *data)
+{
+	return dap_vendor_xfer(request, data) == SWDP_ACK_OK ? 0 : -EIO;
+}
+
+/* Clear sticky errors, so the host does not inherit them */
+static void rtt_clear_errors(void)
+{
+	uint32_t abort = ABORT_CLEAR;
+
+	dap_vendor_xfer(DP_ABORT, &abort);
+}
+
+/* Bring the SWD port up when no host is connected */
+static int rtt_attach(void)
+{
+	const struct swdp_api *api = rtt.swd_dev->api;
+	uint32_t dpidr;
+	uint32_t clock;
+	int ret;
+
+	api->swdp_port_on(rtt.swd_dev);
+	api->swdp_set_clock(rtt.swd_dev, CONFIG_RTT_SWD_CLOCK);
+	api->swdp_configure(rtt.swd_dev, 1, false);
+
+	ret = dap_vendor_attach(&dpidr);
+
+	/* Run a calibrated target at its own clock */
+	if (IS_ENABLED(CONFIG_SWD_CAL) && ret == 0) {
+		clock = swd_cal_lookup(dpidr);
+		if (clock != 0) {
+			api->swdp_set_clock(rtt.swd_dev, clock);
+		}
+	}
+
+	rtt.host_select = 0;
+	rtt.attached = (ret == 0);
+
+	return ret;
+}
+
+static void rtt_detach(void)
+{
+	const struct swdp_api *api = rtt.swd_dev->api;
+
+	api->swdp_port_off(rtt.swd_dev);
+	rtt.attached = false;
+}
+
+/* Select MEM-AP 0 and save the host CSW and TAR */
+static int rtt_begin(void)
+{
+	uint32_t value = 0;
+	int ret;
+
+	if (!rtt.host_connected && !rtt.attached) {
+		if (!IS_ENABLED(CONFIG_RTT_ATTACH)) {
+			return -ENODEV;
+		}
+
+		ret = rtt_attach();
+		if (ret) {
+			return ret;
+		}
+	}
+
+	if (rtt.host_select != 0) {
+		ret = rtt_xfer(DP_SELECT, &value);
+		if (ret) {
+			return ret;
+		}
+	}
+
+	/* Posted reads: CSW comes with the TAR read, TAR with RDBUFF */
+	ret = rtt_xfer(AP_CSW | SWDP_REQUEST_RnW, &value);
+	if (ret == 0) {
+		ret = rtt_xfer(AP_TAR | SWDP_REQUEST_RnW, &rtt.csw);
+	}
+	if (ret == 0) {
+		ret = rtt_xfer(DP_RDBUFF | SWDP_REQUEST_RnW, &rtt.tar);
+	}
+
+	return ret;
+}
+
+/* Give the debug port back as the host left it */
+static void rtt_end(void)
+{
+	rtt_xfer(AP_CSW, &rtt.csw);
+	rtt_xfer(AP_TAR, &rtt.tar);
+
+	if (rtt.host_select != 0) {
+		rtt_xfer(DP_SELECT, &rtt.host_select);
+	}
+}
+
+/* Read bytes at any address with word accesses, into rtt_scratch */
+static int rtt_read(uint32_t addr, uint32_t len, const uint8_t **data)
+{
+	uint32_t start = addr & ~3U;
+	uint32_t words = (addr + len - start + 3) / 4;
+	uint32_t done;
+
+	if (dap_vendor_mem_read(start, rtt_scratch, words, &done) != SWDP_ACK_OK) {
+		return -EIO;
+	}
+
+	*data = &rtt_scratch[addr - start];
+
+	return 0;
+}
+
+static int rtt_read_words(uint32_t addr, uint32_t *words, uint32_t count)
+{
+	const uint8_t *data;
+	int ret;
+
+	ret = rtt_read(addr, count * 4, &data);
+	for (uint32_t i = 0; ret == 0 && i < count; i++) {
+		words[i] = sys_get_le32(&data[i * 4]);
+	}
+
+	return ret;
+}
+
+static int rtt_write_word(uint32_t addr, uint32_t value)
+{
+	uint8_t buf[4];
+
+	sys_put_le32(value, buf);
+
+	return dap_vendor_mem_write(addr, buf, 1) == SWDP_ACK_OK ? 0 : -EIO;
+}
+
+/* Write bytes at any address with byte accesses */
+static int rtt_write_bytes(uint32_t addr, const uint8_t *src, uint32_t len)
+{
+	uint32_t value = CSW_BYTE_INCR;
+	int ret;
+
+	ret = rtt_xfer(AP_CSW, &value);
+
+	for (uint32_t i = 0; ret == 0 && i < len; i++, addr++) {
+		if (i == 0 || addr % TAR_WRAP == 0) {
+			value = addr;
+			ret = rtt_xfer(AP_TAR, &value);
+			if (ret) {
+				break;
+			}
+		}
+
+		/* Byte lane of the address */
+		value = (uint32_t)src[i] << (8 * (addr & 3));
+		ret = rtt_xfer(AP_DRW, &value);
+	}
+
+	/* Wait for the last write to complete */
+	if (ret == 0) {
+		ret = rtt_xfer(DP_RDBUFF | SWDP_REQUEST_RnW, &value);
+	}
+
+	return ret;
+}
+
+static void rtt_rescan(void)
+{
+	rtt.state = RTT_SCANNING;
+	rtt.scan_addr = rtt.range_addr;
+	rtt.cb = 0;
+}
+
+/* Read the buffer descriptors of a candidate control block */
+static int rtt_found(uint32_t cb)
+{
+	uint32_t max[2];
+	uint32_t desc[2];
+	int ret;
+
+	ret = rtt_read_words(cb + CB_MAX_UP, max, 2);
+	if (ret || max[0] > CB_MAX_BUFFERS || max[1] > CB_MAX_BUFFERS) {
+		return ret;
+	}
+
+	for (uint32_t i = 0; i < ARRAY_SIZE(rtt_channels); i++) {
+		struct rtt_channel *ch = &rtt_channels[i];
+
+		ch->up_desc = 0;
+		ch->down_desc = 0;
+
+		if (i < max[0]) {
+			ch->up_desc = cb + CB_BUFFERS + i * DESC_SIZE;
+			ret = rtt_read_words(ch->up_desc + DESC_BUF, desc, 2);
+			if (ret) {
+				return ret;
+			}
+			ch->up_buf = desc[0];
+			ch->up_size = desc[1];
+			if (ch->up_buf == 0 || ch->up_size == 0) {
+				ch->up_desc = 0;
+			}
+		}
+
+		if (i < max[1]) {
+			ch->down_desc = cb + CB_BUFFERS + (max[0] + i) * DESC_SIZE;
+			ret = rtt_read_words(ch->down_desc + DESC_BUF, desc, 2);
+			if (ret) {
+				return ret;
+			}
+			ch->down_buf = desc[0];
+			ch->down_size = desc[1];
+			if (ch->down_buf == 0 || ch->down_size == 0) {
+				ch->down_desc = 0;
+			}
+		}
+	}
+
+	LOG_INF("Control block at 0x%08x, %u up and %u down buffers",
+		cb, max[0], max[1]);
+
+	rtt.cb = cb;
+	rtt.state = RTT_RUNNING;
+	rtt.verify_ms = k_uptime_get() + RTT_VERIFY_MS;
+
+	return 0;
+}
+
+/* Look for the control block ID in the next slice of the range */
+static int rtt_scan_step(void)
+{
+	uint32_t end = rtt.range_addr + rtt.range_size;
+	uint32_t len = MIN(RTT_SCAN_SLICE, end - rtt.scan_addr);
+	uint32_t done;
+
+	if (len < CB_ID_LEN) {
+		/* Not found in the whole range, the target may not be up yet */
+		rtt.scan_addr = rtt.range_addr;
+		rtt.next = k_uptime_ticks() + k_ms_to_ticks_ceil64(RTT_RESCAN_MS);
+		return 0;
+	}
+
+	if (dap_vendor_mem_read(rtt.scan_addr, rtt_scratch, len / 4, &done) !=
+	    SWDP_ACK_OK) {
+		return -EIO;
+	}
+
+	for (uint32_t off = 0; off + CB_ID_LEN <= len; off += 4) {
+		if (memcmp(&rtt_scratch[off], rtt_id, CB_ID_LEN) == 0 &&
+		    rtt_found(rtt.scan_addr + off) == 0 &&
+		    rtt.state == RTT_RUNNING) {
+			return 0;
+		}
+	}
+
+	/* Overlap the slices so that an ID across two of them is seen */
+	rtt.scan_addr += len - (CB_ID_LEN - 4);
+
+	return 0;
+}
+
+/* Check that the control block is still there */
+static int rtt_verify(void)
+{
+	const uint8_t *id;
+	int ret;
+
+	ret = rtt_read(rtt.cb, CB_ID_LEN, &id);
+	if (ret) {
+		return ret;
+	}
+	if (memcmp(id, rtt_id, CB_ID_LEN) != 0) {
+		return -ENOENT;
+	}
+
+	rtt.verify_ms = k_uptime_get() + RTT_VERIFY_MS;
+
+	return 0;
+}
+
+/* Move target output to the CDC ring */
+static int rtt_up_step(struct rtt_channel *ch, uint32_t *moved)
+{
+	uint32_t space = ring_buf_space_get(ch->up);
+	const uint8_t *data;
+	uint32_t off[2];
+	uint32_t wr, rd, len;
+	int ret;
+
+	if (ch->up_desc == 0 || space == 0) {
+		return 0;
+	}
+
+	ret = rtt_read_words(ch->up_desc + DESC_WR_OFF, off, 2);
+	if (ret) {
+		return ret;
+	}
+
+	wr = off[0];
+	rd = off[1];
+	if (wr >= ch->up_size || rd >= ch->up_size) {
+		return -ENOENT;
+	}
+
+	if (wr == rd) {
+		return 0;
+	}
+
+	/* RdOff is written below */
+	ret = rtt_verify();
+	if (ret) {
+		return ret;
+	}
+
+	/* Contiguous part only, the rest comes with the next step */
+	len = (wr > rd ? wr : ch->up_size) - rd;
+	len = MIN(len, MIN(space, RTT_CHUNK));
+
+	ret = rtt_read(ch->up_buf + rd, len, &data);
+	if (ret) {
+		return ret;
+	}
+
+	ring_buf_put(ch->up, data, len);
+	uart_irq_tx_enable(ch->cdc);
+
+	ch->up_bytes += len;
+	*moved += len;
+
+	return rtt_write_word(ch->up_desc + DESC_RD_OFF, (rd + len) % ch->up_size);
+}
+
+/* Move host input to the target */
+static int rtt_down_step(struct rtt_channel *ch, uint32_t *moved)
+{
+	uint32_t off[2];
+	uint32_t wr, rd, len;
+	uint8_t *data;
+	int ret;
+
+	if (ch->down_desc == 0 || ring_buf_is_empty(ch->down)) {
+		return 0;
+	}
+
+	ret = rtt_read_words(ch->down_desc + DESC_WR_OFF, off, 2);
+	if (ret) {
+		return ret;
+	}
+
+	wr = off[0];
+	rd = off[1];
+	if (wr >= ch->down_size || rd >= ch->down_size) {
+		return -ENOENT;
+	}
+
+	/* Contiguous free space, one byte is kept free to tell full from empty */
+	len = (rd > wr) ? rd - wr - 1 : ch->down_size - wr - (rd == 0 ? 1 : 0);
+	if (len == 0) {
+		return 0;
+	}
+
+	/* The buffer and WrOff are written below */
+	ret = rtt_verify();
+	if (ret) {
+		return ret;
+	}
+
+	len = ring_buf_get_claim(ch->down, &data, MIN(len, RTT_CHUNK));
+	if (len == 0) {
+		return 0;
+	}
+
+	ret = rtt_write_bytes(ch->down_buf + wr, data, len);
+	if (ret) {
+		ring_buf_get_finish(ch->down, 0);
+		return ret;
+	}
+
+	ring_buf_get_finish(ch->down, len);
+	if (ch->rx_paused) {
+		ch->rx_paused = false;
+		uart_irq_rx_enable(ch->cdc);
+	}
+
+	ch->down_bytes += len;
+	*moved += len;
+
+	return rtt_write_word(ch->down_desc + DESC_WR_OFF,
+			      (wr + len) % ch->down_size);
+}
+
+static int rtt_run_step(uint32_t *moved)
+{
+	int ret = 0;
+
+	/* The target may have been reset or reflashed */
+	if (k_uptime_get() >= rtt.verify_ms) {
+		ret = rtt_verify();
+		if (ret) {
+			return ret;
+		}
+	}
+
+	for (uint32_t i = 0; ret == 0 && i < ARRAY_SIZE(rtt_channels); i++) {
+		ret = rtt_up_step(&rtt_channels[i], moved);
+		if (ret == 0) {
+			ret = rtt_down_step(&rtt_channels[i], moved);
+		}
+	}
+
+	return ret;
+}
+
+/* Adapt the poll interval to the traffic */
+static void rtt_schedule(bool busy)
+{
+	if (busy) {
+		rtt.interval_us = CONFIG_RTT_POLL_MIN_US;
+	} else {
+		rtt.interval_us = MIN(rtt.interval_us * 2,
+				      CONFIG_RTT_POLL_MAX_MS * USEC_PER_MSEC);
+	}
+
+	rtt.next = k_uptime_ticks() + k_us_to_ticks_ceil64(rtt.interval_us);
+}
+
+k_ticks_t rtt_poll_ticks(k_ticks_t max)
+{
+	k_ticks_t delay;
+
+	if (rtt.state == RTT_STOPPED) {
+		return rtt.attached ? 0 : max;
+	}
+
+	if (atomic_get(&rtt_kick)) {
+		return 0;
+	}
+
+	delay = rtt.next - k_uptime_ticks();
+
+	return CLAMP(delay, 0, max);
+}
+
+/* The host halted the core, or the probe runs a flash algorithm */
+static bool rtt_suspended(void)
+{
+	return rtt.host_halted ||
+	       (IS_ENABLED(CONFIG_DAP_FLASH) && dap_flash_busy());
+}
+
+PERF_POINT_DEFINE(rtt_poll);
+
+void rtt_poll(void)
+{
+	uint32_t moved = 0;
+	uint32_t cycles;
+	int ret;
+
+	if (rtt_poll_ticks(1) > 0) {
+		return;
+	}
+
+	k_mutex_lock(&rtt_lock, K_FOREVER);
+
+	if (rtt.state == RTT_STOPPED) {
+		if (rtt.attached && !rtt.host_connected) {
+			rtt_detach();
+		}
+		k_mutex_unlock(&rtt_lock);
+		return;
+	}
+
+	if (rtt_suspended()) {
+		/* Host input waits in the ring */
+		atomic_clear(&rtt_kick);
+		rtt_schedule(false);
+		k_mutex_unlock(&rtt_lock);
+		return;
+	}
+
+	PERF_BEGIN(rtt_poll);
+	cycles = k_cycle_get_32();
+	atomic_clear(&rtt_kick);
+
+	ret = rtt_begin();
+	if (ret == 0) {
+		if (rtt.state == RTT_SCANNING) {
+			ret = rtt_scan_step();
+		} else {
+			ret = rtt_run_step(&moved);
+		}
+		rtt_end();
+	}
+
+	if (ret == -EIO || ret == -ETIMEDOUT) {
+		rtt_clear_errors();
+		rtt.errors++;
+		/* Attach again on the next step */
+		rtt.attached = false;
+	} else if (ret == -ENOENT) {
+		LOG_INF("Control block lost, scanning again");
+		rtt_rescan();
+	}
+
+	cycles = k_cycle_get_32() - cycles;
+	rtt.steps++;
+	rtt.step_cycles += cycles;
+	rtt.step_max = MAX(rtt.step_max, cycles);
+
+	/* A rescan delay set by the scan step is kept */
+	if (rtt.next <= k_uptime_ticks()) {
+		rtt_schedule(moved > 0 || (ret == 0 && rtt.state == RTT_SCANNING));
+	}
+
+	PERF_END(rtt_poll);
+	k_mutex_unlock(&rtt_lock);
+}
+
+/* A register write of the host, from DAP_Transfer */
+static void rtt_snoop_write(uint8_t reg, uint32_t value)
+{
+	switch (reg) {
+	case XFER_DP_SELECT:
+		rtt.host_select = value;
+		break;
+	case XFER_AP_TAR:
+		rtt.host_tar = value;
+		break;
+	case XFER_AP_DRW:
+		if (rtt.host_tar == DHCSR &&
+		    (value & DHCSR_KEY_MASK) == DHCSR_DBGKEY) {
+			rtt.host_halted = (value & DHCSR_C_HALT) != 0;
+		}
+		/* TAR moved on, or not, depending on CSW */
+		rtt.host_tar = 0;
+		break;
+	default:
+		break;
+	}
+}
+
+void rtt_snoop(const uint8_t *request, const uint8_t *response)
+{
+	const uint8_t *p = &request[3];
+
+	switch (request[0]) {
+	case DAP_CMD_CONNECT:
+		rtt.host_connected = (response[1] != 0);
+		rtt.host_select = 0;
+		rtt.host_halted = false;
+		rtt.attached = false;
+		break;
+
+	case DAP_CMD_DISCONNECT:
+		rtt.host_connected = false;
+		rtt.host_halted = false;
+		rtt.attached = false;
+		break;
+
+	case DAP_CMD_TRANSFER:
+		/* Only the transfers the DAP core executed */
+		for (uint8_t i = 0; i < request[2] && i < response[1]; i++) {
+			uint8_t req = *p++;
+
+			if ((req & XFER_RnW) && !(req & XFER_MATCH_VALUE)) {
+				if ((req & XFER_REG_MASK) == XFER_AP_DRW) {
+					rtt.host_tar = 0;
+				}
+				continue;
+			}
+
+			if (!(req & (XFER_RnW | XFER_MATCH_MASK))) {
+				rtt_snoop_write(req & XFER_REG_MASK,
+						sys_get_le32(p));
+			}
+			p += 4;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+void rtt_start(uint32_t addr, uint32_t size)
+{
+	k_mutex_lock(&rtt_lock, K_FOREVER);
+
+	rtt.range_addr = addr & ~3U;
+	rtt.range_size = size & ~3U;
+	rtt_rescan();
+	rtt.interval_us = CONFIG_RTT_POLL_MIN_US;
+	rtt.next = k_uptime_ticks();
+
+	rtt.start_ms = k_uptime_get();
+	rtt.steps = 0;
+	rtt.errors = 0;
+	rtt.step_cycles = 0;
+	rtt.step_max = 0;
+	for (uint32_t i = 0; i < ARRAY_SIZE(rtt_channels); i++) {
+		rtt_channels[i].up_bytes = 0;
+		rtt_channels[i].down_bytes = 0;
+	}
+
+	k_mutex_unlock(&rtt_lock);
+}
+
+void rtt_stop(void)
+{
+	k_mutex_lock(&rtt_lock, K_FOREVER);
+	rtt.state = RTT_STOPPED;
+	k_mutex_unlock(&rtt_lock);
+}
+
+static void rtt_cdc_isr(const struct device *dev, void *user_data)
+{
+	struct rtt_channel *ch = user_data;
+	uint8_t *ptr;
+	uint32_t len;
+
+	while (uart_irq_update(dev) && uart_irq_is_pending(dev)) {
+		if (uart_irq_rx_ready(dev)) {
+			len = ring_buf_put_claim(ch->down, &ptr,
+						 CONFIG_RTT_RING_SIZE);
+			if (len == 0) {
+				/* Let USB flow control hold the host back */
+				ch->rx_paused = true;
+				uart_irq_rx_disable(dev);
+			} else {
+				len = uart_fifo_read(dev, ptr, len);
+				ring_buf_put_finish(ch->down, len);
+				atomic_set(&rtt_kick, 1);
+			}
+		}
+
+		if (uart_irq_tx_ready(dev)) {
+			len = ring_buf_get_claim(ch->up, &ptr,
+						 CONFIG_RTT_RING_SIZE);
+			if (len == 0) {
+				uart_irq_tx_disable(dev);
+			} else {
+				len = uart_fifo_fill(dev, ptr, len);
+				ring_buf_get_finish(ch->up, len);
+			}
+		}
+	}
+}
+
+int rtt_init(const struct device *swd_dev)
+{
+	int ret;
+
+	if (!device_is_ready(swd_dev)) {
+		return -ENODEV;
+	}
+
+	rtt.swd_dev = swd_dev;
+
+	for (uint32_t i = 0; i < ARRAY_SIZE(rtt_channels); i++) {
+		struct rtt_channel *ch = &rtt_channels[i];
+
+		if (!device_is_ready(ch->cdc)) {
+			return -ENODEV;
+		}
+
+		ret = uart_irq_callback_user_data_set(ch->cdc, rtt_cdc_isr, ch);
+		if (ret) {
+			return ret;
+		}
+
+		uart_irq_rx_enable(ch->cdc);
+	}
+
+	if (IS_ENABLED(CONFIG_RTT_AUTOSTART)) {
+		rtt_start(CONFIG_RTT_SEARCH_ADDR, CONFIG_RTT_SEARCH_SIZE);
+	}
+
+	return 0;
+}
+
+/* Shell commands */
+
+static int cmd_rtt_start(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t addr = CONFIG_RTT_SEARCH_ADDR;
+	uint32_t size = CONFIG_RTT_SEARCH_SIZE;
+
+	if (argc > 1) {
+		addr = strtoul(argv[1], NULL, 0);
+	}
+	if (argc > 2) {
+		size = strtoul(argv[2], NULL, 0);
+	}
+
+	if (size < CB_ID_LEN) {
+		shell_error(sh, "Range too small");
+		return -EINVAL;
+	}
+
+	rtt_start(addr, size);
+	shell_print(sh, "Looking for RTT in 0x%08x-0x%08x", addr, addr + size);
+
+	return 0;
+}
+
+static int cmd_rtt_stop(const struct shell *sh, size_t argc, char **argv)
+{
+	rtt_stop();
+	shell_print(sh, "RTT stopped");
+
+	return 0;
+}
+
+static int cmd_rtt_status(const struct shell *sh, size_t argc, char **argv)
+{
+	int64_t ms = MAX(k_uptime_get() - rtt.start_ms, 1);
+	uint32_t steps = MAX(rtt.steps, 1);
+
+	shell_print(sh, "RTT %s, range 0x%08x-0x%08x, port %s",
+		    rtt_state_str[rtt.state], rtt.range_addr,
+		    rtt.range_addr + rtt.range_size,
+		    rtt.host_connected ? "shared with host" :
+		    rtt.attached ? "attached by probe" : "off");
+	if (rtt.state == RTT_RUNNING) {
+		shell_print(sh, "  control block: 0x%08x", rtt.cb);
+	}
+	if (rtt.state != RTT_STOPPED && rtt_suspended()) {
+		shell_print(sh, "  suspended:     target halted or being flashed");
+	}
+	shell_print(sh, "  poll interval: %u us (%u-%u us)", rtt.interval_us,
+		    CONFIG_RTT_POLL_MIN_US, CONFIG_RTT_POLL_MAX_MS * USEC_PER_MSEC);
+	shell_print(sh, "  steps:         %u, %u SWD errors", rtt.steps,
+		    rtt.errors);
+	shell_print(sh, "  step time:     avg %u us, max %u us",
+		    k_cyc_to_us_floor32(rtt.step_cycles / steps),
+		    k_cyc_to_us_floor32(rtt.step_max));
+
+	for (uint32_t i = 0; i < ARRAY_SIZE(rtt_channels); i++) {
+		const struct rtt_channel *ch = &rtt_channels[i];
+
+		shell_print(sh, "  channel %u: up %u bytes (%llu B/s), "
+			    "down %u bytes (%llu B/s)%s", i,
+			    ch->up_bytes, (uint64_t)ch->up_bytes * 1000U / ms,
+			    ch->down_bytes, (uint64_t)ch->down_bytes * 1000U / ms,
+			    ch->up_desc || ch->down_desc ? "" : ", no buffer");
+	}
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_rtt,
+	SHELL_CMD_ARG(start, NULL, "Look for RTT: [addr] [size]",
+		      cmd_rtt_start, 1, 2),
+	SHELL_CMD(stop, NULL, "Stop RTT polling", cmd_rtt_stop),
+	SHELL_CMD(status, NULL, "Show RTT state, latency and bandwidth",
+		  cmd_rtt_status),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(rtt, &sub_rtt, "Probe-side SEGGER RTT", cmd_rtt_status);
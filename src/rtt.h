@@ -0,0 +1,63 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Probe-side SEGGER RTT engine
+ */
+
+#ifndef RTT_H
+#define RTT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+struct device;
+
+/**
+ * Set the SWD port and the CDC ACM instances of the RTT channels.
+ *
+ * @param swd_dev SWD port device, the one given to dap_setup()
+ * @return 0 on success, -ENODEV if a device is not ready
+ */
+int rtt_init(const struct device *swd_dev);
+
+/**
+ * Start looking for the control block in a target RAM range.
+ *
+ * @param addr Word aligned start address
+ * @param size Range size in bytes
+ */
+void rtt_start(uint32_t addr, uint32_t size);
+
+/**
+ * Stop polling, the channels keep the data already buffered.
+ */
+void rtt_stop(void);
+
+/**
+ * Run one polling step if it is due: a slice of the control block scan,
+ * or one transfer per channel and direction. Must only be called from
+ * the DAP queue thread, between requests.
+ */
+void rtt_poll(void);
+
+/**
+ * Get the time until the next polling step.
+ *
+ * @param max Longest wait in ticks
+ * @return Ticks until rtt_poll() has work, at most max
+ */
+k_ticks_t rtt_poll_ticks(k_ticks_t max);
+
+/**
+ * Track the debug port state set by the host, after a command ran:
+ * DAP_Connect, DAP_Disconnect, and DP SELECT and DHCSR writes in
+ * DAP_Transfer.
+ *
+ * @param request Command
+ * @param response Its response
+ */
+void rtt_snoop(const uint8_t *request, const uint8_t *response);
+
+#endif /* RTT_H */
@@ -0,0 +1,144 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Periodic job scheduler
+ *
+ * Each job is a delayable work item on a dedicated work queue. It is
+ * rescheduled on an absolute timeout, release += period, so periods do
+ * not drift with execution time. With the tickless kernel the next timer
+ * interrupt is programmed for the earliest pending release, there is no
+ * polling loop.
+ *
+ * For every run the scheduler records the lateness (start - release),
+ * the execution time and whether the job completed within its deadline.
+ * A job that overran its whole period skips the missed releases instead
+ * of running back to back.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include "sched.h"
+
+static K_THREAD_STACK_DEFINE(sched_stack, CONFIG_SCHED_STACK_SIZE);
+static struct k_work_q sched_wq;
+static sys_slist_t sched_jobs = SYS_SLIST_STATIC_INIT(&sched_jobs);
+
+static void sched_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct sched_job *job = CONTAINER_OF(dwork, struct sched_job, work);
+	int64_t period = k_ms_to_ticks_ceil64(job->period_ms);
+	int64_t deadline = k_ms_to_ticks_ceil64(job->deadline_ms ?
+						 job->deadline_ms : job->period_ms);
+	int64_t start = k_uptime_ticks();
+	uint32_t cycles = k_cycle_get_32();
+	uint32_t exec_us;
+	uint32_t late_us;
+	int64_t end;
+
+	job->handler();
+
+	exec_us = k_cyc_to_us_ceil32(k_cycle_get_32() - cycles);
+	end = k_uptime_ticks();
+	late_us = (uint32_t)k_ticks_to_us_ceil64(MAX(start - job->release, 0));
+
+	job->runs++;
+	job->wcet_us = MAX(job->wcet_us, exec_us);
+	job->max_late_us = MAX(job->max_late_us, late_us);
+	if (end - job->release > deadline) {
+		job->misses++;
+	}
+
+	job->release += period;
+	while (job->release <= end) {
+		job->release += period;
+		job->skipped++;
+	}
+
+	k_work_reschedule_for_queue(&sched_wq, &job->work,
+				    K_TIMEOUT_ABS_TICKS(job->release));
+}
+
+int sched_add(struct sched_job *job)
+{
+	if (job->period_ms == 0 || job->handler == NULL) {
+		return -EINVAL;
+	}
+
+	k_work_init_delayable(&job->work, sched_work_handler);
+	sys_slist_append(&sched_jobs, &job->node);
+
+	job->release = k_uptime_ticks() + k_ms_to_ticks_ceil64(job->period_ms);
+
+	return k_work_reschedule_for_queue(&sched_wq, &job->work,
+					   K_TIMEOUT_ABS_TICKS(job->release)) < 0 ?
+	       -EIO : 0;
+}
+
+void sched_reset_stats(void)
+{
+	struct sched_job *job;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&sched_jobs, job, node) {
+		job->runs = 0;
+		job->misses = 0;
+		job->skipped = 0;
+		job->wcet_us = 0;
+		job->max_late_us = 0;
+	}
+}
+
+static int sched_init(void)
+{
+	const struct k_work_queue_config cfg = {
+		.name = "sched",
+	};
+
+	k_work_queue_start(&sched_wq, sched_stack,
+			   K_THREAD_STACK_SIZEOF(sched_stack),
+			   CONFIG_SCHED_THREAD_PRIORITY, &cfg);
+
+	return 0;
+}
+
+SYS_INIT(sched_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
+
+/* Shell commands */
+
+static int cmd_sched_list(const struct shell *sh, size_t argc, char **argv)
+{
+	struct sched_job *job;
+
+	shell_print(sh, "%-12s %8s %8s %8s %6s %6s %9s %9s",
+		    "Job", "Period", "Deadline", "Runs", "Miss", "Skip",
+		    "WCET(us)", "Late(us)");
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&sched_jobs, job, node) {
+		shell_print(sh, "%-12s %6ums %6ums %8u %6u %6u %9u %9u",
+			    job->name, job->period_ms,
+			    job->deadline_ms ? job->deadline_ms : job->period_ms,
+			    job->runs, job->misses, job->skipped,
+			    job->wcet_us, job->max_late_us);
+	}
+
+	return 0;
+}
+
+static int cmd_sched_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	sched_reset_stats();
+	shell_print(sh, "Scheduler counters reset");
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_sched,
+	SHELL_CMD(list, NULL, "Show per-job runs, WCET and lateness",
+		  cmd_sched_list),
+	SHELL_CMD(reset, NULL, "Reset job counters", cmd_sched_reset),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(sched, &sub_sched, "Periodic job scheduler", cmd_sched_list);
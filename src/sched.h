@@ -0,0 +1,68 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Periodic job scheduler
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/slist.h>
+
+/* A periodic job, statically allocated by its owner */
+struct sched_job {
+	/* Name shown by the sched shell command */
+	const char *name;
+	/* Job body, runs in the scheduler work queue thread */
+	void (*handler)(void);
+	/* Release period */
+	uint32_t period_ms;
+	/* Must complete within this time after its release, 0 = period */
+	uint32_t deadline_ms;
+
+	/* Private, managed by the scheduler */
+	sys_snode_t node;
+	struct k_work_delayable work;
+	int64_t release;
+	uint32_t runs;
+	uint32_t misses;
+	uint32_t skipped;
+	uint32_t wcet_us;
+	uint32_t max_late_us;
+};
+
+/**
+ * Define a periodic job.
+ *
+ * @param _name Variable name, also used as the job name
+ * @param _handler Job body
+ * @param _period_ms Release period in milliseconds
+ * @param _deadline_ms Relative deadline in milliseconds, 0 for the period
+ */
+#define SCHED_JOB_DEFINE(_name, _handler, _period_ms, _deadline_ms)	\
+	static struct sched_job _name = {				\
+		.name = #_name,						\
+		.handler = _handler,					\
+		.period_ms = _period_ms,				\
+		.deadline_ms = _deadline_ms,				\
+	}
+
+/**
+ * Register a job and release it for the first time one period from now.
+ * Jobs are released independently, each on its own timeout, so the CPU
+ * only wakes up when one of them is due.
+ *
+ * @param job Job to start
+ * @return 0 on success, negative error code on failure
+ */
+int sched_add(struct sched_job *job);
+
+/**
+ * Reset the run, miss and timing counters of all jobs.
+ */
+void sched_reset_stats(void);
+
+#endif /* SCHED_H */
@@ -5,12 +5,17 @@
 
 #include <zephyr/shell/shell.h>
 
+#include "prefs.h"
+
 /* Bonjour message state - can be toggled via shell */
 bool bonjour_enabled;
 
 static int cmd_bonjour_on(const struct shell *sh, size_t argc, char **argv)
 {
 	bonjour_enabled = true;
+	if (IS_ENABLED(CONFIG_PREFS)) {
+		prefs_set(PREFS_BONJOUR, true);
+	}
 	shell_print(sh, "Bonjour message enabled");
 	return 0;
 }
@@ -18,6 +23,9 @@ static int cmd_bonjour_on(const struct shell *sh, size_t argc, char **argv)
 static int cmd_bonjour_off(const struct shell *sh, size_t argc, char **argv)
 {
 	bonjour_enabled = false;
+	if (IS_ENABLED(CONFIG_PREFS)) {
+		prefs_set(PREFS_BONJOUR, false);
+	}
 	shell_print(sh, "Bonjour message disabled");
 	return 0;
 }
@@ -0,0 +1,786 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * SWD clock calibration per target
+ *
+ * A calibration ramps SWCLK up from CONFIG_SWD_CAL_START_HZ in 25%
+ * steps. Each step runs CONFIG_SWD_CAL_PASSES passes of: line reset and
+ * DPIDR read, which must match the value read at the lowest clock, then
+ * a block written and read back through MEM-AP 0. The patterns change
+ * from pass to pass (alternating bits, walking one, walking zero,
+ * pseudo-random) to catch both crosstalk and sampling errors. The ramp
+ * stops at the first failing step, the highest passing clock less
+ * CONFIG_SWD_CAL_MARGIN_PERCENT is stored for the DPIDR of the target.
+ *
+ * The stored clocks live in their own flash partition. Hosts set their
+ * clock before they read DPIDR, so when the DPIDR of a known target
+ * shows up in a DAP_Transfer response, the stored clock replaces the
+ * host one; a DAP_SWJ_Clock sent later still wins until the host
+ * connects again.
+ *
+ * The core behind MEM-AP 0 is halted through DHCSR for the whole ramp,
+ * so the program cannot use the test block while it is overwritten, and
+ * the copy written back afterwards is the one it left. A core that was
+ * running is resumed, one halted by the host stays halted. A target
+ * that cannot be halted is not calibrated.
+ *
+ * Calibration runs in the DAP queue thread, which owns the SWD port: a
+ * vendor command runs it in place, a shell request is picked up between
+ * host requests. With a host connected, SELECT and the CSW and TAR of
+ * MEM-AP 0 are given back as the host left them, as rtt.c does;
+ * otherwise the port is turned off again.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/swdp.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(swd_cal, LOG_LEVEL_INF);
+
+#include "swd_cal.h"
+#include "dap_queue.h"
+#include "dap_vendor.h"
+#include "flash_guard.h"
+
+/* Host commands tracked by swd_cal_snoop() */
+#define DAP_CMD_CONNECT		0x02
+#define DAP_CMD_DISCONNECT	0x03
+#define DAP_CMD_TRANSFER	0x05
+#define DAP_CMD_SWJ_CLOCK	0x11
+
+/* DAP_Transfer request bits */
+#define XFER_RnW		BIT(1)
+#define XFER_REG_MASK		0x0F
+#define XFER_MATCH_VALUE	BIT(4)
+#define XFER_MATCH_MASK		BIT(5)
+#define XFER_TIMESTAMP		BIT(7)
+#define XFER_DP_IDCODE		XFER_RnW
+#define XFER_DP_SELECT		0x08
+
+#define DP_SELECT	SWDP_REQUEST_A3
+#define DP_RDBUFF	(SWDP_REQUEST_A2 | SWDP_REQUEST_A3)
+#define AP_CSW		SWDP_REQUEST_APnDP
+#define AP_TAR		(SWDP_REQUEST_APnDP | SWDP_REQUEST_A2)
+
+/* Debug Halting Control and Status Register of a Cortex-M core */
+#define DHCSR			0xE000EDF0
+#define DHCSR_DBGKEY		0xA05F0000
+#define DHCSR_C_DEBUGEN		BIT(0)
+#define DHCSR_C_HALT		BIT(1)
+#define DHCSR_C_MASKINTS	BIT(3)
+#define DHCSR_S_HALT		BIT(17)
+#define DHCSR_HALT_POLLS	100
+
+#define SWD_CAL_PORT_MAX_HZ DT_PROP(DT_NODELABEL(dp0), max_frequency)
+#define SWD_CAL_WORDS CONFIG_SWD_CAL_TEST_WORDS
+#define SWD_CAL_TIMEOUT K_SECONDS(10)
+
+#define SWD_CAL_PARTITION FIXED_PARTITION_ID(swd_cal_partition)
+/* "SWDC" */
+#define SWD_CAL_MAGIC 0x43445753
+
+struct swd_cal_entry {
+	uint32_t dpidr;
+	uint32_t clock;
+};
+
+/* Record at the start of the partition, least recently calibrated first */
+struct swd_cal_table {
+	uint32_t magic;
+	uint32_t count;
+	struct swd_cal_entry entry[CONFIG_SWD_CAL_TARGETS];
+	uint32_t crc;
+};
+
+static struct {
+	const struct device *swd_dev;
+	struct swd_cal_table table;
+
+	/* Debug port state left by the host */
+	bool host_connected;
+	uint32_t host_clock;
+	uint32_t host_select;
+	/* DPIDR seen since the host connected, 0 before */
+	uint32_t seen;
+} swd_cal;
+
+/* Calibration requested from the shell */
+static struct {
+	atomic_t pending;
+	uint32_t max_hz;
+	uint32_t addr;
+	int ret;
+	struct swd_cal_result result;
+} swd_cal_req;
+
+/* Serializes the table between the shell and the queue thread */
+static K_MUTEX_DEFINE(swd_cal_lock);
+static K_SEM_DEFINE(swd_cal_done, 0, 1);
+
+/* Target RAM under the pattern test, and the pattern read back */
+static uint8_t swd_cal_backup[SWD_CAL_WORDS * 4] __aligned(4);
+static uint8_t swd_cal_buf[SWD_CAL_WORDS * 4] __aligned(4);
+
+static uint32_t swd_cal_crc(const struct swd_cal_table *table)
+{
+	return crc32_ieee((const uint8_t *)table,
+			  offsetof(struct swd_cal_table, crc));
+}
+
+static void swd_cal_load(void)
+{
+	const struct flash_area *fa;
+	struct swd_cal_table *table = &swd_cal.table;
+
+	if (flash_area_open(SWD_CAL_PARTITION, &fa)) {
+		return;
+	}
+
+	if (flash_area_read(fa, 0, table, sizeof(*table)) != 0 ||
+	    table->magic != SWD_CAL_MAGIC || table->crc != swd_cal_crc(table) ||
+	    table->count > CONFIG_SWD_CAL_TARGETS) {
+		memset(table, 0, sizeof(*table));
+	}
+
+	flash_area_close(fa);
+}
+
+/* Called with swd_cal_lock held */
+static int swd_cal_save(void)
+{
+	const struct flash_area *fa;
+	struct swd_cal_table *table = &swd_cal.table;
+	int ret;
+
+	table->magic = SWD_CAL_MAGIC;
+	table->crc = swd_cal_crc(table);
+
+	ret = flash_area_open(SWD_CAL_PARTITION, &fa);
+	if (ret) {
+		return ret;
+	}
+
+	/* Once per calibration, XIP stalls meanwhile */
+	flash_guard_enter();
+	ret = flash_area_erase(fa, 0, fa->fa_size);
+	if (ret == 0) {
+		ret = flash_area_write(fa, 0, table, sizeof(*table));
+	}
+	flash_guard_exit();
+
+	flash_area_close(fa);
+
+	return ret;
+}
+
+/* Called with swd_cal_lock held */
+static void swd_cal_remove(uint32_t i)
+{
+	struct swd_cal_table *table = &swd_cal.table;
+
+	memmove(&table->entry[i], &table->entry[i + 1],
+		(table->count - i - 1) * sizeof(table->entry[0]));
+	table->count--;
+}
+
+static int swd_cal_find(uint32_t dpidr)
+{
+	for (uint32_t i = 0; i < swd_cal.table.count; i++) {
+		if (swd_cal.table.entry[i].dpidr == dpidr) {
+			return i;
+		}
+	}
+
+	return -ENOENT;
+}
+
+static int swd_cal_store(uint32_t dpidr, uint32_t clock)
+{
+	struct swd_cal_table *table = &swd_cal.table;
+	int i;
+	int ret;
+
+	k_mutex_lock(&swd_cal_lock, K_FOREVER);
+
+	i = swd_cal_find(dpidr);
+	if (i >= 0) {
+		swd_cal_remove(i);
+	} else if (table->count == CONFIG_SWD_CAL_TARGETS) {
+		swd_cal_remove(0);
+	}
+
+	table->entry[table->count].dpidr = dpidr;
+	table->entry[table->count].clock = clock;
+	table->count++;
+
+	ret = swd_cal_save();
+
+	k_mutex_unlock(&swd_cal_lock);
+
+	return ret;
+}
+
+uint32_t swd_cal_lookup(uint32_t dpidr)
+{
+	uint32_t clock = 0;
+	int i;
+
+	k_mutex_lock(&swd_cal_lock, K_FOREVER);
+	i = swd_cal_find(dpidr);
+	if (i >= 0) {
+		clock = swd_cal.table.entry[i].clock;
+	}
+	k_mutex_unlock(&swd_cal_lock);
+
+	return clock;
+}
+
+/* Alternating bits, walking one, walking zero, then pseudo-random words */
+static uint32_t swd_cal_pattern(uint32_t seed, uint32_t i)
+{
+	uint32_t x;
+
+	switch (seed % 4) {
+	case 0:
+		return (i & 1) ? 0x55555555 : 0xAAAAAAAA;
+	case 1:
+		return BIT(i % 32);
+	case 2:
+		return ~BIT(i % 32);
+	default:
+		/* xorshift32 of the seed and the index */
+		x = (seed * 0x9E3779B9U) ^ (i + 1);
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		return x;
+	}
+}
+
+/* Line reset, DPIDR check and MEM-AP 0 selected */
+static int swd_cal_attach(uint32_t *dpidr)
+{
+	uint32_t select = 0;
+	int ret;
+
+	ret = dap_vendor_attach(dpidr);
+	if (ret == 0 && dap_vendor_xfer(DP_SELECT, &select) != SWDP_ACK_OK) {
+		ret = -EIO;
+	}
+
+	return ret;
+}
+
+/* MEM-AP 0 CSW and TAR, with posted reads as in rtt_begin() */
+static int swd_cal_save_ap(uint32_t *csw, uint32_t *tar)
+{
+	uint32_t value = 0;
+
+	if (dap_vendor_xfer(AP_CSW | SWDP_REQUEST_RnW, &value) != SWDP_ACK_OK ||
+	    dap_vendor_xfer(AP_TAR | SWDP_REQUEST_RnW, csw) != SWDP_ACK_OK ||
+	    dap_vendor_xfer(DP_RDBUFF | SWDP_REQUEST_RnW, tar) != SWDP_ACK_OK) {
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/* Give the access port back as the host left it */
+static void swd_cal_restore_ap(uint32_t csw, uint32_t tar)
+{
+	dap_vendor_xfer(AP_CSW, &csw);
+	dap_vendor_xfer(AP_TAR, &tar);
+
+	if (swd_cal.host_select != 0) {
+		dap_vendor_xfer(DP_SELECT, &swd_cal.host_select);
+	}
+}
+
+static int swd_cal_dhcsr_read(uint32_t *dhcsr)
+{
+	uint8_t buf[4];
+	uint32_t done;
+
+	if (dap_vendor_mem_read(DHCSR, buf, 1, &done) != SWDP_ACK_OK) {
+		return -EIO;
+	}
+
+	*dhcsr = sys_get_le32(buf);
+
+	return 0;
+}
+
+static int swd_cal_dhcsr_write(uint32_t dhcsr)
+{
+	uint8_t buf[4];
+
+	sys_put_le32(DHCSR_DBGKEY | (dhcsr & 0xFFFF), buf);
+
+	return dap_vendor_mem_write(DHCSR, buf, 1) == SWDP_ACK_OK ? 0 : -EIO;
+}
+
+/* Let a core that was running go again, with its debug enables */
+static void swd_cal_resume(uint32_t dhcsr)
+{
+	if (dhcsr & DHCSR_S_HALT) {
+		return;
+	}
+
+	if (swd_cal_dhcsr_write(dhcsr & (DHCSR_C_DEBUGEN | DHCSR_C_MASKINTS)) != 0) {
+		LOG_WRN("Target core not resumed");
+	}
+}
+
+/* Halt the core, keep the DHCSR found for swd_cal_resume() */
+static int swd_cal_halt(uint32_t *dhcsr)
+{
+	uint32_t value;
+
+	if (swd_cal_dhcsr_read(dhcsr) != 0) {
+		return -EACCES;
+	}
+
+	if (*dhcsr & DHCSR_S_HALT) {
+		return 0;
+	}
+
+	if (swd_cal_dhcsr_write(DHCSR_C_DEBUGEN | DHCSR_C_HALT) != 0) {
+		return -EACCES;
+	}
+
+	for (int i = 0; i < DHCSR_HALT_POLLS; i++) {
+		if (swd_cal_dhcsr_read(&value) == 0 && (value & DHCSR_S_HALT)) {
+			return 0;
+		}
+	}
+
+	swd_cal_resume(*dhcsr);
+
+	return -EACCES;
+}
+
+/* One pass at the current clock */
+static int swd_cal_pass(uint32_t dpidr, uint32_t addr, uint32_t seed)
+{
+	uint32_t value = 0;
+	uint32_t done;
+	int ret;
+
+	ret = swd_cal_attach(&value);
+	if (ret || value != dpidr) {
+		return -EIO;
+	}
+
+	for (uint32_t i = 0; i < SWD_CAL_WORDS; i++) {
+		sys_put_le32(swd_cal_pattern(seed, i), &swd_cal_buf[i * 4]);
+	}
+
+	if (dap_vendor_mem_write(addr, swd_cal_buf, SWD_CAL_WORDS) !=
+	    SWDP_ACK_OK) {
+		return -EIO;
+	}
+
+	memset(swd_cal_buf, 0, sizeof(swd_cal_buf));
+	if (dap_vendor_mem_read(addr, swd_cal_buf, SWD_CAL_WORDS, &done) !=
+	    SWDP_ACK_OK) {
+		return -EIO;
+	}
+
+	for (uint32_t i = 0; i < SWD_CAL_WORDS; i++) {
+		if (sys_get_le32(&swd_cal_buf[i * 4]) !=
+		    swd_cal_pattern(seed, i)) {
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+int swd_cal_run(uint32_t max_hz, uint32_t addr, struct swd_cal_result *result)
+{
+	const struct device *dev = swd_cal.swd_dev;
+	const struct swdp_api *api = dev->api;
+	uint32_t clock = CONFIG_SWD_CAL_START_HZ;
+	uint32_t seed = 0;
+	uint32_t csw = 0;
+	uint32_t tar = 0;
+	uint32_t dhcsr;
+	uint32_t done;
+	int ret;
+
+	memset(result, 0, sizeof(*result));
+
+	if (max_hz == 0 || max_hz > SWD_CAL_PORT_MAX_HZ) {
+		max_hz = SWD_CAL_PORT_MAX_HZ;
+	}
+	max_hz = MAX(max_hz, CONFIG_SWD_CAL_START_HZ);
+	addr = (addr != 0 ? addr : CONFIG_SWD_CAL_TEST_ADDR) & ~3U;
+
+	api->swdp_port_on(dev);
+	api->swdp_configure(dev, 1, false);
+	api->swdp_set_clock(dev, CONFIG_SWD_CAL_START_HZ);
+
+	ret = swd_cal_attach(&result->dpidr);
+	if (ret) {
+		result->dpidr = 0;
+		goto out;
+	}
+
+	ret = swd_cal_save_ap(&csw, &tar);
+	if (ret) {
+		goto out;
+	}
+
+	ret = swd_cal_halt(&dhcsr);
+	if (ret) {
+		goto restore_ap;
+	}
+
+	if (dap_vendor_mem_read(addr, swd_cal_backup, SWD_CAL_WORDS, &done) !=
+	    SWDP_ACK_OK) {
+		ret = -EIO;
+		goto resume;
+	}
+
+	while (true) {
+		api->swdp_set_clock(dev, clock);
+
+		for (uint32_t i = 0; ret == 0 && i < CONFIG_SWD_CAL_PASSES; i++) {
+			ret = swd_cal_pass(result->dpidr, addr, seed++);
+		}
+
+		dap_queue_beat();
+
+		if (ret) {
+			result->first_fail = clock;
+			break;
+		}
+
+		result->max_pass = clock;
+		if (clock >= max_hz) {
+			break;
+		}
+		clock = MIN(clock + clock / 4, max_hz);
+	}
+
+	/* Give the test area back at the clock known to work */
+	api->swdp_set_clock(dev, CONFIG_SWD_CAL_START_HZ);
+	if (swd_cal_attach(NULL) != 0 ||
+	    dap_vendor_mem_write(addr, swd_cal_backup, SWD_CAL_WORDS) !=
+	    SWDP_ACK_OK) {
+		LOG_WRN("Target RAM at 0x%08x not restored", addr);
+	}
+
+	ret = result->max_pass != 0 ? 0 : -EIO;
+
+resume:
+	swd_cal_resume(dhcsr);
+restore_ap:
+	swd_cal_restore_ap(csw, tar);
+
+	if (ret) {
+		goto out;
+	}
+
+	result->clock = MAX(result->max_pass *
+			    (100U - CONFIG_SWD_CAL_MARGIN_PERCENT) / 100U, 1U);
+
+	LOG_INF("DPIDR 0x%08x: passed up to %u Hz, stored %u Hz",
+		result->dpidr, result->max_pass, result->clock);
+
+	ret = swd_cal_store(result->dpidr, result->clock);
+	if (ret == 0) {
+		swd_cal.seen = result->dpidr;
+	}
+
+out:
+	api->swdp_set_clock(dev, ret == 0 ? result->clock : swd_cal.host_clock);
+
+	if (!swd_cal.host_connected) {
+		api->swdp_port_off(dev);
+	}
+
+	return ret;
+}
+
+void swd_cal_poll(void)
+{
+	if (!atomic_cas(&swd_cal_req.pending, 1, 0)) {
+		return;
+	}
+
+	swd_cal_req.ret = swd_cal_run(swd_cal_req.max_hz, swd_cal_req.addr,
+				      &swd_cal_req.result);
+	k_sem_give(&swd_cal_done);
+}
+
+/* DPIDR read by a DAP_Transfer that completed */
+static bool swd_cal_find_dpidr(const uint8_t *request, const uint8_t *response,
+			       uint32_t *dpidr)
+{
+	const uint8_t *req = &request[3];
+	const uint8_t *data = &response[3];
+
+	if (response[2] != SWDP_ACK_OK) {
+		return false;
+	}
+
+	for (uint8_t i = 0; i < request[2] && i < response[1]; i++) {
+		uint8_t r = *req++;
+
+		if (r & XFER_TIMESTAMP) {
+			data += 4;
+		}
+
+		if ((r & XFER_RnW) && !(r & XFER_MATCH_VALUE)) {
+			if ((r & XFER_REG_MASK) == XFER_DP_IDCODE) {
+				*dpidr = sys_get_le32(data);
+				return true;
+			}
+			data += 4;
+		} else {
+			req += 4;
+		}
+	}
+
+	return false;
+}
+
+/* SELECT written by a DAP_Transfer, as tracked in rtt_snoop() */
+static void swd_cal_find_select(const uint8_t *request, const uint8_t *response)
+{
+	const uint8_t *req = &request[3];
+
+	for (uint8_t i = 0; i < request[2] && i < response[1]; i++) {
+		uint8_t r = *req++;
+
+		if ((r & XFER_RnW) && !(r & XFER_MATCH_VALUE)) {
+			continue;
+		}
+
+		if ((r & XFER_REG_MASK) == XFER_DP_SELECT &&
+		    !(r & XFER_MATCH_MASK)) {
+			swd_cal.host_select = sys_get_le32(req);
+		}
+		req += 4;
+	}
+}
+
+void swd_cal_snoop(const uint8_t *request, const uint8_t *response)
+{
+	const struct swdp_api *api;
+	uint32_t dpidr;
+	uint32_t clock;
+
+	if (swd_cal.swd_dev == NULL) {
+		return;
+	}
+
+	api = swd_cal.swd_dev->api;
+
+	switch (request[0]) {
+	case DAP_CMD_CONNECT:
+		swd_cal.host_connected = (response[1] != 0);
+		swd_cal.host_select = 0;
+		swd_cal.seen = 0;
+		break;
+
+	case DAP_CMD_DISCONNECT:
+		swd_cal.host_connected = false;
+		swd_cal.seen = 0;
+		break;
+
+	case DAP_CMD_SWJ_CLOCK:
+		if (response[1] == 0) {
+			swd_cal.host_clock = sys_get_le32(&request[1]);
+		}
+		break;
+
+	case DAP_CMD_TRANSFER:
+		swd_cal_find_select(request, response);
+
+		if (swd_cal.seen != 0 ||
+		    !swd_cal_find_dpidr(request, response, &dpidr)) {
+			break;
+		}
+
+		swd_cal.seen = dpidr;
+		clock = swd_cal_lookup(dpidr);
+		if (clock != 0) {
+			api->swdp_set_clock(swd_cal.swd_dev, clock);
+			LOG_INF("DPIDR 0x%08x: SWD clock %u Hz", dpidr, clock);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+uint32_t swd_cal_execute(const uint8_t *request, uint32_t req_len,
+			 uint8_t *response, uint32_t resp_size)
+{
+	struct swd_cal_result result = { 0 };
+	int ret = -ENODEV;
+
+	if (req_len < 9 || resp_size < 14) {
+		return dap_vendor_reject(response, req_len);
+	}
+
+	if (swd_cal.swd_dev != NULL) {
+		ret = swd_cal_run(sys_get_le32(&request[1]),
+				  sys_get_le32(&request[5]), &result);
+	}
+
+	response[0] = DAP_VENDOR_SWD_CAL;
+	response[1] = ret ? DAP_VENDOR_ERROR : 0;
+	sys_put_le32(result.dpidr, &response[2]);
+	sys_put_le32(result.max_pass, &response[6]);
+	sys_put_le32(result.clock, &response[10]);
+
+	return (9 << 16) | 14;
+}
+
+int swd_cal_init(const struct device *swd_dev)
+{
+	if (!device_is_ready(swd_dev)) {
+		return -ENODEV;
+	}
+
+	swd_cal.swd_dev = swd_dev;
+	/* The port driver starts at its limit */
+	swd_cal.host_clock = SWD_CAL_PORT_MAX_HZ;
+
+	swd_cal_load();
+
+	return 0;
+}
+
+/* Shell commands */
+
+static int cmd_swdcal_list(const struct shell *sh, size_t argc, char **argv)
+{
+	k_mutex_lock(&swd_cal_lock, K_FOREVER);
+
+	shell_print(sh, "%u of %u targets calibrated, margin %u%%",
+		    swd_cal.table.count, CONFIG_SWD_CAL_TARGETS,
+		    CONFIG_SWD_CAL_MARGIN_PERCENT);
+	for (uint32_t i = 0; i < swd_cal.table.count; i++) {
+		const struct swd_cal_entry *e = &swd_cal.table.entry[i];
+
+		shell_print(sh, "  DPIDR 0x%08x: %u Hz%s", e->dpidr, e->clock,
+			    e->dpidr == swd_cal.seen ? " (connected)" : "");
+	}
+
+	k_mutex_unlock(&swd_cal_lock);
+
+	return 0;
+}
+
+static int cmd_swdcal_run(const struct shell *sh, size_t argc, char **argv)
+{
+	const struct swd_cal_result *r = &swd_cal_req.result;
+
+	if (swd_cal.swd_dev == NULL) {
+		shell_error(sh, "SWD port not ready");
+		return -ENODEV;
+	}
+
+	swd_cal_req.max_hz = (argc > 1) ? strtoul(argv[1], NULL, 0) : 0;
+	swd_cal_req.addr = (argc > 2) ? strtoul(argv[2], NULL, 0) : 0;
+
+	/* Drop the completion of a request that timed out before */
+	k_sem_reset(&swd_cal_done);
+	atomic_set(&swd_cal_req.pending, 1);
+
+	shell_print(sh, "Calibrating...");
+	if (k_sem_take(&swd_cal_done, SWD_CAL_TIMEOUT) != 0) {
+		atomic_set(&swd_cal_req.pending, 0);
+		shell_error(sh, "DAP queue busy, try again");
+		return -EBUSY;
+	}
+
+	if (r->dpidr == 0) {
+		shell_error(sh, "No target answers at %u Hz",
+			    CONFIG_SWD_CAL_START_HZ);
+		return swd_cal_req.ret;
+	}
+
+	shell_print(sh, "DPIDR 0x%08x", r->dpidr);
+	if (swd_cal_req.ret == -EACCES) {
+		shell_error(sh, "Target core cannot be halted");
+		return swd_cal_req.ret;
+	}
+	if (r->max_pass == 0) {
+		shell_error(sh, "Pattern test fails at %u Hz",
+			    CONFIG_SWD_CAL_START_HZ);
+		return swd_cal_req.ret;
+	}
+
+	shell_print(sh, "  passed up to %u Hz", r->max_pass);
+	if (r->first_fail != 0) {
+		shell_print(sh, "  failed at    %u Hz", r->first_fail);
+	}
+	if (swd_cal_req.ret) {
+		shell_error(sh, "Failed to store the clock: %d", swd_cal_req.ret);
+		return swd_cal_req.ret;
+	}
+	shell_print(sh, "  stored       %u Hz", r->clock);
+
+	return 0;
+}
+
+static int cmd_swdcal_forget(const struct shell *sh, size_t argc, char **argv)
+{
+	bool all = strcmp(argv[1], "all") == 0;
+	uint32_t dpidr = strtoul(argv[1], NULL, 0);
+	int i;
+	int ret;
+
+	k_mutex_lock(&swd_cal_lock, K_FOREVER);
+
+	if (all) {
+		swd_cal.table.count = 0;
+	} else {
+		i = swd_cal_find(dpidr);
+		if (i < 0) {
+			k_mutex_unlock(&swd_cal_lock);
+			shell_error(sh, "DPIDR 0x%08x not calibrated", dpidr);
+			return -ENOENT;
+		}
+		swd_cal_remove(i);
+	}
+
+	ret = swd_cal_save();
+
+	k_mutex_unlock(&swd_cal_lock);
+
+	if (ret) {
+		shell_error(sh, "Failed to store the table: %d", ret);
+		return ret;
+	}
+
+	return cmd_swdcal_list(sh, 1, argv);
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_swdcal,
+	SHELL_CMD(list, NULL, "Show the stored clock of each target",
+		  cmd_swdcal_list),
+	SHELL_CMD_ARG(run, NULL,
+		      "Calibrate the connected target: [max_hz] [ram_addr]",
+		      cmd_swdcal_run, 1, 2),
+	SHELL_CMD_ARG(forget, NULL, "Drop a stored clock: <dpidr|all>",
+		      cmd_swdcal_forget, 2, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(swdcal, &sub_swdcal, "SWD clock calibration per target",
+		   cmd_swdcal_list);
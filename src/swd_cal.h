@@ -0,0 +1,87 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * SWD clock calibration per target
+ */
+
+#ifndef SWD_CAL_H
+#define SWD_CAL_H
+
+#include <stdint.h>
+
+struct device;
+
+/* Outcome of a calibration run */
+struct swd_cal_result {
+	/* DPIDR of the target, 0 if it did not answer */
+	uint32_t dpidr;
+	/* Highest clock that passed every test, 0 if none */
+	uint32_t max_pass;
+	/* First clock that failed, 0 if the ramp reached its limit */
+	uint32_t first_fail;
+	/* Clock stored for the target, max_pass less the margin */
+	uint32_t clock;
+};
+
+/**
+ * Set the SWD port and load the stored clocks.
+ *
+ * @param swd_dev SWD port device, the one given to dap_setup()
+ * @return 0 on success, -ENODEV if the device is not ready
+ */
+int swd_cal_init(const struct device *swd_dev);
+
+/**
+ * Ramp the SWD clock on the connected target, test each step and store
+ * the result for its DPIDR. Must only be called from the DAP queue
+ * thread. The target core is halted during the ramp, and the RAM used by
+ * the pattern test is restored before it is resumed.
+ *
+ * @param max_hz Highest clock tried, 0 for the port limit
+ * @param addr Word aligned target RAM address for the pattern test, 0
+ *        for CONFIG_SWD_CAL_TEST_ADDR
+ * @param result Outcome
+ * @return 0 on success, -EIO if the target does not pass at the lowest
+ *         clock, -EACCES if its core cannot be halted, negative errno
+ *         from the flash driver otherwise
+ */
+int swd_cal_run(uint32_t max_hz, uint32_t addr, struct swd_cal_result *result);
+
+/**
+ * Get the stored clock of a target.
+ *
+ * @param dpidr DPIDR of the target
+ * @return Clock in Hz, 0 if the target was never calibrated
+ */
+uint32_t swd_cal_lookup(uint32_t dpidr);
+
+/**
+ * Run a calibration requested from the shell, if any. Must only be
+ * called from the DAP queue thread, between requests.
+ */
+void swd_cal_poll(void);
+
+/**
+ * Apply the stored clock when the host reads the DPIDR of a known
+ * target, after a command ran.
+ *
+ * @param request Command
+ * @param response Its response
+ */
+void swd_cal_snoop(const uint8_t *request, const uint8_t *response);
+
+/**
+ * Run the DAP_VENDOR_SWD_CAL vendor command.
+ *
+ * @param request Command
+ * @param req_len Request bytes left, from the command ID on
+ * @param response Response buffer
+ * @param resp_size Response bytes left, at least 1
+ * @return Request length in the upper 16 bits, response length in the
+ *         lower 16 bits, as dap_execute_cmd()
+ */
+uint32_t swd_cal_execute(const uint8_t *request, uint32_t req_len,
+			 uint8_t *response, uint32_t resp_size);
+
+#endif /* SWD_CAL_H */
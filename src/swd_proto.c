@@ -0,0 +1,118 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * SWD wire protocol shared by the SWD port drivers
+ *
+ * The port drivers only know how to clock bits in and out. Everything
+ * that defines an SWD packet (header, turnaround, acknowledge, data
+ * parity, WAIT/FAULT data phase) lives here, so the PIO engine and the
+ * emulated target run exactly the same protocol code.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/swdp.h>
+
+#include "swd_proto.h"
+
+static void swd_proto_idle(const struct swd_proto *p, uint8_t cycles)
+{
+	while (cycles > 0) {
+		uint8_t n = MIN(cycles, 32);
+
+		p->phy->write(p->ctx, 0, n);
+		cycles -= n;
+	}
+}
+
+int swd_proto_transfer(const struct swd_proto *p, uint8_t request,
+		       uint32_t *data, uint8_t idle_cycles, uint8_t *response)
+{
+	const bool rnw = (request & SWDP_REQUEST_RnW) != 0;
+	uint32_t ack;
+	uint32_t val;
+	uint32_t parity;
+
+	p->phy->write(p->ctx, swd_request_header(request), 8);
+	p->phy->turnaround(p->ctx, p->turnaround);
+	ack = p->phy->read(p->ctx, 3);
+
+	switch (ack) {
+	case SWDP_ACK_OK:
+		if (rnw) {
+			val = p->phy->read(p->ctx, 32);
+			parity = p->phy->read(p->ctx, 1);
+			p->phy->turnaround(p->ctx, p->turnaround);
+			if (parity != swd_parity(val)) {
+				ack = SWDP_TRANSFER_ERROR;
+			}
+			if (data != NULL) {
+				*data = val;
+			}
+		} else {
+			val = (data != NULL) ? *data : 0;
+			p->phy->turnaround(p->ctx, p->turnaround);
+			p->phy->write(p->ctx, val, 32);
+			p->phy->write(p->ctx, swd_parity(val), 1);
+		}
+		swd_proto_idle(p, idle_cycles);
+		break;
+
+	case SWDP_ACK_WAIT:
+	case SWDP_ACK_FAULT:
+		if (p->data_phase && rnw) {
+			p->phy->read(p->ctx, 32);
+			p->phy->read(p->ctx, 1);
+		}
+		p->phy->turnaround(p->ctx, p->turnaround);
+		if (p->data_phase && !rnw) {
+			p->phy->write(p->ctx, 0, 32);
+			p->phy->write(p->ctx, 0, 1);
+		}
+		break;
+
+	default:
+		/* Protocol error: let the target time out of the data phase */
+		p->phy->turnaround(p->ctx, p->turnaround);
+		p->phy->turnaround(p->ctx, 32);
+		p->phy->turnaround(p->ctx, 1);
+		break;
+	}
+
+	*response = (uint8_t)ack;
+
+	return 0;
+}
+
+void swd_proto_output_sequence(const struct swd_proto *p, uint32_t count,
+			       const uint8_t *data)
+{
+	while (count > 0) {
+		uint8_t n = MIN(count, 32);
+		uint32_t bits = 0;
+
+		for (uint8_t i = 0; i < DIV_ROUND_UP(n, 8); i++) {
+			bits |= (uint32_t)data[i] << (8 * i);
+		}
+
+		p->phy->write(p->ctx, bits, n);
+		data += DIV_ROUND_UP(n, 8);
+		count -= n;
+	}
+}
+
+void swd_proto_input_sequence(const struct swd_proto *p, uint32_t count,
+			      uint8_t *data)
+{
+	while (count > 0) {
+		uint8_t n = MIN(count, 32);
+		uint32_t bits = p->phy->read(p->ctx, n);
+
+		for (uint8_t i = 0; i < DIV_ROUND_UP(n, 8); i++) {
+			data[i] = (uint8_t)(bits >> (8 * i));
+		}
+
+		data += DIV_ROUND_UP(n, 8);
+		count -= n;
+	}
+}
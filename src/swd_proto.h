@@ -0,0 +1,92 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * SWD wire protocol shared by the SWD port drivers
+ */
+
+#ifndef SWD_PROTO_H
+#define SWD_PROTO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Host-driven ones that put the target in the line reset state */
+#define SWD_LINE_RESET_BITS 50
+
+/**
+ * Bit-level operations a SWD port backend provides.
+ * All bit fields are sent and received LSB first.
+ */
+struct swd_phy_api {
+	/** Drive count bits (1-32) of bits onto SWDIO */
+	void (*write)(void *ctx, uint32_t bits, uint8_t count);
+	/** Sample count bits (1-32) from SWDIO */
+	uint32_t (*read)(void *ctx, uint8_t count);
+	/** Clock count cycles with SWDIO released */
+	void (*turnaround)(void *ctx, uint8_t count);
+};
+
+/* Protocol state of one SWD port */
+struct swd_proto {
+	const struct swd_phy_api *phy;
+	void *ctx;
+	uint8_t turnaround;
+	bool data_phase;
+};
+
+/**
+ * Even parity of a 32-bit word, as used for SWD data and requests.
+ */
+static inline uint32_t swd_parity(uint32_t value)
+{
+	return __builtin_parity(value);
+}
+
+/**
+ * Build the 8-bit packet request header from APnDP, RnW, A2 and A3.
+ *
+ * @param request SWDP_REQUEST_* bits
+ * @return Header with start, parity, stop and park bits
+ */
+static inline uint8_t swd_request_header(uint8_t request)
+{
+	request &= 0x0F;
+
+	return 0x81 | (request << 1) | (swd_parity(request) << 5);
+}
+
+/**
+ * Run one SWD packet: request, acknowledge and data phase.
+ *
+ * @param p Port state
+ * @param request SWDP_REQUEST_* bits
+ * @param data Data to write, or location for read data
+ * @param idle_cycles Idle cycles to clock after the packet
+ * @param response SWDP_ACK_* value, or SWDP_TRANSFER_ERROR on parity error
+ * @return 0
+ */
+int swd_proto_transfer(const struct swd_proto *p, uint8_t request,
+		       uint32_t *data, uint8_t idle_cycles, uint8_t *response);
+
+/**
+ * Drive an arbitrary bit sequence onto SWDIO.
+ *
+ * @param p Port state
+ * @param count Number of bits
+ * @param data Bits, LSB of data[0] first
+ */
+void swd_proto_output_sequence(const struct swd_proto *p, uint32_t count,
+			       const uint8_t *data);
+
+/**
+ * Sample an arbitrary bit sequence from SWDIO.
+ *
+ * @param p Port state
+ * @param count Number of bits
+ * @param data Buffer for bits, LSB of data[0] first
+ */
+void swd_proto_input_sequence(const struct swd_proto *p, uint32_t count,
+			      uint8_t *data);
+
+#endif /* SWD_PROTO_H */
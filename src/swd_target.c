@@ -0,0 +1,455 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Software model of an SWD target (DP + MEM-AP + memory)
+ *
+ * The model is clocked one SWCLK cycle at a time and follows the wire
+ * protocol of ADIv5: line reset detection, packet header checks,
+ * turnaround, acknowledge, data parity, posted AP reads and TAR auto
+ * increment limited to the 1 KB boundary, as on a real Cortex-M.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/swdp.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+
+#include "swd_proto.h"
+#include "swd_target.h"
+
+/* Wire states */
+enum {
+	SWD_T_LOCKOUT,		/* protocol error, wait for line reset */
+	SWD_T_RESET,		/* line reset seen, wait for idle */
+	SWD_T_IDLE,
+	SWD_T_REQUEST,
+	SWD_T_TRN_ACK,
+	SWD_T_ACK,
+	SWD_T_RDATA,
+	SWD_T_TRN_WDATA,
+	SWD_T_WDATA,
+	SWD_T_TRN_IDLE,
+};
+
+/* DP registers (A[3:2] << 2) */
+#define DP_DPIDR_ABORT		0x0
+#define DP_CTRL_STAT		0x4
+#define DP_SELECT_RESEND	0x8
+#define DP_RDBUFF		0xC
+
+#define CTRL_STICKYORUN		BIT(1)
+#define CTRL_STICKYCMP		BIT(4)
+#define CTRL_STICKYERR		BIT(5)
+#define CTRL_WDATAERR		BIT(7)
+#define CTRL_CDBGPWRUPREQ	BIT(28)
+#define CTRL_CSYSPWRUPREQ	BIT(30)
+
+#define ABORT_STKCMPCLR		BIT(1)
+#define ABORT_STKERRCLR		BIT(2)
+#define ABORT_WDERRCLR		BIT(3)
+#define ABORT_ORUNERRCLR	BIT(4)
+
+/* MEM-AP registers (bank << 4 | A[3:2] << 2) */
+#define AP_CSW			0x00
+#define AP_TAR			0x04
+#define AP_DRW			0x0C
+#define AP_BD0			0x10
+#define AP_BD3			0x1C
+#define AP_IDR			0xFC
+
+#define CSW_SIZE_MASK		0x7
+#define CSW_ADDRINC_SINGLE	BIT(4)
+#define CSW_ADDRINC_MASK	(0x3 << 4)
+#define CSW_RESET		0x03000042
+
+/* Auto increment is only guaranteed within a 1 KB block */
+#define TAR_INC_MASK		0x3FF
+
+void swd_target_reset(struct swd_target *t)
+{
+	t->state = SWD_T_LOCKOUT;
+	t->bit = 0;
+	t->ones = 0;
+	t->turnaround = 1;
+	t->ctrl_stat = 0;
+	t->select = 0;
+	t->rdbuff = 0;
+	t->csw = CSW_RESET;
+	t->tar = 0;
+	t->wait_count = 0;
+	memset(&t->stats, 0, sizeof(t->stats));
+}
+
+int swd_target_add_region(struct swd_target *t, uint32_t base, uint8_t *data,
+			  uint32_t size, bool read_only)
+{
+	if (t->num_regions >= SWD_TARGET_MAX_REGIONS) {
+		return -ENOMEM;
+	}
+
+	t->regions[t->num_regions++] = (struct swd_target_region){
+		.base = base,
+		.size = size,
+		.data = data,
+		.read_only = read_only,
+	};
+
+	return 0;
+}
+
+int swd_target_mem_access(struct swd_target *t, uint32_t addr, uint8_t size,
+			  uint32_t *val, bool write)
+{
+	const uint8_t lane = (addr & 0x3) * 8;
+
+	if (addr & (size - 1)) {
+		return -EFAULT;
+	}
+
+	for (uint8_t i = 0; i < t->num_regions; i++) {
+		struct swd_target_region *r = &t->regions[i];
+		uint8_t *p;
+
+		if (addr < r->base || addr - r->base + size > r->size) {
+			continue;
+		}
+
+		p = &r->data[addr - r->base];
+
+		if (write) {
+			if (r->read_only) {
+				return -EFAULT;
+			}
+			for (uint8_t b = 0; b < size; b++) {
+				p[b] = (uint8_t)(*val >> (lane + 8 * b));
+			}
+		} else {
+			*val = 0;
+			for (uint8_t b = 0; b < size; b++) {
+				*val |= (uint32_t)p[b] << (lane + 8 * b);
+			}
+		}
+
+		return 0;
+	}
+
+	return -EFAULT;
+}
+
+static uint8_t swd_target_csw_size(const struct swd_target *t)
+{
+	return 1U << MIN(t->csw & CSW_SIZE_MASK, 2U);
+}
+
+static uint8_t swd_target_drw(struct swd_target *t, uint32_t *val, bool write)
+{
+	uint8_t size = swd_target_csw_size(t);
+
+	if (swd_target_mem_access(t, t->tar, size, val, write) < 0) {
+		t->ctrl_stat |= CTRL_STICKYERR;
+		return SWDP_ACK_OK;
+	}
+
+	if ((t->csw & CSW_ADDRINC_MASK) == CSW_ADDRINC_SINGLE) {
+		t->tar = (t->tar & ~TAR_INC_MASK) |
+			 ((t->tar + size) & TAR_INC_MASK);
+	}
+
+	return SWDP_ACK_OK;
+}
+
+static uint8_t swd_target_ap(struct swd_target *t, uint8_t addr, bool rnw,
+			     uint32_t *data)
+{
+	uint8_t reg = (t->select & 0xF0) | addr;
+	uint32_t val = 0;
+	uint32_t bd_addr;
+
+	if (t->wait_every != 0 && ++t->wait_count >= t->wait_every) {
+		t->wait_count = 0;
+		t->stats.waits++;
+		return SWDP_ACK_WAIT;
+	}
+
+	if (t->ctrl_stat & (CTRL_STICKYERR | CTRL_STICKYORUN | CTRL_WDATAERR)) {
+		t->stats.faults++;
+		return SWDP_ACK_FAULT;
+	}
+
+	/* Only AP #0 exists */
+	if ((t->select >> 24) != 0) {
+		if (rnw) {
+			*data = t->rdbuff;
+			t->rdbuff = 0;
+		}
+		return SWDP_ACK_OK;
+	}
+
+	if (rnw) {
+		t->stats.ap_reads++;
+	} else {
+		t->stats.ap_writes++;
+		val = *data;
+	}
+
+	switch (reg) {
+	case AP_CSW:
+		if (rnw) {
+			val = t->csw;
+		} else {
+			t->csw = val;
+		}
+		break;
+	case AP_TAR:
+		if (rnw) {
+			val = t->tar;
+		} else {
+			t->tar = val;
+		}
+		break;
+	case AP_DRW:
+		swd_target_drw(t, &val, !rnw);
+		break;
+	case AP_BD0 ... AP_BD3:
+		bd_addr = (t->tar & ~0xF) | (reg & 0xC);
+		if (swd_target_mem_access(t, bd_addr, 4, &val, !rnw) < 0) {
+			t->ctrl_stat |= CTRL_STICKYERR;
+		}
+		break;
+	case AP_IDR:
+		val = SWD_TARGET_AP_IDR;
+		break;
+	default:
+		val = 0;
+		break;
+	}
+
+	/* AP reads are posted: return the previous result */
+	if (rnw) {
+		*data = t->rdbuff;
+		t->rdbuff = val;
+	}
+
+	return SWDP_ACK_OK;
+}
+
+static uint8_t swd_target_dp(struct swd_target *t, uint8_t addr, bool rnw,
+			     uint32_t *data)
+{
+	uint32_t val = rnw ? 0 : *data;
+
+	switch (addr) {
+	case DP_DPIDR_ABORT:
+		if (rnw) {
+			*data = SWD_TARGET_DPIDR;
+			break;
+		}
+		if (val & ABORT_STKCMPCLR) {
+			t->ctrl_stat &= ~CTRL_STICKYCMP;
+		}
+		if (val & ABORT_STKERRCLR) {
+			t->ctrl_stat &= ~CTRL_STICKYERR;
+		}
+		if (val & ABORT_WDERRCLR) {
+			t->ctrl_stat &= ~CTRL_WDATAERR;
+		}
+		if (val & ABORT_ORUNERRCLR) {
+			t->ctrl_stat &= ~CTRL_STICKYORUN;
+		}
+		break;
+	case DP_CTRL_STAT:
+		if (rnw) {
+			/* Power-up acknowledges follow the requests */
+			*data = t->ctrl_stat |
+				((t->ctrl_stat & CTRL_CDBGPWRUPREQ) << 1) |
+				((t->ctrl_stat & CTRL_CSYSPWRUPREQ) << 1);
+			break;
+		}
+		t->ctrl_stat = (t->ctrl_stat & (CTRL_STICKYORUN | CTRL_STICKYCMP |
+						CTRL_STICKYERR | CTRL_WDATAERR)) |
+			       (val & (CTRL_CDBGPWRUPREQ | CTRL_CSYSPWRUPREQ |
+				       0x0FFFFF01));
+		break;
+	case DP_SELECT_RESEND:
+		if (rnw) {
+			*data = t->rdbuff;
+		} else {
+			t->select = val;
+		}
+		break;
+	case DP_RDBUFF:
+		if (rnw) {
+			*data = t->rdbuff;
+		}
+		break;
+	}
+
+	return SWDP_ACK_OK;
+}
+
+static bool swd_target_header_valid(uint8_t header)
+{
+	return (header & 0xC1) == 0x81 &&
+	       ((header >> 5) & 1) == swd_parity((header >> 1) & 0x0F);
+}
+
+/* Decode a packet header and run the register access behind it */
+static void swd_target_packet(struct swd_target *t)
+{
+	const bool apndp = t->request & BIT(1);
+	const bool rnw = t->request & BIT(2);
+	const uint8_t addr = (t->request >> 1) & 0x0C;
+	uint32_t data = 0;
+
+	t->stats.packets++;
+
+	if (rnw) {
+		t->ack = apndp ? swd_target_ap(t, addr, true, &data) :
+				 swd_target_dp(t, addr, true, &data);
+		t->shift = data | ((uint64_t)swd_parity(data) << 32);
+	} else {
+		/* Writes are acknowledged now and applied after the data phase */
+		t->ack = SWDP_ACK_OK;
+		if (apndp && t->wait_every != 0 &&
+		    t->wait_count + 1 >= t->wait_every) {
+			t->wait_count = 0;
+			t->stats.waits++;
+			t->ack = SWDP_ACK_WAIT;
+		} else if (apndp && (t->ctrl_stat & (CTRL_STICKYERR |
+						    CTRL_STICKYORUN |
+						    CTRL_WDATAERR))) {
+			t->stats.faults++;
+			t->ack = SWDP_ACK_FAULT;
+		}
+	}
+}
+
+static void swd_target_write_done(struct swd_target *t)
+{
+	const bool apndp = t->request & BIT(1);
+	const uint8_t addr = (t->request >> 1) & 0x0C;
+	uint32_t data = (uint32_t)t->shift;
+
+	if (((t->shift >> 32) & 1) != swd_parity(data)) {
+		t->ctrl_stat |= CTRL_WDATAERR;
+		return;
+	}
+
+	if (apndp) {
+		/* The WAIT decision was already taken at acknowledge time */
+		uint16_t wait_every = t->wait_every;
+
+		t->wait_every = 0;
+		swd_target_ap(t, addr, false, &data);
+		t->wait_every = wait_every;
+		if (wait_every != 0) {
+			t->wait_count++;
+		}
+	} else {
+		swd_target_dp(t, addr, false, &data);
+	}
+}
+
+bool swd_target_clock(struct swd_target *t, bool drive, bool bit)
+{
+	bool out = true;
+
+	if (drive) {
+		t->ones = bit ? MIN(t->ones + 1, UINT8_MAX) : 0;
+		if (t->ones == SWD_LINE_RESET_BITS) {
+			t->state = SWD_T_RESET;
+			t->stats.line_resets++;
+		}
+	}
+
+	switch (t->state) {
+	case SWD_T_LOCKOUT:
+		break;
+
+	case SWD_T_RESET:
+		if (drive && !bit) {
+			t->state = SWD_T_IDLE;
+		}
+		break;
+
+	case SWD_T_IDLE:
+		if (drive && bit) {
+			t->request = 1;
+			t->bit = 1;
+			t->state = SWD_T_REQUEST;
+		}
+		break;
+
+	case SWD_T_REQUEST:
+		t->request |= (uint8_t)((drive && bit) << t->bit);
+		if (++t->bit < 8) {
+			break;
+		}
+		t->bit = 0;
+		if (!drive || !swd_target_header_valid(t->request)) {
+			t->stats.protocol_errors++;
+			t->state = SWD_T_LOCKOUT;
+			break;
+		}
+		swd_target_packet(t);
+		t->state = SWD_T_TRN_ACK;
+		break;
+
+	case SWD_T_TRN_ACK:
+		if (++t->bit >= t->turnaround) {
+			t->bit = 0;
+			t->state = SWD_T_ACK;
+		}
+		break;
+
+	case SWD_T_ACK:
+		out = (t->ack >> t->bit) & 1;
+		if (++t->bit < 3) {
+			break;
+		}
+		t->bit = 0;
+		if (t->ack != SWDP_ACK_OK) {
+			t->state = SWD_T_TRN_IDLE;
+		} else if (t->request & BIT(2)) {
+			t->state = SWD_T_RDATA;
+		} else {
+			t->state = SWD_T_TRN_WDATA;
+		}
+		break;
+
+	case SWD_T_RDATA:
+		out = (t->shift >> t->bit) & 1;
+		if (++t->bit == 33) {
+			t->bit = 0;
+			t->state = SWD_T_TRN_IDLE;
+		}
+		break;
+
+	case SWD_T_TRN_WDATA:
+		if (++t->bit >= t->turnaround) {
+			t->bit = 0;
+			t->shift = 0;
+			t->state = SWD_T_WDATA;
+		}
+		break;
+
+	case SWD_T_WDATA:
+		t->shift |= (uint64_t)(drive && bit) << t->bit;
+		if (++t->bit == 33) {
+			t->bit = 0;
+			swd_target_write_done(t);
+			t->state = SWD_T_IDLE;
+		}
+		break;
+
+	case SWD_T_TRN_IDLE:
+		if (++t->bit >= t->turnaround) {
+			t->bit = 0;
+			t->state = SWD_T_IDLE;
+		}
+		break;
+	}
+
+	return drive ? bit : out;
+}
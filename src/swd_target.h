@@ -0,0 +1,112 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Software model of an SWD target (DP + MEM-AP + memory)
+ */
+
+#ifndef SWD_TARGET_H
+#define SWD_TARGET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Cortex-M0+ identification values */
+#define SWD_TARGET_DPIDR	0x0BC11477
+#define SWD_TARGET_AP_IDR	0x04770031
+
+#define SWD_TARGET_MAX_REGIONS	2
+
+/* Memory region visible through the MEM-AP */
+struct swd_target_region {
+	uint32_t base;
+	uint32_t size;
+	uint8_t *data;
+	bool read_only;
+};
+
+/* Counters exported by the model */
+struct swd_target_stats {
+	uint32_t packets;
+	uint32_t ap_reads;
+	uint32_t ap_writes;
+	uint32_t waits;
+	uint32_t faults;
+	uint32_t protocol_errors;
+	uint32_t line_resets;
+};
+
+struct swd_target {
+	/* Wire state */
+	uint8_t state;
+	uint8_t bit;
+	uint8_t ones;
+	uint8_t request;
+	uint8_t ack;
+	uint8_t turnaround;
+	uint64_t shift;
+
+	/* Debug port */
+	uint32_t ctrl_stat;
+	uint32_t select;
+	uint32_t rdbuff;
+
+	/* MEM-AP */
+	uint32_t csw;
+	uint32_t tar;
+
+	/* Answer every wait_every-th AP access with WAIT (0 = never) */
+	uint16_t wait_every;
+	uint16_t wait_count;
+
+	struct swd_target_region regions[SWD_TARGET_MAX_REGIONS];
+	uint8_t num_regions;
+
+	struct swd_target_stats stats;
+};
+
+/**
+ * Reset the model to its power-on state.
+ * Memory regions and fault injection settings are kept.
+ *
+ * @param t Target model
+ */
+void swd_target_reset(struct swd_target *t);
+
+/**
+ * Attach a memory region to the MEM-AP address space.
+ *
+ * @param t Target model
+ * @param base Target address of the region
+ * @param data Backing storage
+ * @param size Region size in bytes
+ * @param read_only true to reject AP writes (flash)
+ * @return 0 on success, -ENOMEM if all region slots are used
+ */
+int swd_target_add_region(struct swd_target *t, uint32_t base, uint8_t *data,
+			  uint32_t size, bool read_only);
+
+/**
+ * Clock one SWCLK cycle.
+ *
+ * @param t Target model
+ * @param drive true if the probe drives SWDIO during this cycle
+ * @param bit Level driven by the probe
+ * @return SWDIO level seen on the wire (pulled up when nobody drives)
+ */
+bool swd_target_clock(struct swd_target *t, bool drive, bool bit);
+
+/**
+ * Access target memory as the MEM-AP would.
+ *
+ * @param t Target model
+ * @param addr Target address
+ * @param size Access size in bytes (1, 2 or 4)
+ * @param val Value in byte lane position
+ * @param write true for a write access
+ * @return 0 on success, -EFAULT on bus error
+ */
+int swd_target_mem_access(struct swd_target *t, uint32_t addr, uint8_t size,
+			  uint32_t *val, bool write);
+
+#endif /* SWD_TARGET_H */
@@ -0,0 +1,224 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * SWD port connected to a software target model
+ *
+ * Implements the swdp API on top of the same protocol layer as the PIO
+ * driver, with each SWCLK cycle fed to swd_target_clock(). This lets the
+ * DAP stack and the SWD packet code run on native_sim without a probe.
+ * The target has RAM and, optionally, a read-only erased flash.
+ */
+
+#define DT_DRV_COMPAT zephyr_swdp_emul
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/swdp.h>
+#include <string.h>
+
+#include "swd_proto.h"
+#include "swd_target.h"
+
+struct swdp_emul_config {
+	uint32_t ram_base;
+	uint32_t ram_size;
+	uint8_t *ram;
+	uint32_t flash_base;
+	uint32_t flash_size;
+	uint8_t *flash;
+};
+
+struct swdp_emul_data {
+	struct swd_target target;
+	struct swd_proto proto;
+	uint32_t clock;
+	uint8_t pins;
+	bool powered;
+};
+
+static void swdp_emul_phy_write(void *ctx, uint32_t bits, uint8_t count)
+{
+	struct swdp_emul_data *data = ctx;
+
+	for (uint8_t i = 0; i < count; i++) {
+		swd_target_clock(&data->target, data->powered, (bits >> i) & 1);
+	}
+}
+
+static uint32_t swdp_emul_phy_read(void *ctx, uint8_t count)
+{
+	struct swdp_emul_data *data = ctx;
+	uint32_t bits = 0;
+
+	for (uint8_t i = 0; i < count; i++) {
+		bits |= (uint32_t)swd_target_clock(&data->target, false, 0) << i;
+	}
+
+	return bits;
+}
+
+static void swdp_emul_phy_turnaround(void *ctx, uint8_t count)
+{
+	swdp_emul_phy_read(ctx, count);
+}
+
+static const struct swd_phy_api swdp_emul_phy = {
+	.write = swdp_emul_phy_write,
+	.read = swdp_emul_phy_read,
+	.turnaround = swdp_emul_phy_turnaround,
+};
+
+static int swdp_emul_output_sequence(const struct device *dev, uint32_t count,
+				     const uint8_t *buf)
+{
+	struct swdp_emul_data *data = dev->data;
+
+	swd_proto_output_sequence(&data->proto, count, buf);
+
+	return 0;
+}
+
+static int swdp_emul_input_sequence(const struct device *dev, uint32_t count,
+				    uint8_t *buf)
+{
+	struct swdp_emul_data *data = dev->data;
+
+	swd_proto_input_sequence(&data->proto, count, buf);
+
+	return 0;
+}
+
+static int swdp_emul_transfer(const struct device *dev, uint8_t request,
+			      uint32_t *buf, uint8_t idle_cycles,
+			      uint8_t *response)
+{
+	struct swdp_emul_data *data = dev->data;
+
+	return swd_proto_transfer(&data->proto, request, buf, idle_cycles,
+				  response);
+}
+
+static int swdp_emul_set_pins(const struct device *dev, uint8_t pins,
+			      uint8_t value)
+{
+	struct swdp_emul_data *data = dev->data;
+
+	data->pins = (data->pins & ~pins) | (value & pins);
+
+	/* A falling edge on nRESET resets the target */
+	if ((pins & BIT(SWDP_nRESET_PIN)) && !(value & BIT(SWDP_nRESET_PIN))) {
+		swd_target_reset(&data->target);
+	}
+
+	return 0;
+}
+
+static int swdp_emul_get_pins(const struct device *dev, uint8_t *state)
+{
+	struct swdp_emul_data *data = dev->data;
+
+	*state = data->pins;
+
+	return 0;
+}
+
+static int swdp_emul_set_clock(const struct device *dev, uint32_t clock)
+{
+	struct swdp_emul_data *data = dev->data;
+
+	data->clock = clock;
+
+	return 0;
+}
+
+static int swdp_emul_configure(const struct device *dev, uint8_t turnaround,
+			       bool data_phase)
+{
+	struct swdp_emul_data *data = dev->data;
+
+	data->proto.turnaround = turnaround;
+	data->proto.data_phase = data_phase;
+	data->target.turnaround = turnaround;
+
+	return 0;
+}
+
+static int swdp_emul_port_on(const struct device *dev)
+{
+	struct swdp_emul_data *data = dev->data;
+
+	data->powered = true;
+	data->pins = BIT(SWDP_SWDIO_PIN) | BIT(SWDP_nRESET_PIN);
+
+	return 0;
+}
+
+static int swdp_emul_port_off(const struct device *dev)
+{
+	struct swdp_emul_data *data = dev->data;
+
+	data->powered = false;
+
+	return 0;
+}
+
+static const struct swdp_api swdp_emul_api = {
+	.swdp_output_sequence = swdp_emul_output_sequence,
+	.swdp_input_sequence = swdp_emul_input_sequence,
+	.swdp_transfer = swdp_emul_transfer,
+	.swdp_set_pins = swdp_emul_set_pins,
+	.swdp_get_pins = swdp_emul_get_pins,
+	.swdp_set_clock = swdp_emul_set_clock,
+	.swdp_configure = swdp_emul_configure,
+	.swdp_port_on = swdp_emul_port_on,
+	.swdp_port_off = swdp_emul_port_off,
+};
+
+static int swdp_emul_init(const struct device *dev)
+{
+	const struct swdp_emul_config *config = dev->config;
+	struct swdp_emul_data *data = dev->data;
+
+	swd_target_reset(&data->target);
+	swd_target_add_region(&data->target, config->ram_base, config->ram,
+			      config->ram_size, false);
+
+	/* Erased flash, read-only through the MEM-AP as on a real target */
+	if (config->flash_size > 0) {
+		memset(config->flash, 0xFF, config->flash_size);
+		swd_target_add_region(&data->target, config->flash_base,
+				      config->flash, config->flash_size, true);
+	}
+
+	data->proto.phy = &swdp_emul_phy;
+	data->proto.ctx = data;
+	data->proto.turnaround = 1;
+	data->proto.data_phase = false;
+
+	return 0;
+}
+
+#define SWDP_EMUL_DEFINE(inst)							\
+	static uint8_t swdp_emul_ram_##inst[DT_INST_PROP(inst, ram_size)];	\
+	static uint8_t swdp_emul_flash_##inst[					\
+		MAX(DT_INST_PROP(inst, flash_size), 1)];			\
+										\
+	static const struct swdp_emul_config swdp_emul_config_##inst = {	\
+		.ram_base = DT_INST_PROP(inst, ram_base),			\
+		.ram_size = DT_INST_PROP(inst, ram_size),			\
+		.ram = swdp_emul_ram_##inst,					\
+		.flash_base = DT_INST_PROP(inst, flash_base),			\
+		.flash_size = DT_INST_PROP(inst, flash_size),			\
+		.flash = swdp_emul_flash_##inst,				\
+	};									\
+										\
+	static struct swdp_emul_data swdp_emul_data_##inst;			\
+										\
+	DEVICE_DT_INST_DEFINE(inst, swdp_emul_init, NULL,			\
+			      &swdp_emul_data_##inst,				\
+			      &swdp_emul_config_##inst,				\
+			      POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEVICE,	\
+			      &swdp_emul_api);
+
+DT_INST_FOREACH_STATUS_OKAY(SWDP_EMUL_DEFINE)
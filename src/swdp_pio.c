@@ -0,0 +1,361 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * SWD port driven by an RP2040 PIO state machine
+ *
+ * The state machine owns SWCLK (side-set) and SWDIO (out/in/pindir).
+ * The CPU pushes one command word per bit field into the TX FIFO:
+ *
+ *   bits  7:0   bit count - 1
+ *   bit   8     SWDIO direction (1 = probe drives)
+ *   bits 13:9   program counter of the routine (write or read)
+ *
+ * A write command is followed by one data word. A read command makes
+ * the state machine push the sampled bits, left aligned, into the RX
+ * FIFO. Each bit takes four PIO cycles, so SWCLK = clk_sys / (4 * div),
+ * which is 31.25 MHz at the default 125 MHz system clock.
+ *
+ * Turnaround cycles are plain write commands with SWDIO released, so
+ * the whole packet, including the direction changes, is clocked by the
+ * state machine without CPU involvement. Header and data parity are a
+ * single __builtin_parity() on the CPU side.
+ */
+
+#define DT_DRV_COMPAT raspberrypi_pico_swdp_pio
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/pinctrl.h>
+#include <zephyr/drivers/swdp.h>
+#include <zephyr/drivers/misc/pio_rpi_pico/pio_rpi_pico.h>
+
+#include <hardware/pio.h>
+#include <hardware/structs/sio.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(swdp_pio, LOG_LEVEL_INF);
+
+#include "swd_proto.h"
+
+#define SWDP_PIO_SYS_CLK_HZ DT_PROP(DT_PATH(cpus, cpu_0), clock_frequency)
+#define SWDP_PIO_CYCLES_PER_BIT 4
+
+/* Routine offsets inside the program below */
+#define SWDP_PIO_WRITE_CMD	0
+#define SWDP_PIO_GET_NEXT_CMD	3
+#define SWDP_PIO_READ_CMD	8
+
+RPI_PICO_PIO_DEFINE_PROGRAM(swdp, 3, 10,
+	/* write_cmd, turnaround_cmd: */
+	0x80a0, /*  0: pull   block                     */
+	/* write_bitloop: */
+	0x7101, /*  1: out    pins, 1         side 0 [1] */
+	0x1941, /*  2: jmp    x--, 1          side 1 [1] */
+		/* .wrap_target */
+	/* get_next_cmd: */
+	0x90a0, /*  3: pull   block           side 0     */
+	0x6028, /*  4: out    x, 8                       */
+	0x6081, /*  5: out    pindirs, 1                 */
+	0x60a5, /*  6: out    pc, 5                      */
+	/* read_bitloop: */
+	0xa042, /*  7: nop                               */
+	/* read_cmd: */
+	0x5901, /*  8: in     pins, 1         side 1 [1] */
+	0x1047, /*  9: jmp    x--, 7          side 0     */
+	0x8020, /* 10: push   block                      */
+		/* .wrap */
+);
+
+struct swdp_pio_config {
+	const struct device *piodev;
+	const struct pinctrl_dev_config *pcfg;
+	struct gpio_dt_spec clk;
+	struct gpio_dt_spec dio;
+	struct gpio_dt_spec reset;
+	uint32_t max_frequency;
+};
+
+struct swdp_pio_data {
+	PIO pio;
+	size_t sm;
+	uint32_t offset;
+	uint32_t clock;
+	struct swd_proto proto;
+};
+
+static inline uint32_t swdp_pio_cmd(const struct swdp_pio_data *data,
+				    uint8_t routine, bool drive, uint8_t count)
+{
+	return (uint32_t)(count - 1) | ((uint32_t)drive << 8) |
+	       ((data->offset + routine) << 9);
+}
+
+static void swdp_pio_phy_write(void *ctx, uint32_t bits, uint8_t count)
+{
+	struct swdp_pio_data *data = ctx;
+
+	pio_sm_put_blocking(data->pio, data->sm,
+			    swdp_pio_cmd(data, SWDP_PIO_WRITE_CMD, true, count));
+	pio_sm_put_blocking(data->pio, data->sm, bits);
+}
+
+static uint32_t swdp_pio_phy_read(void *ctx, uint8_t count)
+{
+	struct swdp_pio_data *data = ctx;
+
+	pio_sm_put_blocking(data->pio, data->sm,
+			    swdp_pio_cmd(data, SWDP_PIO_READ_CMD, false, count));
+
+	return pio_sm_get_blocking(data->pio, data->sm) >> (32 - count);
+}
+
+static void swdp_pio_phy_turnaround(void *ctx, uint8_t count)
+{
+	struct swdp_pio_data *data = ctx;
+
+	if (count == 0) {
+		return;
+	}
+
+	pio_sm_put_blocking(data->pio, data->sm,
+			    swdp_pio_cmd(data, SWDP_PIO_WRITE_CMD, false, count));
+	pio_sm_put_blocking(data->pio, data->sm, 0);
+}
+
+static const struct swd_phy_api swdp_pio_phy = {
+	.write = swdp_pio_phy_write,
+	.read = swdp_pio_phy_read,
+	.turnaround = swdp_pio_phy_turnaround,
+};
+
+static int swdp_pio_output_sequence(const struct device *dev, uint32_t count,
+				    const uint8_t *buf)
+{
+	struct swdp_pio_data *data = dev->data;
+
+	swd_proto_output_sequence(&data->proto, count, buf);
+
+	return 0;
+}
+
+static int swdp_pio_input_sequence(const struct device *dev, uint32_t count,
+				   uint8_t *buf)
+{
+	struct swdp_pio_data *data = dev->data;
+
+	swd_proto_input_sequence(&data->proto, count, buf);
+
+	return 0;
+}
+
+static int swdp_pio_transfer(const struct device *dev, uint8_t request,
+			     uint32_t *buf, uint8_t idle_cycles,
+			     uint8_t *response)
+{
+	struct swdp_pio_data *data = dev->data;
+
+	return swd_proto_transfer(&data->proto, request, buf, idle_cycles,
+				  response);
+}
+
+/*
+ * SWCLK and SWDIO belong to the state machine, only nRESET can be
+ * driven directly (DAP_SWJ_Pins is used by hosts for target reset).
+ */
+static int swdp_pio_set_pins(const struct device *dev, uint8_t pins,
+			     uint8_t value)
+{
+	const struct swdp_pio_config *config = dev->config;
+
+	if ((pins & BIT(SWDP_nRESET_PIN)) && config->reset.port != NULL) {
+		gpio_pin_set_dt(&config->reset,
+				(value & BIT(SWDP_nRESET_PIN)) ? 0 : 1);
+	}
+
+	return 0;
+}
+
+static int swdp_pio_get_pins(const struct device *dev, uint8_t *state)
+{
+	const struct swdp_pio_config *config = dev->config;
+	uint32_t in = sio_hw->gpio_in;
+	uint8_t pins = 0;
+
+	if (in & BIT(config->clk.pin)) {
+		pins |= BIT(SWDP_SWCLK_PIN);
+	}
+
+	if (in & BIT(config->dio.pin)) {
+		pins |= BIT(SWDP_SWDIO_PIN);
+	}
+
+	if (config->reset.port == NULL || gpio_pin_get_dt(&config->reset) == 0) {
+		pins |= BIT(SWDP_nRESET_PIN);
+	}
+
+	*state = pins;
+
+	return 0;
+}
+
+static int swdp_pio_set_clock(const struct device *dev, uint32_t clock)
+{
+	const struct swdp_pio_config *config = dev->config;
+	struct swdp_pio_data *data = dev->data;
+	uint64_t div256;
+
+	if (clock == 0) {
+		return -EINVAL;
+	}
+
+	clock = MIN(clock, config->max_frequency);
+
+	/* 16.8 fixed point divider, 1.0 is the fastest possible */
+	div256 = ((uint64_t)SWDP_PIO_SYS_CLK_HZ << 8) /
+		 ((uint64_t)clock * SWDP_PIO_CYCLES_PER_BIT);
+	div256 = CLAMP(div256, 256U, (uint64_t)UINT16_MAX << 8);
+
+	pio_sm_set_clkdiv_int_frac(data->pio, data->sm, div256 >> 8,
+				   div256 & 0xFF);
+	data->clock = (uint32_t)(((uint64_t)SWDP_PIO_SYS_CLK_HZ << 8) /
+				 (div256 * SWDP_PIO_CYCLES_PER_BIT));
+
+	LOG_DBG("SWCLK requested %u Hz, set %u Hz", clock, data->clock);
+
+	return 0;
+}
+
+static int swdp_pio_configure(const struct device *dev, uint8_t turnaround,
+			      bool data_phase)
+{
+	struct swdp_pio_data *data = dev->data;
+
+	data->proto.turnaround = turnaround;
+	data->proto.data_phase = data_phase;
+
+	return 0;
+}
+
+static int swdp_pio_port_on(const struct device *dev)
+{
+	const struct swdp_pio_config *config = dev->config;
+	struct swdp_pio_data *data = dev->data;
+	uint32_t mask = BIT(config->clk.pin) | BIT(config->dio.pin);
+
+	pio_sm_set_pins_with_mask(data->pio, data->sm, BIT(config->dio.pin),
+				  mask);
+	pio_sm_set_pindirs_with_mask(data->pio, data->sm, mask, mask);
+	pio_sm_set_enabled(data->pio, data->sm, true);
+
+	if (config->reset.port != NULL) {
+		gpio_pin_configure_dt(&config->reset, GPIO_OUTPUT_INACTIVE);
+	}
+
+	return 0;
+}
+
+static int swdp_pio_port_off(const struct device *dev)
+{
+	const struct swdp_pio_config *config = dev->config;
+	struct swdp_pio_data *data = dev->data;
+	uint32_t mask = BIT(config->clk.pin) | BIT(config->dio.pin);
+
+	pio_sm_set_enabled(data->pio, data->sm, false);
+	pio_sm_set_pindirs_with_mask(data->pio, data->sm, 0, mask);
+
+	if (config->reset.port != NULL) {
+		gpio_pin_configure_dt(&config->reset, GPIO_INPUT);
+	}
+
+	return 0;
+}
+
+static const struct swdp_api swdp_pio_api = {
+	.swdp_output_sequence = swdp_pio_output_sequence,
+	.swdp_input_sequence = swdp_pio_input_sequence,
+	.swdp_transfer = swdp_pio_transfer,
+	.swdp_set_pins = swdp_pio_set_pins,
+	.swdp_get_pins = swdp_pio_get_pins,
+	.swdp_set_clock = swdp_pio_set_clock,
+	.swdp_configure = swdp_pio_configure,
+	.swdp_port_on = swdp_pio_port_on,
+	.swdp_port_off = swdp_pio_port_off,
+};
+
+static int swdp_pio_init(const struct device *dev)
+{
+	const struct swdp_pio_config *config = dev->config;
+	struct swdp_pio_data *data = dev->data;
+	const pio_program_t *program = RPI_PICO_PIO_GET_PROGRAM(swdp);
+	pio_sm_config sm_config;
+	int ret;
+
+	if (!device_is_ready(config->piodev)) {
+		return -ENODEV;
+	}
+
+	data->pio = pio_rpi_pico_get_pio(config->piodev);
+
+	ret = pio_rpi_pico_allocate_sm(config->piodev, &data->sm);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (!pio_can_add_program(data->pio, program)) {
+		return -EBUSY;
+	}
+
+	data->offset = pio_add_program(data->pio, program);
+
+	sm_config = pio_get_default_sm_config();
+	sm_config_set_wrap(&sm_config,
+			   data->offset + RPI_PICO_PIO_GET_WRAP_TARGET(swdp),
+			   data->offset + RPI_PICO_PIO_GET_WRAP(swdp));
+	/* One side-set pin (SWCLK), optional */
+	sm_config_set_sideset(&sm_config, 2, true, false);
+	sm_config_set_sideset_pins(&sm_config, config->clk.pin);
+	sm_config_set_out_pins(&sm_config, config->dio.pin, 1);
+	sm_config_set_set_pins(&sm_config, config->dio.pin, 1);
+	sm_config_set_in_pins(&sm_config, config->dio.pin);
+	sm_config_set_out_shift(&sm_config, true, false, 32);
+	sm_config_set_in_shift(&sm_config, true, false, 32);
+
+	pio_sm_init(data->pio, data->sm,
+		    data->offset + SWDP_PIO_GET_NEXT_CMD, &sm_config);
+
+	ret = pinctrl_apply_state(config->pcfg, PINCTRL_STATE_DEFAULT);
+	if (ret < 0) {
+		return ret;
+	}
+
+	data->proto.phy = &swdp_pio_phy;
+	data->proto.ctx = data;
+	data->proto.turnaround = 1;
+	data->proto.data_phase = false;
+
+	return swdp_pio_set_clock(dev, config->max_frequency);
+}
+
+#define SWDP_PIO_DEFINE(inst)							\
+	PINCTRL_DT_INST_DEFINE(inst);						\
+										\
+	static const struct swdp_pio_config swdp_pio_config_##inst = {		\
+		.piodev = DEVICE_DT_GET(DT_INST_PARENT(inst)),			\
+		.pcfg = PINCTRL_DT_INST_DEV_CONFIG_GET(inst),			\
+		.clk = GPIO_DT_SPEC_INST_GET(inst, clk_gpios),			\
+		.dio = GPIO_DT_SPEC_INST_GET(inst, dio_gpios),			\
+		.reset = GPIO_DT_SPEC_INST_GET_OR(inst, reset_gpios, {0}),	\
+		.max_frequency = DT_INST_PROP(inst, max_frequency),		\
+	};									\
+										\
+	static struct swdp_pio_data swdp_pio_data_##inst;			\
+										\
+	DEVICE_DT_INST_DEFINE(inst, swdp_pio_init, NULL,			\
+			      &swdp_pio_data_##inst,				\
+			      &swdp_pio_config_##inst,				\
+			      POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEVICE,	\
+			      &swdp_pio_api);
+
+DT_INST_FOREACH_STATUS_OKAY(SWDP_PIO_DEFINE)
@@ -0,0 +1,536 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * SWO trace capture
+ *
+ * SWO in UART (NRZ) mode is received by a PIO state machine on the J2
+ * RX line, 8N1, eight PIO cycles per bit. The state machine pushes one
+ * byte per word into its joined RX FIFO and a DMA channel, paced by the
+ * FIFO DREQ, copies it to a ring buffer whose size is a power of two,
+ * using the DMA address wrap. The CPU is not involved in the capture;
+ * the producer position is read from the DMA transfer counter.
+ *
+ * The host gets the data through the CMSIS-DAP SWO commands, either
+ * polled with DAP_SWO_Data, or streamed on the third bulk IN endpoint
+ * of the CMSIS-DAP v2 interface by a dedicated thread. Data overwritten
+ * before it was read is reported as a buffer overrun in the trace
+ * status, once, as the reference firmware does.
+ *
+ * The DMA channel is claimed statically (CONFIG_SWO_DMA_CHANNEL) and
+ * must not be used by any Zephyr DMA client.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/pinctrl.h>
+#include <zephyr/drivers/misc/pio_rpi_pico/pio_rpi_pico.h>
+#include <zephyr/net_buf.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+
+#include <hardware/dma.h>
+#include <hardware/pio.h>
+
+#include "swo.h"
+#include "swo_ring.h"
+#include "dap_queue.h"
+#include "dap_usb.h"
+#include "health.h"
+
+#define SWO_NODE DT_NODELABEL(swo0)
+
+#define SWO_SYS_CLK_HZ DT_PROP(DT_PATH(cpus, cpu_0), clock_frequency)
+#define SWO_CYCLES_PER_BIT 8
+
+#define SWO_DMA_CH CONFIG_SWO_DMA_CHANNEL
+/* The DMA counter is re-armed long before it runs out */
+#define SWO_DMA_COUNT UINT32_MAX
+#define SWO_DMA_REARM BIT(31)
+
+#define SWO_SIZE CONFIG_SWO_BUFFER_SIZE
+
+/* Response header of DAP_SWO_Data: command, status, count */
+#define SWO_DATA_HDR 4
+/* Longest response but DAP_SWO_Data, which also fits its header */
+#define SWO_RESP_MIN 6
+
+#define SWO_HEALTH_BUDGET_MS 1000
+/* Longest wait for a free stream buffer, the host is not reading */
+#define SWO_STREAM_TIMEOUT K_MSEC(100)
+
+BUILD_ASSERT(IS_POWER_OF_TWO(SWO_SIZE), "SWO buffer size must be a power of 2");
+
+/*
+ * UART receiver, 8N1. Wait for the start bit, then sample each data bit
+ * in its middle. A byte without a valid stop bit is dropped and the
+ * state machine waits for the line to return idle.
+ */
+RPI_PICO_PIO_DEFINE_PROGRAM(swo_uart_rx, 0, 8,
+		/* .wrap_target */
+	/* start: */
+	0x2020, /*  0: wait   0 pin, 0                   */
+	0xea27, /*  1: set    x, 7                  [10] */
+	/* bitloop: */
+	0x4001, /*  2: in     pins, 1                    */
+	0x0642, /*  3: jmp    x--, 2                [6]  */
+	0x00c8, /*  4: jmp    pin, 8                     */
+	/* framing error: */
+	0xa042, /*  5: nop                               */
+	0x20a0, /*  6: wait   1 pin, 0                   */
+	0x0000, /*  7: jmp    0                          */
+	/* good_stop: */
+	0x8020, /*  8: push   block                      */
+		/* .wrap */
+);
+
+PINCTRL_DT_DEFINE(SWO_NODE);
+
+static const struct device *const swo_piodev = DEVICE_DT_GET(DT_PARENT(SWO_NODE));
+static const struct pinctrl_dev_config *const swo_pcfg =
+	PINCTRL_DT_DEV_CONFIG_GET(SWO_NODE);
+static const struct gpio_dt_spec swo_rx = GPIO_DT_SPEC_GET(SWO_NODE, rx_gpios);
+
+/* Aligned on its size for the DMA write address wrap */
+static uint8_t swo_buf[SWO_SIZE] __aligned(SWO_SIZE);
+
+static uint32_t swo_written(void);
+
+static struct {
+	PIO pio;
+	size_t sm;
+	uint32_t offset;
+	bool ready;
+
+	uint8_t transport;
+	uint8_t mode;
+	uint32_t baudrate;
+	bool active;
+	/* SWO_STATUS_* error bits not reported yet */
+	uint8_t errors;
+
+	/* Bytes written by the DMA channel before its last (re)start */
+	uint32_t dma_base;
+	struct swo_ring ring;
+	struct swo_stats stats;
+} swo = {
+	.ring = {
+		.buf = swo_buf,
+		.size = SWO_SIZE,
+		.written = swo_written,
+	},
+};
+
+/* Serializes the DAP commands and the stream thread */
+static K_MUTEX_DEFINE(swo_lock);
+static K_SEM_DEFINE(swo_wake, 0, 1);
+static HEALTH_HB_DEFINE(swo_stream, SWO_HEALTH_BUDGET_MS);
+
+/* Producer count, with swo_lock held */
+static uint32_t swo_written(void)
+{
+	uint32_t left;
+
+	if (!swo.active) {
+		return swo.dma_base;
+	}
+
+	left = dma_hw->ch[SWO_DMA_CH].transfer_count;
+	if (left < SWO_DMA_REARM) {
+		/*
+		 * The write address is kept across the abort and the RX FIFO
+		 * holds the bytes received meanwhile, nothing is lost.
+		 */
+		dma_channel_abort(SWO_DMA_CH);
+		left = dma_hw->ch[SWO_DMA_CH].transfer_count;
+		swo.dma_base += SWO_DMA_COUNT - left;
+		dma_channel_set_trans_count(SWO_DMA_CH, SWO_DMA_COUNT, true);
+		left = SWO_DMA_COUNT;
+	}
+
+	return swo.dma_base + (SWO_DMA_COUNT - left);
+}
+
+/* Trace status byte, pending errors are reported once */
+static uint8_t swo_status(uint32_t wr)
+{
+	uint8_t status = swo.errors;
+
+	if (wr - swo.ring.rd > swo.ring.size) {
+		status |= SWO_STATUS_OVERRUN;
+	}
+
+	if (swo.active) {
+		status |= SWO_STATUS_ACTIVE;
+	}
+
+	swo.errors = 0;
+
+	return status;
+}
+
+static uint32_t swo_set_baudrate(uint32_t baudrate)
+{
+	uint64_t div256;
+
+	if (baudrate == 0) {
+		return 0;
+	}
+
+	/* 16.8 fixed point divider, 1.0 gives the highest rate */
+	div256 = ((uint64_t)SWO_SYS_CLK_HZ << 8) /
+		 ((uint64_t)baudrate * SWO_CYCLES_PER_BIT);
+	if (div256 < 256 || div256 > ((uint64_t)UINT16_MAX << 8)) {
+		return 0;
+	}
+
+	pio_sm_set_clkdiv_int_frac(swo.pio, swo.sm, div256 >> 8, div256 & 0xFF);
+	swo.baudrate = (uint32_t)(((uint64_t)SWO_SYS_CLK_HZ << 8) /
+				  (div256 * SWO_CYCLES_PER_BIT));
+
+	return swo.baudrate;
+}
+
+static void swo_start(void)
+{
+	dma_channel_config cfg = dma_channel_get_default_config(SWO_DMA_CH);
+
+	pio_sm_set_enabled(swo.pio, swo.sm, false);
+	pio_sm_clear_fifos(swo.pio, swo.sm);
+	pio_sm_restart(swo.pio, swo.sm);
+	pio_sm_exec(swo.pio, swo.sm, pio_encode_jmp(swo.offset));
+
+	/* The received byte is in the top byte of the FIFO word */
+	channel_config_set_transfer_data_size(&cfg, DMA_SIZE_8);
+	channel_config_set_read_increment(&cfg, false);
+	channel_config_set_write_increment(&cfg, true);
+	channel_config_set_ring(&cfg, true, __builtin_ctz(SWO_SIZE));
+	channel_config_set_dreq(&cfg, pio_get_dreq(swo.pio, swo.sm, false));
+	dma_channel_configure(SWO_DMA_CH, &cfg, swo_buf,
+			      (const uint8_t *)&swo.pio->rxf[swo.sm] + 3,
+			      SWO_DMA_COUNT, true);
+
+	swo.dma_base = 0;
+	swo_ring_reset(&swo.ring, 0);
+	swo.errors = 0;
+	swo.active = true;
+
+	pio_sm_set_enabled(swo.pio, swo.sm, true);
+	k_sem_give(&swo_wake);
+}
+
+static void swo_stop(void)
+{
+	pio_sm_set_enabled(swo.pio, swo.sm, false);
+
+	/* Let the DMA drain the FIFO, then freeze the producer count */
+	while (!pio_sm_is_rx_fifo_empty(swo.pio, swo.sm)) {
+	}
+
+	dma_channel_abort(SWO_DMA_CH);
+	swo.dma_base += SWO_DMA_COUNT - dma_hw->ch[SWO_DMA_CH].transfer_count;
+	swo.active = false;
+}
+
+static uint32_t swo_cmd_data(const uint8_t *request, uint8_t *response,
+			     uint32_t resp_size)
+{
+	uint16_t max = sys_get_le16(&request[1]);
+	uint32_t wr = swo_written();
+	uint32_t len = 0;
+	bool overrun = false;
+
+	if (swo.transport == SWO_TRANSPORT_DATA) {
+		max = MIN(max, resp_size - SWO_DATA_HDR);
+		len = swo_ring_read(&swo.ring, &response[SWO_DATA_HDR], max,
+				    &overrun);
+	}
+
+	if (overrun) {
+		swo.errors |= SWO_STATUS_OVERRUN;
+	}
+
+	response[1] = swo_status(wr);
+	sys_put_le16(len, &response[2]);
+
+	return (3 << 16) | (SWO_DATA_HDR + len);
+}
+
+static uint32_t swo_cmd_extended_status(const uint8_t *request,
+					uint8_t *response)
+{
+	uint32_t wr = swo_written();
+	uint32_t len = 1;
+
+	/* Status, then count; index and timestamp are not supported */
+	if (request[1] & BIT(0)) {
+		response[len++] = swo_status(wr);
+	}
+	if (request[1] & BIT(1)) {
+		sys_put_le32(swo_ring_level(&swo.ring, wr), &response[len]);
+		len += 4;
+	}
+
+	return (2 << 16) | len;
+}
+
+/* Commands answered with a single status byte */
+static uint8_t swo_cmd_setup(const uint8_t *request)
+{
+	switch (request[0]) {
+	case DAP_CMD_SWO_TRANSPORT:
+		if (swo.active || request[1] > SWO_TRANSPORT_ENDPOINT) {
+			return 0xFF;
+		}
+		swo.transport = request[1];
+		return 0;
+
+	case DAP_CMD_SWO_MODE:
+		if (swo.active || request[1] > SWO_MODE_UART || !swo.ready) {
+			return 0xFF;
+		}
+		swo.mode = request[1];
+		return 0;
+
+	default: /* DAP_CMD_SWO_CONTROL */
+		if (request[1] && !swo.active) {
+			if (swo.mode != SWO_MODE_UART || swo.baudrate == 0) {
+				return 0xFF;
+			}
+			swo_start();
+		} else if (!request[1] && swo.active) {
+			swo_stop();
+		}
+		return 0;
+	}
+}
+
+/* Request length of a command */
+static uint32_t swo_req_len(uint8_t cmd)
+{
+	switch (cmd) {
+	case DAP_CMD_SWO_BAUDRATE:
+		return 5;
+	case DAP_CMD_SWO_STATUS:
+		return 1;
+	case DAP_CMD_SWO_DATA:
+		return 3;
+	default:
+		return 2;
+	}
+}
+
+uint32_t swo_execute(const uint8_t *request, uint32_t req_len,
+		     uint8_t *response, uint32_t resp_size)
+{
+	uint32_t ret;
+	uint32_t val;
+
+	/* Inside a batch, as the DAP core answers a malformed command */
+	if (req_len < swo_req_len(request[0]) || resp_size < SWO_RESP_MIN) {
+		response[0] = DAP_CMD_INVALID;
+		return (req_len << 16) | 1;
+	}
+
+	response[0] = request[0];
+
+	k_mutex_lock(&swo_lock, K_FOREVER);
+
+	switch (request[0]) {
+	case DAP_CMD_SWO_BAUDRATE:
+		val = swo.ready ? swo_set_baudrate(sys_get_le32(&request[1])) : 0;
+		sys_put_le32(val, &response[1]);
+		ret = (5 << 16) | 5;
+		break;
+
+	case DAP_CMD_SWO_STATUS:
+		val = swo_written();
+		response[1] = swo_status(val);
+		sys_put_le32(swo_ring_level(&swo.ring, val), &response[2]);
+		ret = (1 << 16) | 6;
+		break;
+
+	case DAP_CMD_SWO_DATA:
+		ret = swo_cmd_data(request, response, resp_size);
+		break;
+
+	case DAP_CMD_SWO_EXTENDED_STATUS:
+		ret = swo_cmd_extended_status(request, response);
+		break;
+
+	default:
+		response[1] = swo_cmd_setup(request);
+		ret = (2 << 16) | 2;
+		break;
+	}
+
+	k_mutex_unlock(&swo_lock);
+
+	return ret;
+}
+
+void swo_get_stats(struct swo_stats *stats)
+{
+	k_mutex_lock(&swo_lock, K_FOREVER);
+	*stats = swo.stats;
+	stats->captured = swo_written();
+	stats->overruns = swo.ring.overruns;
+	k_mutex_unlock(&swo_lock);
+}
+
+bool swo_peek_errors(uint32_t *overruns, uint32_t *stream_errors)
+{
+	*overruns = swo.ring.overruns;
+	*stream_errors = swo.stats.stream_errors;
+
+	return swo.active;
+}
+
+static bool swo_streaming(void)
+{
+	return swo.active && swo.transport == SWO_TRANSPORT_ENDPOINT;
+}
+
+/* Move captured data to the SWO endpoint while streaming is selected */
+static void swo_thread(void *p1, void *p2, void *p3)
+{
+	struct net_buf *buf;
+	uint32_t len;
+	bool overrun;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	health_register(&swo_stream);
+
+	while (true) {
+		health_beat(&swo_stream);
+
+		if (!swo_streaming()) {
+			k_sem_take(&swo_wake, K_MSEC(SWO_HEALTH_BUDGET_MS / 4));
+			continue;
+		}
+
+		buf = dap_usb_swo_alloc(SWO_STREAM_TIMEOUT);
+		if (buf == NULL) {
+			k_mutex_lock(&swo_lock, K_FOREVER);
+			swo.errors |= SWO_STATUS_STREAM_ERROR;
+			swo.stats.stream_errors++;
+			k_mutex_unlock(&swo_lock);
+			k_sleep(SWO_STREAM_TIMEOUT);
+			continue;
+		}
+
+		overrun = false;
+		len = 0;
+
+		k_mutex_lock(&swo_lock, K_FOREVER);
+		if (swo_streaming()) {
+			len = swo_ring_read(&swo.ring, buf->data,
+					    net_buf_tailroom(buf), &overrun);
+		}
+		if (overrun) {
+			swo.errors |= SWO_STATUS_OVERRUN;
+		}
+		k_mutex_unlock(&swo_lock);
+
+		if (len == 0) {
+			net_buf_unref(buf);
+			k_sleep(K_MSEC(CONFIG_SWO_STREAM_PERIOD_MS));
+			continue;
+		}
+
+		net_buf_add(buf, len);
+		if (dap_usb_swo_send(buf) == 0) {
+			swo.stats.streamed += len;
+		}
+	}
+}
+
+K_THREAD_DEFINE(swo_tid, CONFIG_SWO_STACK_SIZE, swo_thread, NULL, NULL, NULL,
+		CONFIG_SWO_THREAD_PRIORITY, 0, 0);
+
+int swo_init(void)
+{
+	const pio_program_t *program = RPI_PICO_PIO_GET_PROGRAM(swo_uart_rx);
+	pio_sm_config sm_config;
+	int ret;
+
+	if (!device_is_ready(swo_piodev)) {
+		return -ENODEV;
+	}
+
+	swo.pio = pio_rpi_pico_get_pio(swo_piodev);
+
+	ret = pio_rpi_pico_allocate_sm(swo_piodev, &swo.sm);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (!pio_can_add_program(swo.pio, program)) {
+		return -EBUSY;
+	}
+
+	swo.offset = pio_add_program(swo.pio, program);
+
+	sm_config = pio_get_default_sm_config();
+	sm_config_set_wrap(&sm_config,
+			   swo.offset + RPI_PICO_PIO_GET_WRAP_TARGET(swo_uart_rx),
+			   swo.offset + RPI_PICO_PIO_GET_WRAP(swo_uart_rx));
+	sm_config_set_in_pins(&sm_config, swo_rx.pin);
+	sm_config_set_jmp_pin(&sm_config, swo_rx.pin);
+	/* LSB first, the byte ends up in bits 31:24 */
+	sm_config_set_in_shift(&sm_config, true, false, 32);
+	sm_config_set_fifo_join(&sm_config, PIO_FIFO_JOIN_RX);
+
+	pio_sm_set_consecutive_pindirs(swo.pio, swo.sm, swo_rx.pin, 1, false);
+	pio_sm_init(swo.pio, swo.sm, swo.offset, &sm_config);
+
+	ret = pinctrl_apply_state(swo_pcfg, PINCTRL_STATE_DEFAULT);
+	if (ret < 0) {
+		return ret;
+	}
+
+	swo.ready = true;
+
+	return 0;
+}
+
+/* Shell commands */
+
+static const char *const swo_transport_str[] = {
+	[SWO_TRANSPORT_NONE] = "none",
+	[SWO_TRANSPORT_DATA] = "DAP_SWO_Data",
+	[SWO_TRANSPORT_ENDPOINT] = "endpoint",
+};
+
+static int cmd_swo_status(const struct shell *sh, size_t argc, char **argv)
+{
+	struct swo_stats stats;
+	uint32_t level;
+
+	swo_get_stats(&stats);
+	level = swo_ring_level(&swo.ring, stats.captured);
+
+	shell_print(sh, "SWO capture: %s, %s at %u baud, transport %s",
+		    swo.active ? "running" : "stopped",
+		    swo.mode == SWO_MODE_UART ? "UART" : "off",
+		    swo.baudrate, swo_transport_str[swo.transport]);
+	shell_print(sh, "  buffer:        %u / %u bytes", level, SWO_SIZE);
+	shell_print(sh, "  captured:      %u bytes", stats.captured);
+	shell_print(sh, "  streamed:      %llu bytes", stats.streamed);
+	shell_print(sh, "  overruns:      %u", stats.overruns);
+	shell_print(sh, "  stream errors: %u", stats.stream_errors);
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_swo,
+	SHELL_CMD(status, NULL, "Show SWO capture state and counters",
+		  cmd_swo_status),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(swo, &sub_swo, "SWO trace capture", cmd_swo_status);
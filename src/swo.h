@@ -0,0 +1,98 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * SWO trace capture and CMSIS-DAP SWO commands
+ */
+
+#ifndef SWO_H
+#define SWO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+
+/* CMSIS-DAP SWO command IDs */
+#define DAP_CMD_SWO_TRANSPORT		0x17
+#define DAP_CMD_SWO_MODE		0x18
+#define DAP_CMD_SWO_BAUDRATE		0x19
+#define DAP_CMD_SWO_CONTROL		0x1A
+#define DAP_CMD_SWO_STATUS		0x1B
+#define DAP_CMD_SWO_DATA		0x1C
+#define DAP_CMD_SWO_EXTENDED_STATUS	0x1E
+
+/* DAP_SWO_Transport values */
+#define SWO_TRANSPORT_NONE		0
+#define SWO_TRANSPORT_DATA		1
+#define SWO_TRANSPORT_ENDPOINT		2
+
+/* DAP_SWO_Mode values, only UART is supported */
+#define SWO_MODE_OFF			0
+#define SWO_MODE_UART			1
+
+/* Trace status bits */
+#define SWO_STATUS_ACTIVE		BIT(0)
+#define SWO_STATUS_STREAM_ERROR		BIT(6)
+#define SWO_STATUS_OVERRUN		BIT(7)
+
+/* Capture counters */
+struct swo_stats {
+	/* Bytes received since capture was started */
+	uint32_t captured;
+	/* Bytes sent on the SWO endpoint */
+	uint64_t streamed;
+	/* Times unread data was overwritten */
+	uint32_t overruns;
+	/* Stream buffers not read by the host in time */
+	uint32_t stream_errors;
+};
+
+/**
+ * Check if a command ID is a DAP_SWO_* command.
+ *
+ * @param cmd Command ID
+ * @return true for a SWO command
+ */
+static inline bool swo_is_cmd(uint8_t cmd)
+{
+	return (cmd >= DAP_CMD_SWO_TRANSPORT && cmd <= DAP_CMD_SWO_DATA) ||
+	       cmd == DAP_CMD_SWO_EXTENDED_STATUS;
+}
+
+/**
+ * Claim the PIO state machine and set up the SWO input pin.
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+int swo_init(void);
+
+/**
+ * Run one DAP_SWO_* command.
+ *
+ * @param request Command
+ * @param req_len Request bytes left, from the command ID on
+ * @param response Response buffer
+ * @param resp_size Response bytes left, at least 1
+ * @return Request length in the upper 16 bits, response length in the
+ *         lower 16 bits, as dap_execute_cmd()
+ */
+uint32_t swo_execute(const uint8_t *request, uint32_t req_len,
+		     uint8_t *response, uint32_t resp_size);
+
+/**
+ * Get a snapshot of the capture counters.
+ *
+ * @param stats Destination
+ */
+void swo_get_stats(struct swo_stats *stats);
+
+/**
+ * Read the error counters without taking the SWO lock.
+ *
+ * @param overruns Times unread data was overwritten
+ * @param stream_errors Stream buffers not read by the host in time
+ * @return true while capture is active
+ */
+bool swo_peek_errors(uint32_t *overruns, uint32_t *stream_errors);
+
+#endif /* SWO_H */
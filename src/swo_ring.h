@@ -0,0 +1,118 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * SWO trace ring buffer, consumer side
+ *
+ * The producer (the DMA channel on the probe) writes the ring on its own
+ * and only exposes a free-running count of bytes written. The consumer
+ * keeps its own free-running read count; the difference is the fill
+ * level. Nothing is locked: when the producer laps the consumer, the
+ * overrun is detected on the next read and the consumer skips ahead to
+ * the newest half of the ring, which the producer is not writing. The
+ * producer keeps running during the copy, so the count is read again
+ * once it is done: bytes overwritten meanwhile are dropped from the copy
+ * and reported as an overrun.
+ *
+ * Header only, so the bench application can drive the same code with a
+ * synthetic producer.
+ */
+
+#ifndef SWO_RING_H
+#define SWO_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <zephyr/sys/barrier.h>
+#include <zephyr/sys/util.h>
+
+struct swo_ring {
+	/* Storage, size is a power of two */
+	uint8_t *buf;
+	uint32_t size;
+	/* Producer count: bytes written since the ring was reset, wraps */
+	uint32_t (*written)(void);
+	/* Bytes consumed since the ring was reset, wraps at 2^32 */
+	uint32_t rd;
+	/* Times the producer overwrote unread data */
+	uint32_t overruns;
+};
+
+/**
+ * Restart the ring at the producer position, dropping unread data.
+ *
+ * @param ring Ring
+ * @param wr Producer count
+ */
+static inline void swo_ring_reset(struct swo_ring *ring, uint32_t wr)
+{
+	ring->rd = wr;
+}
+
+/**
+ * Get the number of unread bytes, capped at the ring size.
+ *
+ * @param ring Ring
+ * @param wr Producer count
+ * @return Unread bytes
+ */
+static inline uint32_t swo_ring_level(const struct swo_ring *ring,
+				      uint32_t wr)
+{
+	return MIN(wr - ring->rd, ring->size);
+}
+
+/**
+ * Copy unread bytes out of the ring. Only the bytes still intact once
+ * the copy is done are returned.
+ *
+ * @param ring Ring
+ * @param dst Destination
+ * @param max Most bytes to copy
+ * @param overrun Set if data was lost since the previous read or during
+ *        the copy, left untouched otherwise
+ * @return Bytes copied
+ */
+static inline uint32_t swo_ring_read(struct swo_ring *ring, uint8_t *dst,
+				     uint32_t max, bool *overrun)
+{
+	uint32_t wr = ring->written();
+	uint32_t start;
+	uint32_t len;
+	uint32_t pos;
+	uint32_t first;
+	uint32_t lost;
+
+	if (wr - ring->rd > ring->size) {
+		/* Lapped: keep the half the producer is not writing */
+		ring->rd = wr - ring->size / 2;
+		ring->overruns++;
+		*overrun = true;
+	}
+
+	start = ring->rd;
+	len = MIN(wr - start, max);
+	pos = start & (ring->size - 1);
+	first = MIN(len, ring->size - pos);
+
+	memcpy(dst, &ring->buf[pos], first);
+	memcpy(&dst[first], ring->buf, len - first);
+	ring->rd += len;
+
+	/* Byte n is overwritten once the producer count passes n + size */
+	barrier_dmem_fence_full();
+	wr = ring->written();
+	if (wr - start <= ring->size) {
+		return len;
+	}
+
+	lost = MIN(wr - ring->size - start, len);
+	memmove(dst, &dst[lost], len - lost);
+	ring->overruns++;
+	*overrun = true;
+
+	return len - lost;
+}
+
+#endif /* SWO_RING_H */
@@ -0,0 +1,128 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Probe telemetry snapshot
+ *
+ * The snapshot is read from the counters the subsystems keep anyway:
+ * plain words written by a single context, copied without locking. A
+ * snapshot may mix values a few microseconds apart, which does not
+ * matter to a fleet poller.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/drivers/hwinfo.h>
+#include <string.h>
+
+#include "telemetry.h"
+#include "dap_queue.h"
+#include "dap_usb.h"
+#include "dap_vendor.h"
+#include "die_temp.h"
+#include "health.h"
+#include "swo.h"
+#include "uart_bridge.h"
+
+/* Read once, the reset cause does not change until the next boot */
+static uint32_t telemetry_reset_cause;
+
+static int16_t telemetry_centi(int32_t mdeg)
+{
+	return (int16_t)CLAMP(mdeg / 10, INT16_MIN, INT16_MAX);
+}
+
+void telemetry_snapshot(struct telemetry_snapshot *snap)
+{
+	struct dap_queue_stats dap;
+	struct dap_usb_stats usb;
+	struct health_status health;
+
+	memset(snap, 0, sizeof(*snap));
+	snap->version = TELEMETRY_VERSION;
+	snap->length = sizeof(*snap);
+	snap->uptime_ms = k_uptime_get_32();
+	snap->reset_cause = telemetry_reset_cause;
+
+	health_get_status(&health);
+	snap->boots = health.boots;
+	snap->health_gap_ms = MIN(health.last_culprit_gap_ms, UINT16_MAX);
+	if (health.fed) {
+		snap->flags |= TELEMETRY_WATCHDOG_FED;
+	}
+	if (health.last_culprit_gap_ms) {
+		snap->flags |= TELEMETRY_HEALTH_RESET;
+	}
+
+	if (IS_ENABLED(CONFIG_DIE_TEMP)) {
+		struct die_temp_stats temp;
+
+		if (die_temp_get(&temp) == 0) {
+			snap->flags |= TELEMETRY_TEMP_VALID;
+			snap->temp_current = telemetry_centi(temp.current);
+			snap->temp_min = telemetry_centi(temp.min);
+			snap->temp_max = telemetry_centi(temp.max);
+		}
+	}
+
+	dap_queue_get_stats(&dap);
+	snap->dap_requests = dap.requests;
+	snap->dap_responses = dap.responses;
+	snap->dap_dropped = dap.dropped;
+
+	dap_usb_get_stats(&usb);
+	snap->usb_out_starved = usb.out_starved;
+	snap->usb_in_timeouts = usb.in_timeouts;
+
+	if (IS_ENABLED(CONFIG_SWO)) {
+		uint32_t overruns;
+		uint32_t stream_errors;
+
+		/* No pointers into the packed snapshot, they may be unaligned */
+		if (swo_peek_errors(&overruns, &stream_errors)) {
+			snap->flags |= TELEMETRY_SWO_ACTIVE;
+		}
+		snap->swo_overruns = overruns;
+		snap->swo_stream_errors = stream_errors;
+	}
+
+	if (IS_ENABLED(CONFIG_UART_BRIDGE)) {
+		struct uart_bridge_stats bridge;
+
+		uart_bridge_get_stats(&bridge);
+		snap->uart_overruns = bridge.uart_overruns;
+		snap->uart_drops = bridge.rx_drops + bridge.tx_drops;
+	}
+}
+
+uint32_t telemetry_execute(const uint8_t *request, uint32_t req_len,
+			   uint8_t *response, uint32_t resp_size)
+{
+	struct telemetry_snapshot snap;
+
+	ARG_UNUSED(request);
+
+	/* Not first in a batch, the snapshot may not fit anymore */
+	if (resp_size < 2 + sizeof(snap)) {
+		return dap_vendor_reject(response, req_len);
+	}
+
+	telemetry_snapshot(&snap);
+
+	response[0] = DAP_VENDOR_TELEMETRY;
+	response[1] = 0;
+	memcpy(&response[2], &snap, sizeof(snap));
+
+	return (1 << 16) | (2 + sizeof(snap));
+}
+
+static int telemetry_init(void)
+{
+	if (hwinfo_get_reset_cause(&telemetry_reset_cause) != 0) {
+		telemetry_reset_cause = 0;
+	}
+
+	return 0;
+}
+
+SYS_INIT(telemetry_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,87 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * Probe telemetry snapshot
+ *
+ * One DAP vendor command returns the state of the probe in a fixed,
+ * versioned binary layout, decoded on the host by tools/dap_telemetry.py:
+ *
+ * Request:  0x87
+ * Response: 0x87, status, struct telemetry_snapshot
+ *
+ * Fields are little endian. A new version only appends fields, so a
+ * host reads the fields it knows up to the returned length. The whole
+ * response fits a 64-byte packet.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/toolchain.h>
+
+#define TELEMETRY_VERSION 1
+
+/* Snapshot flags */
+#define TELEMETRY_TEMP_VALID		BIT(0)
+#define TELEMETRY_WATCHDOG_FED		BIT(1)
+#define TELEMETRY_HEALTH_RESET		BIT(2)
+#define TELEMETRY_SWO_ACTIVE		BIT(3)
+
+struct telemetry_snapshot {
+	uint8_t version;
+	/* Bytes in the snapshot, this field included */
+	uint8_t length;
+	/* TELEMETRY_* flags */
+	uint16_t flags;
+	uint32_t uptime_ms;
+	/* hwinfo RESET_* bits of the last reset */
+	uint32_t reset_cause;
+	uint32_t boots;
+	/* Die temperature in centidegrees Celsius */
+	int16_t temp_current;
+	int16_t temp_min;
+	int16_t temp_max;
+	/* Heartbeat gap that caused the last reset, saturated, or 0 */
+	uint16_t health_gap_ms;
+	/* DAP queue */
+	uint32_t dap_requests;
+	uint32_t dap_responses;
+	uint32_t dap_dropped;
+	/* DAP USB endpoints */
+	uint32_t usb_out_starved;
+	uint32_t usb_in_timeouts;
+	/* SWO capture */
+	uint32_t swo_overruns;
+	uint32_t swo_stream_errors;
+	/* UART bridge */
+	uint32_t uart_overruns;
+	uint32_t uart_drops;
+} __packed;
+
+BUILD_ASSERT(sizeof(struct telemetry_snapshot) + 2 <= 64,
+	     "Telemetry snapshot must fit a 64-byte DAP packet");
+
+/**
+ * Fill a snapshot from the subsystem counters.
+ *
+ * @param snap Destination
+ */
+void telemetry_snapshot(struct telemetry_snapshot *snap);
+
+/**
+ * Run the DAP_VENDOR_TELEMETRY vendor command.
+ *
+ * @param request Command
+ * @param req_len Request bytes left, from the command ID on
+ * @param response Response buffer
+ * @param resp_size Response bytes left, at least 1
+ * @return Request length in the upper 16 bits, response length in the
+ *         lower 16 bits, as dap_execute_cmd()
+ */
+uint32_t telemetry_execute(const uint8_t *request, uint32_t req_len,
+			   uint8_t *response, uint32_t resp_size);
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,334 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * USB CDC ACM <-> UART1 (J2 connector) bridge
+ *
+ * Two ring buffers decouple the USB and UART sides:
+ *
+ *   UART1 RX --> uart_to_cdc --> CDC ACM IN   (target console to host)
+ *   CDC ACM OUT --> cdc_to_uart --> UART1 TX  (host to target)
+ *
+ * Both sides are interrupt driven and move whole FIFO bursts per
+ * interrupt, so no CPU time is spent waiting on a character. When the
+ * UART ring is full, CDC reception is paused and USB flow control holds
+ * the host back. The UART side has no flow control: bytes that do not
+ * fit in the CDC ring are counted as drops.
+ *
+ * The line coding set by the host (baud rate, parity, stop bits) is
+ * applied to UART1 when the CDC ACM class reports a change.
+ *
+ * In loopback mode, data from the host is sent straight back through
+ * uart_to_cdc instead of UART1, so the USB path can be measured without
+ * a wire on J2 (see tools/usb_bench.py). UART1 reception is off
+ * meanwhile: the ring has a single producer, like every ring here.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <zephyr/usb/usbd.h>
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(uart_bridge, LOG_LEVEL_INF);
+
+#include "uart_bridge.h"
+#include "activity.h"
+#include "perf.h"
+
+static const struct device *const uart_dev = DEVICE_DT_GET(DT_NODELABEL(uart1));
+static const struct device *const cdc_dev =
+	DEVICE_DT_GET(DT_NODELABEL(cdc_acm_uart1));
+
+RING_BUF_DECLARE(uart_to_cdc, CONFIG_UART_BRIDGE_RING_SIZE);
+RING_BUF_DECLARE(cdc_to_uart, CONFIG_UART_BRIDGE_RING_SIZE);
+
+/* Serializes the two producers of cdc_to_uart (CDC ISR and local writes) */
+static struct k_spinlock tx_lock;
+
+static struct uart_bridge_stats bridge_stats;
+static bool cdc_rx_paused;
+static bool loopback;
+
+static void uart_bridge_uart_isr(const struct device *dev, void *user_data)
+{
+	uint8_t *ptr;
+	uint32_t len;
+	int err;
+
+	ARG_UNUSED(user_data);
+
+	while (uart_irq_update(dev) && uart_irq_is_pending(dev)) {
+		if (uart_irq_rx_ready(dev)) {
+			len = ring_buf_put_claim(&uart_to_cdc, &ptr,
+						 CONFIG_UART_BRIDGE_RING_SIZE);
+			if (len == 0) {
+				uint8_t scratch[16];
+
+				bridge_stats.rx_drops +=
+					uart_fifo_read(dev, scratch, sizeof(scratch));
+			} else {
+				len = uart_fifo_read(dev, ptr, len);
+				ring_buf_put_finish(&uart_to_cdc, len);
+				bridge_stats.uart_rx += len;
+				activity_signal(ACTIVITY_UART_RX);
+				uart_irq_tx_enable(cdc_dev);
+			}
+		}
+
+		if (uart_irq_tx_ready(dev)) {
+			len = ring_buf_get_claim(&cdc_to_uart, &ptr,
+						 CONFIG_UART_BRIDGE_RING_SIZE);
+			if (len == 0) {
+				uart_irq_tx_disable(dev);
+			} else {
+				len = uart_fifo_fill(dev, ptr, len);
+				ring_buf_get_finish(&cdc_to_uart, len);
+				bridge_stats.uart_tx += len;
+				activity_signal(ACTIVITY_UART_TX);
+				if (cdc_rx_paused) {
+					cdc_rx_paused = false;
+					uart_irq_rx_enable(cdc_dev);
+				}
+			}
+		}
+	}
+
+	err = uart_err_check(dev);
+	if (err & UART_ERROR_OVERRUN) {
+		bridge_stats.uart_overruns++;
+	}
+	if (err & (UART_ERROR_PARITY | UART_ERROR_FRAMING | UART_BREAK)) {
+		bridge_stats.uart_errors++;
+	}
+}
+
+/* Echo host data back to the host, flow controlled by the CDC ring */
+static void uart_bridge_cdc_loopback(const struct device *dev)
+{
+	uint8_t *ptr;
+	uint32_t len;
+
+	len = ring_buf_put_claim(&uart_to_cdc, &ptr,
+				 CONFIG_UART_BRIDGE_RING_SIZE);
+	if (len == 0) {
+		cdc_rx_paused = true;
+		uart_irq_rx_disable(dev);
+		return;
+	}
+
+	len = uart_fifo_read(dev, ptr, len);
+	ring_buf_put_finish(&uart_to_cdc, len);
+	bridge_stats.cdc_rx += len;
+	uart_irq_tx_enable(dev);
+}
+
+PERF_POINT_DEFINE(cdc_bridge_isr);
+
+static void uart_bridge_cdc_isr(const struct device *dev, void *user_data)
+{
+	uint8_t buf[64];
+	uint8_t *ptr;
+	uint32_t len;
+
+	ARG_UNUSED(user_data);
+	PERF_BEGIN(cdc_bridge_isr);
+
+	while (uart_irq_update(dev) && uart_irq_is_pending(dev)) {
+		if (uart_irq_rx_ready(dev) && loopback) {
+			uart_bridge_cdc_loopback(dev);
+		} else if (uart_irq_rx_ready(dev)) {
+			len = MIN(ring_buf_space_get(&cdc_to_uart), sizeof(buf));
+			if (len == 0) {
+				/* Let USB flow control hold the host back */
+				cdc_rx_paused = true;
+				uart_irq_rx_disable(dev);
+			} else {
+				len = uart_fifo_read(dev, buf, len);
+				K_SPINLOCK(&tx_lock) {
+					ring_buf_put(&cdc_to_uart, buf, len);
+				}
+				bridge_stats.cdc_rx += len;
+				uart_irq_tx_enable(uart_dev);
+			}
+		}
+
+		if (uart_irq_tx_ready(dev)) {
+			len = ring_buf_get_claim(&uart_to_cdc, &ptr,
+						 CONFIG_UART_BRIDGE_RING_SIZE);
+			if (len == 0) {
+				uart_irq_tx_disable(dev);
+			} else {
+				len = uart_fifo_fill(dev, ptr, len);
+				ring_buf_get_finish(&uart_to_cdc, len);
+				bridge_stats.cdc_tx += len;
+				if (loopback && cdc_rx_paused) {
+					cdc_rx_paused = false;
+					uart_irq_rx_enable(dev);
+				}
+			}
+		}
+	}
+
+	PERF_END(cdc_bridge_isr);
+}
+
+size_t uart_bridge_write(const uint8_t *data, size_t len)
+{
+	uint32_t written;
+
+	K_SPINLOCK(&tx_lock) {
+		written = ring_buf_put(&cdc_to_uart, data, len);
+	}
+
+	if (written < len) {
+		bridge_stats.tx_drops += len - written;
+	}
+
+	if (written > 0) {
+		uart_irq_tx_enable(uart_dev);
+	}
+
+	return written;
+}
+
+/* Apply the host line coding of the bridge CDC ACM to UART1 */
+static void uart_bridge_line_coding(void)
+{
+	struct uart_config cfg;
+	uint32_t baudrate;
+	int ret;
+
+	ret = uart_config_get(cdc_dev, &cfg);
+	if (ret) {
+		/* Fall back to the baud rate only */
+		if (uart_config_get(uart_dev, &cfg) ||
+		    uart_line_ctrl_get(cdc_dev, UART_LINE_CTRL_BAUD_RATE,
+				       &baudrate)) {
+			return;
+		}
+		cfg.baudrate = baudrate;
+	}
+
+	cfg.flow_ctrl = UART_CFG_FLOW_CTRL_NONE;
+
+	ret = uart_configure(uart_dev, &cfg);
+	if (ret) {
+		LOG_WRN("Unsupported line coding %u baud: %d", cfg.baudrate, ret);
+		return;
+	}
+
+	LOG_INF("UART1 set to %u baud", cfg.baudrate);
+}
+
+void uart_bridge_usbd_msg(const struct usbd_msg *msg)
+{
+	if (msg->type == USBD_MSG_CDC_ACM_LINE_CODING && msg->dev == cdc_dev) {
+		uart_bridge_line_coding();
+	}
+}
+
+void uart_bridge_get_stats(struct uart_bridge_stats *stats)
+{
+	*stats = bridge_stats;
+}
+
+void uart_bridge_set_loopback(bool on)
+{
+	uart_irq_rx_disable(cdc_dev);
+	/* The CDC callback is then the only producer of uart_to_cdc */
+	if (on) {
+		uart_irq_rx_disable(uart_dev);
+	}
+
+	loopback = on;
+	cdc_rx_paused = false;
+
+	if (!on) {
+		uart_irq_rx_enable(uart_dev);
+	}
+	uart_irq_rx_enable(cdc_dev);
+}
+
+int uart_bridge_init(void)
+{
+	int ret;
+
+	if (!device_is_ready(uart_dev) || !device_is_ready(cdc_dev)) {
+		printk("UART bridge devices not ready\n");
+		return -ENODEV;
+	}
+
+	ret = uart_irq_callback_user_data_set(uart_dev, uart_bridge_uart_isr, NULL);
+	if (ret) {
+		return ret;
+	}
+
+	ret = uart_irq_callback_user_data_set(cdc_dev, uart_bridge_cdc_isr, NULL);
+	if (ret) {
+		return ret;
+	}
+
+	uart_irq_rx_enable(uart_dev);
+	uart_irq_rx_enable(cdc_dev);
+
+	return 0;
+}
+
+/* Shell commands */
+
+static int cmd_bridge_status(const struct shell *sh, size_t argc, char **argv)
+{
+	struct uart_config cfg;
+
+	if (uart_config_get(uart_dev, &cfg) == 0) {
+		shell_print(sh, "UART1: %u baud, parity %u, stop bits %u",
+			    cfg.baudrate, cfg.parity, cfg.stop_bits);
+	}
+
+	shell_print(sh, "UART1 -> USB: %u bytes, %u dropped, %u overruns, %u errors",
+		    bridge_stats.uart_rx, bridge_stats.rx_drops,
+		    bridge_stats.uart_overruns, bridge_stats.uart_errors);
+	shell_print(sh, "USB -> UART1: %u bytes, %u sent, %u dropped",
+		    bridge_stats.cdc_rx, bridge_stats.uart_tx,
+		    bridge_stats.tx_drops);
+	shell_print(sh, "Rings: %u/%u to USB, %u/%u to UART1",
+		    ring_buf_size_get(&uart_to_cdc), CONFIG_UART_BRIDGE_RING_SIZE,
+		    ring_buf_size_get(&cdc_to_uart), CONFIG_UART_BRIDGE_RING_SIZE);
+
+	shell_print(sh, "Loopback: %s", loopback ? "on" : "off");
+
+	return 0;
+}
+
+static int cmd_bridge_loopback(const struct shell *sh, size_t argc, char **argv)
+{
+	bool on;
+
+	if (strcmp(argv[1], "on") == 0) {
+		on = true;
+	} else if (strcmp(argv[1], "off") == 0) {
+		on = false;
+	} else {
+		shell_error(sh, "Usage: bridge loopback <on|off>");
+		return -EINVAL;
+	}
+
+	uart_bridge_set_loopback(on);
+	shell_print(sh, "Loopback %s", on ? "on" : "off");
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_bridge,
+	SHELL_CMD(status, NULL, "Show UART bridge settings and counters",
+		  cmd_bridge_status),
+	SHELL_CMD_ARG(loopback, NULL, "Echo host data back instead of UART1: <on|off>",
+		      cmd_bridge_loopback, 2, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(bridge, &sub_bridge, "USB CDC <-> UART1 bridge", NULL);
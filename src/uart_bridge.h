@@ -0,0 +1,108 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * Copyright (c) 2025 Vincent Jardin
+ *
+ * USB CDC ACM <-> UART1 (J2 connector) bridge
+ */
+
+#ifndef UART_BRIDGE_H
+#define UART_BRIDGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct usbd_msg;
+
+/* Bridge counters, bytes unless noted */
+struct uart_bridge_stats {
+	uint32_t uart_rx;
+	uint32_t uart_tx;
+	uint32_t cdc_rx;
+	uint32_t cdc_tx;
+	/* UART receiver FIFO overruns (events) */
+	uint32_t uart_overruns;
+	/* UART framing/parity/break errors (events) */
+	uint32_t uart_errors;
+	/* Received on UART1 but lost because the CDC ring was full */
+	uint32_t rx_drops;
+	/* Local writes lost because the UART ring was full */
+	uint32_t tx_drops;
+};
+
+#if defined(CONFIG_UART_BRIDGE)
+
+/**
+ * Start bridging the CDC ACM instance to UART1.
+ *
+ * @return 0 on success, negative error code on failure
+ */
+int uart_bridge_init(void);
+
+/**
+ * Queue bytes for transmission on UART1 without blocking.
+ * Shares the ring used for data coming from the host.
+ *
+ * @param data Bytes to send
+ * @param len Number of bytes
+ * @return Number of bytes queued
+ */
+size_t uart_bridge_write(const uint8_t *data, size_t len);
+
+/**
+ * Handle USB device messages (line coding changes of the bridge CDC).
+ *
+ * @param msg USB device message
+ */
+void uart_bridge_usbd_msg(const struct usbd_msg *msg);
+
+/**
+ * Echo data received from the host back to it instead of sending it on
+ * UART1. Used to measure the CDC path without a loopback wire. UART1
+ * reception is stopped meanwhile.
+ *
+ * @param on true to enable loopback
+ */
+void uart_bridge_set_loopback(bool on);
+
+/**
+ * Get a snapshot of the bridge counters.
+ *
+ * @param stats Destination
+ */
+void uart_bridge_get_stats(struct uart_bridge_stats *stats);
+
+#else
+
+/* No bridge: UART1 output is dropped, the counters stay at zero */
+static inline int uart_bridge_init(void)
+{
+	return 0;
+}
+
+static inline size_t uart_bridge_write(const uint8_t *data, size_t len)
+{
+	(void)data;
+	(void)len;
+
+	return 0;
+}
+
+static inline void uart_bridge_usbd_msg(const struct usbd_msg *msg)
+{
+	(void)msg;
+}
+
+static inline void uart_bridge_set_loopback(bool on)
+{
+	(void)on;
+}
+
+static inline void uart_bridge_get_stats(struct uart_bridge_stats *stats)
+{
+	*stats = (struct uart_bridge_stats){ 0 };
+}
+
+#endif /* CONFIG_UART_BRIDGE */
+
+#endif /* UART_BRIDGE_H */
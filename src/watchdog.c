@@ -9,6 +9,7 @@
 #include <zephyr/drivers/watchdog.h>
 
 #include "watchdog.h"
+#include "perf.h"
 
 /* Watchdog timeout in milliseconds */
 #define WDT_TIMEOUT_MS 5000
@@ -17,6 +18,8 @@
 static const struct device *const wdt_dev = DEVICE_DT_GET(DT_NODELABEL(wdt0));
 static int wdt_channel_id = -1;
 
+PERF_POINT_DEFINE(wdt_feed);
+
 /**
  * Initialize the watchdog with a 5 second timeout.
  * The watchdog will reset the system if not fed within the timeout.
@@ -58,11 +61,13 @@ int watchdog_init(void)
 
 /**
  * Feed the watchdog to prevent system reset.
- * Should be called periodically from the main loop.
+ * Called by the health supervisor while all heartbeats are on time.
  */
 void watchdog_feed(void)
 {
 	if (wdt_channel_id >= 0) {
+		PERF_BEGIN(wdt_feed);
 		wdt_feed(wdt_dev, wdt_channel_id);
+		PERF_END(wdt_feed);
 	}
 }
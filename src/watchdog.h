@@ -18,7 +18,7 @@ int watchdog_init(void);
 
 /**
  * Feed the watchdog to prevent system reset.
- * Should be called periodically from the main loop.
+ * Called by the health supervisor while all heartbeats are on time.
  */
 void watchdog_feed(void);
 
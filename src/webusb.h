@@ -67,27 +67,32 @@ static const uint8_t webusb_origin_url[] = {
 	'h', 'e', 'l', 'l', 'o',
 };
 
+PERF_POINT_DEFINE(usb_webusb_req);
+
 static int webusb_to_host_cb(const struct usbd_context *const ctx,
 			     const struct usb_setup_packet *const setup,
 			     struct net_buf *const buf)
 {
+	int ret = -ENOTSUP;
+
+	PERF_BEGIN(usb_webusb_req);
 	LOG_DBG("WebUSB vendor callback");
 
 	if (setup->wIndex == WEBUSB_REQ_GET_URL) {
 		uint8_t index = USB_GET_DESCRIPTOR_INDEX(setup->wValue);
 
-		if (index != SAMPLE_WEBUSB_LANDING_PAGE) {
-			return -ENOTSUP;
+		if (index == SAMPLE_WEBUSB_LANDING_PAGE) {
+			LOG_INF("Get WebUSB URL request, index %u", index);
+			net_buf_add_mem(buf, &webusb_origin_url,
+					MIN(net_buf_tailroom(buf),
+					    sizeof(webusb_origin_url)));
+			ret = 0;
 		}
-
-		LOG_INF("Get WebUSB URL request, index %u", index);
-		net_buf_add_mem(buf, &webusb_origin_url,
-				MIN(net_buf_tailroom(buf), sizeof(webusb_origin_url)));
-
-		return 0;
 	}
 
-	return -ENOTSUP;
+	PERF_END(usb_webusb_req);
+
+	return ret;
 }
 
 USBD_DESC_BOS_VREQ_DEFINE(bos_vreq_webusb, sizeof(bos_cap_webusb), &bos_cap_webusb,
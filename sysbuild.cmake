@@ -0,0 +1,12 @@
+# SPDX-License-Identifier: AGPL-3.0-or-later
+# Copyright (c) 2025 Vincent Jardin
+#
+# sysbuild.conf puts MCUboot in front of the application. The slot layout
+# and the image manager come with the mcuboot snippet: without it, the
+# application would be linked at the start of the flash, over MCUboot.
+
+if(SB_CONFIG_BOOTLOADER_MCUBOOT AND NOT "mcuboot" IN_LIST SNIPPET)
+  message(FATAL_ERROR
+    "--sysbuild adds MCUboot, it needs the mcuboot snippet:\n"
+    "  west build -b rpi_debug_probe --sysbuild -S mcuboot")
+endif()
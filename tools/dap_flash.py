@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: AGPL-3.0-or-later
+# Copyright (c) 2025 Vincent Jardin
+#
+# Program a target flash through the on-probe flash algorithm runner.
+#
+# The flash algorithm comes from a CMSIS-Pack .FLM file. It is loaded in
+# target RAM behind a BKPT instruction, followed by the stack and two
+# page buffers. The probe then erases and programs the pages on its own
+# (see src/dap_flash.h): the host only streams the image and reads one
+# status per packet.
+#
+# The default RAM address is past the default RTT search range of the
+# probe (CONFIG_RTT_SEARCH_ADDR/SIZE), so a control block found there is
+# not overwritten by the algorithm.
+#
+# Usage: tools/dap_flash.py -a algo.FLM [--ram 0x20010000] image.bin [addr]
+
+import argparse
+import struct
+import sys
+import time
+
+try:
+    from elftools.elf.elffile import ELFFile
+except ImportError:
+    sys.exit("pyelftools is required: pip install pyelftools")
+
+from usb_bench import (Dap, find_device, swd_attach, DAP_DISCONNECT,
+                       REQ_AP, REQ_A2, REQ_A3)
+
+DAP_VENDOR_WRITE_MEM = 0x81
+DAP_VENDOR_FLASH_SETUP = 0x82
+DAP_VENDOR_FLASH_START = 0x83
+DAP_VENDOR_FLASH_DATA = 0x84
+DAP_VENDOR_FLASH_FINISH = 0x85
+DAP_VENDOR_FLASH_SECTORS = 0x8A
+
+STATUS = ["ok", "SWD error", "timeout", "algorithm error", "bad state",
+          "bad parameter"]
+
+DHCSR = 0xE000EDF0
+DHCSR_HALT = 0xA05F0003
+BKPT = struct.pack("<I", 0xE00ABE00)
+STACK_SIZE = 0x800
+
+
+class FlashAlgo:
+    """Code, entry points and geometry of a .FLM flash algorithm."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            elf = ELFFile(f)
+            dev = elf.get_section_by_name("DevDsc")
+            if dev is None:
+                sys.exit(f"{path} is not a flash algorithm")
+
+            # PrgCode, then PrgData (RW) and PrgData (ZI), linked at 0
+            self.blob = bytearray()
+            self.static_base = None
+            for sec in elf.iter_sections():
+                if sec.name not in ("PrgCode", "PrgData"):
+                    continue
+                if sec.name == "PrgData" and self.static_base is None:
+                    self.static_base = sec["sh_addr"]
+                end = sec["sh_addr"] + sec["sh_size"]
+                self.blob += b"\0" * max(0, end - len(self.blob))
+                if sec["sh_type"] != "SHT_NOBITS":
+                    self.blob[sec["sh_addr"]:end] = sec.data()
+            if self.static_base is None:
+                self.static_base = len(self.blob)
+
+            symtab = elf.get_section_by_name(".symtab")
+            self.entry = {}
+            for name in ("Init", "UnInit", "EraseSector", "ProgramPage"):
+                syms = symtab.get_symbol_by_name(name)
+                if not syms:
+                    sys.exit(f"{path}: no {name} function")
+                self.entry[name] = syms[0]["st_value"]
+
+            desc = dev.data()
+            self.name = desc[2:130].split(b"\0")[0].decode()
+            self.base, self.size, self.page_size = \
+                struct.unpack_from("<III", desc, 132)
+
+            # FlashSectors: (size, offset from base), up to 0xFFFFFFFF
+            self.sectors = []
+            for off in range(160, len(desc) - 7, 8):
+                size, start = struct.unpack_from("<II", desc, off)
+                if size == 0xFFFFFFFF:
+                    break
+                self.sectors.append((self.base + start, size))
+            if not self.sectors:
+                sys.exit(f"{path}: empty sector table")
+
+        self.blob = bytes(self.blob) + b"\0" * (-len(self.blob) % 4)
+
+
+def write_mem(dap, addr, data):
+    chunk = (dap.packet_size - 7) & ~3
+    for off in range(0, len(data), chunk):
+        part = data[off:off + chunk]
+        resp = dap.xfer(struct.pack("<BIH", DAP_VENDOR_WRITE_MEM,
+                                    addr + off, len(part)) + part)
+        if resp[1] != 0x01:
+            raise RuntimeError(f"write at 0x{addr + off:08x}: ack {resp[1]}")
+
+
+def check(resp, what):
+    if resp[1] != 0:
+        status = STATUS[resp[1]] if resp[1] < len(STATUS) else resp[1]
+        raise RuntimeError(f"{what}: {status}")
+
+
+def program(dap, algo, ram, image, addr):
+    # RAM layout: BKPT, algorithm, stack, two page buffers
+    code = ram + len(BKPT)
+    stack_top = code + len(algo.blob) + STACK_SIZE
+    buffers = (stack_top, stack_top + algo.page_size)
+
+    # Halt the core, the algorithm runs from the halted state
+    dap.transfer([(REQ_AP | REQ_A2, DHCSR), (REQ_AP | REQ_A2 | REQ_A3,
+                                            DHCSR_HALT)])
+    write_mem(dap, ram, BKPT + algo.blob)
+
+    setup = struct.pack("<B10I", DAP_VENDOR_FLASH_SETUP, ram,
+                        code + algo.entry["Init"],
+                        code + algo.entry["UnInit"],
+                        code + algo.entry["EraseSector"],
+                        code + algo.entry["ProgramPage"],
+                        code + algo.static_base, stack_top,
+                        buffers[0], buffers[1], algo.page_size)
+    check(dap.xfer(setup), "setup")
+
+    # Sector table, closed by a region of size 0 at the end of the flash
+    regions = algo.sectors + [(algo.base + algo.size, 0)]
+    per_packet = (dap.packet_size - 2) // 8
+    for i in range(0, len(regions), per_packet):
+        part = regions[i:i + per_packet]
+        req = struct.pack("<BB", DAP_VENDOR_FLASH_SECTORS, len(part))
+        for start, size in part:
+            req += struct.pack("<II", start, size)
+        check(dap.xfer(req), "sectors")
+    check(dap.xfer(struct.pack("<BI", DAP_VENDOR_FLASH_START, addr)),
+          "start")
+
+    # Stream the image, keeping as many packets in flight as the probe has
+    chunk = dap.packet_size - 3
+    depth = max(1, dap.packet_count)
+    inflight = 0
+    for off in range(0, len(image), chunk):
+        part = image[off:off + chunk]
+        if inflight == depth:
+            check(dap.recv(), f"data at 0x{addr + off:08x}")
+            inflight -= 1
+        dap.send(struct.pack("<BH", DAP_VENDOR_FLASH_DATA, len(part)) + part)
+        inflight += 1
+    while inflight:
+        check(dap.recv(), "data")
+        inflight -= 1
+
+    resp = dap.xfer(bytes([DAP_VENDOR_FLASH_FINISH]))
+    end, result = struct.unpack_from("<II", resp, 2)
+    if resp[1] != 0:
+        raise RuntimeError(f"{STATUS[resp[1]]} at 0x{end:08x}, "
+                           f"algorithm returned 0x{result:x}")
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description="Program a target flash with the on-probe flash "
+                    "algorithm runner")
+    ap.add_argument("-a", "--algo", required=True,
+                    help="CMSIS-Pack flash algorithm (.FLM)")
+    ap.add_argument("--ram", type=lambda x: int(x, 0), default=0x20010000,
+                    help="target RAM for the algorithm and buffers "
+                         "(default: 0x20010000)")
+    ap.add_argument("--clock", type=int, default=10000000,
+                    help="SWD clock in Hz (default: 10000000)")
+    ap.add_argument("--vid", type=lambda x: int(x, 0), default=0x2E8A)
+    ap.add_argument("--pid", type=lambda x: int(x, 0), default=0x000A)
+    ap.add_argument("--serial", help="select a probe by serial number")
+    ap.add_argument("image", help="raw binary image")
+    ap.add_argument("addr", nargs="?", type=lambda x: int(x, 0),
+                    help="flash address (default: flash base of the "
+                         "algorithm)")
+    args = ap.parse_args()
+
+    algo = FlashAlgo(args.algo)
+    addr = algo.base if args.addr is None else args.addr
+    with open(args.image, "rb") as f:
+        image = f.read()
+
+    dev = find_device(args.vid, args.pid, args.serial)
+    if dev is None:
+        sys.exit(f"No device {args.vid:04x}:{args.pid:04x}")
+
+    dap = Dap(dev, 5000)
+    try:
+        swd_attach(dap, args.clock)
+        t0 = time.perf_counter()
+        program(dap, algo, args.ram, image, addr)
+        elapsed = time.perf_counter() - t0
+        print(f"{algo.name}: {len(image)} bytes at 0x{addr:08x} in "
+              f"{elapsed:.2f} s ({len(image) / 1024 / elapsed:.1f} KiB/s)")
+    except RuntimeError as e:
+        sys.exit(str(e))
+    finally:
+        dap.xfer(bytes([DAP_DISCONNECT]))
+        dap.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: AGPL-3.0-or-later
+# Copyright (c) 2025 Vincent Jardin
+#
+# Poll the telemetry snapshot of one or many probes.
+#
+# The snapshot is one CMSIS-DAP vendor command (0x87, see
+# src/telemetry.h) on the DAP bulk interface, so it neither needs the
+# shell nor disturbs a debug session. The request is sent to every probe
+# before any response is read: one thread keeps all the probes busy and
+# a poll costs about one USB round trip whatever the number of probes.
+#
+# Usage: tools/dap_telemetry.py [--serial SN] [-i 1.0] [-n 10] [--json]
+
+import argparse
+import json
+import struct
+import sys
+import time
+
+import usb.core
+
+from usb_bench import Dap
+
+DAP_VENDOR_TELEMETRY = 0x87
+
+# Version 1 layout, little endian, packed
+SNAPSHOT_V1 = struct.Struct("<BBHIII hhhH IIIIIIIII")
+FIELDS_V1 = (
+    "version", "length", "flags", "uptime_ms", "reset_cause", "boots",
+    "temp_current", "temp_min", "temp_max", "health_gap_ms",
+    "dap_requests", "dap_responses", "dap_dropped",
+    "usb_out_starved", "usb_in_timeouts",
+    "swo_overruns", "swo_stream_errors",
+    "uart_overruns", "uart_drops",
+)
+
+FLAGS = {
+    0x0001: "temp",
+    0x0002: "fed",
+    0x0004: "health_reset",
+    0x0008: "swo",
+}
+
+# Zephyr hwinfo RESET_* bits
+RESET_CAUSES = {
+    0x0001: "pin",
+    0x0002: "software",
+    0x0004: "brownout",
+    0x0008: "por",
+    0x0010: "watchdog",
+    0x0020: "debug",
+    0x0040: "security",
+    0x0080: "low_power_wake",
+    0x0100: "cpu_lockup",
+    0x0200: "parity",
+    0x0400: "pll",
+    0x0800: "clock",
+    0x1000: "hardware",
+    0x2000: "user",
+    0x4000: "temperature",
+}
+
+
+def decode(resp):
+    """Decode a telemetry response into a dict, or raise ValueError."""
+    if len(resp) < 4 or resp[0] != DAP_VENDOR_TELEMETRY:
+        raise ValueError("not a telemetry response")
+    if resp[1] != 0:
+        raise ValueError(f"status {resp[1]}")
+
+    version, length = resp[2], resp[3]
+    # Newer versions only append fields, the known prefix is decoded
+    if version < 1:
+        raise ValueError(f"unknown snapshot version {version}")
+    if length < SNAPSHOT_V1.size or len(resp) < 2 + SNAPSHOT_V1.size:
+        raise ValueError(f"short snapshot ({length} bytes)")
+
+    snap = dict(zip(FIELDS_V1, SNAPSHOT_V1.unpack_from(resp, 2)))
+    temp_valid = snap["flags"] & 0x0001
+    for key in ("temp_current", "temp_min", "temp_max"):
+        snap[key] = snap[key] / 100 if temp_valid else None
+    snap["flag_names"] = [n for b, n in FLAGS.items() if snap["flags"] & b]
+    snap["reset_names"] = [n for b, n in RESET_CAUSES.items()
+                           if snap["reset_cause"] & b]
+    return snap
+
+
+def poll(probes):
+    """Query every probe once, yield (serial, snapshot or error)."""
+    cmd = bytes([DAP_VENDOR_TELEMETRY])
+    sent = []
+    for serial, dap in probes.items():
+        try:
+            dap.send(cmd)
+            sent.append((serial, dap))
+        except usb.core.USBError as e:
+            yield serial, {"error": str(e)}
+
+    for serial, dap in sent:
+        try:
+            yield serial, decode(dap.recv())
+        except (usb.core.USBError, ValueError) as e:
+            yield serial, {"error": str(e)}
+
+
+def print_table(results, header):
+    if header:
+        print(f"{'serial':<18}{'uptime':>10}{'boots':>7}{'temp':>8}"
+              f"{'dap req':>10}{'drop':>6}{'usb err':>8}{'swo err':>8}"
+              f"{'uart err':>9}  reset/flags")
+    for serial, s in results:
+        if "error" in s:
+            print(f"{serial:<18}  error: {s['error']}")
+            continue
+        temp = "-" if s["temp_current"] is None else f"{s['temp_current']:.1f}"
+        usb_err = s["usb_out_starved"] + s["usb_in_timeouts"]
+        swo_err = s["swo_overruns"] + s["swo_stream_errors"]
+        uart_err = s["uart_overruns"] + s["uart_drops"]
+        print(f"{serial:<18}{s['uptime_ms'] / 1000:>10.1f}{s['boots']:>7}"
+              f"{temp:>8}{s['dap_requests']:>10}{s['dap_dropped']:>6}"
+              f"{usb_err:>8}{swo_err:>8}{uart_err:>9}  "
+              f"{','.join(s['reset_names']) or '-'}"
+              f"/{','.join(s['flag_names']) or '-'}")
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description="Poll the telemetry snapshot of CMSIS-DAP probes")
+    ap.add_argument("--vid", type=lambda x: int(x, 0), default=0x2E8A)
+    ap.add_argument("--pid", type=lambda x: int(x, 0), default=0x000A)
+    ap.add_argument("--serial", action="append",
+                    help="select a probe by serial number (repeatable, "
+                         "default: every probe)")
+    ap.add_argument("--timeout", type=int, default=1000,
+                    help="USB transfer timeout in ms (default: 1000)")
+    ap.add_argument("-i", "--interval", type=float, default=1.0,
+                    help="seconds between polls (default: 1.0)")
+    ap.add_argument("-n", "--count", type=int, default=1,
+                    help="number of polls, 0 for ever (default: 1)")
+    ap.add_argument("--json", action="store_true",
+                    help="print one JSON object per probe and poll")
+    args = ap.parse_args()
+
+    probes = {}
+    for dev in usb.core.find(find_all=True, idVendor=args.vid,
+                             idProduct=args.pid):
+        serial = dev.serial_number
+        if args.serial and serial not in args.serial:
+            continue
+        try:
+            probes[serial] = Dap(dev, args.timeout)
+        except (usb.core.USBError, RuntimeError) as e:
+            print(f"{serial}: {e}", file=sys.stderr)
+    if not probes:
+        sys.exit("no probe found")
+
+    try:
+        n = 0
+        while True:
+            start = time.monotonic()
+            results = list(poll(probes))
+            if args.json:
+                for serial, snap in results:
+                    print(json.dumps({"serial": serial, "time": time.time(),
+                                      **snap}))
+            else:
+                print_table(results, n == 0)
+            sys.stdout.flush()
+
+            n += 1
+            if args.count and n >= args.count:
+                break
+            time.sleep(max(0.0, args.interval - (time.monotonic() - start)))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        for dap in probes.values():
+            dap.close()
+
+
+if __name__ == "__main__":
+    main()
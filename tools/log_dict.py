@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: AGPL-3.0-or-later
+# Copyright (c) 2025 Vincent Jardin
+#
+# Decode the dictionary log stream of a build made with "-S log-dict".
+#
+# The firmware only sends message IDs, arguments and timestamps. The
+# strings and argument types come from log_dictionary.json, generated
+# from zephyr.elf at build time, so the build directory must match the
+# firmware running on the probe.
+#
+# Usage: tools/log_dict.py [-b build] [-p /dev/ttyACM2]
+
+import argparse
+import os
+import sys
+import time
+
+try:
+    import serial
+except ImportError:
+    sys.exit("pyserial is required: pip install pyserial")
+
+
+def load_parser(zephyr_base, dbfile):
+    sys.path.insert(0, os.path.join(zephyr_base, "scripts", "logging",
+                                    "dictionary"))
+    import dictionary_parser
+    from dictionary_parser.log_database import LogDatabase
+
+    database = LogDatabase.read_json_database(dbfile)
+    if database is None:
+        sys.exit(f"Cannot open dictionary {dbfile}")
+
+    parser = dictionary_parser.get_parser(database)
+    if parser is None:
+        sys.exit(f"Unsupported dictionary version in {dbfile}")
+
+    return parser
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description="Decode the dictionary log stream of the probe")
+    ap.add_argument("-b", "--build", default="build",
+                    help="build directory (default: build)")
+    ap.add_argument("-p", "--port", default="/dev/ttyACM2",
+                    help="log CDC ACM device (default: /dev/ttyACM2)")
+    ap.add_argument("--debug", action="store_true",
+                    help="dump raw records")
+    args = ap.parse_args()
+
+    zephyr_base = os.environ.get("ZEPHYR_BASE")
+    if not zephyr_base:
+        sys.exit("ZEPHYR_BASE is not set")
+
+    dbfile = os.path.join(args.build, "zephyr", "log_dictionary.json")
+    parser = load_parser(zephyr_base, dbfile)
+
+    # A read may end in the middle of a record: keep the bytes the parser
+    # did not consume and parse them again with the next read
+    data = bytearray()
+    with serial.Serial(args.port, 115200, timeout=1) as port:
+        while True:
+            size = port.in_waiting
+            if size:
+                data += port.read(size)
+                done = parser.parse_log_data(data, debug=args.debug)
+                del data[:done]
+            else:
+                time.sleep(0.05)
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: AGPL-3.0-or-later
+# Copyright (c) 2025 Vincent Jardin
+#
+# Read the perf probe points from the shell and print them as JSON.
+#
+# Runs "perf dump" on the shell CDC ACM and decodes the binary record
+# (see src/perf.c). Times are converted to nanoseconds with the clock
+# rate reported by the probe.
+#
+# Needs a build with the debug snippet (CONFIG_PERF_PROBES).
+#
+# Usage: tools/perf_dump.py [-p /dev/ttyACM0] [--reset]
+
+import argparse
+import json
+import struct
+import sys
+import time
+
+try:
+    import serial
+except ImportError:
+    sys.exit("pyserial is required: pip install pyserial")
+
+NAME_LEN = 24
+HEADER = struct.Struct("<4sHHI")
+POINT = struct.Struct(f"<{NAME_LEN}sIIIQ")
+
+
+def shell_cmd(port, cmd, end, timeout=2.0):
+    port.reset_input_buffer()
+    port.write(cmd.encode() + b"\r\n")
+
+    lines = []
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        line = port.readline().decode(errors="replace").strip()
+        if not line:
+            continue
+        lines.append(line)
+        if end in line:
+            return lines
+
+    sys.exit(f"No answer to \"{cmd}\"")
+
+
+def decode(lines):
+    start = next(i for i, line in enumerate(lines)
+                 if line.startswith("-- perf dump"))
+    size = int(lines[start].split()[3])
+    blob = bytearray()
+    for line in lines[start + 1:]:
+        if line.startswith("-- end"):
+            break
+        blob += bytes.fromhex(line)
+
+    if len(blob) != size:
+        sys.exit(f"Truncated dump: {len(blob)} of {size} bytes")
+
+    magic, version, count, hz = HEADER.unpack_from(blob, 0)
+    if magic != b"PERF" or version != 1:
+        sys.exit(f"Unsupported dump {magic!r} version {version}")
+
+    ns = 1e9 / hz
+    points = {}
+    for i in range(count):
+        name, n, lo, hi, total = POINT.unpack_from(
+            blob, HEADER.size + i * POINT.size)
+        name = name.rstrip(b"\0").decode()
+        points[name] = {
+            "count": n,
+            "min_ns": round(lo * ns) if n else None,
+            "avg_ns": round(total / n * ns) if n else None,
+            "max_ns": round(hi * ns) if n else None,
+        }
+
+    return {"clock_hz": hz, "points": points}
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description="Dump the perf probe points of the probe as JSON")
+    ap.add_argument("-p", "--port", default="/dev/ttyACM0",
+                    help="shell CDC ACM device (default: /dev/ttyACM0)")
+    ap.add_argument("--reset", action="store_true",
+                    help="reset the probe points after reading them")
+    args = ap.parse_args()
+
+    with serial.Serial(args.port, 115200, timeout=0.2) as port:
+        report = decode(shell_cmd(port, "perf dump", "-- end"))
+        if args.reset:
+            shell_cmd(port, "perf reset", "reset")
+
+    print(json.dumps(report, indent=2))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: AGPL-3.0-or-later
+# Copyright (c) 2025 Vincent Jardin
+#
+# Host side checks of tools/dap_flash.py, without a probe.
+#
+# program() runs against a fake DAP link that records the packets, and
+# each one is checked against the request layout the firmware parses
+# (src/dap_flash.c): a packet the probe reads differently fails here,
+# not on a target.
+#
+# Usage: python3 -m unittest discover -s tools -v
+
+import os
+import re
+import struct
+import unittest
+from types import SimpleNamespace
+
+import dap_flash
+
+SRC = os.path.join(os.path.dirname(__file__), "..", "src", "dap_flash.c")
+
+
+def algo_words():
+    """Words of struct dap_flash_algo, as the firmware declares it."""
+    with open(SRC) as f:
+        body = re.search(r"struct dap_flash_algo \{(.*?)\};", f.read(),
+                         re.S).group(1)
+    words = 0
+    for count in re.findall(r"uint32_t \w+(?:\[(\d+)\])?;", body):
+        words += int(count) if count else 1
+    return words
+
+
+class FakeDap:
+    """DAP link answering every flash command with status 0."""
+
+    packet_size = 64
+    packet_count = 2
+
+    def __init__(self):
+        self.sent = []
+        self.pending = 0
+
+    def transfer(self, requests):
+        pass
+
+    def send(self, cmd):
+        self.sent.append(bytes(cmd))
+        self.pending += 1
+
+    def recv(self):
+        cmd = self.sent[-self.pending]
+        self.pending -= 1
+        if cmd[0] == dap_flash.DAP_VENDOR_WRITE_MEM:
+            return bytes([cmd[0], 0x01])
+        return bytes([cmd[0], 0]) + bytes(8)
+
+    def xfer(self, cmd):
+        self.send(cmd)
+        return self.recv()
+
+    def packets(self, cmd):
+        return [p for p in self.sent if p[0] == cmd]
+
+
+class ProgramTest(unittest.TestCase):
+    def setUp(self):
+        self.algo = SimpleNamespace(
+            blob=bytes(64), static_base=48, page_size=256,
+            entry={"Init": 0, "UnInit": 8, "EraseSector": 16,
+                   "ProgramPage": 32},
+            base=0x10000000, size=0x10000,
+            sectors=[(0x10000000, 4096)])
+        self.image = bytes(range(256)) * 3
+        self.dap = FakeDap()
+        dap_flash.program(self.dap, self.algo, 0x20010000, self.image,
+                          self.algo.base)
+
+    def test_setup(self):
+        setup, = self.dap.packets(dap_flash.DAP_VENDOR_FLASH_SETUP)
+        words = algo_words()
+
+        # FLASH_SETUP_LEN in src/dap_flash.c
+        self.assertEqual(len(setup), 1 + 4 * words)
+        fields = struct.unpack_from(f"<{words}I", setup, 1)
+        self.assertEqual(fields[0], 0x20010000)
+        self.assertEqual(fields[-1], self.algo.page_size)
+
+    def test_sectors(self):
+        for req in self.dap.packets(dap_flash.DAP_VENDOR_FLASH_SECTORS):
+            self.assertEqual(len(req), 2 + 8 * req[1])
+            self.assertLessEqual(len(req), self.dap.packet_size)
+
+    def test_data(self):
+        data = b""
+        for req in self.dap.packets(dap_flash.DAP_VENDOR_FLASH_DATA):
+            self.assertLessEqual(len(req), self.dap.packet_size)
+            self.assertEqual(len(req), 3 + struct.unpack_from("<H", req, 1)[0])
+            data += req[3:]
+        self.assertEqual(data, self.image)
+
+    def test_sequence(self):
+        cmds = [p[0] for p in self.dap.sent
+                if p[0] != dap_flash.DAP_VENDOR_WRITE_MEM]
+        self.assertEqual(cmds[0], dap_flash.DAP_VENDOR_FLASH_SETUP)
+        self.assertEqual(cmds[-1], dap_flash.DAP_VENDOR_FLASH_FINISH)
+        self.assertEqual(self.dap.pending, 0)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,462 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: AGPL-3.0-or-later
+# Copyright (c) 2025 Vincent Jardin
+#
+# End-to-end USB benchmark of the probe, run from the host.
+#
+# Measures, through libusb and the CDC ACM tty:
+#   - enumeration time (USB reset until the DAP interface answers again)
+#   - CMSIS-DAP v2 bulk round-trip latency (DAP_Info)
+#   - sustained DAP_TransferBlock read throughput (needs an SWD target)
+#   - the same read through the streamed vendor command (0x80)
+#   - CDC echo throughput on the bridge port ("bridge loopback on", or a
+#     wire between J2 TX and RX)
+#
+# The report is JSON, so two runs can be compared with --compare. The
+# tool only relies on the USB descriptors, so it runs unchanged against a
+# real probe or a device attached with "usbip attach".
+#
+# Usage: tools/usb_bench.py [-o report.json] [--enum] [--cdc /dev/ttyACM1]
+#        tools/usb_bench.py --compare base.json new.json
+
+import argparse
+import json
+import platform
+import statistics
+import struct
+import sys
+import threading
+import time
+
+try:
+    import usb.core
+    import usb.util
+except ImportError:
+    sys.exit("pyusb is required: pip install pyusb")
+
+DAP_INTERFACE = "CMSIS-DAP v2"
+
+DAP_INFO = 0x00
+DAP_CONNECT = 0x02
+DAP_DISCONNECT = 0x03
+DAP_TRANSFER = 0x05
+DAP_TRANSFER_BLOCK = 0x06
+DAP_SWJ_CLOCK = 0x11
+DAP_SWJ_SEQUENCE = 0x12
+DAP_VENDOR_READ_MEM = 0x80
+
+DAP_INFO_FW_VER = 0x04
+DAP_INFO_PRODUCT_FW_VER = 0x09
+DAP_INFO_PACKET_SIZE = 0xFE
+DAP_INFO_PACKET_COUNT = 0xFF
+
+# Transfer request bits
+REQ_AP = 0x01
+REQ_READ = 0x02
+REQ_A2 = 0x04
+REQ_A3 = 0x08
+
+DP_DPIDR = REQ_READ
+DP_CTRL_STAT = REQ_A2
+AP_CSW = REQ_AP
+AP_TAR = REQ_AP | REQ_A2
+AP_DRW = REQ_AP | REQ_A2 | REQ_A3
+
+CSW_WORD_INCR = 0x23000012
+# TAR auto-increment is only guaranteed within 1 KiB
+TAR_WRAP = 1024
+
+
+class Dap:
+    def __init__(self, dev, timeout_ms):
+        self.dev = dev
+        self.timeout = timeout_ms
+        self.intf = None
+        self.ep_out = None
+        self.ep_in = None
+
+        cfg = dev.get_active_configuration()
+        for intf in cfg:
+            if not intf.iInterface:
+                continue
+            if usb.util.get_string(dev, intf.iInterface) != DAP_INTERFACE:
+                continue
+            self.intf = intf
+            self.ep_out = usb.util.find_descriptor(
+                intf, custom_match=lambda e: usb.util.endpoint_direction(
+                    e.bEndpointAddress) == usb.util.ENDPOINT_OUT)
+            self.ep_in = usb.util.find_descriptor(
+                intf, custom_match=lambda e: usb.util.endpoint_direction(
+                    e.bEndpointAddress) == usb.util.ENDPOINT_IN)
+            break
+
+        if self.intf is None or self.ep_out is None or self.ep_in is None:
+            raise RuntimeError(f"no \"{DAP_INTERFACE}\" interface")
+
+        usb.util.claim_interface(dev, self.intf)
+        self.packet_size = 64
+        self.packet_size = self.info_u16(DAP_INFO_PACKET_SIZE)
+        self.packet_count = self.info_u8(DAP_INFO_PACKET_COUNT)
+
+    def close(self):
+        usb.util.release_interface(self.dev, self.intf)
+        usb.util.dispose_resources(self.dev)
+
+    def send(self, cmd):
+        self.ep_out.write(cmd, self.timeout)
+
+    def recv(self):
+        return bytes(self.ep_in.read(self.packet_size, self.timeout))
+
+    def xfer(self, cmd):
+        self.send(cmd)
+        resp = self.recv()
+        if not resp or resp[0] != cmd[0]:
+            raise RuntimeError(f"bad response to command 0x{cmd[0]:02x}")
+        return resp
+
+    def info(self, info_id):
+        resp = self.xfer(bytes([DAP_INFO, info_id]))
+        return resp[2:2 + resp[1]]
+
+    def info_u8(self, info_id):
+        return self.info(info_id)[0]
+
+    def info_u16(self, info_id):
+        return struct.unpack("<H", self.info(info_id)[:2])[0]
+
+    def info_str(self, info_id):
+        return self.info(info_id).rstrip(b"\0").decode(errors="replace")
+
+    def transfer(self, requests):
+        """Run one DAP_Transfer, requests is a list of (request, value)."""
+        cmd = bytearray([DAP_TRANSFER, 0, len(requests)])
+        for req, value in requests:
+            cmd.append(req)
+            if not req & REQ_READ:
+                cmd += struct.pack("<I", value)
+        resp = self.xfer(bytes(cmd))
+        if resp[1] != len(requests) or resp[2] != 0x01:
+            raise RuntimeError(f"transfer ack {resp[2]:#x} after {resp[1]}")
+        return [struct.unpack_from("<I", resp, 3 + 4 * i)[0]
+                for i in range((len(resp) - 3) // 4)]
+
+
+def find_device(vid, pid, serial):
+    for dev in usb.core.find(find_all=True, idVendor=vid, idProduct=pid):
+        if serial is None or dev.serial_number == serial:
+            return dev
+    return None
+
+
+def percentiles(samples_us):
+    samples = sorted(samples_us)
+    qs = statistics.quantiles(samples, n=100)
+    return {
+        "min": samples[0],
+        "p50": qs[49],
+        "p90": qs[89],
+        "p99": qs[98],
+        "max": samples[-1],
+        "mean": statistics.fmean(samples),
+    }
+
+
+def bench_enum(args):
+    dev = find_device(args.vid, args.pid, args.serial)
+    dev.reset()
+    usb.util.dispose_resources(dev)
+
+    t0 = time.perf_counter()
+    deadline = t0 + args.enum_timeout
+    while time.perf_counter() < deadline:
+        time.sleep(0.005)
+        try:
+            dev = find_device(args.vid, args.pid, args.serial)
+            if dev is None:
+                continue
+            dap = Dap(dev, args.timeout)
+            dap.close()
+            return {"ms": (time.perf_counter() - t0) * 1000.0}
+        except (usb.core.USBError, RuntimeError, ValueError):
+            continue
+
+    raise RuntimeError("device did not come back after reset")
+
+
+def bench_rtt(dap, iterations):
+    cmd = bytes([DAP_INFO, DAP_INFO_PACKET_SIZE])
+    samples = []
+
+    for _ in range(iterations):
+        t0 = time.perf_counter_ns()
+        dap.xfer(cmd)
+        samples.append((time.perf_counter_ns() - t0) / 1000.0)
+
+    return {"iterations": iterations, "us": percentiles(samples)}
+
+
+def swd_attach(dap, clock_hz):
+    dap.xfer(struct.pack("<BI", DAP_SWJ_CLOCK, clock_hz))
+    if dap.xfer(bytes([DAP_CONNECT, 1]))[1] != 1:
+        raise RuntimeError("SWD connect failed")
+
+    # Line reset, JTAG-to-SWD, line reset, idle
+    dap.xfer(bytes([DAP_SWJ_SEQUENCE, 51]) + b"\xff" * 7)
+    dap.xfer(bytes([DAP_SWJ_SEQUENCE, 16, 0x9e, 0xe7]))
+    dap.xfer(bytes([DAP_SWJ_SEQUENCE, 51]) + b"\xff" * 7)
+    dap.xfer(bytes([DAP_SWJ_SEQUENCE, 8, 0x00]))
+
+    dpidr = dap.transfer([(DP_DPIDR, 0)])[0]
+    # CSYSPWRUPREQ | CDBGPWRUPREQ
+    dap.transfer([(DP_CTRL_STAT, 0x50000000)])
+    dap.transfer([(AP_CSW, CSW_WORD_INCR)])
+
+    return dpidr
+
+
+def bench_block(dap, args):
+    """Read target memory with pipelined DAP_Transfer/DAP_TransferBlock."""
+    max_words = (dap.packet_size - 4) // 4
+    cmds = []
+
+    addr = args.addr
+    end = args.addr + args.size
+    while addr < end:
+        chunk_end = min(end, (addr & ~(TAR_WRAP - 1)) + TAR_WRAP)
+        cmds.append((False, bytes([DAP_TRANSFER, 0, 1, AP_TAR]) +
+                     struct.pack("<I", addr)))
+        while addr < chunk_end:
+            words = min(max_words, (chunk_end - addr) // 4)
+            cmds.append((True, struct.pack("<BBHB", DAP_TRANSFER_BLOCK, 0,
+                                           words, AP_DRW)))
+            addr += words * 4
+
+    faults = 0
+    inflight = []
+    depth = max(1, dap.packet_count)
+
+    t0 = time.perf_counter()
+    for _ in range(args.block_passes):
+        for is_block, cmd in cmds:
+            if len(inflight) == depth:
+                faults += check_block(dap.recv(), inflight.pop(0))
+            dap.send(cmd)
+            inflight.append(is_block)
+        while inflight:
+            faults += check_block(dap.recv(), inflight.pop(0))
+    elapsed = time.perf_counter() - t0
+
+    total = args.size * args.block_passes
+    return {
+        "bytes": total,
+        "seconds": elapsed,
+        "kib_per_s": total / 1024.0 / elapsed,
+        "faults": faults,
+        "pipeline_depth": depth,
+    }
+
+
+def bench_vendor_read(dap, args):
+    """Read target memory with one streamed vendor command per pass."""
+    cmd = struct.pack("<BII", DAP_VENDOR_READ_MEM, args.addr, args.size)
+    faults = 0
+
+    t0 = time.perf_counter()
+    for _ in range(args.block_passes):
+        dap.send(cmd)
+        got = 0
+        while got < args.size:
+            resp = dap.recv()
+            if resp[0] != DAP_VENDOR_READ_MEM:
+                raise RuntimeError("vendor read not supported")
+            got += struct.unpack_from("<H", resp, 2)[0]
+            if resp[1] != 0x01:
+                faults += 1
+                break
+    elapsed = time.perf_counter() - t0
+
+    total = args.size * args.block_passes
+    return {
+        "bytes": total,
+        "seconds": elapsed,
+        "kib_per_s": total / 1024.0 / elapsed,
+        "faults": faults,
+    }
+
+
+def check_block(resp, is_block):
+    if is_block:
+        return 0 if resp[0] == DAP_TRANSFER_BLOCK and resp[3] == 0x01 else 1
+    return 0 if resp[0] == DAP_TRANSFER and resp[2] == 0x01 else 1
+
+
+def bench_cdc(args):
+    try:
+        import serial
+    except ImportError:
+        sys.exit("pyserial is required for --cdc: pip install pyserial")
+
+    payload = bytes((i * 7 + 3) & 0xFF for i in range(args.cdc_size))
+    received = bytearray()
+
+    with serial.Serial(args.cdc, args.cdc_baud, timeout=0.5) as port:
+        port.reset_input_buffer()
+
+        def reader():
+            idle = 0
+            while len(received) < len(payload) and idle < 4:
+                chunk = port.read(4096)
+                if chunk:
+                    received.extend(chunk)
+                    idle = 0
+                else:
+                    idle += 1
+
+        rx = threading.Thread(target=reader)
+        t0 = time.perf_counter()
+        rx.start()
+        for off in range(0, len(payload), 4096):
+            port.write(payload[off:off + 4096])
+        port.flush()
+        rx.join()
+        elapsed = time.perf_counter() - t0
+
+    matched = len(received) == len(payload) and received == payload
+    return {
+        "port": args.cdc,
+        "bytes": len(payload),
+        "received": len(received),
+        "seconds": elapsed,
+        "kib_per_s": len(received) / 1024.0 / elapsed,
+        "intact": matched,
+    }
+
+
+def run(args):
+    report = {
+        "host": platform.node(),
+        "date": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+    }
+
+    if args.enum:
+        report["enumeration"] = bench_enum(args)
+
+    dev = find_device(args.vid, args.pid, args.serial)
+    if dev is None:
+        sys.exit(f"No device {args.vid:04x}:{args.pid:04x}")
+
+    dap = Dap(dev, args.timeout)
+    try:
+        report["device"] = {
+            "serial": dev.serial_number,
+            "speed": dev.speed,
+            "dap_fw": dap.info_str(DAP_INFO_FW_VER),
+            "product_fw": dap.info_str(DAP_INFO_PRODUCT_FW_VER),
+            "packet_size": dap.packet_size,
+            "packet_count": dap.packet_count,
+        }
+
+        report["dap_rtt"] = bench_rtt(dap, args.iterations)
+
+        try:
+            dpidr = swd_attach(dap, args.clock)
+            report["dap_block"] = bench_block(dap, args)
+            report["dap_block"]["dpidr"] = f"0x{dpidr:08x}"
+            report["dap_block"]["clock_hz"] = args.clock
+            report["dap_vendor_read"] = bench_vendor_read(dap, args)
+        except RuntimeError as e:
+            report["dap_block"] = {"skipped": str(e)}
+        finally:
+            dap.xfer(bytes([DAP_DISCONNECT]))
+    finally:
+        dap.close()
+
+    if args.cdc:
+        report["cdc_echo"] = bench_cdc(args)
+
+    return report
+
+
+# Metrics compared by --compare, higher_is_better
+METRICS = [
+    ("enumeration.ms", False),
+    ("dap_rtt.us.p50", False),
+    ("dap_rtt.us.p99", False),
+    ("dap_rtt.us.max", False),
+    ("dap_block.kib_per_s", True),
+    ("dap_vendor_read.kib_per_s", True),
+    ("cdc_echo.kib_per_s", True),
+]
+
+
+def lookup(report, path):
+    for key in path.split("."):
+        if not isinstance(report, dict) or key not in report:
+            return None
+        report = report[key]
+    return report
+
+
+def compare(base_file, new_file):
+    with open(base_file) as f:
+        base = json.load(f)
+    with open(new_file) as f:
+        new = json.load(f)
+
+    print(f"{'metric':<22} {'base':>12} {'new':>12} {'delta':>9}")
+    for path, higher_is_better in METRICS:
+        a = lookup(base, path)
+        b = lookup(new, path)
+        if a is None or b is None:
+            continue
+        delta = (b - a) * 100.0 / a if a else 0.0
+        better = delta > 0 if higher_is_better else delta < 0
+        mark = "" if abs(delta) < 5.0 else ("  better" if better else "  worse")
+        print(f"{path:<22} {a:>12.1f} {b:>12.1f} {delta:>+8.1f}%{mark}")
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description="End-to-end USB benchmark of the CDC ACM and "
+                    "CMSIS-DAP v2 interfaces")
+    ap.add_argument("--vid", type=lambda x: int(x, 0), default=0x2E8A)
+    ap.add_argument("--pid", type=lambda x: int(x, 0), default=0x000A)
+    ap.add_argument("--serial", help="select a probe by serial number")
+    ap.add_argument("--timeout", type=int, default=1000,
+                    help="USB transfer timeout in ms (default: 1000)")
+    ap.add_argument("--enum", action="store_true",
+                    help="reset the device and time its enumeration")
+    ap.add_argument("--enum-timeout", type=float, default=10.0)
+    ap.add_argument("-n", "--iterations", type=int, default=2000,
+                    help="DAP round trips (default: 2000)")
+    ap.add_argument("--clock", type=int, default=10000000,
+                    help="SWD clock in Hz (default: 10000000)")
+    ap.add_argument("--addr", type=lambda x: int(x, 0), default=0x20000000,
+                    help="target memory read by DAP_TransferBlock")
+    ap.add_argument("--size", type=lambda x: int(x, 0), default=0x10000,
+                    help="bytes read per pass (default: 0x10000)")
+    ap.add_argument("--block-passes", type=int, default=8)
+    ap.add_argument("--cdc", help="bridge CDC ACM port for the echo test, "
+                    "e.g. /dev/ttyACM1")
+    ap.add_argument("--cdc-baud", type=int, default=921600)
+    ap.add_argument("--cdc-size", type=int, default=256 * 1024)
+    ap.add_argument("-o", "--output", help="write the report to a file")
+    ap.add_argument("--compare", nargs=2, metavar=("BASE", "NEW"),
+                    help="compare two reports and exit")
+    args = ap.parse_args()
+
+    if args.compare:
+        compare(*args.compare)
+        return
+
+    report = run(args)
+    text = json.dumps(report, indent=2)
+    print(text)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text + "\n")
+
+
+if __name__ == "__main__":
+    main()